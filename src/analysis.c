@@ -0,0 +1,475 @@
+#include "vichess.h"
+
+// Live analysis: a pool of UCI engine processes (-a COMMAND, -A N)
+// evaluating every game the client sees.
+//
+// The writers only record the newest position of each game and poke a
+// pipe (analysis_submit); one thread, t_analysis, owns the engines and
+// talks to them over non-blocking pipes, so a slow or wedged engine
+// never holds up the terminal.  Scheduling:
+//
+//  - a newer position for a game being searched stops that search; its
+//    result is stale and is dropped
+//  - idle engines take the waiting game with the highest priority: my
+//    own game first, then the most recently moved
+//  - my own game may preempt an engine searching someone else's
+//  - my game's search gets the spare cpus (setoption Threads), the
+//    others one thread each
+//
+// Results go to the session as notices, with the line in SAN, and into
+// the persistent cache (cache.c, -k FILE).  A position found there is
+// reported at once and not searched again.
+
+#define ANALYSIS_GAMES  64
+#define OUTBOX_SIZE     ( ANALYSIS_GAMES + ANALYSIS_MAX_ENGINES )
+
+enum __ENGINE_STATES
+{
+  ENGINE_STARTING,              // "uci" sent, waiting for "uciok"
+  ENGINE_IDLE,
+  ENGINE_SEARCHING,
+  ENGINE_STOPPING,              // "stop" sent, waiting for "bestmove"
+  ENGINE_DEAD
+};
+
+static const char *STATE_NAMES[] = { "starting", "idle", "searching", "stopping", "dead" };
+
+typedef struct GAME_SLOT
+{
+  bool used;
+  int session;
+  unsigned int game_number;
+  bool mine;                    // I am playing this game
+  char fen[FEN_MAX];
+  uint64_t generation;          // bumped for each new position
+  uint64_t analysed;            // generation last sent to an engine
+  uint64_t moved_ns;
+  bool cached;                  // found in the cache, not yet reported
+  CACHED hit;
+} GAME_SLOT;
+
+typedef struct ENGINE_PROC
+{
+  pid_t pid;
+  int in, out;                  // engine's stdin, stdout
+  int state;
+  int threads;                  // last Threads option sent
+  int slot;                     // game being searched
+  uint64_t generation;          // ... and which position of it
+  char fen[FEN_MAX];
+  char info[MAX_LINE_SIZE];     // last "info ... pv" line
+  LINE_BUFFER buf;
+} ENGINE_PROC;
+
+struct ANALYSIS
+{
+  pthread_mutex_t lock;         // games[], between writers and t_analysis
+  GAME_SLOT games[ANALYSIS_GAMES];
+  int wake[2];                  // writers -> t_analysis
+  ENGINE_PROC engines[ANALYSIS_MAX_ENGINES];
+  int n_engines;
+  int budget;                   // threads for all engines together
+  int movetime_ms;
+  CACHE *cache;                 // or NULL
+  // notices are queued under the lock and sent after it is released
+  struct { int session; char text[512]; } outbox[OUTBOX_SIZE];
+  int n_outbox;
+  // counters, for :analysis
+  unsigned long submitted, started, cancelled, preempted, completed;
+};
+
+static void engine_write(ENGINE_PROC *e, const char *fmt, ...)
+{
+  char msg[MAX_LINE_SIZE];
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(msg, sizeof msg, fmt, args);
+  va_end(args);
+  if ( len >= (int) sizeof msg ) len = sizeof msg - 1;
+  // commands are short and the pipe is deep; a full pipe means the
+  // engine has stopped reading
+  if ( e->state != ENGINE_DEAD && write(e->in, msg, len) != len ) e->state = ENGINE_DEAD;
+}
+
+static void spawn(ENGINE_PROC *e, const char *command)
+{
+  int to[2], from[2];
+  if ( pipe2(to, O_CLOEXEC) == -1 || pipe2(from, O_CLOEXEC) == -1 ) error("pipe");
+
+  e->pid = fork();
+  if ( e->pid == -1 ) error("fork");
+  if ( e->pid == 0 )
+  {
+    dup2(to[0], STDIN_FILENO);
+    dup2(from[1], STDOUT_FILENO);
+    execl("/bin/sh", "sh", "-c", command, (char *) NULL);
+    _exit(127);
+  }
+  close(to[0]); close(from[1]);
+  e->in   = to[1];
+  e->out  = from[0];
+  if ( fcntl(e->in, F_SETFL, O_NONBLOCK) == -1 || fcntl(e->out, F_SETFL, O_NONBLOCK) == -1 ) error("fcntl");
+  e->state = ENGINE_STARTING;
+  engine_write(e, "uci\n");
+}
+
+static void post(ANALYSIS *a, int session, const char *fmt, ...)
+{
+  if ( a->n_outbox == OUTBOX_SIZE ) return;
+  va_list args;
+  va_start(args, fmt);
+  a->outbox[a->n_outbox].session = session;
+  vsnprintf(a->outbox[a->n_outbox].text, sizeof a->outbox[0].text, fmt, args);
+  va_end(args);
+  a->n_outbox++;
+}
+
+// "+0.35" or "#3", from white's side; UCI and the cache score from the
+// side to move
+static void format_white_score(int score, int side, char *out, size_t n)
+{
+  if ( side == BLACK_SIDE ) score = -score;
+  if ( abs(score) > CACHE_MATE - MAX_PLY )  snprintf(out, n, "#%d", score > 0 ? CACHE_MATE - score : -( CACHE_MATE + score ));
+  else                                      snprintf(out, n, "%+.2f", score / 100.0);
+}
+
+// Start 'n' copies of 'command'.  'cache' may be NULL.  Returns NULL if
+// n is out of range.
+ANALYSIS *analysis_new(const char *command, int n, int movetime_ms, CACHE *cache)
+{
+  if ( n < 1 || n > ANALYSIS_MAX_ENGINES ) return NULL;
+  ANALYSIS *a = calloc(1, sizeof *a);
+  if ( a == NULL ) error("analysis_new");
+  pthread_mutex_init(&a->lock, NULL);
+  if ( pipe2(a->wake, O_CLOEXEC | O_NONBLOCK) == -1 ) error("pipe");
+  signal(SIGPIPE, SIG_IGN); // an engine dying must not take us with it
+
+  a->n_engines    = n;
+  a->movetime_ms  = movetime_ms;
+  a->cache        = cache;
+  a->budget       = sysconf(_SC_NPROCESSORS_ONLN);
+  if ( a->budget < n ) a->budget = n;
+  for (int i = 0; i < n; i++) spawn(&a->engines[i], command);
+  return a;
+}
+
+void analysis_free(ANALYSIS *a)
+{
+  for (int i = 0; i < a->n_engines; i++)
+  {
+    ENGINE_PROC *e = &a->engines[i];
+    engine_write(e, "quit\n");
+    close(e->in); close(e->out);
+    kill(e->pid, SIGTERM);
+    waitpid(e->pid, NULL, 0);
+  }
+  close(a->wake[0]); close(a->wake[1]);
+  if ( a->cache != NULL ) cache_close(a->cache);
+  pthread_mutex_destroy(&a->lock);
+  free(a);
+}
+
+// Record the newest position of a game.  Called by the writers for
+// every board; takes a short lock and never waits on an engine.
+void analysis_submit(ANALYSIS *a, int session, const STYLE12 *s)
+{
+  // examined and isolated positions are not games in progress
+  if ( s->relation != PLAYING_MY_MOVE && s->relation != PLAYING_OPPONENTS_MOVE && s->relation != OBSERVING ) return;
+
+  POSITION pos;
+  char fen[FEN_MAX];
+  CACHED hit = { 0 };
+  position_from_style12(&pos, s);
+  position_to_fen(&pos, fen);
+  // outside the lock: the cache has none of its own
+  bool cached = a->cache != NULL && cache_probe(a->cache, pos.hash, &hit);
+
+  pthread_mutex_lock(&a->lock);
+  GAME_SLOT *slot = NULL, *oldest = NULL;
+  for (int i = 0; i < ANALYSIS_GAMES; i++)
+  {
+    GAME_SLOT *g = &a->games[i];
+    if ( g->used && g->session == session && g->game_number == s->game_number ) { slot = g; break; }
+    if ( ! g->used ) { if ( oldest == NULL || oldest->used ) oldest = g; }
+    else if ( oldest == NULL || ( oldest->used && g->moved_ns < oldest->moved_ns ) ) oldest = g;
+  }
+  if ( slot == NULL )
+  {
+    // reuse the least recently moved; a search still running on it is
+    // recognized as stale by its generation
+    slot = oldest;
+    uint64_t generation = slot->generation;
+    memset(slot, 0, sizeof *slot);
+    slot->used        = true;
+    slot->session     = session;
+    slot->game_number = s->game_number;
+    slot->generation  = slot->analysed = generation;
+  }
+  if ( ! equals(slot->fen, fen) )
+  {
+    snprintf(slot->fen, sizeof slot->fen, "%s", fen);
+    slot->mine      = s->relation != OBSERVING;
+    slot->moved_ns  = now_ns();
+    slot->generation++;
+    a->submitted++;
+    // known already: report it, and leave the engines to other games
+    slot->cached    = cached;
+    slot->hit       = hit;
+    if ( cached ) slot->analysed = slot->generation;
+  }
+  pthread_mutex_unlock(&a->lock);
+
+  char poke = 1;
+  if ( write(a->wake[1], &poke, 1) == -1 && errno != EAGAIN ) perror("analysis wake");
+}
+
+
+/// The analysis thread
+
+static uint64_t priority(const GAME_SLOT *g)
+{
+  return ( g->mine ? 1ULL << 63 : 0 ) | ( g->moved_ns >> 1 );
+}
+
+static bool being_searched(ANALYSIS *a, int slot)
+{
+  for (int i = 0; i < a->n_engines; i++)
+    if ( a->engines[i].slot == slot && ( a->engines[i].state == ENGINE_SEARCHING || a->engines[i].state == ENGINE_STOPPING ) )
+      return true;
+  return false;
+}
+
+static void start_search(ANALYSIS *a, ENGINE_PROC *e, int slot)
+{
+  GAME_SLOT *g = &a->games[slot];
+  int others  = a->n_engines - 1;
+  int threads = g->mine ? ( a->budget - others > 1 ? a->budget - others : 1 ) : 1;
+  if ( threads != e->threads )
+  {
+    engine_write(e, "setoption name Threads value %d\n", threads);
+    e->threads = threads;
+  }
+  e->slot       = slot;
+  e->generation = g->generation;
+  e->info[0]    = '\0';
+  snprintf(e->fen, sizeof e->fen, "%s", g->fen);
+  g->analysed   = g->generation;
+  engine_write(e, "position fen %s\ngo movetime %d\n", g->fen, a->movetime_ms);
+  if ( e->state != ENGINE_DEAD ) e->state = ENGINE_SEARCHING;
+  a->started++;
+}
+
+// Called with the lock held, whenever something changed.
+static void schedule(ANALYSIS *a)
+{
+  for (int i = 0; i < ANALYSIS_GAMES; i++)
+  {
+    GAME_SLOT *g = &a->games[i];
+    if ( ! g->cached ) continue;
+    POSITION pos;
+    char score[16], san[16] = "";
+    position_from_fen(&pos, g->fen);
+    format_white_score(g->hit.score, pos.side, score, sizeof score);
+    MOVE_LIST legal;
+    generate_legal_moves(&pos, &legal);
+    for (int j = 0; j < legal.n; j++)
+      if ( legal.moves[j] == g->hit.move ) { san[0] = ' '; move_to_san(&pos, g->hit.move, san + 1); }
+    post(a, g->session, "analysis: game %u %s depth %d%s (cached)\n", g->game_number, score, g->hit.depth, san);
+    g->cached = false;
+  }
+
+  // stale searches: a newer position of the same game has arrived
+  for (int i = 0; i < a->n_engines; i++)
+  {
+    ENGINE_PROC *e = &a->engines[i];
+    if ( e->state == ENGINE_SEARCHING && a->games[e->slot].generation != e->generation )
+    {
+      engine_write(e, "stop\n");
+      if ( e->state != ENGINE_DEAD ) e->state = ENGINE_STOPPING;
+      a->cancelled++;
+    }
+  }
+
+  while ( true )
+  {
+    // the most urgent game waiting for an engine
+    int best = -1;
+    for (int i = 0; i < ANALYSIS_GAMES; i++)
+    {
+      GAME_SLOT *g = &a->games[i];
+      if ( ! g->used || g->generation == g->analysed || being_searched(a, i) ) continue;
+      if ( best == -1 || priority(g) > priority(&a->games[best]) ) best = i;
+    }
+    if ( best == -1 ) return;
+
+    ENGINE_PROC *idle = NULL, *victim = NULL;
+    for (int i = 0; i < a->n_engines; i++)
+    {
+      ENGINE_PROC *e = &a->engines[i];
+      if ( e->state == ENGINE_IDLE ) { idle = e; break; }
+      if ( e->state == ENGINE_SEARCHING && ! a->games[e->slot].mine
+          && ( victim == NULL || priority(&a->games[e->slot]) < priority(&a->games[victim->slot]) ) )
+        victim = e;
+    }
+    if ( idle != NULL ) { start_search(a, idle, best); continue; }
+
+    // all busy: only my own game may push another off an engine
+    if ( a->games[best].mine && victim != NULL )
+    {
+      engine_write(victim, "stop\n");
+      if ( victim->state != ENGINE_DEAD ) victim->state = ENGINE_STOPPING;
+      a->preempted++;
+    }
+    return;
+  }
+}
+
+// "info depth 12 score cp 35 ... pv e2e4 e7e5": a notice for the
+// session, and an entry in the cache
+static void report(ANALYSIS *a, ENGINE_PROC *e)
+{
+  GAME_SLOT *g = &a->games[e->slot];
+  char *info = e->info, *p;
+  int depth = 0, value = 0;
+  if ( (p = strstr(info, " depth ")) != NULL )            depth = atoi(p + 7);
+  if ( (p = strstr(info, " score cp ")) != NULL )         value = atoi(p + 10);
+  else if ( (p = strstr(info, " score mate ")) != NULL )
+  {
+    int n = atoi(p + 12);
+    value = n > 0 ? CACHE_MATE - n : -CACHE_MATE - n;
+  }
+
+  POSITION pos;
+  position_from_fen(&pos, e->fen);
+  uint64_t key = pos.hash;
+  char score[16];
+  format_white_score(value, pos.side, score, sizeof score);
+
+  // the line in SAN
+  char line[384] = "";
+  size_t len = 0;
+  MOVE best = MOVE_NONE;
+  if ( (p = strstr(info, " pv ")) != NULL )
+  {
+    char *save, *tok = strtok_r(p + 4, " ", &save);
+    for (int n = 0; tok != NULL && n < 12 && len < sizeof line - 16; tok = strtok_r(NULL, " ", &save), n++)
+    {
+      MOVE m = parse_move(&pos, tok);
+      if ( m == MOVE_NONE ) break;
+      if ( n == 0 ) best = m;
+      char san[16];
+      UNDO undo;
+      move_to_san(&pos, m, san);
+      len += snprintf(line + len, sizeof line - len, " %s", san);
+      make_move(&pos, m, &undo);
+    }
+  }
+  post(a, g->session, "analysis: game %u %s depth %d%s\n", g->game_number, score, depth, line);
+  if ( a->cache != NULL && best != MOVE_NONE ) cache_store(a->cache, key, best, value, depth);
+}
+
+static void engine_line(ANALYSIS *a, ENGINE_PROC *e, char *line)
+{
+  line[strcspn(line, "\r\n")] = '\0';
+  if ( equals(line, "uciok") )
+  {
+    if ( e->state == ENGINE_STARTING ) e->state = ENGINE_IDLE;
+  }
+  else if ( begins_with(line, "info ") && strstr(line, " pv ") != NULL )
+    snprintf(e->info, sizeof e->info, "%s", line);
+  else if ( begins_with(line, "bestmove") )
+  {
+    bool stale = e->state == ENGINE_STOPPING || a->games[e->slot].generation != e->generation;
+    if ( ! stale && e->info[0] != '\0' ) { report(a, e); a->completed++; }
+    if ( e->state != ENGINE_DEAD ) e->state = ENGINE_IDLE;
+  }
+}
+
+void t_analysis(void *config)
+{
+  trace_thread("analysis");
+  CONFIG *c = (CONFIG *) config;
+  ANALYSIS *a = c->analysis;
+  struct pollfd fds[ANALYSIS_MAX_ENGINES + 1];
+
+  while ( running )
+  {
+    fds[0] = (struct pollfd) { .fd = a->wake[0], .events = POLLIN };
+    for (int i = 0; i < a->n_engines; i++)
+      fds[i + 1] = (struct pollfd) { .fd = a->engines[i].state == ENGINE_DEAD ? -1 : a->engines[i].out, .events = POLLIN };
+
+    // time out now and then to notice that the client is exiting
+    int ready = poll(fds, a->n_engines + 1, 100);
+    if ( ready == -1 && errno != EINTR ) error("poll");
+    if ( ready <= 0 ) continue;
+
+    if ( fds[0].revents & POLLIN )
+    {
+      char drain[256];
+      while ( read(a->wake[0], drain, sizeof drain) > 0 ) ;
+    }
+
+    pthread_mutex_lock(&a->lock);
+    for (int i = 0; i < a->n_engines; i++)
+    {
+      ENGINE_PROC *e = &a->engines[i];
+      if ( ! ( fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR) ) ) continue;
+      char line[MAX_LINE_SIZE];
+      ssize_t len;
+      while ( (len = read_line_buffered(e->out, &e->buf, line, sizeof line, '\n')) > 0 )
+        engine_line(a, e, line);
+      if ( len == 0 || errno != EAGAIN )
+      {
+        e->state = ENGINE_DEAD;
+        post(a, c->active, "analysis: engine %d exited\n", i + 1);
+      }
+    }
+    schedule(a);
+    int n_outbox = a->n_outbox;
+    pthread_mutex_unlock(&a->lock);
+
+    // the writer takes the lock in analysis_submit(), so never block on
+    // its queue while holding it; only this thread empties the outbox
+    for (int i = 0; i < n_outbox; i++)
+      send_message(c->ib_mq, a->outbox[i].session, MSG_NOTICE, "%s", a->outbox[i].text);
+    pthread_mutex_lock(&a->lock);
+    memmove(a->outbox, a->outbox + n_outbox, ( a->n_outbox - n_outbox ) * sizeof a->outbox[0]);
+    a->n_outbox -= n_outbox;
+    pthread_mutex_unlock(&a->lock);
+  }
+}
+
+// :analysis -- engines, what they are doing, and the counters
+void analysis_status(CONFIG *c)
+{
+  ANALYSIS *a = c->analysis;
+  if ( a == NULL ) { send_message(c->ib_mq, c->active, MSG_NOTICE, "no analysis engines (see -a)\n"); return; }
+
+  // format under the lock, send after it (see t_analysis)
+  char lines[ANALYSIS_MAX_ENGINES + 2][128];
+  pthread_mutex_lock(&a->lock);
+  for (int i = 0; i < a->n_engines; i++)
+  {
+    ENGINE_PROC *e = &a->engines[i];
+    if ( e->state == ENGINE_SEARCHING || e->state == ENGINE_STOPPING )
+      snprintf(lines[i], sizeof lines[i], "engine %d %-9s game %u (session %d), %d threads\n",
+          i + 1, STATE_NAMES[e->state], a->games[e->slot].game_number, a->games[e->slot].session + 1, e->threads);
+    else
+      snprintf(lines[i], sizeof lines[i], "engine %d %s\n", i + 1, STATE_NAMES[e->state]);
+  }
+  snprintf(lines[a->n_engines], sizeof lines[0],
+      "positions %lu, searches %lu: %lu completed, %lu stale, %lu preempted\n",
+      a->submitted, a->started, a->completed, a->cancelled, a->preempted);
+  pthread_mutex_unlock(&a->lock);
+  int n_lines = a->n_engines + 1;
+  if ( a->cache != NULL )
+  {
+    CACHE_STATS st;
+    cache_stats(a->cache, &st);
+    snprintf(lines[n_lines++], sizeof lines[0],
+        "cache %lu entries: %lu probes, %.1f%% hits, %.0f ns/probe, %lu stores\n",
+        st.entries, st.probes, st.probes ? 100.0 * st.hits / st.probes : 0.0,
+        st.probes ? (double) st.probe_ns / st.probes : 0.0, st.stores);
+  }
+  for (int i = 0; i < n_lines; i++) send_message(c->ib_mq, c->active, MSG_NOTICE, "%s", lines[i]);
+}
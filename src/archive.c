@@ -0,0 +1,453 @@
+#include "vichess.h"
+
+// Game archive: every game played or observed, appended to one binary
+// file as it happens, and exported as PGN on demand (vichess -p FILE).
+//
+// Games that run at the same time are interleaved, so each record names
+// its game by a channel (0-63) that is only valid between the game's
+// START and END.  A record starts with one byte, type << 6 | channel:
+//
+//   CONTROL  channel 0: a client started; games still open are unfinished
+//   START    varint length, then the game's metadata (see start_game)
+//   MOVE     SAN length, the SAN as FICS sent it, zigzag varint of the
+//            mover's clock change in ms; or, for a takeback, a 0 length,
+//            the plies taken back and both clocks after it
+//   END      varint length, result byte, reason string
+//
+// A move is thus typically 7 or 8 bytes.  Export needs no chess logic:
+// the SAN is already there, so it is a single pass over the mapped file.
+
+#define ARCHIVE_MAGIC     "VIGAMES1"
+#define ARCHIVE_CHANNELS  64
+
+enum __ARCHIVE_RECORDS
+{
+  REC_CONTROL,
+  REC_START,
+  REC_MOVE,
+  REC_END
+};
+
+enum __RESULTS { RESULT_NONE, RESULT_WHITE, RESULT_BLACK, RESULT_DRAW };
+static const char *RESULTS[] = { "*", "1-0", "0-1", "1/2-1/2" };
+
+typedef struct CHANNEL
+{
+  bool used;
+  int session;
+  uint32_t game_number;
+  int last_ply;
+  int32_t clock[2];             // white, black ms after the last move
+} CHANNEL;
+
+struct ARCHIVE
+{
+  int fd;
+  CHANNEL channels[ARCHIVE_CHANNELS];
+};
+
+
+/// Encoding
+
+static size_t put_varint(uint8_t *p, uint64_t v)
+{
+  size_t n = 0;
+  for ( ; v >= 0x80; v >>= 7) p[n++] = ( v & 0x7f ) | 0x80;
+  p[n++] = v;
+  return n;
+}
+
+static uint64_t zigzag(int64_t v) { return ( (uint64_t) v << 1 ) ^ (uint64_t) ( v >> 63 ); }
+
+static size_t put_string(uint8_t *p, const char *s)
+{
+  size_t n = strlen(s) + 1;
+  memcpy(p, s, n);
+  return n;
+}
+
+// write one record: header byte, [varint length,] body
+static void put_record(ARCHIVE *a, int type, int channel, const uint8_t *body, size_t n, bool sized)
+{
+  uint8_t rec[16 + MAX_LINE_SIZE];
+  size_t len = 0;
+  rec[len++] = type << 6 | channel;
+  if ( sized ) len += put_varint(rec + len, n);
+  memcpy(rec + len, body, n);
+  // one write() per record, to an O_APPEND file: records never tear
+  if ( write(a->fd, rec, len + n) != (ssize_t) ( len + n ) ) perror("archive write");
+}
+
+
+/// Recording
+
+// Open (or create) the archive at 'path' for appending.  Only one
+// client may record into an archive at a time; returns NULL, with errno
+// set, if another one is.
+ARCHIVE *archive_open(const char *path)
+{
+  int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+  if ( fd == -1 ) return NULL;
+  struct stat st;
+  if ( flock(fd, LOCK_EX | LOCK_NB) == -1 || fstat(fd, &st) == -1 ) { close(fd); return NULL; }
+  if ( st.st_size == 0 && write(fd, ARCHIVE_MAGIC, 8) != 8 ) { close(fd); return NULL; }
+
+  ARCHIVE *a = calloc(1, sizeof *a);
+  if ( a == NULL ) error("archive_open");
+  a->fd = fd;
+  put_record(a, REC_CONTROL, 0, NULL, 0, false);
+  return a;
+}
+
+void archive_close(ARCHIVE *a)
+{
+  close(a->fd);
+  free(a);
+}
+
+static void end_game(ARCHIVE *a, CHANNEL *ch, int result, const char *reason)
+{
+  uint8_t body[MAX_LINE_SIZE];
+  size_t n = 0;
+  body[n++] = result;
+  n += snprintf((char *) body + n, sizeof body - n - 1, "%s", reason) + 1;
+  put_record(a, REC_END, ch - a->channels, body, n, true);
+  ch->used = false;
+}
+
+static void start_game(ARCHIVE *a, int session, const STYLE12 *b, const GAMEINFO *g1)
+{
+  CHANNEL *ch = NULL;
+  for (int i = 0; i < ARCHIVE_CHANNELS && ch == NULL; i++)
+    if ( ! a->channels[i].used ) ch = &a->channels[i];
+  if ( ch == NULL ) return; // that many games at once: this one goes unrecorded
+
+  *ch = (CHANNEL) { .used = true, .session = session, .game_number = b->game_number, .last_ply = style12_ply(b),
+                    .clock = { b->white_ms, b->black_ms } };
+
+  // gameinfo comes before the game's first board, when there is one
+  static const GAMEINFO none = { 0 };
+  if ( g1->game_number != b->game_number ) g1 = &none;
+
+  POSITION pos;
+  char fen[FEN_MAX];
+  position_from_style12(&pos, b);
+  position_to_fen(&pos, fen);
+  if ( equals(fen, START_FEN) ) *fen = '\0';
+
+  uint8_t body[MAX_LINE_SIZE];
+  size_t n = 0;
+  n += put_varint(body + n, b->game_number);
+  n += put_varint(body + n, time(NULL));
+  body[n++] = g1->rated;
+  n += put_varint(body + n, b->match_minutes * 60);
+  n += put_varint(body + n, b->match_increment);
+  n += put_varint(body + n, zigzag(b->white_ms));
+  n += put_varint(body + n, zigzag(b->black_ms));
+  n += put_varint(body + n, ch->last_ply);
+  n += put_string(body + n, b->white);
+  n += put_string(body + n, b->black);
+  n += put_string(body + n, g1->white_rating);
+  n += put_string(body + n, g1->black_rating);
+  n += put_string(body + n, g1->type);
+  n += put_string(body + n, fen);
+  put_record(a, REC_START, ch - a->channels, body, n, true);
+}
+
+// Record a board of session 'session'; 'g1' is the session's latest
+// gameinfo.  Only played and observed games are kept.
+void archive_board(ARCHIVE *a, int session, const STYLE12 *b, const GAMEINFO *g1)
+{
+  if ( b->relation != PLAYING_MY_MOVE && b->relation != PLAYING_OPPONENTS_MOVE && b->relation != OBSERVING ) return;
+
+  CHANNEL *ch = NULL;
+  for (int i = 0; i < ARCHIVE_CHANNELS && ch == NULL; i++)
+    if ( a->channels[i].used && a->channels[i].session == session && a->channels[i].game_number == b->game_number )
+      ch = &a->channels[i];
+  if ( ch == NULL ) { start_game(a, session, b, g1); return; }
+
+  int ply = style12_ply(b), channel = ch - a->channels;
+  if ( ply == ch->last_ply ) return; // refresh
+  if ( ply < ch->last_ply )
+  {
+    uint8_t body[32];
+    size_t n = 0;
+    body[n++] = 0;
+    n += put_varint(body + n, ch->last_ply - ply);
+    n += put_varint(body + n, zigzag(b->white_ms));
+    n += put_varint(body + n, zigzag(b->black_ms));
+    put_record(a, REC_MOVE, channel, body, n, false);
+    ch->clock[0] = b->white_ms;
+    ch->clock[1] = b->black_ms;
+    ch->last_ply = ply;
+    return;
+  }
+  if ( ply > ch->last_ply + 1 || equals((char *) b->pretty_move, "none") )
+  {
+    // moves were missed: close this record and start again from here
+    end_game(a, ch, RESULT_NONE, "moves missing");
+    start_game(a, session, b, g1);
+    return;
+  }
+
+  int mover = b->turn == 'W'; // 1: black just moved
+  int32_t clock = mover ? b->black_ms : b->white_ms;
+  uint8_t body[32];
+  size_t n = 0, len = strnlen(b->pretty_move, sizeof b->pretty_move);
+  body[n++] = len;
+  memcpy(body + n, b->pretty_move, len); n += len;
+  n += put_varint(body + n, zigzag((int64_t) ch->clock[mover] - clock));
+  put_record(a, REC_MOVE, channel, body, n, false);
+  ch->clock[mover] = clock;
+  ch->last_ply = ply;
+}
+
+// Watch session text for the end of a game:
+//   {Game 77 (Newton vs. Einstein) Einstein resigns} 1-0
+void archive_text(ARCHIVE *a, int session, const char *line)
+{
+  unsigned int game;
+  if ( sscanf(line, "{Game %u (", &game) != 1 ) return;
+  const char *reason = strchr(line, ')'), *close = strrchr(line, '}');
+  if ( reason == NULL || close == NULL || close < reason ) return;
+
+  char result[8] = "";
+  sscanf(close + 1, "%7s", result);
+  int r = equals(result, "1-0") ? RESULT_WHITE : equals(result, "0-1") ? RESULT_BLACK
+        : equals(result, "1/2-1/2") ? RESULT_DRAW : equals(result, "*") ? RESULT_NONE : -1;
+  if ( r == -1 ) return; // "{Game 77 (...) Creating ...}" and the like
+
+  for (int i = 0; i < ARCHIVE_CHANNELS; i++)
+  {
+    CHANNEL *ch = &a->channels[i];
+    if ( ! ch->used || ch->session != session || ch->game_number != game ) continue;
+    char why[MAX_LINE_SIZE];
+    snprintf(why, sizeof why, "%.*s", (int) ( close - reason - 2 ), reason + 2);
+    end_game(a, ch, r, why);
+  }
+}
+
+
+/// Export
+
+typedef struct PLY
+{
+  const char *san;
+  uint8_t len;
+  int32_t clock;                // mover's ms after the move
+} PLY;
+
+typedef struct GAME
+{
+  bool used;
+  uint32_t game_number;
+  uint64_t started;
+  bool rated;
+  uint32_t initial, increment;
+  int32_t clock[2];
+  int first_ply;
+  const char *white, *black, *white_rating, *black_rating, *type, *fen;
+  PLY *plies;
+  int n_plies, max_plies;
+} GAME;
+
+typedef struct READER
+{
+  const uint8_t *p, *end;
+  bool bad;
+} READER;
+
+static uint64_t get_varint(READER *r)
+{
+  uint64_t v = 0;
+  for (int shift = 0; shift < 64; shift += 7)
+  {
+    if ( r->p >= r->end ) { r->bad = true; return 0; }
+    uint8_t byte = *r->p++;
+    v |= (uint64_t) ( byte & 0x7f ) << shift;
+    if ( byte < 0x80 ) return v;
+  }
+  r->bad = true;
+  return 0;
+}
+
+static int64_t get_zigzag(READER *r) { uint64_t v = get_varint(r); return (int64_t) ( v >> 1 ) ^ -(int64_t) ( v & 1 ); }
+
+static const char *get_string(READER *r)
+{
+  const char *s = (const char *) r->p;
+  const uint8_t *nul = memchr(r->p, '\0', r->end - r->p);
+  if ( nul == NULL ) { r->bad = true; return ""; }
+  r->p = nul + 1;
+  return s;
+}
+
+// printf is most of the cost of an export; numbers are written by hand
+static char *put_uint(char *p, unsigned int v)
+{
+  char digits[10];
+  int n = 0;
+  do digits[n++] = '0' + v % 10; while ( (v /= 10) > 0 );
+  while ( n > 0 ) *p++ = digits[--n];
+  return p;
+}
+
+// "0:02:58.2"
+static char *put_clock(char *p, int32_t ms)
+{
+  if ( ms < 0 ) ms = 0;
+  int tenths = ms / 100 % 10, s = ms / 1000 % 60, m = ms / 60000 % 60, h = ms / 3600000;
+  p = put_uint(p, h);
+  *p++ = ':';
+  *p++ = '0' + m / 10; *p++ = '0' + m % 10; *p++ = ':';
+  *p++ = '0' + s / 10; *p++ = '0' + s % 10; *p++ = '.';
+  *p++ = '0' + tenths;
+  return p;
+}
+
+static void write_game(GAME *g, int result, const char *reason, FILE *out)
+{
+  char date[16];
+  time_t t = g->started;
+  struct tm tm;
+  strftime(date, sizeof date, "%Y.%m.%d", gmtime_r(&t, &tm));
+
+  fprintf(out, "[Event \"FICS %s %s%sgame\"]\n[Site \"freechess.org\"]\n[Date \"%s\"]\n[Round \"-\"]\n"
+               "[White \"%s\"]\n[Black \"%s\"]\n[Result \"%s\"]\n",
+      g->rated ? "rated" : "unrated", g->type, *g->type ? " " : "", date, g->white, g->black, RESULTS[result]);
+  if ( *g->white_rating ) fprintf(out, "[WhiteElo \"%.*s\"]\n", (int) strspn(g->white_rating, "0123456789"), g->white_rating);
+  if ( *g->black_rating ) fprintf(out, "[BlackElo \"%.*s\"]\n", (int) strspn(g->black_rating, "0123456789"), g->black_rating);
+  fprintf(out, "[TimeControl \"%u+%u\"]\n", g->initial, g->increment);
+  if ( *g->fen ) fprintf(out, "[SetUp \"1\"]\n[FEN \"%s\"]\n", g->fen);
+  if ( *reason ) fprintf(out, "[Termination \"%s\"]\n", reason);
+  fputc('\n', out);
+
+  // movetext, wrapped before 80 columns
+  char line[256], *p = line;
+  for (int i = 0; i < g->n_plies; i++)
+  {
+    char token[64], *q = token;
+    int ply = g->first_ply + i;
+    if ( ply % 2 == 0 )       { q = put_uint(q, ply / 2 + 1); memcpy(q, ". ", 2); q += 2; }
+    else if ( i == 0 )        { q = put_uint(q, ply / 2 + 1); memcpy(q, "... ", 4); q += 4; }
+    memcpy(q, g->plies[i].san, g->plies[i].len); q += g->plies[i].len;
+    memcpy(q, " {[%clk ", 8); q += 8;
+    q = put_clock(q, g->plies[i].clock);
+    *q++ = ']'; *q++ = '}';
+    if ( p != line && ( p - line ) + 1 + ( q - token ) > 79 ) { *p++ = '\n'; fwrite(line, 1, p - line, out); p = line; }
+    if ( p != line ) *p++ = ' ';
+    memcpy(p, token, q - token); p += q - token;
+  }
+  if ( p != line && ( p - line ) + 1 + strlen(RESULTS[result]) > 79 ) { *p++ = '\n'; fwrite(line, 1, p - line, out); p = line; }
+  if ( p != line ) *p++ = ' ';
+  p += sprintf(p, "%s\n\n", RESULTS[result]);
+  fwrite(line, 1, p - line, out);
+
+  g->used = false;
+}
+
+// Write every game in the archive at 'path' to 'out' as PGN, in the
+// order they ended.  Returns the number of games, or -1 (errno set).
+long archive_export(const char *path, FILE *out)
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if ( fd == -1 ) return -1;
+  struct stat st;
+  if ( fstat(fd, &st) == -1 ) { close(fd); return -1; }
+  if ( st.st_size < 8 ) { close(fd); errno = EINVAL; return -1; }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if ( map == MAP_FAILED ) return -1;
+  if ( memcmp(map, ARCHIVE_MAGIC, 8) != 0 ) { munmap(map, st.st_size); errno = EINVAL; return -1; }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  GAME games[ARCHIVE_CHANNELS] = { 0 };
+  READER r = { .p = (const uint8_t *) map + 8, .end = (const uint8_t *) map + st.st_size };
+  long n_games = 0;
+  while ( r.p < r.end && ! r.bad )
+  {
+    int type = *r.p >> 6;
+    GAME *g = &games[*r.p & ( ARCHIVE_CHANNELS - 1 )];
+    r.p++;
+    switch ( type )
+    {
+      case REC_CONTROL: // a new client: whatever was open is unfinished
+        for (int i = 0; i < ARCHIVE_CHANNELS; i++)
+          if ( games[i].used ) { write_game(&games[i], RESULT_NONE, "client exited", out); n_games++; }
+        break;
+
+      case REC_START:
+      {
+        uint64_t len = get_varint(&r);
+        if ( r.bad || len > (uint64_t) ( r.end - r.p ) ) { r.bad = true; break; }
+        if ( g->used ) { write_game(g, RESULT_NONE, "", out); n_games++; }
+        READER body = { .p = r.p, .end = r.p + len };
+        r.p += len;
+        g->game_number  = get_varint(&body);
+        g->started      = get_varint(&body);
+        g->rated        = body.p < body.end && *body.p++;
+        g->initial      = get_varint(&body);
+        g->increment    = get_varint(&body);
+        g->clock[0]     = get_zigzag(&body);
+        g->clock[1]     = get_zigzag(&body);
+        g->first_ply    = get_varint(&body);
+        g->white        = get_string(&body);
+        g->black        = get_string(&body);
+        g->white_rating = get_string(&body);
+        g->black_rating = get_string(&body);
+        g->type         = get_string(&body);
+        g->fen          = get_string(&body);
+        g->n_plies      = 0;
+        g->used         = ! body.bad;
+        break;
+      }
+
+      case REC_MOVE:
+      {
+        if ( r.p >= r.end ) { r.bad = true; break; }
+        uint8_t len = *r.p++;
+        if ( len == 0 )
+        {
+          uint64_t back = get_varint(&r);
+          g->n_plies -= back < (uint64_t) g->n_plies ? (int) back : g->n_plies;
+          g->clock[0] = get_zigzag(&r);
+          g->clock[1] = get_zigzag(&r);
+          break;
+        }
+        if ( len > r.end - r.p ) { r.bad = true; break; }
+        const char *san = (const char *) r.p;
+        r.p += len;
+        int64_t delta = get_zigzag(&r);
+        if ( ! g->used ) break;
+        if ( g->n_plies == g->max_plies )
+        {
+          g->max_plies = g->max_plies ? g->max_plies * 2 : 128;
+          if ( (g->plies = realloc(g->plies, g->max_plies * sizeof *g->plies)) == NULL ) error("archive_export");
+        }
+        int mover = ( g->first_ply + g->n_plies ) & 1;
+        g->clock[mover] -= delta;
+        g->plies[g->n_plies++] = (PLY) { .san = san, .len = len, .clock = g->clock[mover] };
+        break;
+      }
+
+      case REC_END:
+      {
+        uint64_t len = get_varint(&r);
+        if ( r.bad || len < 2 || len > (uint64_t) ( r.end - r.p ) ) { r.bad = true; break; }
+        int result = r.p[0] < LEN(RESULTS) ? r.p[0] : RESULT_NONE;
+        const char *reason = (const char *) r.p + 1;
+        r.p += len;
+        if ( g->used ) { write_game(g, result, reason, out); n_games++; }
+        break;
+      }
+    }
+  }
+  // a torn last record (crash mid-write) ends the export quietly
+  for (int i = 0; i < ARCHIVE_CHANNELS; i++)
+  {
+    if ( games[i].used ) { write_game(&games[i], RESULT_NONE, "", out); n_games++; }
+    free(games[i].plies);
+  }
+  munmap(map, st.st_size);
+  return n_games;
+}
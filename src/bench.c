@@ -0,0 +1,1685 @@
+#include "vichess.h"
+
+#include <sys/un.h>     // struct sockaddr_un
+
+// Built-in benchmarks, run with `vichess -b NAME` (or `make bench`).
+// None of them touch the network; inputs are canned server lines.
+
+// A short blitz game as the server sends it: gameinfo, then boards
+// interleaved with ordinary text.
+static const char *CORPUS[] =
+{
+  "<g1> 77 p=0 t=blitz r=1 u=1,1 it=180,0 i=180,0 pt=0 rt=1880,1789E ts=1,1 m=2 n=1\n\r",
+  "<12> rnbqkbnr pppppppp -------- -------- -------- -------- PPPPPPPP RNBQKBNR W -1 1 1 1 1 0 77 Newton Einstein 0 3 0 39 39 180000 180000 1 none (0:00.000) none 0 0 0\n\r",
+  "<12> rnbqkbnr pppppppp -------- -------- ----P--- -------- PPPP-PPP RNBQKBNR B 4 1 1 1 1 0 77 Newton Einstein 0 3 0 39 39 180000 180000 1 P/e2-e4 (0:00.000) e4 0 0 0\n\r",
+  "Newton(1880)[77] kibitzes: good luck\n\r",
+  "<12> rnbqkbnr pp-ppppp -------- --p----- ----P--- -------- PPPP-PPP RNBQKBNR W 2 1 1 1 1 0 77 Newton Einstein 0 3 0 39 39 178231 179012 2 P/c7-c5 (0:00.988) c5 0 0 0\n\r",
+  "<12> rnbqkbnr pp-ppppp -------- --p----- ----P--- -----N-- PPPP-PPP RNBQKB-R B -1 1 1 1 1 1 77 Newton Einstein 0 3 0 39 39 178231 177544 2 N/g1-f3 (0:01.468) Nf3 0 0 0\n\r",
+  "Game 77: Einstein requests to take back 1 half move(s).\n\r",
+  "<12> r-bqkbnr pp-ppppp --n----- --p----- ----P--- -----N-- PPPP-PPP RNBQKB-R W -1 1 1 1 1 2 77 Newton Einstein 0 3 0 39 39 176002 177544 3 N/b8-c6 (0:02.229) Nc6 0 0 0\n\r",
+  "Gaurav tells you: want a rematch later?\n\r",
+  "<12> r-bqkbnr pp-ppppp --n----- --p----- ---PP--- -----N-- PPP--PPP RNBQKB-R B 3 1 1 1 1 0 77 Newton Einstein 0 3 0 39 39 176002 175160 3 P/d2-d4 (0:02.384) d4 0 0 0\n\r",
+};
+
+static double per_second(uint64_t n, uint64_t ns) { return n * 1e9 / (ns ? ns : 1); }
+
+// Whether any check has come out WRONG, for bench()'s exit status.
+static bool failed;
+
+// A check's verdict, as printed.
+static const char *verdict(bool ok)
+{
+  failed |= ! ok;
+  return ok ? "ok" : "WRONG";
+}
+
+static void free_update(UPDATE *u)
+{
+  mem_free(u->text);          u->text         = NULL;
+  mem_free(u->my_nick);       u->my_nick      = NULL;
+  mem_free(u->opp_nick);      u->opp_nick     = NULL;
+  mem_free(u->my_rating);     u->my_rating    = NULL;
+  mem_free(u->opp_rating);    u->opp_rating   = NULL;
+  mem_free(u->my_status_str); u->my_status_str = NULL;
+}
+
+// parse one corpus line into 'u' the way the writers do; returns EV_*
+static int parse_line(const char *line, UPDATE *u)
+{
+  free_update(u);
+  if ( begins_with((char *) line, GAMEINFO_MARKER) )
+  {
+    parse_gameinfo_string(line, u);
+    return EV_GAMEINFO;
+  }
+  if ( begins_with((char *) line, STYLE12_MARKER) )
+  {
+    parse_s12_string(line, u);
+    return EV_BOARD;
+  }
+  return EV_TEXT;
+}
+
+
+/// headless: events/s written by the headless writer vs. the curses one
+
+static uint64_t run_headless(int format, int rounds, FILE *devnull)
+{
+  CONFIG c = { .format = format, .out = devnull };
+  UPDATE u = { 0 };
+  EVENT ev;
+
+  uint64_t start = now_ns();
+  for (int r = 0; r < rounds; r++)
+    for (int i = 0; i < LEN(CORPUS); i++)
+    {
+      int type = parse_line(CORPUS[i], &u);
+      make_event(&ev, 0, type, &u, CORPUS[i]);
+      write_event(&c, &ev);
+    }
+  fflush(devnull);
+  uint64_t elapsed = now_ns() - start;
+
+  free_update(&u);
+  return elapsed;
+}
+
+static uint64_t run_curses(int rounds, FILE *devnull)
+{
+  // a real terminal description, rendering into /dev/null
+  SCREEN *screen = newterm("xterm-256color", devnull, stdin);
+  if ( screen == NULL ) return 0;
+  start_color();
+  WINDOW *board = newwin(LINES / 2, COLS, 0, 0);
+  WINDOW *text  = newwin(LINES / 2 - 1, COLS, LINES / 2, 0);
+  scrollok(text, TRUE);
+  UPDATE u = { 0 };
+
+  uint64_t start = now_ns();
+  for (int r = 0; r < rounds; r++)
+    for (int i = 0; i < LEN(CORPUS); i++)
+    {
+      switch ( parse_line(CORPUS[i], &u) )
+      {
+        case EV_BOARD:  cb_write_board(board, &u); break;
+        case EV_TEXT:   cb_write_response(text, (void *) CORPUS[i]); break;
+      }
+    }
+  uint64_t elapsed = now_ns() - start;
+
+  free_update(&u);
+  delwin(board); delwin(text);
+  endwin();
+  delscreen(screen);
+  return elapsed;
+}
+
+static void bench_headless(void)
+{
+  FILE *devnull = fopen("/dev/null", "w");
+  if ( devnull == NULL ) error("/dev/null");
+  setvbuf(devnull, NULL, _IOFBF, 1 << 20);
+
+  int rounds    = 20000;
+  uint64_t n    = (uint64_t) rounds * LEN(CORPUS);
+  uint64_t json = run_headless(OUT_JSON,   rounds, devnull);
+  uint64_t bin  = run_headless(OUT_BINARY, rounds, devnull);
+  uint64_t term = run_curses(rounds / 20, devnull);
+
+  printf("headless  json    %10.0f events/s  %7.1f ns/event\n", per_second(n, json), (double) json / n);
+  printf("headless  binary  %10.0f events/s  %7.1f ns/event\n", per_second(n, bin),  (double) bin / n);
+  if ( term > 0 )
+    printf("curses            %10.0f events/s  %7.1f ns/event\n",
+        per_second(n / 20, term), (double) term / (n / 20));
+  else
+    printf("curses            (no terminfo for xterm-256color)\n");
+  fclose(devnull);
+}
+
+
+/// triggers: socket readable -> action sent, on the I/O loop's path
+
+static int compare_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return (x > y) - (x < y);
+}
+
+static void bench_triggers(void)
+{
+  static const char *rules[] =
+  {
+    "on challenge from=Bob send accept %h",
+    "on seek type=standard send play %n",
+    "on seek time=1 inc=0 rating=1800-2100 rated=1 send play %n",
+  };
+  static const char *lines[] =
+  {
+    "Gaurav tells you: want a rematch later?\n\r",
+    "Alice (1500) seeking 5 0 rated blitz (\"play 12\" to respond)\n\r",
+    "<12> rnbqkbnr pppppppp -------- -------- ----P--- -------- PPPP-PPP RNBQKBNR B 4 1 1 1 1 0 77 Newton Einstein 0 3 0 39 39 180000 180000 1 P/e2-e4 (0:00.000) e4 0 0 0\n\r",
+    "Carol (1822) seeking 1 0 rated lightning f (\"play 7\" to respond)\n\r",
+  };
+  for (int i = 0; i < LEN(rules); i++) if ( ! triggers_add(rules[i]) ) error("bench rule");
+
+  int sv[2];
+  if ( socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1 ) error("socketpair");
+  SESSION s = { .id = 0, .sk = sv[0] };
+
+  enum { ROUNDS = 20000 };
+  static uint64_t sent[ROUNDS];
+  uint64_t n_sent = 0, n_lines = 0, miss_ns = 0;
+  char drain[4096];
+
+  for (int r = 0; r < ROUNDS; r++)
+    for (int i = 0; i < LEN(lines); i++)
+    {
+      uint64_t start = now_ns();
+      TRIGGER *t = triggers_run(&s, lines[i], start);
+      n_lines++;
+      if ( t == NULL ) { miss_ns += now_ns() - start; continue; }
+      sent[n_sent++] = atomic_load_explicit(&t->last_latency, memory_order_relaxed);
+      if ( read(sv[1], drain, sizeof drain) < 1 ) error("bench read");
+    }
+
+  qsort(sent, n_sent, sizeof *sent, compare_u64);
+  printf("%lu lines, %lu matched; non-matching lines cost %.0f ns\n",
+      n_lines, n_sent, (double) miss_ns / (n_lines - n_sent));
+  printf("trigger-to-send  min %.1f  p50 %.1f  p99 %.1f  max %.1f us\n",
+      sent[0] / 1000.0, sent[n_sent / 2] / 1000.0,
+      sent[n_sent * 99 / 100] / 1000.0, sent[n_sent - 1] / 1000.0);
+
+  close(sv[0]); close(sv[1]);
+  N_TRIGGERS = 0;
+}
+
+
+/// perft: move generator speed, checked against the published counts
+
+static const struct { const char *fen; int depth; uint64_t nodes; } PERFT[] =
+{
+  { START_FEN,                                                                  5,  4865609 },
+  { "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",     4,  4085603 },
+  { "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",                                5,   674624 },
+  { "r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1",         4,   422333 },
+};
+
+static void bench_perft(void)
+{
+  for (int i = 0; i < LEN(PERFT); i++)
+  {
+    POSITION pos;
+    if ( ! position_from_fen(&pos, PERFT[i].fen) ) error("bench fen");
+    uint64_t start = now_ns();
+    uint64_t nodes = perft(&pos, PERFT[i].depth);
+    uint64_t elapsed = now_ns() - start;
+    printf("perft %d  %9lu nodes  %10.0f nodes/s  %s\n", PERFT[i].depth, nodes,
+        per_second(nodes, elapsed), verdict(nodes == PERFT[i].nodes));
+  }
+}
+
+
+/// engine: fixed-depth searches, nodes/s and time to depth by threads
+
+static const struct { const char *fen; int depth; } SEARCHES[] =
+{
+  { START_FEN,                                                                  9 },
+  { "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",     7 },
+  { "r1bq1rk1/pp2ppbp/2np1np1/8/3NP3/2N1BP2/PPPQ2PP/R3KB1R w KQ - 0 9",        8 },
+  { "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",                               12 },
+};
+
+static void bench_engine(void)
+{
+  int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  uint64_t base_ns = 0;
+  // 1, 2, 4 ... and finally every cpu
+  for (int threads = 1; threads <= cpus; threads = ( threads < cpus && threads * 2 > cpus ) ? cpus : threads * 2)
+  {
+    uint64_t nodes = 0, elapsed = 0;
+    for (int i = 0; i < LEN(SEARCHES); i++)
+    {
+      POSITION pos;
+      if ( ! position_from_fen(&pos, SEARCHES[i].fen) ) error("bench fen");
+      engine_tt_clear(); // every run starts cold
+      SEARCH_RESULT r = engine_search(&pos, NULL, 0, (SEARCH_LIMITS) { .depth = SEARCHES[i].depth, .threads = threads });
+      nodes   += r.nodes;
+      elapsed += r.ns;
+    }
+    if ( threads == 1 ) base_ns = elapsed;
+    printf("threads %3d  %10lu nodes  %8.0f ms  %10.0f nodes/s  time-to-depth speedup %.2fx\n",
+        threads, nodes, elapsed / 1e6, per_second(nodes, elapsed), (double) base_ns / elapsed);
+  }
+}
+
+
+/// cache: concurrent probes and stores on the persistent analysis cache
+
+typedef struct CACHE_WORK { CACHE *cache; uint64_t seed; long n; } CACHE_WORK;
+
+static void *t_cache_work(void *arg)
+{
+  CACHE_WORK *w = (CACHE_WORK *) arg;
+  CACHED hit;
+  // keys drawn from a working set twice the size of the table, so
+  // that replacement is exercised; one store for every four probes
+  for (long i = 0; i < w->n; i++)
+  {
+    w->seed = w->seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    uint64_t key = ( ( w->seed >> 43 ) + 1 ) * 0x9e3779b97f4a7c15ULL;
+    if ( ( i & 3 ) == 0 ) cache_store(w->cache, key, MAKE_MOVE(0x14, 0x34, 0, 0), (int) ( key & 255 ), 1 + ( key & 15 ));
+    else                  cache_probe(w->cache, key, &hit);
+  }
+  return NULL;
+}
+
+static void bench_cache(void)
+{
+  char path[] = "/tmp/vichess-bench-cache.XXXXXX";
+  int fd = mkstemp(path);
+  if ( fd == -1 ) error("mkstemp");
+  close(fd);
+  CACHE *cache = cache_open(path, 16);
+  if ( cache == NULL ) error("cache_open");
+
+  int cpus = sysconf(_SC_NPROCESSORS_ONLN), threads = cpus > 1 ? cpus : 2;
+  enum { PER_THREAD = 2000000 };
+  CACHE_WORK work[threads];
+  pthread_t tid[threads];
+  uint64_t start = now_ns();
+  for (int i = 0; i < threads; i++)
+  {
+    work[i] = (CACHE_WORK) { .cache = cache, .seed = i + 1, .n = PER_THREAD };
+    pthread_create(&tid[i], NULL, t_cache_work, &work[i]);
+  }
+  for (int i = 0; i < threads; i++) pthread_join(tid[i], NULL);
+  uint64_t elapsed = now_ns() - start;
+
+  CACHE_STATS st;
+  cache_stats(cache, &st);
+  printf("%d threads, %lu entries: %10.0f ops/s, %.1f ns/probe, %.1f%% hits\n",
+      threads, st.entries, per_second((uint64_t) threads * PER_THREAD, elapsed),
+      (double) st.probe_ns / st.probes, 100.0 * st.hits / st.probes);
+
+  // reopen: everything stored is still there
+  cache_close(cache);
+  cache = cache_open(path, 16);
+  CACHE_WORK again = { .cache = cache, .seed = 1, .n = PER_THREAD / 4 };
+  t_cache_work(&again);
+  cache_stats(cache, &st);
+  printf("after reopening: %.1f%% hits\n", 100.0 * st.hits / st.probes);
+  cache_close(cache);
+  unlink(path);
+}
+
+
+/// repetition: cost of tracking a board for draw claims
+
+static void bench_repetition(void)
+{
+  // knights out and back: the start position recurs every four plies,
+  // so the first threefold repetition is at ply 8; nothing irreversible
+  // happens, so the 50-move rule applies from ply 100 and the window wraps
+  enum { PLIES = 1024, ROUNDS = 2000 };
+  static const char *SHUFFLE[] = { "Nf3", "Nf6", "Ng1", "Ng8" };
+  position_init();
+  STYLE12 *boards = calloc(PLIES, sizeof *boards);
+  uint64_t *keys  = calloc(PLIES, sizeof *keys);
+  if ( boards == NULL || keys == NULL ) error("bench calloc");
+  POSITION pos;
+  position_start(&pos);
+  UPDATE u = { 0 };
+  parse_line(CORPUS[0], &u); // boards need the gameinfo
+  char line[MAX_LINE_SIZE];
+  for (int i = 0; i < PLIES; i++)
+  {
+    position_to_style12(&pos, line, sizeof line, 77, "Newton", "Einstein", OBSERVING, 0, 180000, 180000, "none", "none");
+    parse_line(line, &u);
+    boards[i] = u.s12;
+    keys[i]   = pos.hash;
+    UNDO undo;
+    make_move(&pos, parse_move(&pos, SHUFFLE[i % LEN(SHUFFLE)]), &undo);
+  }
+  free_update(&u);
+
+  // each of the four positions is reported when it first occurs three
+  // times, and the fifty moves once
+  SESSION s = { 0 };
+  int first = -1, reported[DRAW_FIFTY_MOVES + 1] = { 0 };
+  uint64_t start = now_ns();
+  for (int r = 0; r < ROUNDS; r++)
+  {
+    mem_free(s.games); s.games = NULL; // a new game each round
+    for (int i = 0; i < PLIES; i++)
+    {
+      int draw = history_update(&s, &boards[i], keys[i]);
+      if ( r > 0 ) continue;
+      reported[draw]++;
+      if ( draw == DRAW_REPETITION && first == -1 ) first = i;
+    }
+  }
+  uint64_t elapsed = now_ns() - start;
+
+  // and the 50-move rule, on a board of a game of its own
+  STYLE12 late = boards[0];
+  late.game_number  = 78;
+  late.irreversible = 100;
+  bool fifty = history_update(&s, &late, keys[0]) == DRAW_FIFTY_MOVES;
+
+  printf("%d boards: %.1f ns/board, %.0f boards/s; threefold at ply %d, 50 moves %s; reported %d and %d times  %s\n",
+      PLIES * ROUNDS, (double) elapsed / ( (uint64_t) PLIES * ROUNDS ), per_second((uint64_t) PLIES * ROUNDS, elapsed),
+      first, fifty ? "seen" : "missed", reported[DRAW_REPETITION], reported[DRAW_FIFTY_MOVES],
+      verdict(first == 8 && fifty && reported[DRAW_REPETITION] == 4 && reported[DRAW_FIFTY_MOVES] == 1));
+  mem_free(s.games);
+  free(keys);
+  free(boards);
+}
+
+
+/// archive: recording games, and exporting them as PGN
+
+static void bench_archive(void)
+{
+  // one game of random legal moves, as Style12 boards with clocks
+  enum { PLIES = 80, GAMES = 20000, COPIES = 10 };
+  position_init();
+  STYLE12 boards[PLIES + 1];
+  POSITION pos;
+  position_start(&pos);
+  UPDATE u = { 0 };
+  parse_line(CORPUS[0], &u);
+  char line[MAX_LINE_SIZE], san[16] = "none", verbose[16] = "none";
+  uint64_t seed = 7;
+  int n_boards = 0;
+  for (int ply = 0; ply <= PLIES; ply++)
+  {
+    int wms = 180000 - ply / 2 * 2345, bms = 180000 - ( ply + 1 ) / 2 * 1789;
+    position_to_style12(&pos, line, sizeof line, 77, "Newton", "Einstein", OBSERVING, 0, wms, bms, verbose, san);
+    parse_line(line, &u);
+    boards[n_boards++] = u.s12;
+    MOVE_LIST list;
+    generate_legal_moves(&pos, &list);
+    if ( list.n == 0 ) break;
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    MOVE m = list.moves[( seed >> 33 ) % list.n];
+    move_to_verbose(&pos, m, verbose);
+    move_to_san(&pos, m, san);
+    UNDO undo;
+    make_move(&pos, m, &undo);
+  }
+  GAMEINFO g1 = u.g1;
+  free_update(&u);
+
+  char path[] = "/tmp/vichess-bench-archive.XXXXXX";
+  int fd = mkstemp(path);
+  if ( fd == -1 ) error("mkstemp");
+  close(fd);
+  unlink(path); // archive_open writes the header into a new file
+  ARCHIVE *a = archive_open(path);
+  if ( a == NULL ) error("archive_open");
+
+  uint64_t start = now_ns();
+  for (int i = 0; i < GAMES; i++)
+  {
+    g1.game_number = 1 + i % 500;
+    for (int j = 0; j < n_boards; j++)
+    {
+      boards[j].game_number = g1.game_number;
+      archive_board(a, 0, &boards[j], &g1);
+    }
+    snprintf(line, sizeof line, "{Game %u (Newton vs. Einstein) Einstein resigns} 1-0", g1.game_number);
+    archive_text(a, 0, line);
+  }
+  uint64_t elapsed = now_ns() - start;
+  archive_close(a);
+
+  struct stat st;
+  stat(path, &st);
+  printf("record: %d games, %.0f games/s, %.1f bytes/move\n", GAMES, per_second(GAMES, elapsed),
+      (double) st.st_size / ( (uint64_t) GAMES * ( n_boards - 1 ) ));
+
+  // the same games COPIES times over, for a bigger export
+  FILE *f = fopen(path, "r+");
+  char *body = malloc(st.st_size);
+  if ( f == NULL || body == NULL || fread(body, 1, st.st_size, f) != (size_t) st.st_size ) error("bench archive read");
+  for (int i = 1; i < COPIES; i++) fwrite(body + 8, 1, st.st_size - 8, f);
+  fclose(f);
+  free(body);
+  stat(path, &st);
+
+  FILE *devnull = fopen("/dev/null", "w");
+  static char buf[1 << 20];
+  setvbuf(devnull, buf, _IOFBF, sizeof buf);
+  start = now_ns();
+  long games = archive_export(path, devnull);
+  fflush(devnull);
+  elapsed = now_ns() - start;
+  fclose(devnull);
+  printf("export: %ld games in %.2f s, %.0f games/s, %.0f MB/s of archive  %s\n", games, elapsed / 1e9,
+      per_second(games, elapsed), per_second(st.st_size, elapsed) / 1e6, verdict(games == (long) GAMES * COPIES));
+  unlink(path);
+}
+
+
+/// import: parallel PGN import, and position queries against the index
+
+static void bench_import(void)
+{
+  // random legal games, written out as PGN; keys[] remembers where each
+  // game is after PROBE plies, to check the index against
+  enum { GAMES = 20000, PLIES = 80, PROBE = 12, QUERIES = 100000 };
+  position_init();
+  char pgn[] = "/tmp/vichess-bench-import.XXXXXX";
+  int fd = mkstemp(pgn);
+  if ( fd == -1 ) error("mkstemp");
+  FILE *f = fdopen(fd, "w");
+  uint64_t *keys = calloc(GAMES, sizeof *keys), seed = 11;
+  if ( f == NULL || keys == NULL ) error("bench import");
+  static const char *RESULTS[] = { "1-0", "0-1", "1/2-1/2" };
+  for (int g = 0; g < GAMES; g++)
+  {
+    const char *result = RESULTS[g % LEN(RESULTS)];
+    fprintf(f, "[Event \"bench\"]\n[Site \"freechess.org\"]\n[Date \"2014.%02d.%02d\"]\n[Round \"-\"]\n"
+        "[White \"Newton%d\"]\n[Black \"Einstein%d\"]\n[Result \"%s\"]\n[WhiteElo \"%d\"]\n[BlackElo \"%d\"]\n\n",
+        1 + g % 12, 1 + g % 28, g, g + 1, result, 1200 + g % 900, 1300 + g % 700);
+    POSITION pos;
+    position_start(&pos);
+    int column = 0;
+    for (int ply = 0; ply < PLIES; ply++)
+    {
+      MOVE_LIST list;
+      generate_legal_moves(&pos, &list);
+      if ( list.n == 0 ) break;
+      seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+      MOVE m = list.moves[( seed >> 33 ) % list.n];
+      char san[16];
+      move_to_san(&pos, m, san);
+      UNDO undo;
+      make_move(&pos, m, &undo);
+      if ( ply + 1 == PROBE ) keys[g] = pos.hash;
+      column += ply % 2 == 0 ? fprintf(f, "%d. %s ", ply / 2 + 1, san) : fprintf(f, "%s ", san);
+      if ( ply % 10 == 9 ) column += fprintf(f, "{[%%clk 0:02:%02d]} ", 59 - ply / 10);
+      if ( column > 70 ) { fputc('\n', f); column = 0; }
+    }
+    fprintf(f, "%s\n\n", result);
+  }
+  if ( fclose(f) != 0 ) error("bench import write");
+
+  char index[sizeof pgn + 4];
+  snprintf(index, sizeof index, "%s.idx", pgn);
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  for (int threads = 1; ; threads *= 2)
+  {
+    if ( threads > cpus ) threads = cpus;
+    IMPORT_STATS st;
+    if ( ! gamedb_import(pgn, index, threads, &st) ) error("gamedb_import");
+    printf("%2d threads: %lu games in %.2f s, %.1f MB/s, %.0f games/s, %lu positions  %s\n", threads,
+        (unsigned long) st.games, st.ns / 1e9, per_second(st.bytes, st.ns) / 1e6, per_second(st.games, st.ns),
+        (unsigned long) st.positions, verdict(st.games == GAMES && st.errors == 0));
+    if ( threads >= cpus ) break;
+  }
+
+  GAMEDB *db = gamedb_open(index);
+  if ( db == NULL ) error("gamedb_open");
+  int found = 0, probed = 0;
+  size_t total = 0;
+  uint32_t games[64];
+  uint64_t start = now_ns();
+  for (int i = 0; i < QUERIES; i++)
+  {
+    int g = ( i * 7919 ) % GAMES;
+    if ( keys[g] == 0 ) continue; // mated early
+    probed++;
+    size_t n = gamedb_query(db, keys[g], games, LEN(games));
+    total += n;
+    for (size_t j = 0; j < n && j < LEN(games); j++) if ( games[j] == (uint32_t) g ) { found++; break; }
+  }
+  uint64_t elapsed = now_ns() - start;
+  char line[256];
+  gamedb_describe(db, 0, line, sizeof line);
+  printf("query: %.2f us/query, %.1f games/query; %s  %s\n", elapsed / 1e3 / probed, (double) total / probed,
+      line, verdict(found == probed));
+  gamedb_close(db);
+  free(keys);
+  unlink(index);
+  unlink(pgn);
+}
+
+
+/// lists: recognizing, indexing and diffing games/who/sought listings
+
+// FICS handles are letters only: 0 -> "a", 27 -> "bb"
+static const char *letters(int n, char *out)
+{
+  int len = 0;
+  do out[len++] = 'a' + n % 26; while ( (n /= 26) > 0 );
+  out[len] = '\0';
+  return out;
+}
+
+static void bench_lists(void)
+{
+  // 1000-row listings of each kind; each refresh moves the clocks of
+  // every game, and replaces one row in fifty
+  enum { ROWS = 1000, REFRESHES = 200, QUERIES = 10000 };
+  static const char *TYPES[] = { "blitz", "lightning", "standard", "crazyhouse" };
+  static const char CODES[] = "blsz";
+  SESSION s = { .id = 1 };     // not the active session: nothing is drawn
+  CONFIG c = { .active = 0 };
+  char line[MAX_LINE_SIZE];
+  uint64_t elapsed[N_LISTS] = { 0 };
+
+  for (int r = 0; r <= REFRESHES; r++)
+    for (int kind = 0; kind < N_LISTS; kind++)
+    {
+      uint64_t start = now_ns();
+      for (int i = 0; i < ROWS; i++)
+      {
+        char h[8];
+        int id = i + 1 + ( i % 50 == r % 50 ? r * ROWS : 0 ), rating = 1000 + ( i * 37 ) % 1400, t = i % 4;
+        if ( kind == LIST_GAMES )
+          snprintf(line, sizeof line, "%3d %4d Newton%-5s %4d Einstein%-5s [ %c%c %2d %3d]  %2d:%02d - %2d:%02d (39-39) W: %2d\n",
+              id, rating, letters(id, h), rating - 50, h, CODES[t], i % 3 ? 'r' : 'u', 1 + t * 2, t, r % 10, i % 60, r % 10, ( i + 7 ) % 60, 1 + r);
+        else if ( kind == LIST_SOUGHT )
+          snprintf(line, sizeof line, "%3d %4d Newton%-12s %3d %3d %-7s %-10s %s 0-9999 %s\n", id, rating, letters(id, h), 1 + t * 2, t,
+              i % 3 ? "rated" : "unrated", TYPES[t], i % 5 ? "       " : "[white]", i % 7 ? "" : "f");
+        else if ( i % 3 == 0 )
+          snprintf(line, sizeof line, "%4d%cNewton%-7s %4d.Einstein%-5s ++++ Guest%s\n", rating, i % 2 ? '^' : ' ', letters(id, h),
+              rating + 1, h, h);
+        else continue;
+        lists_feed(&c, &s, line);
+      }
+      static const char *FOOTERS[] = { "%d games displayed (of %d in progress).\n",
+          "%d players displayed (of %d). (*) indicates system administrator.\n", "%d ads displayed.\n" };
+      snprintf(line, sizeof line, FOOTERS[kind], ROWS, ROWS);
+      lists_feed(&c, &s, line);
+      if ( r > 0 ) elapsed[kind] += now_ns() - start;
+    }
+
+  for (int kind = 0; kind < N_LISTS; kind++)
+    printf("%-6s %d-row refresh: %.3f ms (parse, index and diff)\n", kind == LIST_GAMES ? "games" : kind == LIST_WHO ? "who" : "sought",
+        ROWS, elapsed[kind] / 1e6 / REFRESHES);
+
+  // queries against the indexes
+  static char texts[ROWS][LIST_TEXT];
+  static const char *QUERY[] = { "sort=rating", "rating=1500-1600 sort=time", "player=Newtonb", "time=3 rated=1 type=lightning" };
+  int total, counts[LEN(QUERY)];
+  for (int q = 0; q < LEN(QUERY); q++)
+  {
+    uint64_t start = now_ns();
+    for (int i = 0; i < QUERIES / 10; i++) counts[q] = lists_select(s.lists, LIST_GAMES, QUERY[q], texts, ROWS, &total);
+    printf("games %-30s %4d of %d rows in %.1f us\n", QUERY[q], counts[q], total, ( now_ns() - start ) / 1e3 / ( QUERIES / 10 ));
+  }
+  // handles spell the id least significant letter first: "b" is 1 mod 26
+  bool ok = counts[0] == ROWS && counts[2] > 0 && counts[2] <= ROWS / 26 + 1;
+  printf("%s\n", verdict(ok));
+  lists_free(s.lists);
+}
+
+
+/// seeks: applying a seekinfo stream to the seek table
+
+static void bench_seeks(void)
+{
+  // a busy evening: seeks come and go among the 600 lowest numbers
+  enum { UPDATES = 1000000, NUMBERS = 600 };
+  static const char *TYPES[] = { "blitz", "lightning", "standard", "crazyhouse", "untimed" };
+  SESSION s = { 0 };
+  CONFIG c = { 0 };             // headless: no redraws queued
+  char (*lines)[128] = malloc(UPDATES * sizeof *lines);
+  bool live[NUMBERS] = { false };
+  int n_live = 0;
+  uint64_t seed = 5;
+  if ( lines == NULL ) error("bench seeks");
+  for (int i = 0; i < UPDATES; i++)
+  {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    int number = 1 + ( seed >> 33 ) % ( NUMBERS - 1 ), r = ( seed >> 20 ) % 100;
+    if ( live[number] )
+      snprintf(lines[i], sizeof lines[i], "<sr> %d\n", number), n_live--;
+    else
+      snprintf(lines[i], sizeof lines[i], "<s> %d w=Newton ti=00 rt=%d%s t=%d i=%d r=%c tp=%s c=? rr=0-9999 a=t f=f\n",
+          number, r < 10 ? 0 : 900 + r * 13, r < 10 ? "P" : "", r % 16, r % 13, r % 2 ? 'r' : 'u', TYPES[r % LEN(TYPES)]), n_live++;
+    live[number] = ! live[number];
+  }
+
+  uint64_t start = now_ns();
+  for (int i = 0; i < UPDATES; i++) seeks_line(&c, &s, lines[i]);
+  uint64_t elapsed = now_ns() - start;
+
+  int sum = 0;
+  for (int i = 0; i < SEEK_ROWS * SEEK_COLS; i++) sum += atomic_load(&s.seeks->counts[i]);
+  printf("%d updates: %.0f ns/update, %.0f updates/s; %d seeks live  %s\n", UPDATES, (double) elapsed / UPDATES,
+      per_second(UPDATES, elapsed), s.seeks->n, verdict(s.seeks->n == n_live && sum == n_live));
+
+  seeks_line(&c, &s, "<sc>\n");
+  printf("after <sc>: %d seeks  %s\n", s.seeks->n, verdict(s.seeks->n == 0));
+  mem_free(s.seeks);
+  free(lines);
+}
+
+
+/// movelist: a game's moves, backfilled, and stepping through them
+
+static void bench_movelist(void)
+{
+  // one long game of random legal moves, as Style12 boards, joined at
+  // ply JOIN; the "moves" listing then fills in the plies before
+  enum { PLIES = 400, JOIN = 150, JUMPS = 1000000 };
+  position_init();
+  STYLE12 *boards = calloc(PLIES + 1, sizeof *boards);
+  POSITION *positions = calloc(PLIES + 1, sizeof *positions);
+  char (*sans)[16] = calloc(PLIES + 1, sizeof *sans);
+  if ( boards == NULL || positions == NULL || sans == NULL ) error("bench calloc");
+  POSITION pos;
+  position_start(&pos);
+  UPDATE u = { 0 };
+  parse_line(CORPUS[0], &u);
+  char line[MAX_LINE_SIZE], san[16] = "none", verbose[16] = "none";
+  uint64_t seed = 11;
+  int n_boards = 0;
+  for (int ply = 0; ply <= PLIES; ply++)
+  {
+    position_to_style12(&pos, line, sizeof line, 77, "Newton", "Einstein", OBSERVING, 0, 180000, 180000, verbose, san);
+    parse_line(line, &u);
+    boards[n_boards] = u.s12;
+    position_from_style12(&positions[n_boards++], &u.s12);
+    MOVE_LIST list;
+    generate_legal_moves(&pos, &list);
+    if ( list.n == 0 ) break;
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    MOVE m = list.moves[( seed >> 33 ) % list.n];
+    move_to_verbose(&pos, m, verbose);
+    move_to_san(&pos, m, san);
+    snprintf(sans[ply], sizeof sans[ply], "%s", san);
+    UNDO undo;
+    make_move(&pos, m, &undo);
+  }
+  free_update(&u);
+
+  SESSION s = { 0 };
+  CONFIG c = { 0 };             // headless: nothing drawn, no "moves" sent
+  GAME_MOVES *g = NULL;
+  uint64_t start = now_ns();
+  for (int i = JOIN; i < n_boards; i++) g = movelist_board(&c, &s, &boards[i], &positions[i]);
+  uint64_t record_ns = now_ns() - start;
+
+  // the listing as the server had it a little after the first board
+  int listed = JOIN + 20 < n_boards - 1 ? JOIN + 20 : n_boards - 1;
+  start = now_ns();
+  movelist_feed(&c, &s, "Movelist for game 77:\n\r", BO_MOVES);
+  movelist_feed(&c, &s, "\n\r", BO_MOVES);
+  movelist_feed(&c, &s, "Move  Newton                  Einstein\n\r", BO_MOVES);
+  movelist_feed(&c, &s, "----  ---------------------   ---------------------\n\r", BO_MOVES);
+  for (int ply = 0; ply < listed; ply += 2)
+  {
+    if ( ply + 1 < listed ) snprintf(line, sizeof line, "%3d.  %-8s(0:01.000)      %-8s(0:02.000)\n\r", ply / 2 + 1, sans[ply], sans[ply + 1]);
+    else                    snprintf(line, sizeof line, "%3d.  %-8s(0:01.000)\n\r", ply / 2 + 1, sans[ply]);
+    movelist_feed(&c, &s, line, BO_MOVES);
+  }
+  movelist_feed(&c, &s, "      {Still in progress} *\n\r", BO_MOVES);
+  uint64_t backfill_ns = now_ns() - start;
+
+  bool ok = g->first_ply == 0 && g->n == n_boards - 1;
+  for (int ply = 0; ok && ply < n_boards; ply++)
+  {
+    movelist_position(g, ply, &pos);
+    ok = pos.hash == positions[ply].hash && ( ply == 0 || equals(g->san[ply - 1], sans[ply - 1]) );
+  }
+  // the same listing asked for by the user is shown
+  bool shown = ! movelist_feed(&c, &s, "Movelist for game 77:\n\r", BO_TERMINAL)
+      && ! movelist_feed(&c, &s, "      {Still in progress} *\n\r", BO_TERMINAL);
+  printf("record: %d boards, %.0f ns/board; backfill %d plies in %.0f us; plies 0-%d; typed listing %s  %s\n", n_boards - JOIN,
+      (double) record_ns / ( n_boards - JOIN ), listed, backfill_ns / 1000.0, n_boards - 1, shown ? "shown" : "hidden",
+      verdict(ok && shown));
+
+  // anywhere in the game: a snapshot and under MOVELIST_SNAPSHOT moves
+  uint64_t check = 0;
+  start = now_ns();
+  for (int i = 0; i < JUMPS; i++)
+  {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    movelist_position(g, ( seed >> 33 ) % n_boards, &pos);
+    check ^= pos.hash;
+  }
+  uint64_t jump_ns = now_ns() - start;
+
+  // the commands, clamped to the game
+  s.u.s12.game_number = 77;
+  movelist_command(&c, &s, "goto 10\n");
+  int at_goto = g->view;
+  movelist_command(&c, &s, "back 1000\n");
+  int at_start = g->view;
+  movelist_command(&c, &s, "live\n");
+  ok = at_goto == 20 && at_start == 0 && g->view == -1 && check != 0;
+  printf("%d jumps: %.0f ns/jump, %.0f jumps/s; commands  %s\n", JUMPS, (double) jump_ns / JUMPS,
+      per_second(JUMPS, jump_ns), verdict(ok));
+
+  movelist_free(&s);
+  free(sans);
+  free(positions);
+  free(boards);
+}
+
+
+/// metrics: counting from every thread, and a scrape
+
+enum { METRICS_PER_THREAD = 10000000 };
+static _Atomic uint64_t shared_counter;
+
+static void *t_metrics_work(void *arg)
+{
+  bool sharded = arg != NULL;
+  for (long i = 0; i < METRICS_PER_THREAD; i++)
+    if ( sharded ) metric_add(M_LINES_IN, 1);
+    else           atomic_fetch_add_explicit(&shared_counter, 1, memory_order_relaxed);
+  return NULL;
+}
+
+static void bench_metrics(void)
+{
+  int cpus = sysconf(_SC_NPROCESSORS_ONLN), threads = cpus > 1 ? cpus : 2;
+  pthread_t tid[threads];
+  uint64_t before = metric_value(M_LINES_IN), elapsed[2];
+  for (int sharded = 0; sharded < 2; sharded++)
+  {
+    uint64_t start = now_ns();
+    for (int i = 0; i < threads; i++) pthread_create(&tid[i], NULL, t_metrics_work, sharded ? &tid[i] : NULL);
+    for (int i = 0; i < threads; i++) pthread_join(tid[i], NULL);
+    elapsed[sharded] = now_ns() - start;
+  }
+  uint64_t total = (uint64_t) threads * METRICS_PER_THREAD, counted = metric_value(M_LINES_IN) - before;
+  printf("%d threads: %.2f ns/add sharded, %.2f ns/add on one shared counter; %lu counted  %s\n", threads,
+      (double) elapsed[1] * threads / total, (double) elapsed[0] * threads / total,
+      (unsigned long) counted, verdict(counted == total));
+
+  // a scrape over the socket, as curl --unix-socket would make it
+  char path[] = "/tmp/vichess-bench-metrics.XXXXXX";
+  int fd = mkstemp(path);
+  if ( fd == -1 ) error("mkstemp");
+  close(fd);
+  unlink(path); // only a unique name: metrics_serve() replaces nothing but a socket
+  if ( ! metrics_serve(NULL, path) ) { perror(path); unlink(path); printf("scrape: no socket  %s\n", verdict(false)); return; }
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  snprintf(addr.sun_path, sizeof addr.sun_path, "%s", path);
+  if ( (fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1 || connect(fd, (struct sockaddr *) &addr, sizeof addr) == -1 ) error("connect");
+  const char *get = "GET /metrics HTTP/1.0\r\n\r\n";
+  uint64_t start = now_ns();
+  if ( send(fd, get, strlen(get), 0) == -1 ) error("send");
+  static char response[1 << 16];
+  size_t got = 0;
+  ssize_t n;
+  while ( got < sizeof response - 1 && (n = recv(fd, response + got, sizeof response - 1 - got, 0)) > 0 ) got += n;
+  uint64_t scrape_ns = now_ns() - start;
+  response[got] = '\0';
+  close(fd);
+  unlink(path);
+
+  char expect[64];
+  snprintf(expect, sizeof expect, "\nvichess_lines_in_total %lu\n", (unsigned long) metric_value(M_LINES_IN));
+  printf("scrape: %zu bytes in %.0f us  %s\n", got, scrape_ns / 1000.0,
+      verdict(begins_with(response, "HTTP/1.0 200 OK") && strstr(response, expect) != NULL));
+}
+
+
+/// trace: spans off, on, and dumped while being written
+
+enum { TRACE_SPANS = 2000000 };
+
+static void *t_trace_work(void *arg)
+{
+  UNUSED( arg );
+  trace_thread("bench");
+  for (long i = 0; i < TRACE_SPANS; i++)
+  {
+    uint64_t t = trace_begin();
+    trace_end(i % N_SPANS, t);
+  }
+  return NULL;
+}
+
+static void bench_trace(void)
+{
+  uint64_t elapsed[2];
+  for (int on = 0; on < 2; on++)
+  {
+    atomic_store(&tracing, on);
+    uint64_t start = now_ns();
+    for (long i = 0; i < TRACE_SPANS; i++)
+    {
+      uint64_t t = trace_begin();
+      trace_end(TR_TELNET_READ, t);
+    }
+    elapsed[on] = now_ns() - start;
+  }
+  printf("%d spans: %.1f ns/span off, %.1f ns/span on\n", TRACE_SPANS,
+      (double) elapsed[0] / TRACE_SPANS, (double) elapsed[1] / TRACE_SPANS);
+
+  // dumps taken while two threads trace flat out: every span in them
+  // must be whole
+  char path[] = "/tmp/vichess-bench-trace.XXXXXX";
+  int fd = mkstemp(path);
+  if ( fd == -1 ) error("mkstemp");
+  close(fd);
+  pthread_t tid[2];
+  for (int i = 0; i < 2; i++) pthread_create(&tid[i], NULL, t_trace_work, NULL);
+  long dumped = 0, bad = 0, dumps = 0;
+  uint64_t dump_ns = 0;
+  for ( ; dumps < 20; dumps++)
+  {
+    uint64_t start = now_ns();
+    dumped = trace_dump(path);
+    dump_ns += now_ns() - start;
+    FILE *f = fopen(path, "r");
+    char line[256];
+    while ( f != NULL && fgets(line, sizeof line, f) != NULL )
+    {
+      char name[64];
+      double ts, dur;
+      const char *p = strstr(line, "\"name\":\"");
+      if ( strstr(line, "\"ph\":\"X\"") == NULL ) continue;
+      if ( p == NULL || sscanf(p, "\"name\":\"%63[^\"]", name) != 1
+          || sscanf(strstr(line, "\"ts\":"), "\"ts\":%lf,\"dur\":%lf", &ts, &dur) != 2
+          || dur < 0 || dur > 1e6 || ts <= 0 ) bad++;
+    }
+    if ( f != NULL ) fclose(f);
+  }
+  for (int i = 0; i < 2; i++) pthread_join(tid[i], NULL);
+  atomic_store(&tracing, false);
+  unlink(path);
+  printf("%ld dumps under load: %.1f ms/dump, %ld events in the last, %ld torn  %s\n", dumps,
+      dump_ns / 1e6 / dumps, dumped, bad, verdict(dumped > 0 && bad == 0));
+}
+
+
+/// log: a board logged off, as a binary record, and as text
+
+enum { LOG_BATCH = 1000, LOG_BATCHES = 200 };
+
+static void bench_log(void)
+{
+  char path[] = "/tmp/vichess-bench-log.XXXXXX";
+  int fd = mkstemp(path);
+  if ( fd == -1 ) error("mkstemp");
+  close(fd);
+  UPDATE u = { 0 };
+  parse_line(CORPUS[0], &u);
+  parse_line(CORPUS[2], &u);
+  if ( ! log_open(path, LOG_INFO) ) error("log_open");
+
+  // in batches the logger drains between, as boards arrive: a ring
+  // holds a few thousand
+  const char *what[3] = { "off", "binary", "text" };
+  uint64_t elapsed[3] = { 0 };
+  struct timespec pause = { 0, 20 * 1000000L };
+  for (int mode = 0; mode < 3; mode++)
+  {
+    atomic_store(&log_level, mode == 0 ? LOG_INFO : LOG_DEBUG);
+    for (int batch = 0; batch < LOG_BATCHES; batch++)
+    {
+      uint64_t start = now_ns();
+      for (int i = 0; i < LOG_BATCH; i++)
+        if ( mode < 2 ) log_s12(LOG_DEBUG, LOGC_PARSE, 0, &u.s12);
+        else log_text(LOG_DEBUG, LOGC_PARSE, "game %u %s-%s %c %s %d %d", u.s12.game_number, u.s12.white,
+            u.s12.black, u.s12.turn, u.s12.pretty_move, u.s12.white_ms, u.s12.black_ms);
+      elapsed[mode] += now_ns() - start;
+      nanosleep(&pause, NULL);
+    }
+  }
+  log_close();
+  for (int mode = 0; mode < 3; mode++)
+    printf("%s%s %.1f ns/board", mode ? ", " : "", what[mode], (double) elapsed[mode] / ( LOG_BATCH * LOG_BATCHES ));
+  printf("\n");
+
+  // every record comes back, whole
+  char *text = NULL;
+  size_t size = 0;
+  FILE *f = open_memstream(&text, &size);
+  long n = log_decode(path, f);
+  fclose(f);
+  long boards = 0;
+  for (const char *p = text; (p = strstr(p, "<12> game 77 Newton-Einstein ply 1 B to move, P/e2-e4 e4")) != NULL; p++) boards++;
+  printf("%ld records decoded (%zu bytes of text), %ld boards  %s\n", n, size, boards,
+      verdict(boards == LOG_BATCH * LOG_BATCHES));
+  free(text);
+  free_update(&u);
+  unlink(path);
+}
+
+
+/// telnet: framing a captured login, in every chunking, and throughput
+
+// The start of a login as captured, negotiation and all, and the lines
+// it frames to.
+static const char TELNET_CAPTURE[] =
+  "\xff\xfd\x18\xff\xfd\x1f"                      // DO TTYPE, DO NAWS
+  "Welcome to the Free Internet Chess Server\n\r"
+  "\n\r"
+  "login: guest\r\n"
+  "\xff\xfb\x01password: \xff\xfa\x18\x01\xff\xf0"  // WILL ECHO, SB TTYPE SEND SE
+  "\xff\xfc\x01\n\r"                              // WONT ECHO
+  "Press return\r\0"
+  "byte \xff\xff then\n"
+  "lone\r"
+  "% \n\r"
+  "<12> rnbqkbnr pppppppp -------- -------- ----P--- -------- PPPP-PPP RNBQKBNR B 4 1 1 1 1 0 77 Newton Einstein 0 3 0 39 39 180000 180000 1 P/e2-e4 (0:00.000) e4 0 0 0\n\r"
+  "fics% ";
+
+static const char *TELNET_LINES[] =
+{
+  "Welcome to the Free Internet Chess Server",
+  "",
+  "login: guest",
+  "password: ",
+  "Press return",
+  "byte \xff then",
+  "lone",
+  "% ",
+  "<12> rnbqkbnr pppppppp -------- -------- ----P--- -------- PPPP-PPP RNBQKBNR B 4 1 1 1 1 0 77 Newton Einstein 0 3 0 39 39 180000 180000 1 P/e2-e4 (0:00.000) e4 0 0 0",
+};
+
+static const unsigned char TELNET_REPLY[] = { 0xff, 0xfc, 0x18, 0xff, 0xfc, 0x1f, 0xff, 0xfe, 0x01 };
+
+typedef struct FRAMED
+{
+  uint64_t lines, bytes;
+  char *text;                   // every line, '|' after each, or NULL
+  size_t len;
+} FRAMED;
+
+static void framed_line(void *arg, char *line, size_t len)
+{
+  FRAMED *f = (FRAMED *) arg;
+  f->lines++;
+  f->bytes += len;
+  if ( f->text == NULL ) return;
+  memcpy(f->text + f->len, line, len);
+  f->len += len;
+  f->text[f->len++] = '|';
+}
+
+// The loop the framer avoids: a byte at a time, each tested for each
+// ending and copied out.  No negotiation.
+static void bytewise(const char *data, size_t n, char *buf, size_t *len, FRAMED *f)
+{
+  for (size_t i = 0; i < n; i++)
+  {
+    char ch = data[i];
+    if ( ch == '\r' || ch == '\n' )
+    {
+      if ( *len == 0 && ch == '\r' ) continue; // "\n\r"
+      buf[*len] = '\0';
+      framed_line(f, buf, *len);
+      *len = 0;
+    }
+    else if ( *len < MAX_LINE_SIZE - 1 ) buf[(*len)++] = ch;
+  }
+}
+
+static void bench_telnet(void)
+{
+  // the capture, fed in every chunk size: the same lines and answers
+  char want[1024] = "";
+  for (int i = 0; i < LEN(TELNET_LINES); i++) strcat(strcat(want, TELNET_LINES[i]), "|");
+  TELNET *t = malloc(sizeof *t);
+  char text[1024];
+  int bad = 0;
+  for (size_t chunk = 1; chunk <= sizeof TELNET_CAPTURE; chunk++)
+  {
+    memset(t, 0, sizeof *t);
+    FRAMED f = { .text = text };
+    for (size_t at = 0; at < sizeof TELNET_CAPTURE - 1; at += chunk)
+    {
+      size_t n = sizeof TELNET_CAPTURE - 1 - at;
+      telnet_feed(t, TELNET_CAPTURE + at, n < chunk ? n : chunk, framed_line, &f);
+    }
+    if ( f.len != strlen(want) || memcmp(text, want, f.len) != 0
+        || t->n_reply != sizeof TELNET_REPLY || memcmp(t->reply, TELNET_REPLY, sizeof TELNET_REPLY) != 0
+        || t->len != strlen("fics% ") ) bad++;
+  }
+  printf("captured login in %zu chunkings: %d framed wrong  %s\n", sizeof TELNET_CAPTURE - 1, bad, verdict(bad == 0));
+
+  // a game's worth of server output, over and over, in socket-sized
+  // reads
+  enum { STREAM = 64 << 20, READ = 4096 };
+  char *stream = malloc(STREAM), *buf = malloc(MAX_LINE_SIZE);
+  size_t size = 0;
+  for (int i = 0; size + MAX_LINE_SIZE < STREAM; i = ( i + 1 ) % LEN(CORPUS))
+  {
+    size_t n = strlen(CORPUS[i]);
+    memcpy(stream + size, CORPUS[i], n);
+    size += n;
+  }
+  FRAMED fast = { 0 }, slow = { 0 };
+  memset(t, 0, sizeof *t);
+  uint64_t start = now_ns();
+  for (size_t at = 0; at < size; at += READ) telnet_feed(t, stream + at, size - at < READ ? size - at : READ, framed_line, &fast);
+  uint64_t framer = now_ns() - start;
+  size_t len = 0;
+  start = now_ns();
+  for (size_t at = 0; at < size; at += READ) bytewise(stream + at, size - at < READ ? size - at : READ, buf, &len, &slow);
+  uint64_t bytes = now_ns() - start;
+  printf("telnet framer  %7.0f MB/s  %10.0f lines/s\n", per_second(size, framer) / 1e6, per_second(fast.lines, framer));
+  printf("bytewise       %7.0f MB/s  %10.0f lines/s\n", per_second(size, bytes) / 1e6, per_second(slow.lines, bytes));
+  printf("%lu lines, %lu bytes of text  %s\n", (unsigned long) fast.lines, (unsigned long) fast.bytes,
+      verdict(fast.lines == slow.lines && fast.bytes == slow.bytes));
+  free(stream);
+  free(buf);
+  free(t);
+}
+
+
+/// block: numbered commands, one at a time or all in flight at once
+
+enum { BLOCK_COMMANDS = 32, BLOCK_RTT_US = 2000 };
+
+// A server in block mode, a round trip away: each read is answered,
+// command by command, after the round trip.
+static void *t_block_server(void *arg)
+{
+  int fd = *(int *) arg;
+  char buf[8192];
+  size_t len = 0;
+  ssize_t n;
+  while ( (n = read(fd, buf + len, sizeof buf - 1 - len)) > 0 )
+  {
+    len += n;
+    usleep(BLOCK_RTT_US);
+    char *line = buf, *nl;
+    while ( (nl = memchr(line, '\n', buf + len - line)) != NULL )
+    {
+      *nl = '\0';
+      char reply[256];
+      int id = atoi(line), m = 0;
+      if ( id > 0 )
+        m = snprintf(reply, sizeof reply, "\x15%d\x16%d\x16%s set.\n\rAnd a second line.\n\r\x17\n\rfics%% ",
+            id, 82, strchr(line, ' ') + 1);
+      if ( m > 0 && write(fd, reply, m) != m ) break;
+      line = nl + 1;
+    }
+    len = buf + len - line;
+    memmove(buf, line, len);
+  }
+  return NULL;
+}
+
+static void block_reply_line(void *arg, char *line, size_t len)
+{
+  UNUSED( len );
+  SESSION *s = (SESSION *) arg;
+  block_line(NULL, s, line);
+}
+
+// Send 'n' commands, 'window' at a time; returns ns until all are
+// answered.
+static uint64_t run_block(SESSION *s, int n, int window)
+{
+  uint64_t start = now_ns();
+  for (int sent = 0; sent < n || block_in_flight(s) > 0; )
+  {
+    while ( sent < n && block_in_flight(s) < window ) { block_send(s, BO_LOGIN, "iset ms 1\n"); sent++; }
+    struct pollfd pfd = { .fd = s->sk, .events = POLLIN };
+    if ( poll(&pfd, 1, 1000) != 1 ) return 0; // lost a reply
+    if ( telnet_read(s->sk, &s->in, block_reply_line, s) == 0 ) return 0;
+  }
+  return now_ns() - start;
+}
+
+static void bench_block(void)
+{
+  int sv[2];
+  if ( socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1 ) error("socketpair");
+  SESSION *s = calloc(1, sizeof *s);
+  s->sk = sv[0];
+  if ( fcntl(s->sk, F_SETFL, fcntl(s->sk, F_GETFL) | O_NONBLOCK) == -1 ) error("fcntl");
+  pthread_t server;
+  pthread_create(&server, NULL, t_block_server, &sv[1]);
+  block_enable(s);
+
+  uint64_t one = run_block(s, BLOCK_COMMANDS, 1);
+  uint64_t all = run_block(s, BLOCK_COMMANDS, BLOCK_COMMANDS);
+  printf("%d commands, %d us round trip: one at a time %.1f ms, pipelined %.1f ms (%.1fx)  %s\n",
+      BLOCK_COMMANDS, BLOCK_RTT_US, one / 1e6, all / 1e6, (double) one / ( all ? all : 1 ),
+      verdict(one > 0 && all > 0 && block_in_flight(s) == 0));
+
+  shutdown(sv[0], SHUT_RDWR);
+  pthread_join(server, NULL);
+  close(sv[0]); close(sv[1]);
+  mem_free(s->blocks);
+  free(s);
+}
+
+
+/// vi: a keyed move, last keystroke to the socket, through the queue
+/// and the I/O loop as the client runs them
+
+typedef struct VI_LOOP
+{
+  CONFIG *c;
+  SESSION *s;
+} VI_LOOP;
+
+// the I/O loop's part: queue to socket
+static void *t_vi_loop(void *arg)
+{
+  VI_LOOP *l = (VI_LOOP *) arg;
+  MESSAGE msg;
+  while ( mq_receive(l->c->ob_mq, (char *) &msg, sizeof msg, 0) != -1 && msg.session == 0 )
+  {
+    block_send(l->s, msg.owner, msg.text);
+    if ( msg.owner == BO_MOVE ) modal_sent();
+  }
+  return NULL;
+}
+
+static void bench_vi(void)
+{
+  enum { ROUNDS = 5000 };
+  static const char *KEYS = "Kk 2k ";           // king, up, pick up, up two, put down: e2e4
+  static const char ROWS[8][9] = { "rnbqkbnr", "pppppppp", "--------", "--------",
+                                   "--------", "--------", "PPPPPPPP", "RNBQKBNR" };
+  STYLE12 b = { .game_number = 77, .turn = 'W', .relation = PLAYING_MY_MOVE };
+  for (int i = 0; i < N_ROWS; i++) memcpy(b.board[i], ROWS[i], N_COLS);
+
+  const char *names[] = { "/vichess.bench.vi.ob", "/vichess.bench.vi.ib" };
+  for (int i = 0; i < LEN(names); i++) mq_unlink(names[i]);
+  mqd_t *ob = get_mq_fd(names[0], O_CREAT | O_RDWR), *ib = get_mq_fd(names[1], O_CREAT | O_RDWR);
+  int sv[2];
+  if ( socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1 ) error("socketpair");
+  SESSION s = { .id = 0, .sk = sv[0] };
+  CONFIG c = { .ob_mq = *ob, .ib_mq = *ib, .n_sessions = 1 };
+  VI_LOOP l = { &c, &s };
+  pthread_t loop;
+  pthread_create(&loop, NULL, t_vi_loop, &l);
+
+  modal_board(0, &b, PANE_WHOLE);
+  modal_enter(&c);
+  static uint64_t arrived[ROUNDS];
+  uint64_t keys_ns = 0;
+  int n_keys = 0, right = 0;
+  for (int r = 0; r < ROUNDS; r++)
+  {
+    uint64_t ns = 0;
+    for (const char *k = KEYS; *k != '\0'; k++, n_keys++)
+    {
+      ns = now_ns();
+      modal_key(&c, *k, ns);
+      if ( k[1] != '\0' ) keys_ns += now_ns() - ns;
+    }
+    char got[16];
+    ssize_t n = read(sv[1], got, sizeof got - 1);
+    arrived[r] = now_ns() - ns;
+    right += n == 5 && memcmp(got, "e2e4\n", 5) == 0;
+    MESSAGE echo;               // the move, echoed to the terminal
+    if ( mq_receive(*ib, (char *) &echo, sizeof echo, 0) == -1 ) error("bench mq_receive");
+  }
+  send_message(c.ob_mq, 1, MSG_INPUT, "\n");    // the loop's end
+  pthread_join(loop, NULL);
+  modal_leave(&c);
+
+  uint64_t p50, p99, max;
+  size_t n = modal_latency(&p50, &p99, &max);
+  qsort(arrived, ROUNDS, sizeof *arrived, compare_u64);
+  printf("%d moves; cursor keys cost %.0f ns\n", ROUNDS, (double) keys_ns / ( n_keys - ROUNDS ));
+  printf("keystroke to send()      p50 %.1f  p99 %.1f  max %.1f us (last %zu)\n", p50 / 1e3, p99 / 1e3, max / 1e3, n);
+  printf("keystroke to peer read   p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f us  %s\n",
+      arrived[ROUNDS / 2] / 1e3, arrived[ROUNDS * 99 / 100] / 1e3, arrived[ROUNDS * 999 / 1000] / 1e3,
+      arrived[ROUNDS - 1] / 1e3, verdict(right == ROUNDS));
+
+  close(sv[0]); close(sv[1]);
+  mq_close(*ob); mq_close(*ib);
+  for (int i = 0; i < LEN(names); i++) mq_unlink(names[i]);
+  free(ob); free(ib);
+}
+
+
+/// gameinfo: <g1> lines as FICS sends them, every variant, parsed by key
+
+static const struct
+{
+  const char *line;
+  unsigned game, white_time, black_inc, partner, m;
+  const char *type, *white_rating, *black_rating;
+} G1_CORPUS[] =
+{
+  { "<g1> 77 p=0 t=blitz r=1 u=1,1 it=180,0 i=180,0 pt=0 rt=1880,1789E ts=1,1 m=2 n=1\n\r",
+        77,  180,  0,   0, 2, "blitz",      "1880",  "1789E" },
+  { "<g1> 1 p=0 t=blitz r=1 u=1,1 it=5,5 i=8,8 pt=0 rt=1600,1700 ts=1,0",
+         1,    5,  8,   0, 0, "blitz",      "1600",  "1700"  },
+  { "<g1> 94 p=0 t=lightning r=1 u=1,1 it=60,60 i=0,0 pt=0 rt=2212,2301 ts=1,1 m=2 n=1",
+        94,   60,  0,   0, 2, "lightning",  "2212",  "2301"  },
+  { "<g1> 12 p=0 t=standard r=1 u=1,1 it=900,900 i=5,5 pt=0 rt=1950,1874 ts=0,1 m=2 n=1",
+        12,  900,  5,   0, 2, "standard",   "1950",  "1874"  },
+  { "<g1> 203 p=0 t=crazyhouse r=1 u=1,1 it=180,180 i=0,0 pt=0 rt=1702P,1655 ts=1,1 m=2 n=1",
+       203,  180,  0,   0, 2, "crazyhouse", "1702P", "1655"  },
+  { "<g1> 61 p=0 t=bughouse r=1 u=1,1 it=120,120 i=0,0 pt=62 rt=1800,1766 ts=1,1 m=2 n=1",
+        61,  120,  0,  62, 2, "bughouse",   "1800",  "1766"  },
+  { "<g1> 62 p=0 t=bughouse r=1 u=1,1 it=120,120 i=0,0 pt=61 rt=1690,1811 ts=1,1 m=2 n=1",
+        62,  120,  0,  61, 2, "bughouse",   "1690",  "1811"  },
+  { "<g1> 18 p=0 t=wild/fr r=0 u=1,0 it=300,300 i=2,2 pt=0 rt=1500,0 ts=1,0 m=2 n=1",
+        18,  300,  2,   0, 2, "wild/fr",    "1500",  "0"     },
+  { "<g1> 233 p=0 t=suicide r=1 u=1,1 it=120,120 i=12,12 pt=0 rt=1420E,1388 ts=1,1 m=2 n=1",
+       233,  120, 12,   0, 2, "suicide",    "1420E", "1388"  },
+  { "<g1> 9 p=1 t=untimed r=0 u=0,0 it=0,0 i=0,0 pt=0 rt=0,0 ts=0,0 m=1 n=0",
+         9,    0,  0,   0, 1, "untimed",    "0",     "0"     },
+  // fields in another order, and fields this client does not know
+  { "<g1> 77 rt=1880,1789E t=blitz it=180,0 i=180,0 zz=7 p=0 r=1 u=1,1 pt=0 ts=1,1 n=1 m=2 eco=B20 xx=1,2,3",
+        77,  180,  0,   0, 2, "blitz",      "1880",  "1789E" },
+  { "<g1> 77 p=0 t=a-type-name-longer-than-its-field r=1 rt=18801880188,1",
+        77,    0,  0,   0, 0, "a-type-name-lon", "1880188", "1" },
+};
+
+static void bench_gameinfo(void)
+{
+  enum { ROUNDS = 200000 };
+  int right = 0;
+  for (int i = 0; i < LEN(G1_CORPUS); i++)
+  {
+    GAMEINFO g;
+    bool ok = parse_gameinfo(G1_CORPUS[i].line, &g);
+    right += ok && g.game_number == G1_CORPUS[i].game && g.white_initial_time == G1_CORPUS[i].white_time
+        && g.black_initial_inc == G1_CORPUS[i].black_inc && g.partner_game_number == G1_CORPUS[i].partner && g.m == G1_CORPUS[i].m
+        && equals(g.type, (char *) G1_CORPUS[i].type) && equals(g.white_rating, (char *) G1_CORPUS[i].white_rating)
+        && equals(g.black_rating, (char *) G1_CORPUS[i].black_rating);
+  }
+  // the same game, whatever the order and whatever is added
+  GAMEINFO first, reordered;
+  parse_gameinfo(G1_CORPUS[0].line, &first);
+  parse_gameinfo(G1_CORPUS[LEN(G1_CORPUS) - 2].line, &reordered);
+  bool same = memcmp(&first, &reordered, sizeof first) == 0;
+  GAMEINFO none;
+  bool rejected = ! parse_gameinfo("<12> rnbqkbnr", &none) && ! parse_gameinfo("<g1> p=0", &none);
+
+  UPDATE u = { 0 };
+  uint64_t start = now_ns();
+  for (int r = 0; r < ROUNDS; r++) parse_gameinfo_string(G1_CORPUS[r % LEN(G1_CORPUS)].line, &u);
+  uint64_t elapsed = now_ns() - start;
+  printf("%d corpus lines, %d as expected; any order: %s; not gameinfo: %s\n", (int) LEN(G1_CORPUS), right,
+      same ? "same" : "DIFFERENT", rejected ? "rejected" : "ACCEPTED");
+  printf("%d lines in %.1f ms: %.0f ns/line, %.0f lines/s, no allocation  %s\n", ROUNDS, elapsed / 1e6,
+      (double) elapsed / ROUNDS, per_second(ROUNDS, elapsed), verdict(right == LEN(G1_CORPUS) && same && rejected));
+}
+
+
+/// stats: a period of 200000 games summed, by one thread and several
+
+static void bench_stats(void)
+{
+  // four years of games, the newest ending yesterday, and a played game
+  // followed board by board
+  enum { GAMES = 200000, YEARS = 4, PLIES = 40 };
+  char path[] = "/tmp/vichess-bench-stats.XXXXXX";
+  int fd = mkstemp(path);
+  if ( fd == -1 ) error("mkstemp");
+  close(fd);
+  STATS *st = stats_open(path);
+  if ( st == NULL ) error("stats_open");
+
+  uint32_t now = time(NULL), span = YEARS * 365 * 86400, year_ago = now - 365 * 86400;
+  uint64_t seed = 11, year_games = 0, year_moves = 0, n_moves = 0;
+  STATS_MOVE moves[80];
+  uint64_t start = now_ns();
+  for (int i = 0; i < GAMES; i++)
+  {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    uint32_t r = seed >> 32;
+    STATS_GAME g = { .time = now - 86400 - span + (uint64_t) span * ( i + 1 ) / GAMES, .rating = 1500 + i / 1000 + r % 50,
+                     .opp_rating = 1400 + r % 300, .base = 60 * ( 1 + r % 5 ), .inc = r % 3, .type = r % ST_OTHER,
+                     .color = r & 1, .score = r % 3, .trouble = r % 5 == 0, .eco = r % ( STATS_ECOS + 20 ) };
+    if ( g.eco >= STATS_ECOS ) g.eco = STATS_NO_ECO;
+    int n = 10 + r % 60;
+    for (int m = 0; m < n; m++) moves[m] = (STATS_MOVE) { .number = m + 1, .used_ms = 500 + ( r >> m % 16 ) % 9000 };
+    stats_append(st, &g, moves, n);
+    n_moves += n;
+    if ( g.time >= year_ago ) { year_games++; year_moves += n; }
+  }
+  uint64_t append = now_ns() - start;
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  static STATS_REPORT one, many;
+  const struct { const char *name; uint32_t since; uint64_t games, moves; } QUERIES[] =
+  {
+    { "last year", year_ago, year_games, year_moves },
+    { "all",       0,        GAMES,      n_moves    },
+  };
+  bool right = true;
+  printf("%d games, %lu moves appended in %.1f ms (%.0f ns/game)\n", GAMES, (unsigned long) n_moves,
+      append / 1e6, (double) append / GAMES);
+  for (int q = 0; q < LEN(QUERIES); q++)
+  {
+    stats_query(st, QUERIES[q].since, now, 1, &one);
+    // at least four parts, so that the split is checked on any machine
+    stats_query(st, QUERIES[q].since, now, cpus > 4 ? cpus : 4, &many);
+    uint64_t games = 0;
+    for (int k = 0; k < N_STATS_TYPES; k++) games += many.by_type[k].games;
+    // the parts add up to the same report, whatever the threads
+    bool same = memcmp(one.by_type, many.by_type, offsetof(STATS_REPORT, moves)) == 0;
+    bool ok = same && games == QUERIES[q].games && many.moves == QUERIES[q].moves && one.moves == many.moves;
+    right &= ok;
+    printf("%-9s %7lu games %9lu moves  1 thread %6.2f ms  %lu threads %6.2f ms  %s\n", QUERIES[q].name,
+        (unsigned long) games, (unsigned long) many.moves, one.ns / 1e6, (unsigned long) many.threads, many.ns / 1e6,
+        verdict(ok));
+  }
+
+  // a game played as white, two seconds a move, won
+  position_init();
+  POSITION pos;
+  position_start(&pos);
+  UPDATE u = { 0 };
+  parse_line(CORPUS[0], &u);
+  char line[MAX_LINE_SIZE], san[16] = "none", verbose[16] = "none";
+  uint64_t before = stats_games(st);
+  for (int ply = 0; ply <= PLIES; ply++)
+  {
+    int wms = 180000 - ( ply + 1 ) / 2 * 2000, bms = 180000 - ply / 2 * 3000;
+    position_to_style12(&pos, line, sizeof line, 77, "Newton", "Einstein", ply % 2 ? PLAYING_OPPONENTS_MOVE : PLAYING_MY_MOVE,
+        0, wms, bms, verbose, san);
+    parse_line(line, &u);
+    stats_board(st, 0, &u.s12, &u.g1, ply == 4 ? "C65 Ruy Lopez: Berlin defence" : NULL);
+    MOVE_LIST list;
+    generate_legal_moves(&pos, &list);
+    if ( list.n == 0 ) break;
+    move_to_verbose(&pos, list.moves[0], verbose);
+    move_to_san(&pos, list.moves[0], san);
+    UNDO undo;
+    make_move(&pos, list.moves[0], &undo);
+  }
+  free_update(&u);
+  stats_text(st, 0, "{Game 77 (Newton vs. Einstein) Einstein resigns} 1-0");
+  stats_query(st, now - 60, now + 60, 1, &one);
+  uint64_t used = 0, n = 0;
+  for (int k = 0; k < N_STATS_TYPES; k++)
+    for (int b = 0; b < STATS_MOVE_BINS; b++) used += one.clock[k][b].used_ms, n += one.clock[k][b].moves;
+  bool followed = stats_games(st) == before + 1 && n == PLIES / 2 && used == n * 2000 && one.by_eco[265].games == 1
+      && one.by_eco[265].score == 2;
+  printf("a game followed board by board: %lu moves, %.1f s a move, C65 %lu won  %s\n", (unsigned long) n,
+      n ? used / 1000.0 / n : 0, (unsigned long) one.by_eco[265].score / 2, verdict(followed));
+  printf("store: %s\n", verdict(right && followed));
+  stats_close(st);
+  unlink(path);
+}
+
+
+/// mem: a tagged and counted allocation, and live bytes followed
+
+static void bench_mem(void)
+{
+  enum { PAIRS = 1000000, BLOCKS = 1000, BOARDS = 10000 };
+  static void *blocks[BLOCKS];
+  bool was = atomic_load(&mem_counting);
+
+  // the cost of a tagged pair, counted and not, against malloc's own
+  uint64_t ns[3];
+  for (int mode = 0; mode < 3; mode++)
+  {
+    atomic_store(&mem_counting, mode == 2);
+    uint64_t start = now_ns();
+    for (int i = 0; i < PAIRS; i++)
+    {
+      size_t size = 16 + i % 64;
+      void *p = mode == 0 ? malloc(size) : mem_alloc(MEM_RENDER, size);
+      *(volatile char *) p = 1;
+      if ( mode == 0 ) free(p); else mem_free(p);
+    }
+    ns[mode] = now_ns() - start;
+  }
+
+  // live bytes and peak follow the blocks, by subsystem and message
+  MEM_STATS before, during, after;
+  mem_get(MEM_RENDER, &before);
+  mem_message(MSG_NOTICE);
+  int64_t bytes = 0;
+  for (int i = 0; i < BLOCKS; i++) bytes += 8 + i, blocks[i] = mem_alloc(MEM_RENDER, 8 + i);
+  blocks[0] = mem_realloc(MEM_RENDER, blocks[0], 4096);
+  bytes += 4096 - 8;
+  mem_get(MEM_RENDER, &during);
+  for (int i = 0; i < BLOCKS; i++) mem_free(blocks[i]);
+  mem_get(MEM_RENDER, &after);
+  mem_message(-1);
+  bool followed = during.live - before.live == bytes && after.live == before.live && during.peak >= during.live
+      && during.allocs - before.allocs == BLOCKS + 1;
+
+  // a board's strings replace the last board's
+  UPDATE u = { 0 };
+  MEM_STATS parser[2];
+  for (int i = 0; i < BOARDS; i++)
+  {
+    parse_s12_string(CORPUS[1 + i % 2], &u);
+    if ( i == 10 ) mem_get(MEM_PARSER, &parser[0]);
+  }
+  mem_get(MEM_PARSER, &parser[1]);
+  free_update(&u);
+  bool flat = parser[1].live == parser[0].live && parser[1].allocs > parser[0].allocs;
+
+  printf("malloc+free %.1f ns, tagged %.1f ns, counted %.1f ns a pair\n",
+      (double) ns[0] / PAIRS, (double) ns[1] / PAIRS, (double) ns[2] / PAIRS);
+  printf("%d blocks and a realloc: %ld bytes live, all freed: %s\n", BLOCKS, (long) ( during.live - before.live ),
+      verdict(followed));
+  printf("parser live bytes over %d boards: %ld, then %ld  %s\n", BOARDS, (long) parser[0].live, (long) parser[1].live,
+      verdict(flat));
+  printf("rss %.1f MB  %s\n", mem_rss_kb() / 1024.0, verdict(mem_rss_kb() > 0));
+  atomic_store(&mem_counting, was);
+}
+
+
+/// jitter: a board off the socket to drawn, under load, with the
+/// tournament profile off and on
+
+enum { JITTER_BOARDS = 5000, JITTER_GAP_US = 500 };
+
+typedef struct JITTER
+{
+  CONFIG *c;
+  SESSION *s;
+  WINDOW *board;
+  uint64_t drawn[JITTER_BOARDS];
+  int n_drawn;
+  atomic_bool loaded;
+} JITTER;
+
+static void jitter_line(void *arg, char *line, size_t len)
+{
+  UNUSED( len );
+  JITTER *j = (JITTER *) arg;
+  session_handle_line(j->c, j->s, line);
+}
+
+// the I/O loop's part: socket to queue
+static void *t_jitter_io(void *arg)
+{
+  JITTER *j = (JITTER *) arg;
+  struct pollfd pfd = { .fd = j->s->sk, .events = POLLIN };
+  while ( poll(&pfd, 1, -1) == 1 )
+  {
+    j->s->received_ns = now_ns();
+    if ( telnet_read(j->s->sk, &j->s->in, jitter_line, j) == 0 ) break;
+  }
+  send_message(j->c->ib_mq, 1, MSG_SWITCH, "");  // the writer's end
+  return NULL;
+}
+
+// the writer's part: queue to window
+static void *t_jitter_writer(void *arg)
+{
+  JITTER *j = (JITTER *) arg;
+  UPDATE u = { 0 };
+  parse_gameinfo_string(CORPUS[0], &u);
+  MESSAGE msg;
+  while ( mq_receive(j->c->ib_mq, (char *) &msg, sizeof msg, 0) != -1 && msg.session == 0 )
+  {
+    if ( ! begins_with(msg.text, STYLE12_MARKER) ) continue;
+    parse_s12_string(msg.text, &u);
+    cb_write_board(j->board, &u);
+    if ( j->n_drawn < JITTER_BOARDS ) j->drawn[j->n_drawn++] = now_ns();
+  }
+  free_update(&u);
+  return NULL;
+}
+
+// Something else wanting the machine: a CPU-bound thread at normal
+// priority, walking more memory than fits in cache.
+static void *t_jitter_load(void *arg)
+{
+  JITTER *j = (JITTER *) arg;
+  enum { LOAD_BYTES = 64 << 20 };
+  volatile char *p = malloc(LOAD_BYTES);
+  if ( p == NULL ) return NULL;
+  for (size_t i = 0; atomic_load_explicit(&j->loaded, memory_order_relaxed); i = ( i + 4096 + 64 ) % LOAD_BYTES) p[i]++;
+  free((void *) p);
+  return NULL;
+}
+
+// Send the boards, one every JITTER_GAP_US, through the two threads
+// created under 'p'; 'latency' gets each board's, sorted.  Returns the
+// number drawn.
+static int run_jitter(PROFILE *p, CONFIG *c, WINDOW *board, uint64_t *latency)
+{
+  static JITTER j;
+  int sv[2];
+  if ( socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1 ) error("socketpair");
+  if ( fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK) == -1 ) error("fcntl");
+  SESSION s = { .id = 0, .sk = sv[0], .message_id = 100 };  // logged in
+  j = (JITTER) { .c = c, .s = &s, .board = board };
+  atomic_store(&j.loaded, true);
+
+  pthread_t io, writer, load;
+  pthread_create(&load, NULL, t_jitter_load, &j);
+  if ( profile_create(p, &io, W_SOCKET_IO, t_jitter_io, &j) != 0 ) error("pthread_create");
+  if ( profile_create(p, &writer, W_WRITER, t_jitter_writer, &j) != 0 ) error("pthread_create");
+
+  static uint64_t sent[JITTER_BOARDS];
+  struct timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  for (int i = 0; i < JITTER_BOARDS; i++)
+  {
+    next.tv_nsec += JITTER_GAP_US * 1000;
+    if ( next.tv_nsec >= 1000000000 ) next.tv_sec++, next.tv_nsec -= 1000000000;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    const char *line = CORPUS[i % 2 ? 2 : 4];
+    sent[i] = now_ns();
+    if ( write(sv[1], line, strlen(line)) == -1 ) error("bench write");
+  }
+  shutdown(sv[1], SHUT_WR);
+  pthread_join(io, NULL);
+  pthread_join(writer, NULL);
+  atomic_store(&j.loaded, false);
+  pthread_join(load, NULL);
+  if ( p != NULL ) profile_free(p);
+
+  for (int i = 0; i < j.n_drawn; i++) latency[i] = j.drawn[i] - sent[i];
+  qsort(latency, j.n_drawn, sizeof *latency, compare_u64);
+  close(sv[0]); close(sv[1]);
+  mem_free(s.blocks);
+  return j.n_drawn;
+}
+
+static void bench_jitter(void)
+{
+  FILE *devnull = fopen("/dev/null", "w");
+  if ( devnull == NULL ) error("/dev/null");
+  SCREEN *screen = newterm("xterm-256color", devnull, stdin);
+  if ( screen == NULL ) { printf("no terminal description  %s\n", verdict(false)); fclose(devnull); return; }
+  start_color();
+  WINDOW *board = newwin(LINES / 2, COLS, 0, 0);
+
+  const char *names[] = { "/vichess.bench.jitter.ob", "/vichess.bench.jitter.ib" };
+  for (int i = 0; i < LEN(names); i++) mq_unlink(names[i]);
+  mqd_t *ob = get_mq_fd(names[0], O_CREAT | O_RDWR), *ib = get_mq_fd(names[1], O_CREAT | O_RDWR);
+  CONFIG c = { .ob_mq = *ob, .ib_mq = *ib, .n_sessions = 1 };
+
+  // the socket loop and the writer on the first CPU or two the process
+  // may use
+  cpu_set_t allowed;
+  int cpus[2] = { 0, 0 }, n = 0;
+  if ( sched_getaffinity(0, sizeof allowed, &allowed) == 0 )
+    for (int cpu = 0; cpu < CPU_SETSIZE && n < 2; cpu++) if ( CPU_ISSET(cpu, &allowed) ) cpus[n++] = cpu;
+  char spec[32];
+  snprintf(spec, sizeof spec, "%d,%d:fifo", cpus[0], n > 1 ? cpus[1] : cpus[0]);
+  PROFILE profile;
+  bool parses = profile_parse(&profile, spec) && ! profile_parse(&profile, "0,x") && ! profile_parse(&profile, "0:rr")
+      && ! profile_parse(&profile, "0,1,2,3,4") && profile_parse(&profile, "-,-,2") && profile.cpu[2] == 2;
+  profile_parse(&profile, spec);
+
+  static uint64_t latency[2][JITTER_BOARDS];
+  int drawn[2];
+  drawn[0] = run_jitter(NULL, &c, board, latency[0]);
+  profile_memory(&profile);
+  drawn[1] = run_jitter(&profile, &c, board, latency[1]);
+  munlockall();
+
+  char line[256];
+  profile_describe(&profile, line, sizeof line);
+  printf("%d boards, one every %d us, beside a CPU-bound thread\n", JITTER_BOARDS, JITTER_GAP_US);
+  printf("%s\n", line);
+  for (int on = 0; on < 2; on++)
+  {
+    uint64_t *l = latency[on];
+    int m = drawn[on] > 0 ? drawn[on] : 1;
+    printf("socket to drawn, profile %-3s  p50 %6.1f  p99 %7.1f  p99.9 %7.1f  max %7.1f us  %s\n", on ? "on" : "off",
+        l[m / 2] / 1e3, l[m * 99 / 100] / 1e3, l[m * 999 / 1000] / 1e3, l[m - 1] / 1e3,
+        verdict(drawn[on] == JITTER_BOARDS && parses));
+  }
+
+  mq_close(*ob); mq_close(*ib);
+  for (int i = 0; i < LEN(names); i++) mq_unlink(names[i]);
+  free(ob); free(ib);
+  delwin(board);
+  endwin();
+  delscreen(screen);
+  fclose(devnull);
+}
+
+
+/// Registry
+
+typedef struct BENCHMARK
+{
+  const char *name;
+  void (*run)(void);
+} BENCHMARK;
+
+static BENCHMARK BENCHMARKS[] =
+{
+  { "headless",   bench_headless  },
+  { "triggers",   bench_triggers  },
+  { "perft",      bench_perft     },
+  { "engine",     bench_engine    },
+  { "cache",      bench_cache     },
+  { "repetition", bench_repetition },
+  { "archive",    bench_archive   },
+  { "import",     bench_import    },
+  { "lists",      bench_lists     },
+  { "seeks",      bench_seeks     },
+  { "movelist",   bench_movelist  },
+  { "metrics",    bench_metrics   },
+  { "trace",      bench_trace     },
+  { "log",        bench_log       },
+  { "telnet",     bench_telnet    },
+  { "block",      bench_block     },
+  { "vi",         bench_vi        },
+  { "gameinfo",   bench_gameinfo  },
+  { "stats",      bench_stats     },
+  { "mem",        bench_mem       },
+  { "jitter",     bench_jitter    },
+};
+
+// Run the named benchmark, or all of them.  Returns an exit status,
+// failure if any check came out WRONG.
+int bench(const char *name)
+{
+  bool found = false;
+  for (int i = 0; i < LEN(BENCHMARKS); i++)
+  {
+    if ( ! equals((char *) name, "all") && ! equals((char *) name, (char *) BENCHMARKS[i].name) ) continue;
+    printf("== %s\n", BENCHMARKS[i].name);
+    BENCHMARKS[i].run();
+    found = true;
+  }
+  if ( ! found )
+  {
+    fprintf(stderr, "unknown benchmark %s; one of: all", name);
+    for (int i = 0; i < LEN(BENCHMARKS); i++) fprintf(stderr, " %s", BENCHMARKS[i].name);
+    fprintf(stderr, "\n");
+  }
+  return found && ! failed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,153 @@
+#include "vichess.h"
+
+// FICS block mode ("iset block 1"): every command goes out numbered,
+// "12 moves 77", and its whole reply comes back framed by that number,
+//
+//    ^U 12 ^V 37 ^V Movelist for game 77: ... ^W
+//
+// apart from anything unsolicited.  So any number of commands can be in
+// flight, and each reply goes to whoever asked: the login settings to
+// the log, everything else to the writer, with MESSAGE.owner saying
+// whose reply it is -- typed commands are shown, a "moves" backfill goes
+// to the move list.  Only the I/O loop touches this; other threads ask
+// on ob_mq, saying who they are in MESSAGE.owner.
+
+#define BLOCK_START     '\x15'
+#define BLOCK_SEPARATOR '\x16'
+#define BLOCK_END       '\x17'
+#define BLOCK_POSE      "\x18\x19"      // around unsolicited output; dropped
+#define BLOCK_ERROR     512             // codes from here on are errors
+#define BLOCK_IN_FLIGHT 64              // per session
+#define BLOCK_IDS       9999
+
+typedef struct REQUEST
+{
+  int id;                       // 0 for a free slot
+  int owner;                    // BO_*
+  uint64_t sent_ns;
+  char command[64];             // for the log
+} REQUEST;
+
+typedef struct BLOCKS
+{
+  int next_id;
+  int in_flight;
+  REQUEST requests[BLOCK_IN_FLIGHT];
+  REQUEST *reading;             // the reply being read, or NULL
+  int code;                     // its command code
+  REQUEST unknown;              // a reply to no request of ours
+} BLOCKS;
+
+static void to_writer(CONFIG *c, SESSION *s, const REQUEST *r, const char *line)
+{
+  send_reply(c->ib_mq, s->id, r->owner, "%s\n", line);
+}
+
+static void to_log(CONFIG *c, SESSION *s, const REQUEST *r, const char *line)
+{
+  UNUSED( c );
+  log_text(LOG_DEBUG, LOGC_SESSION, "session %d: %s: %s", s->id + 1, r->command, line);
+}
+
+// who gets the reply, a line at a time
+static void (*const ROUTES[N_BLOCK_OWNERS])(CONFIG *, SESSION *, const REQUEST *, const char *) =
+{
+  [BO_TERMINAL] = to_writer,
+  [BO_LOGIN]    = to_log,
+  [BO_MOVES]    = to_writer,    // movelist_feed() takes the listing out
+  [BO_TRIGGER]  = to_writer,
+  [BO_MOVE]     = to_writer,    // "Illegal move", mostly
+};
+
+// Turn block mode on: from here every command is numbered.
+void block_enable(SESSION *s)
+{
+  if ( s->blocks != NULL ) return;
+  session_send(s, "iset block 1\n");
+  if ( (s->blocks = mem_calloc(MEM_TRANSPORT, 1, sizeof *s->blocks)) == NULL ) error("block calloc");
+  s->blocks->unknown.owner = BO_TERMINAL;
+}
+
+// Commands sent and not yet answered.
+int block_in_flight(const SESSION *s)
+{
+  return s->blocks != NULL ? s->blocks->in_flight : 0;
+}
+
+// Send 'command' (ending "\n") for 'owner', numbered if block mode is
+// on.  Returns its number, or 0.
+int block_send(SESSION *s, int owner, const char *command)
+{
+  BLOCKS *b = s->blocks;
+  if ( b == NULL ) { session_send(s, "%s", command); return 0; }
+
+  // the slot of the oldest request, if all are taken: its reply will
+  // go to the terminal
+  REQUEST *r = &b->requests[0];
+  for (int i = 0; i < BLOCK_IN_FLIGHT; i++)
+  {
+    if ( b->requests[i].id == 0 ) { r = &b->requests[i]; break; }
+    if ( b->requests[i].sent_ns < r->sent_ns ) r = &b->requests[i];
+  }
+  if ( r->id != 0 ) b->in_flight--;
+  if ( r == b->reading ) b->reading = &b->unknown;
+
+  b->next_id = b->next_id % BLOCK_IDS + 1;
+  *r = (REQUEST) { .id = b->next_id, .owner = owner, .sent_ns = now_ns() };
+  snprintf(r->command, sizeof r->command, "%.*s", (int) strcspn(command, "\n"), command);
+  b->in_flight++;
+  session_send(s, "%d %s", r->id, command);
+  return r->id;
+}
+
+static REQUEST *find(BLOCKS *b, int id)
+{
+  for (int i = 0; i < BLOCK_IN_FLIGHT; i++) if ( b->requests[i].id == id ) return &b->requests[i];
+  return NULL;
+}
+
+static void finish(SESSION *s, BLOCKS *b)
+{
+  REQUEST *r = b->reading;
+  if ( b->code >= BLOCK_ERROR )
+    log_text(LOG_WARN, LOGC_SESSION, "session %d: \"%s\" failed, code %d", s->id + 1, r->command, b->code);
+  log_text(LOG_DEBUG, LOGC_SESSION, "session %d: \"%s\" answered in %.1f ms", s->id + 1, r->command,
+      ( now_ns() - r->sent_ns ) / 1e6);
+  if ( r != &b->unknown ) { r->id = 0; b->in_flight--; }
+  b->reading = NULL;
+}
+
+// Take what belongs to a reply out of 'line', a line framed from the
+// server, and route it.  Returns what is left for the caller: the line,
+// the text after a reply's end, or NULL if nothing is.
+char *block_line(CONFIG *c, SESSION *s, char *line)
+{
+  BLOCKS *b = s->blocks;
+  if ( b == NULL ) return line;
+
+  // unsolicited output may come marked
+  for (char *p; (p = strpbrk(line, BLOCK_POSE)) != NULL; ) memmove(p, p + 1, strlen(p));
+
+  char *start = b->reading == NULL ? strchr(line, BLOCK_START) : NULL;
+  if ( start != NULL )
+  {
+    // "^U id ^V code ^V text"
+    char *sep = strchr(start, BLOCK_SEPARATOR), *sep2 = sep != NULL ? strchr(sep + 1, BLOCK_SEPARATOR) : NULL;
+    if ( sep2 == NULL ) return line; // not a block header after all
+    int id = atoi(start + 1);
+    b->code = atoi(sep + 1);
+    b->reading = find(b, id);
+    if ( b->reading == NULL ) { b->unknown.id = id; b->unknown.sent_ns = now_ns(); b->reading = &b->unknown; }
+    *start = '\0';
+    if ( start != line && ! equals(line, "% ") && ! equals(line, "fics% ") ) send_message(c->ib_mq, s->id, MSG_LINE, "%s\n", line);
+    line = sep2 + 1;
+  }
+  if ( b->reading == NULL ) return line;
+
+  char *end = strchr(line, BLOCK_END);
+  if ( end != NULL ) *end = '\0';
+  if ( end == NULL || end != line ) ROUTES[b->reading->owner](c, s, b->reading, line);
+  if ( end == NULL ) return NULL;
+  finish(s, b);
+  return end[1] != '\0' ? block_line(c, s, end + 1) : NULL;
+}
@@ -0,0 +1,156 @@
+#include "vichess.h"
+
+// Persistent analysis cache: depth, score and best move per position,
+// keyed by Zobrist hash, in a fixed-size memory-mapped file, so that a
+// position analysed once is known the next time it is seen, even after
+// a restart.
+//
+// The table is buckets of four 16-byte entries (one cache line).  Each
+// entry is two 64-bit words, key ^ data and data, written without
+// locks; a torn entry fails the key check and reads as a miss.  When a
+// bucket is full the shallowest entry is replaced: the cache is lossy
+// by design and never grows.
+
+#define CACHE_MAGIC     "VICACHE1"
+#define CACHE_HEADER    4096
+#define BUCKET_SIZE     4
+
+typedef struct CACHE_HEADER_PAGE
+{
+  char magic[8];
+  uint64_t n_buckets;
+  uint64_t start_key;           // Zobrist key of the start position
+} CACHE_HEADER_PAGE;
+
+typedef struct CACHE_ENTRY
+{
+  _Atomic uint64_t check;       // key ^ data
+  _Atomic uint64_t data;        // move:32 score:16 depth:8 unused:8
+} CACHE_ENTRY;
+
+struct CACHE
+{
+  void *map;
+  size_t size;
+  CACHE_ENTRY *entries;
+  uint64_t n_buckets;           // a power of two
+  // counters, shared by every thread using the cache
+  atomic_ulong probes, hits, stores, probe_ns;
+};
+
+static uint64_t pack(MOVE move, int score, int depth)
+{
+  return (uint64_t) move | (uint64_t) (uint16_t) score << 32 | (uint64_t) (uint8_t) depth << 48;
+}
+
+// Open (or create) the cache file at 'path', 'mb' megabytes.  A file
+// of another size, or written with other Zobrist keys, is reset.
+// Returns NULL, with errno set, on failure.
+CACHE *cache_open(const char *path, size_t mb)
+{
+  position_init();
+  POSITION start;
+  position_start(&start);
+
+  uint64_t n_buckets = 1;
+  while ( n_buckets * 2 * BUCKET_SIZE * sizeof(CACHE_ENTRY) <= mb << 20 ) n_buckets *= 2;
+  size_t size = CACHE_HEADER + n_buckets * BUCKET_SIZE * sizeof(CACHE_ENTRY);
+
+  int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if ( fd == -1 ) return NULL;
+  struct stat st;
+  if ( fstat(fd, &st) == -1 ) { close(fd); return NULL; }
+
+  bool fresh = st.st_size != (off_t) size;
+  // ftruncate to zero and back: a sparse file of zeroed (empty) entries
+  if ( fresh && ( ftruncate(fd, 0) == -1 || ftruncate(fd, size) == -1 ) ) { close(fd); return NULL; }
+
+  // populated up front, so the first probe of a position is not a page fault
+  void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+  close(fd);
+  if ( map == MAP_FAILED ) return NULL;
+
+  CACHE_HEADER_PAGE *h = (CACHE_HEADER_PAGE *) map;
+  if ( ! fresh && ( memcmp(h->magic, CACHE_MAGIC, 8) != 0 || h->n_buckets != n_buckets || h->start_key != start.hash ) )
+  {
+    memset((char *) map + CACHE_HEADER, 0, size - CACHE_HEADER);
+    fresh = true;
+  }
+  if ( fresh )
+  {
+    memcpy(h->magic, CACHE_MAGIC, 8);
+    h->n_buckets = n_buckets;
+    h->start_key = start.hash;
+  }
+
+  CACHE *c = calloc(1, sizeof *c);
+  if ( c == NULL ) error("cache_open");
+  c->map       = map;
+  c->size      = size;
+  c->entries   = (CACHE_ENTRY *) ( (char *) map + CACHE_HEADER );
+  c->n_buckets = n_buckets;
+  return c;
+}
+
+void cache_close(CACHE *c)
+{
+  msync(c->map, c->size, MS_ASYNC);
+  munmap(c->map, c->size);
+  free(c);
+}
+
+bool cache_probe(CACHE *c, uint64_t key, CACHED *out)
+{
+  uint64_t start = now_ns();
+  CACHE_ENTRY *bucket = &c->entries[( key & ( c->n_buckets - 1 ) ) * BUCKET_SIZE];
+  bool hit = false;
+  for (int i = 0; i < BUCKET_SIZE && ! hit; i++)
+  {
+    uint64_t data  = atomic_load_explicit(&bucket[i].data, memory_order_relaxed);
+    uint64_t check = atomic_load_explicit(&bucket[i].check, memory_order_relaxed);
+    if ( data == 0 || ( check ^ data ) != key ) continue;
+    out->move  = (MOVE) data;
+    out->score = (int16_t) ( data >> 32 );
+    out->depth = (uint8_t) ( data >> 48 );
+    hit = true;
+  }
+  atomic_fetch_add_explicit(&c->probes, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&c->hits, hit, memory_order_relaxed);
+  atomic_fetch_add_explicit(&c->probe_ns, now_ns() - start, memory_order_relaxed);
+  return hit;
+}
+
+// Store a result.  A shallower result never replaces a deeper one for
+// the same position.
+void cache_store(CACHE *c, uint64_t key, MOVE move, int score, int depth)
+{
+  CACHE_ENTRY *bucket = &c->entries[( key & ( c->n_buckets - 1 ) ) * BUCKET_SIZE];
+  CACHE_ENTRY *victim = NULL;
+  int victim_depth = INT_MAX;
+  for (int i = 0; i < BUCKET_SIZE; i++)
+  {
+    uint64_t data  = atomic_load_explicit(&bucket[i].data, memory_order_relaxed);
+    uint64_t check = atomic_load_explicit(&bucket[i].check, memory_order_relaxed);
+    int old_depth  = data == 0 ? -1 : (uint8_t) ( data >> 48 );
+    if ( data != 0 && ( check ^ data ) == key )
+    {
+      if ( old_depth > depth ) return;
+      victim = &bucket[i];
+      break;
+    }
+    if ( old_depth < victim_depth ) { victim = &bucket[i]; victim_depth = old_depth; }
+  }
+  uint64_t data = pack(move, score, depth);
+  atomic_store_explicit(&victim->check, key ^ data, memory_order_relaxed);
+  atomic_store_explicit(&victim->data, data, memory_order_relaxed);
+  atomic_fetch_add_explicit(&c->stores, 1, memory_order_relaxed);
+}
+
+void cache_stats(CACHE *c, CACHE_STATS *s)
+{
+  s->entries  = c->n_buckets * BUCKET_SIZE;
+  s->probes   = atomic_load(&c->probes);
+  s->hits     = atomic_load(&c->hits);
+  s->stores   = atomic_load(&c->stores);
+  s->probe_ns = atomic_load(&c->probe_ns);
+}
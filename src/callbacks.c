@@ -29,19 +29,45 @@
  *      }
  * */
 
+void cb_clear(WINDOW *w, void *data)
+{
+  UNUSED( data );
+  wclear(w);
+  wrefresh(w);
+}
+
 void cb_read_command(WINDOW *w, void *data)
 {
-  // (blockingly) read a line of input from the CLI window
+  // (blockingly) read a line of input from the CLI window, after the
+  // prompt already in 'data', if any
   char *d = (char *) data;
   char input[MAX_LINE_SIZE-1];
-  wgetnstr(w, input, MAX_LINE_SIZE-1);
-  snprintf(d, MAX_LINE_SIZE, "%s\n", input); // append newline
+  int prompt = strlen(d);
+  wmove(w, 0, 0); wclrtoeol(w);
+  waddstr(w, d);
+  wgetnstr(w, input, MAX_LINE_SIZE-2-prompt);
+  snprintf(d + prompt, MAX_LINE_SIZE - prompt, "%s\n", input); // append newline
   // reset the input window
   wclrtoeol(w); 
   wmove(w, 0, 0);
   wrefresh(w);
 }
 
+// Wait up to KEY_POLL_MS for one keystroke, unechoed, with the status
+// line of board mode showing.
+void cb_read_key(WINDOW *w, void *data)
+{
+  KEYSTROKE *k = (KEYSTROKE *) data;
+  noecho();
+  wmove(w, 0, 0); wclrtoeol(w);
+  waddstr(w, k->status);
+  wtimeout(w, KEY_POLL_MS);
+  k->ch = wgetch(w);
+  k->ns = now_ns();
+  wtimeout(w, -1);
+  echo();
+}
+
 void cb_write_response(WINDOW *w, void *data)
 {
   // match strings with these prefixes
@@ -68,6 +94,8 @@ void cb_write_response(WINDOW *w, void *data)
   };
 
   char *line = (char *) data;
+  uint64_t trace = trace_begin();
+  metric_add(M_RENDER_TEXT, 1);
 
   // highlight matches
   for (int i=0; i < LEN(highlight_prefixes); i++)
@@ -80,6 +108,33 @@ void cb_write_response(WINDOW *w, void *data)
   waddstr(w, line); 
   wstandend(w);
   wrefresh(w);
+  trace_end(TR_WRITE_RESPONSE, trace);
+}
+
+
+// Rewrite the title line.  With more than one session, follow the
+// title with each session's number and handle; the active one is
+// marked with '%' (as in :ls) and the others show their unread count.
+void cb_write_sessions(WINDOW *w, void *data)
+{
+  CONFIG *c = (CONFIG *) data;
+  char title_line[COLS];
+  int len = snprintf(title_line, COLS, "%s", TITLE);
+
+  if ( c->n_sessions > 1 )
+    for (int i = 0; i < c->n_sessions && len < COLS; i++)
+    {
+      SESSION *s = c->sessions[i];
+      if ( i == c->active )   len += snprintf(title_line + len, COLS - len, "  %d%%%s", i + 1, s->handle);
+      else if ( s->unread )   len += snprintf(title_line + len, COLS - len, "  %d:%s(%u)", i + 1, s->handle, s->unread);
+      else                    len += snprintf(title_line + len, COLS - len, "  %d:%s", i + 1, s->handle);
+    }
+
+  wmove(w, TITLE_LINE, 0); wclrtoeol(w);
+  wattron(w, COLOR_PAIR( BLUISH) );
+  mvwaddstr(w, TITLE_LINE, centered(title_line), title_line);
+  wstandend(w);
+  wrefresh(w);
 }
 
 
@@ -111,33 +166,91 @@ void cb_write_response(WINDOW *w, void *data)
  * */
 
 
+// The columns of the board window that a board's pane covers.
+static void pane_span(WINDOW *w, int pane, int *left, int *width)
+{
+  int w_y, w_x; getmaxyx(w, w_y, w_x);
+  UNUSED( w_y );
+  *left  = pane == PANE_RIGHT ? w_x / 2 : 0;
+  *width = pane == PANE_WHOLE ? w_x : pane == PANE_LEFT ? w_x / 2 : w_x - w_x / 2;
+}
+
+// Clear line 'y' of a pane, and center 'text' in it.
+static void write_pane_line(WINDOW *w, int y, int left, int width, const char *text)
+{
+  wmove(w, y, left);
+  for (int i = 0; i < width; i++) waddch(w, ' ');
+  int len = strlen(text), x = len < width ? ( width - len ) / 2 : 0;
+  mvwaddnstr(w, y, left + x, text, width);
+}
+
+// " ♟2 ♞": the pieces one side holds, white's glyphs or black's
+static void holdings_text(const UPDATE *u, int side, char *out, size_t n)
+{
+  size_t len = 0;
+  out[0] = '\0';
+  if ( ! u->has_holdings ) return;
+  for (int i = 0; i < N_HOLDINGS && len < n; i++)
+  {
+    int count = u->holdings[side][i];
+    if ( count == 0 ) continue;
+    char piece = side == 0 ? HOLDING_PIECES[i] : tolower(HOLDING_PIECES[i]);
+    len += snprintf(out + len, n - len, count > 1 ? " %s%d" : " %s", char_to_piece(piece), count);
+  }
+}
+
+// The player lines above and below a board: name, rating, clock, whose
+// move, and in crazyhouse and bughouse the pieces in hand.
+void cb_write_players(WINDOW *w, void *data)
+{
+  UPDATE *u = (UPDATE*) data;
+  char hh_mm_ss_ms[STR_TIME_LEN], update_line[COLS + 1], held[64];
+  int left, width, my_side = u->my_color == BLACK;
+  pane_span(w, u->pane, &left, &width);
+  metric_add(M_RENDER_PLAYERS, 1);
+
+  // update opponent info line
+  //
+  ms_to_hh_mm_ss_ms(u->opp_ms, hh_mm_ss_ms);
+  holdings_text(u, ! my_side, held, sizeof held);
+  snprintf(update_line, sizeof update_line, "%s (%s) %s %s%s", u->opp_nick, u->opp_rating, hh_mm_ss_ms, ( ! u->my_turn ? FINGER : "   "), held);
+  write_pane_line(w, OPP_INFO_LINE, left, width, update_line);
+
+  // update my info line
+  //
+  ms_to_hh_mm_ss_ms(u->my_ms, hh_mm_ss_ms);
+  holdings_text(u, my_side, held, sizeof held);
+  snprintf(update_line, sizeof update_line, "%s (%s) %s %s%s", u->my_nick, u->my_rating, hh_mm_ss_ms, (u->my_turn ? FINGER : "   "), held);
+  write_pane_line(w, MY_INFO_LINE, left, width, update_line);
+
+  wstandend(w);
+  wrefresh(w);
+}
+
+// A board and its lines, in its pane: everything in the pane is
+// rewritten, and nothing outside it.
 void cb_write_board(WINDOW *w, void *data)
 {
   UPDATE *u = (UPDATE*) data;
+  uint64_t trace = trace_begin();
 
   // ok, here we go -- update the gui
   
   //    reusable buffers
-  char hh_mm_ss_ms[STR_TIME_LEN], update_line[COLS]; 
-  memset(hh_mm_ss_ms, 0, STR_TIME_LEN);
+  char update_line[COLS + 1];
+  int left, width;
+  pane_span(w, u->pane, &left, &width);
+  metric_add(M_RENDER_BOARD, 1);
 
   // update game info line
-  memset(update_line, 0, COLS); wmove(w, GAME_INFO_LINE, 0); wclrtoeol(w);
-  sprintf(update_line, "%s %s game #%d, %d +%d %s", 
+  snprintf(update_line, sizeof update_line, "%s %s game #%d, %d +%d %s", 
                         u->my_status_str,
                         u->type, 
                         u->game_number, 
                         u->match_minutes,
                         u->match_increment,
                         u->rated ? "rated" : "unrated");
-  mvwprintw(w, GAME_INFO_LINE, centered(update_line), update_line);
-
-  // update opponent info line
-  //
-  memset(update_line, 0, COLS); wmove(w, OPP_INFO_LINE, 0); wclrtoeol(w);
-  ms_to_hh_mm_ss_ms(u->opp_ms, hh_mm_ss_ms);
-  sprintf(update_line, "%s (%s) %s %s", u->opp_nick, u->opp_rating, hh_mm_ss_ms, ( ! u->my_turn ? FINGER : "   "));
-  mvwprintw(w, OPP_INFO_LINE, centered(update_line), update_line);
+  write_pane_line(w, GAME_INFO_LINE, left, width, update_line);
 
   // update board
   //    pad board for display
@@ -149,11 +262,10 @@ void cb_write_board(WINDOW *w, void *data)
         ? u->board[row][(col/SQUARE_WIDTH)]
         : EMPTY_SQUARE ;
 
-  //    determine the window width and thereby, the proper indentation
-  int w_y, w_x, h_indent, v_indent; getmaxyx(w, w_y, w_x);
-  h_indent = (w_x - N_ROWS * SQUARE_WIDTH) / 2;
+  //    the pane width gives the proper indentation
+  int h_indent, v_indent;
+  h_indent = left + (width - N_ROWS * SQUARE_WIDTH) / 2;
   v_indent = BOARD_START_LINE;
-  UNUSED( w_y) ;
 
   //    print the board
   for (int row = 0; row < N_ROWS; row++)
@@ -167,8 +279,10 @@ void cb_write_board(WINDOW *w, void *data)
       {
         black_square = ! black_square;
       }
-      if (black_square)   wattron(w, COLOR_PAIR( DARK_SQUARE    ) );
-      else                wattron(w, COLOR_PAIR( LIGHT_SQUARE   ) );
+      int pair = black_square ? DARK_SQUARE : LIGHT_SQUARE;
+      // board mode's cursor, on the main board
+      if ( u->pane != PANE_RIGHT ) pair = modal_square(row, col / SQUARE_WIDTH, pair);
+      wattron(w, COLOR_PAIR( pair ) );
 
       // highlight last move FIXME
       /*
@@ -185,14 +299,161 @@ void cb_write_board(WINDOW *w, void *data)
     }
   }
 
-  // update my info line
+  // update opening line
   //
-  memset(update_line, 0, COLS); wmove(w, MY_INFO_LINE, 0); wclrtoeol(w);
-  ms_to_hh_mm_ss_ms(u->my_ms, hh_mm_ss_ms);
-  sprintf(update_line, "%s (%s) %s %s", u->my_nick, u->my_rating, hh_mm_ss_ms, (u->my_turn ? FINGER : "   "));
-  mvwprintw(w, MY_INFO_LINE, centered(update_line), update_line);
+  write_pane_line(w, OPENING_LINE, left, width, u->opening != NULL ? u->opening : "");
+
+  // the player lines, and refresh the gui
+  cb_write_players(w, u);
+  trace_end(TR_WRITE_BOARD, trace);
+}
+
+
+// One square of the main board, as board mode's cursor passes.
+void cb_write_square(WINDOW *w, void *data)
+{
+  SQUARE_VIEW *v = (SQUARE_VIEW *) data;
+  int left, width;
+  pane_span(w, v->pane, &left, &width);
+  int x = left + (width - N_COLS * SQUARE_WIDTH) / 2 + v->col * SQUARE_WIDTH;
+
+  wattron(w, COLOR_PAIR( v->pair ) );
+  mvwaddstr(w, BOARD_START_LINE + v->row, x, EMPTY_SQUARE);
+  waddstr(w, v->glyph);
+  waddstr(w, EMPTY_SQUARE);
+  wstandend(w);
+  wrefresh(w);
+}
+
+
+// The seek graph, left of the board: one row per rating band (unrated
+// at the bottom), one column per time control, each cell the number of
+// seeks in it.  The bottom line labels the columns with minutes.
+#define SEEK_CELL_WIDTH 3
+#define SEEK_LABEL      6
+#define SEEK_WIDTH      ( SEEK_LABEL + SEEK_COLS * SEEK_CELL_WIDTH )
 
-  // clean up formatting and refresh the gui
+static bool seek_graph_fits(WINDOW *w)
+{
+  int w_y, w_x; getmaxyx(w, w_y, w_x);
+  UNUSED( w_y );
+  return ( w_x - N_COLS * SQUARE_WIDTH ) / 2 > SEEK_WIDTH;
+}
+
+static void write_seek_cell(WINDOW *w, SEEKS *t, int cell)
+{
+  int n = atomic_load(&t->counts[cell]);
+  char text[16];
+  if      ( n == 0 ) snprintf(text, sizeof text, "  ·");
+  else if ( n > 99 ) snprintf(text, sizeof text, " 99");
+  else               snprintf(text, sizeof text, "%3d", n);
+  if ( n > 0 ) wattron(w, COLOR_PAIR( GREENISH ));
+  mvwaddstr(w, BOARD_START_LINE + cell / SEEK_COLS, SEEK_LABEL + cell % SEEK_COLS * SEEK_CELL_WIDTH, text);
+  wstandend(w);
+}
+
+// the whole graph, labels and all
+void cb_write_seeks(WINDOW *w, void *data)
+{
+  static const char *ROWS[SEEK_ROWS] = { " 2000", " 1800", " 1600", " 1400", " 1200", "<1200", "  unr" };
+  static const char *COLUMNS = "  1  2  3  5 10 15 30";
+  SEEKS *t = (SEEKS *) data;
+  if ( ! seek_graph_fits(w) ) return;
+  metric_add(M_RENDER_SEEKS, 1);
+
+  atomic_store(&t->dirty, 0);
+  wattron(w, COLOR_PAIR( GRAY_ON_BLACK ));
+  for (int row = 0; row < SEEK_ROWS; row++) mvwaddstr(w, BOARD_START_LINE + row, 0, ROWS[row]);
+  mvwaddstr(w, BOARD_START_LINE + SEEK_ROWS, SEEK_LABEL, COLUMNS);
   wstandend(w);
+  for (int cell = 0; cell < SEEK_ROWS * SEEK_COLS; cell++) write_seek_cell(w, t, cell);
+  t->drawn = true;
   wrefresh(w);
 }
+
+// only the cells that changed since the last call
+void cb_update_seeks(WINDOW *w, void *data)
+{
+  SEEKS *t = (SEEKS *) data;
+  if ( ! t->drawn ) { cb_write_seeks(w, data); return; }
+  if ( ! seek_graph_fits(w) ) return;
+
+  uint64_t dirty = atomic_exchange(&t->dirty, 0);
+  if ( dirty == 0 ) return;
+  metric_add(M_RENDER_SEEKS, 1);
+  for (int cell = 0; cell < SEEK_ROWS * SEEK_COLS; cell++)
+    if ( dirty & ( (uint64_t) 1 << cell ) ) write_seek_cell(w, t, cell);
+  wrefresh(w);
+}
+
+
+// The move list, right of the board: a line per move number, each new
+// move added where the last one ended and the pane scrolling up as it
+// fills.  Only another game, or a move taken back, rewrites it.
+#define MOVES_WIDTH     28
+#define MOVES_BLACK     13      // column of black's moves
+
+static WINDOW *moves_pane;      // shares the board window's cells
+static GAME_MOVES *moves_shown; // the game in it
+
+static WINDOW *move_pane(WINDOW *w)
+{
+  if ( moves_pane != NULL ) return moves_pane;
+  int w_y, w_x; getmaxyx(w, w_y, w_x);
+  UNUSED( w_y );
+  int left = ( w_x + N_COLS * SQUARE_WIDTH ) / 2 + 3, width = w_x - left - 1;
+  if ( width > MOVES_WIDTH ) width = MOVES_WIDTH;
+  if ( width < MOVES_BLACK + 8 ) return NULL;
+  if ( (moves_pane = derwin(w, N_ROWS, width, BOARD_START_LINE, left)) != NULL ) scrollok(moves_pane, TRUE);
+  return moves_pane;
+}
+
+static void write_move(WINDOW *p, const GAME_MOVES *g, int i)
+{
+  int ply = g->first_ply + i;
+  if ( ply % 2 == 0 )
+  {
+    if ( getcurx(p) != 0 ) waddch(p, '\n');
+    wprintw(p, "%3d. %s", ply / 2 + 1, g->san[i]);
+  }
+  else
+  {
+    if ( getcurx(p) == 0 ) wprintw(p, "%3d. ...", ply / 2 + 1);
+    mvwaddstr(p, getcury(p), MOVES_BLACK, g->san[i]);
+  }
+}
+
+// the last rows of moves, from the start of a line
+void cb_write_moves(WINDOW *w, void *data)
+{
+  GAME_MOVES *g = (GAME_MOVES *) data;
+  WINDOW *p = move_pane(w);
+  if ( p == NULL ) return;
+  metric_add(M_RENDER_MOVES, 1);
+  werase(p);
+  wmove(p, 0, 0);
+  moves_shown = g;
+  if ( g != NULL )
+  {
+    int last = g->first_ply + g->n, from = ( ( last - 1 ) / 2 - ( N_ROWS - 1 ) ) * 2;
+    if ( from < g->first_ply ) from = g->first_ply;
+    wattron(p, COLOR_PAIR( GRAY_ON_BLACK ));
+    for (g->drawn = from - g->first_ply; g->drawn < g->n; g->drawn++) write_move(p, g, g->drawn);
+    wstandend(p);
+  }
+  wrefresh(p);
+}
+
+// only the moves since the last call
+void cb_update_moves(WINDOW *w, void *data)
+{
+  GAME_MOVES *g = (GAME_MOVES *) data;
+  if ( g != moves_shown || g->drawn < 0 || g->drawn > g->n ) { cb_write_moves(w, data); return; }
+  WINDOW *p = move_pane(w);
+  if ( p == NULL || g->drawn == g->n ) return;
+  metric_add(M_RENDER_MOVES, 1);
+  wattron(p, COLOR_PAIR( GRAY_ON_BLACK ));
+  for ( ; g->drawn < g->n; g->drawn++) write_move(p, g, g->drawn);
+  wstandend(p);
+  wrefresh(p);
+}
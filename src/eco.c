@@ -0,0 +1,69 @@
+#include "vichess.h"
+
+// Opening classification.  The table is built ahead of time (make
+// eco.bin) and mapped read-only; every bucket is one cache line and the
+// builder guarantees each position sits in its home bucket, so a lookup
+// is a single probe.  Positions are keyed by Zobrist hash, so an
+// opening reached by another move order is still recognised.
+
+struct ECO
+{
+  void *map;
+  size_t size;
+  const ECO_SLOT *slots;
+  uint64_t n_buckets;
+  const char *names;
+  uint64_t names_size;
+};
+
+// Map the table at 'path'.  Returns NULL if it is missing, or was built
+// for another format or other Zobrist keys.
+ECO *eco_open(const char *path)
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if ( fd == -1 ) return NULL;
+  struct stat st;
+  if ( fstat(fd, &st) == -1 || st.st_size < (off_t) sizeof(ECO_HEADER) ) { close(fd); return NULL; }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+  close(fd);
+  if ( map == MAP_FAILED ) return NULL;
+
+  position_init();
+  POSITION start;
+  position_start(&start);
+
+  const ECO_HEADER *h = (const ECO_HEADER *) map;
+  size_t slots_size = h->n_buckets * ECO_BUCKET * sizeof(ECO_SLOT);
+  if ( memcmp(h->magic, ECO_MAGIC, 8) != 0 || h->start_key != start.hash
+      || ( h->n_buckets & ( h->n_buckets - 1 ) ) != 0
+      || (size_t) st.st_size != sizeof *h + slots_size + h->names_size )
+  {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+
+  ECO *e = calloc(1, sizeof *e);
+  if ( e == NULL ) error("eco_open");
+  e->map        = map;
+  e->size       = st.st_size;
+  e->slots      = (const ECO_SLOT *) ( h + 1 );
+  e->n_buckets  = h->n_buckets;
+  e->names      = (const char *) map + sizeof *h + slots_size;
+  e->names_size = h->names_size;
+  return e;
+}
+
+void eco_close(ECO *e)
+{
+  munmap(e->map, e->size);
+  free(e);
+}
+
+// The ECO code and name of the position with Zobrist key 'key', or NULL
+const char *eco_lookup(const ECO *e, uint64_t key)
+{
+  const ECO_SLOT *bucket = &e->slots[( key & ( e->n_buckets - 1 ) ) * ECO_BUCKET];
+  for (int i = 0; i < ECO_BUCKET; i++)
+    if ( bucket[i].key == key && bucket[i].name < e->names_size ) return e->names + bucket[i].name;
+  return NULL;
+}
@@ -0,0 +1,453 @@
+#include "vichess.h"
+
+// A small chess engine: alpha-beta (PVS) with quiescence, null move
+// and late move reductions, iterative deepening, and Lazy SMP: every
+// thread searches the same root and they share only the transposition
+// table, which steers each of them away from work another has done.
+//
+// The table is lock-free.  Each slot is two 64-bit words, key ^ data
+// and data; a torn write fails the key check and reads as a miss.
+
+#define INF             32000
+#define MATE            30000
+#define MATE_BOUND      ( MATE - MAX_PLY )
+
+enum __BOUNDS { BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT };
+
+typedef struct TT_ENTRY
+{
+  _Atomic uint64_t check;       // key ^ data
+  _Atomic uint64_t data;        // move:32 score:16 depth:8 bound:8
+} TT_ENTRY;
+
+static TT_ENTRY *TT = NULL;
+static size_t TT_MASK = 0;
+
+static atomic_bool STOP;
+
+typedef struct THREAD
+{
+  int id;
+  POSITION pos;
+  SEARCH_LIMITS limits;
+  uint64_t start_ns;
+  uint64_t nodes;
+  // repetition detection: keys of the game so far, then the search path
+  uint64_t keys[MAX_GAME_PLY + MAX_PLY];
+  int n_keys;
+  MOVE killers[MAX_PLY][2];
+  int history[16][128];
+  MOVE pv[MAX_PLY][MAX_PLY];
+  int pv_len[MAX_PLY];
+  SEARCH_RESULT result;
+  pthread_t tid;
+} THREAD;
+
+
+/// Transposition table
+
+void engine_tt_resize(size_t mb)
+{
+  size_t n = 1;
+  while ( n * 2 * sizeof(TT_ENTRY) <= mb << 20 ) n *= 2;
+  free(TT);
+  TT = calloc(n, sizeof *TT);
+  if ( TT == NULL ) error("engine_tt_resize");
+  TT_MASK = n - 1;
+}
+
+void engine_tt_clear(void)
+{
+  if ( TT != NULL ) memset(TT, 0, (TT_MASK + 1) * sizeof *TT);
+}
+
+// mate scores are stored relative to the node, not the root
+static int score_to_tt(int score, int ply)
+{
+  return score >= MATE_BOUND ? score + ply : score <= -MATE_BOUND ? score - ply : score;
+}
+
+static int score_from_tt(int score, int ply)
+{
+  return score >= MATE_BOUND ? score - ply : score <= -MATE_BOUND ? score + ply : score;
+}
+
+static bool tt_probe(uint64_t key, MOVE *move, int *score, int *depth, int *bound)
+{
+  TT_ENTRY *e = &TT[key & TT_MASK];
+  uint64_t data  = atomic_load_explicit(&e->data, memory_order_relaxed);
+  uint64_t check = atomic_load_explicit(&e->check, memory_order_relaxed);
+  if ( ( check ^ data ) != key ) return false;
+  *move  = (MOVE) data;
+  *score = (int16_t) ( data >> 32 );
+  *depth = (uint8_t) ( data >> 48 );
+  *bound = (uint8_t) ( data >> 56 );
+  return true;
+}
+
+static void tt_store(uint64_t key, MOVE move, int score, int depth, int bound)
+{
+  TT_ENTRY *e = &TT[key & TT_MASK];
+  // keep the old move if this search did not find one
+  if ( move == MOVE_NONE )
+  {
+    uint64_t old = atomic_load_explicit(&e->data, memory_order_relaxed);
+    if ( ( atomic_load_explicit(&e->check, memory_order_relaxed) ^ old ) == key ) move = (MOVE) old;
+  }
+  uint64_t data = (uint64_t) move | (uint64_t) (uint16_t) score << 32
+                | (uint64_t) (uint8_t) depth << 48 | (uint64_t) bound << 56;
+  atomic_store_explicit(&e->check, key ^ data, memory_order_relaxed);
+  atomic_store_explicit(&e->data, data, memory_order_relaxed);
+}
+
+
+/// Evaluation: material and piece-square tables, from the side to move
+
+static const int VALUE[8] = { 0, 100, 320, 330, 500, 900, 0, 0 };
+
+// from white's point of view, a8..h8 first (read as printed); black
+// looks the tables up with the rank flipped
+static const int PST[7][64] =
+{
+  { 0 },
+  { // pawn
+      0,  0,  0,  0,  0,  0,  0,  0,   50, 50, 50, 50, 50, 50, 50, 50,
+     10, 10, 20, 30, 30, 20, 10, 10,    5,  5, 10, 25, 25, 10,  5,  5,
+      0,  0,  0, 20, 20,  0,  0,  0,    5, -5,-10,  0,  0,-10, -5,  5,
+      5, 10, 10,-20,-20, 10, 10,  5,    0,  0,  0,  0,  0,  0,  0,  0 },
+  { // knight
+    -50,-40,-30,-30,-30,-30,-40,-50,  -40,-20,  0,  0,  0,  0,-20,-40,
+    -30,  0, 10, 15, 15, 10,  0,-30,  -30,  5, 15, 20, 20, 15,  5,-30,
+    -30,  0, 15, 20, 20, 15,  0,-30,  -30,  5, 10, 15, 15, 10,  5,-30,
+    -40,-20,  0,  5,  5,  0,-20,-40,  -50,-40,-30,-30,-30,-30,-40,-50 },
+  { // bishop
+    -20,-10,-10,-10,-10,-10,-10,-20,  -10,  0,  0,  0,  0,  0,  0,-10,
+    -10,  0,  5, 10, 10,  5,  0,-10,  -10,  5,  5, 10, 10,  5,  5,-10,
+    -10,  0, 10, 10, 10, 10,  0,-10,  -10, 10, 10, 10, 10, 10, 10,-10,
+    -10,  5,  0,  0,  0,  0,  5,-10,  -20,-10,-10,-10,-10,-10,-10,-20 },
+  { // rook
+      0,  0,  0,  0,  0,  0,  0,  0,    5, 10, 10, 10, 10, 10, 10,  5,
+     -5,  0,  0,  0,  0,  0,  0, -5,   -5,  0,  0,  0,  0,  0,  0, -5,
+     -5,  0,  0,  0,  0,  0,  0, -5,   -5,  0,  0,  0,  0,  0,  0, -5,
+     -5,  0,  0,  0,  0,  0,  0, -5,    0,  0,  0,  5,  5,  0,  0,  0 },
+  { // queen
+    -20,-10,-10, -5, -5,-10,-10,-20,  -10,  0,  0,  0,  0,  0,  0,-10,
+    -10,  0,  5,  5,  5,  5,  0,-10,   -5,  0,  5,  5,  5,  5,  0, -5,
+      0,  0,  5,  5,  5,  5,  0, -5,  -10,  5,  5,  5,  5,  5,  0,-10,
+    -10,  0,  5,  0,  0,  0,  0,-10,  -20,-10,-10, -5, -5,-10,-10,-20 },
+  { // king, middlegame
+    -30,-40,-40,-50,-50,-40,-40,-30,  -30,-40,-40,-50,-50,-40,-40,-30,
+    -30,-40,-40,-50,-50,-40,-40,-30,  -30,-40,-40,-50,-50,-40,-40,-30,
+    -20,-30,-30,-40,-40,-30,-30,-20,  -10,-20,-20,-20,-20,-20,-20,-10,
+     20, 20,  0,  0,  0,  0, 20, 20,   20, 30, 10,  0,  0, 10, 30, 20 },
+};
+
+static const int KING_ENDGAME[64] =
+{
+  -50,-40,-30,-20,-20,-30,-40,-50,  -30,-20,-10,  0,  0,-10,-20,-30,
+  -30,-10, 20, 30, 30, 20,-10,-30,  -30,-10, 30, 40, 40, 30,-10,-30,
+  -30,-10, 30, 40, 40, 30,-10,-30,  -30,-10, 20, 30, 30, 20,-10,-30,
+  -30,-30,  0,  0,  0,  0,-30,-30,  -50,-30,-30,-30,-30,-30,-30,-50,
+};
+
+int evaluate(const POSITION *pos)
+{
+  int score[2] = { 0, 0 }, phase = 0;
+  int king_sq[2] = { 0, 0 };
+
+  for (int sq = 0; sq < 128; sq++)
+  {
+    if ( sq & 0x88 ) { sq += 7; continue; }
+    int piece = pos->board[sq];
+    if ( piece == EMPTY ) continue;
+    int type = PIECE_TYPE(piece), side = PIECE_SIDE(piece);
+    int rank = sq >> 4, file = sq & 7;
+    int index = ( side == WHITE_SIDE ? 7 - rank : rank ) * 8 + file;
+    if ( type == KING ) { king_sq[side] = index; continue; }
+    score[side] += VALUE[type] + PST[type][index];
+    if ( type >= KNIGHT ) phase += VALUE[type];
+  }
+  // kings: shelter while there is material about, centralize after
+  const int *king = phase > 2600 ? PST[KING] : KING_ENDGAME;
+  score[WHITE_SIDE] += king[king_sq[WHITE_SIDE]];
+  score[BLACK_SIDE] += king[king_sq[BLACK_SIDE]];
+
+  int eval = score[WHITE_SIDE] - score[BLACK_SIDE];
+  return pos->side == WHITE_SIDE ? eval : -eval;
+}
+
+
+/// Search
+
+static bool time_up(THREAD *t)
+{
+  if ( atomic_load_explicit(&STOP, memory_order_relaxed) ) return true;
+  if ( t->id != 0 || ( t->nodes & 2047 ) != 0 || t->limits.movetime_ms <= 0 ) return false;
+  if ( now_ns() - t->start_ns >= (uint64_t) t->limits.movetime_ms * 1000000 ) atomic_store(&STOP, true);
+  return atomic_load_explicit(&STOP, memory_order_relaxed);
+}
+
+// draw by repetition (once is enough inside the search) or 50 moves
+static bool is_draw(THREAD *t)
+{
+  const POSITION *pos = &t->pos;
+  if ( pos->halfmove >= 100 ) return true;
+  for (int i = t->n_keys - 3, back = 2; i >= 0 && back <= pos->halfmove; i -= 2, back += 2)
+    if ( t->keys[i] == pos->hash ) return true;
+  return false;
+}
+
+static bool has_pieces(const POSITION *pos)
+{
+  int color = pos->side == WHITE_SIDE ? 0 : BLACK_BIT;
+  for (int sq = 0; sq < 128; sq++)
+  {
+    if ( sq & 0x88 ) { sq += 7; continue; }
+    int p = pos->board[sq];
+    if ( p != EMPTY && ( p & BLACK_BIT ) == color && PIECE_TYPE(p) != PAWN && PIECE_TYPE(p) != KING ) return true;
+  }
+  return false;
+}
+
+static void score_moves(THREAD *t, const MOVE_LIST *list, int *scores, MOVE tt_move, int ply)
+{
+  const uint8_t *b = t->pos.board;
+  for (int i = 0; i < list->n; i++)
+  {
+    MOVE m = list->moves[i];
+    if      ( m == tt_move )                            scores[i] = 1 << 30;
+    else if ( MOVE_FLAGS(m) & MOVE_CAPTURE )            // most valuable victim, least valuable attacker
+      scores[i] = ( 1 << 20 ) + VALUE[PIECE_TYPE(b[MOVE_TO(m)])] * 16 - PIECE_TYPE(b[MOVE_FROM(m)]);
+    else if ( MOVE_FLAGS(m) & MOVE_PROMOTION )          scores[i] = ( 1 << 20 ) + MOVE_PROMOTED(m);
+    else if ( m == t->killers[ply][0] )                 scores[i] = ( 1 << 19 ) + 1;
+    else if ( m == t->killers[ply][1] )                 scores[i] = ( 1 << 19 );
+    else scores[i] = t->history[b[MOVE_FROM(m)]][MOVE_TO(m)];
+  }
+}
+
+// selection sort, one step: bring the best remaining move to 'i'
+static MOVE next_move(MOVE_LIST *list, int *scores, int i)
+{
+  int best = i;
+  for (int j = i + 1; j < list->n; j++) if ( scores[j] > scores[best] ) best = j;
+  MOVE m = list->moves[best];    int s = scores[best];
+  list->moves[best] = list->moves[i]; scores[best] = scores[i];
+  list->moves[i] = m;             scores[i] = s;
+  return m;
+}
+
+static int quiesce(THREAD *t, int alpha, int beta, int ply)
+{
+  t->nodes++;
+  t->pv_len[ply] = 0;
+  if ( time_up(t) ) return 0;
+
+  int stand_pat = evaluate(&t->pos);
+  if ( ply >= MAX_PLY - 1 ) return stand_pat;
+  if ( stand_pat >= beta ) return stand_pat;
+  if ( stand_pat > alpha ) alpha = stand_pat;
+
+  MOVE_LIST list;
+  int scores[MAX_MOVES];
+  UNDO undo;
+  generate_moves(&t->pos, &list, true);
+  score_moves(t, &list, scores, MOVE_NONE, ply);
+
+  for (int i = 0; i < list.n; i++)
+  {
+    MOVE m = next_move(&list, scores, i);
+    if ( ! make_move(&t->pos, m, &undo) ) continue;
+    int score = -quiesce(t, -beta, -alpha, ply + 1);
+    unmake_move(&t->pos, m, &undo);
+    if ( score >= beta ) return score;
+    if ( score > alpha ) alpha = score;
+  }
+  return alpha;
+}
+
+static int search(THREAD *t, int alpha, int beta, int depth, int ply, bool null_ok)
+{
+  POSITION *pos = &t->pos;
+  bool pv_node = beta - alpha > 1;
+  t->pv_len[ply] = 0;
+
+  if ( ply > 0 && is_draw(t) ) return 0;
+  bool check = in_check(pos);
+  if ( check ) depth++;
+  if ( depth <= 0 ) return quiesce(t, alpha, beta, ply);
+  t->nodes++;
+  if ( time_up(t) ) return 0;
+  if ( ply >= MAX_PLY - 1 ) return evaluate(pos);
+
+  MOVE tt_move = MOVE_NONE;
+  int tt_score, tt_depth, tt_bound;
+  if ( tt_probe(pos->hash, &tt_move, &tt_score, &tt_depth, &tt_bound) && ply > 0 && ! pv_node && tt_depth >= depth )
+  {
+    tt_score = score_from_tt(tt_score, ply);
+    if ( tt_bound == BOUND_EXACT
+        || ( tt_bound == BOUND_LOWER && tt_score >= beta )
+        || ( tt_bound == BOUND_UPPER && tt_score <= alpha ) )
+      return tt_score;
+  }
+
+  UNDO undo;
+  // null move: if passing still fails high, a real move will too
+  if ( null_ok && ! check && ! pv_node && depth >= 3 && has_pieces(pos) && evaluate(pos) >= beta )
+  {
+    make_null_move(pos, &undo);
+    t->keys[t->n_keys++] = pos->hash;
+    int score = -search(t, -beta, -beta + 1, depth - 3, ply + 1, false);
+    t->n_keys--;
+    unmake_null_move(pos, &undo);
+    if ( atomic_load_explicit(&STOP, memory_order_relaxed) ) return 0;
+    if ( score >= beta ) return beta;
+  }
+
+  MOVE_LIST list;
+  int scores[MAX_MOVES];
+  generate_moves(pos, &list, false);
+  score_moves(t, &list, scores, tt_move, ply);
+
+  int best = -INF, legal = 0, old_alpha = alpha;
+  MOVE best_move = MOVE_NONE;
+  for (int i = 0; i < list.n; i++)
+  {
+    MOVE m = next_move(&list, scores, i);
+    int piece = pos->board[MOVE_FROM(m)];
+    if ( ! make_move(pos, m, &undo) ) continue;
+    legal++;
+    t->keys[t->n_keys++] = pos->hash;
+
+    int score;
+    bool quiet = ! ( MOVE_FLAGS(m) & ( MOVE_CAPTURE | MOVE_PROMOTION ) );
+    if ( legal == 1 ) score = -search(t, -beta, -alpha, depth - 1, ply + 1, true);
+    else
+    {
+      // late quiet moves are probably bad: look at them less deeply
+      int reduction = ( quiet && ! check && depth >= 3 && legal > 4 && ! in_check(pos) ) ? 1 + ( legal > 12 ) : 0;
+      score = -search(t, -alpha - 1, -alpha, depth - 1 - reduction, ply + 1, true);
+      if ( score > alpha && reduction )     score = -search(t, -alpha - 1, -alpha, depth - 1, ply + 1, true);
+      if ( score > alpha && score < beta )  score = -search(t, -beta, -alpha, depth - 1, ply + 1, true);
+    }
+
+    t->n_keys--;
+    unmake_move(pos, m, &undo);
+    if ( atomic_load_explicit(&STOP, memory_order_relaxed) ) return 0;
+
+    if ( score > best ) { best = score; best_move = m; }
+    if ( score > alpha )
+    {
+      alpha = score;
+      t->pv[ply][0] = m;
+      memcpy(&t->pv[ply][1], t->pv[ply + 1], t->pv_len[ply + 1] * sizeof(MOVE));
+      t->pv_len[ply] = t->pv_len[ply + 1] + 1;
+    }
+    if ( alpha >= beta )
+    {
+      if ( quiet )
+      {
+        if ( t->killers[ply][0] != m ) { t->killers[ply][1] = t->killers[ply][0]; t->killers[ply][0] = m; }
+        t->history[piece][MOVE_TO(m)] += depth * depth;
+        if ( t->history[piece][MOVE_TO(m)] > ( 1 << 18 ) )
+          for (int p = 0; p < 16; p++) for (int sq = 0; sq < 128; sq++) t->history[p][sq] /= 2;
+      }
+      break;
+    }
+  }
+
+  if ( legal == 0 ) return check ? -MATE + ply : 0;
+
+  int bound = best >= beta ? BOUND_LOWER : alpha > old_alpha ? BOUND_EXACT : BOUND_UPPER;
+  tt_store(pos->hash, best_move, score_to_tt(best, ply), depth, bound);
+  return best;
+}
+
+static void *t_search(void *arg)
+{
+  THREAD *t = (THREAD *) arg;
+  SEARCH_RESULT *r = &t->result;
+
+  // helpers start staggered, so they are not all on the same depth
+  for (int depth = 1 + ( t->id & 1 ); depth <= t->limits.depth; depth++)
+  {
+    int score = search(t, -INF, INF, depth, 0, false);
+    if ( atomic_load_explicit(&STOP, memory_order_relaxed) && r->depth > 0 ) break;
+    if ( t->pv_len[0] == 0 ) continue;
+    r->best   = t->pv[0][0];
+    r->score  = score;
+    r->depth  = depth;
+    r->pv_len = t->pv_len[0];
+    memcpy(r->pv, t->pv[0], r->pv_len * sizeof(MOVE));
+    if ( t->id == 0 && abs(score) >= MATE_BOUND ) break; // forced mate found
+  }
+  // the main thread finishing stops everyone
+  if ( t->id == 0 ) atomic_store(&STOP, true);
+  return NULL;
+}
+
+// Search 'root' within 'limits'.  'history' is the hashes of the game's
+// earlier positions, oldest first, for repetition detection; it may be
+// NULL.  Call engine_tt_resize() once first.
+SEARCH_RESULT engine_search(const POSITION *root, const uint64_t *history, int n_history, SEARCH_LIMITS limits)
+{
+  if ( TT == NULL ) engine_tt_resize(ENGINE_TT_MB);
+  if ( limits.threads < 1 ) limits.threads = 1;
+  if ( limits.depth < 1 || limits.depth > MAX_PLY - 8 ) limits.depth = MAX_PLY - 8;
+  if ( n_history > MAX_GAME_PLY - 1 ) { history += n_history - ( MAX_GAME_PLY - 1 ); n_history = MAX_GAME_PLY - 1; }
+
+  THREAD *threads = calloc(limits.threads, sizeof *threads);
+  if ( threads == NULL ) error("engine_search");
+  atomic_store(&STOP, false);
+  uint64_t start = now_ns();
+
+  for (int i = 0; i < limits.threads; i++)
+  {
+    THREAD *t   = &threads[i];
+    t->id       = i;
+    t->pos      = *root;
+    t->limits   = limits;
+    t->start_ns = start;
+    if ( history != NULL ) memcpy(t->keys, history, n_history * sizeof *history);
+    t->n_keys   = n_history;
+    t->keys[t->n_keys++] = root->hash;
+    if ( i > 0 && pthread_create(&t->tid, NULL, t_search, t) != 0 ) error("pthread_create");
+  }
+  t_search(&threads[0]);
+  for (int i = 1; i < limits.threads; i++) pthread_join(threads[i].tid, NULL);
+
+  // the main thread's answer, unless a helper completed a deeper one
+  SEARCH_RESULT r = threads[0].result;
+  uint64_t nodes = 0;
+  for (int i = 0; i < limits.threads; i++)
+  {
+    nodes += threads[i].nodes;
+    if ( threads[i].result.depth > r.depth ) r = threads[i].result;
+  }
+  r.nodes = nodes;
+  r.ns    = now_ns() - start;
+
+  // no completed iteration (tiny movetime): any legal move will do
+  if ( r.best == MOVE_NONE )
+  {
+    MOVE_LIST list;
+    POSITION pos = *root;
+    generate_legal_moves(&pos, &list);
+    if ( list.n > 0 ) r.best = list.moves[0];
+  }
+  free(threads);
+  return r;
+}
+
+// Ask a running engine_search() to return as soon as it can.
+void engine_stop(void)
+{
+  atomic_store(&STOP, true);
+}
+
+// "+0.35", "-1.20", "#3", "#-2": a score as players write it
+void format_score(int score, char *out, size_t n)
+{
+  if      ( score >= MATE_BOUND )   snprintf(out, n, "#%d", ( MATE - score + 1 ) / 2);
+  else if ( score <= -MATE_BOUND )  snprintf(out, n, "#-%d", ( MATE + score ) / 2);
+  else                              snprintf(out, n, "%+.2f", score / 100.0);
+}
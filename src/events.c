@@ -0,0 +1,159 @@
+#define _GNU_SOURCE
+
+#include "events.h"
+
+#include <errno.h>      // errno
+#include <fcntl.h>      // O_* bits
+#include <stdlib.h>     // malloc()
+#include <string.h>     // memcpy()
+#include <sys/mman.h>   // shm_open(), mmap()
+#include <sys/stat.h>   // S_* bits
+#include <unistd.h>     // ftruncate()
+
+// Only includes events.h, so that readers outside vichess can link it.
+
+// Bytes of 'ev' that carry data: text events stop after their text.
+size_t event_size(const EVENT *ev)
+{
+  switch (ev->type)
+  {
+    case EV_BOARD:      return offsetof(EVENT, board)    + sizeof ev->board;
+    case EV_GAMEINFO:   return offsetof(EVENT, gameinfo) + sizeof ev->gameinfo;
+    case EV_TEXT:       return offsetof(EVENT, text)     + ev->len + 1;
+  }
+  return sizeof *ev;
+}
+
+static size_t ring_size(uint32_t n_slots)
+{
+  return sizeof(RING) + (size_t) n_slots * sizeof(RING_SLOT);
+}
+
+/// Writer
+
+// Create (or replace) the named shared-memory ring.  Returns NULL and
+// sets errno on failure.
+RING *ring_create(const char *name, uint32_t n_slots)
+{
+  if (n_slots == 0 || (n_slots & (n_slots - 1)) != 0) { errno = EINVAL; return NULL; }
+
+  shm_unlink(name); // delete any stale ring
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+  if (fd == -1) return NULL;
+  if (ftruncate(fd, ring_size(n_slots)) == -1) { close(fd); return NULL; }
+
+  RING *r = mmap(NULL, ring_size(n_slots), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (r == MAP_FAILED) return NULL;
+
+  // ftruncate() zero-fills, so every slot starts out unpublished
+  r->n_slots    = n_slots;
+  r->slot_size  = sizeof(RING_SLOT);
+  r->version    = RING_VERSION;
+  atomic_store_explicit(&r->head, 0, memory_order_relaxed);
+  atomic_store_explicit((_Atomic uint32_t *) &r->magic, RING_MAGIC, memory_order_release);
+  return r;
+}
+
+// Return the slot for the next event, marked as being written.  The
+// caller fills it in place and then calls ring_publish().
+EVENT *ring_claim(RING *r)
+{
+  uint64_t seq    = atomic_load_explicit(&r->head, memory_order_relaxed);
+  RING_SLOT *slot = &r->slots[seq & (r->n_slots - 1)];
+
+  atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  return &slot->ev;
+}
+
+void ring_publish(RING *r)
+{
+  uint64_t seq    = atomic_load_explicit(&r->head, memory_order_relaxed);
+  RING_SLOT *slot = &r->slots[seq & (r->n_slots - 1)];
+
+  atomic_store_explicit(&slot->seq, seq + 1, memory_order_release);
+  atomic_store_explicit(&r->head, seq + 1, memory_order_release);
+}
+
+void ring_destroy(RING *r, const char *name)
+{
+  munmap(r, ring_size(r->n_slots));
+  shm_unlink(name);
+}
+
+
+/// Readers
+
+// Attach to the named ring, starting at the oldest event still held.
+// n.b.: client must ring_close()
+RING_READER *ring_open(const char *name)
+{
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd == -1) return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_size < (off_t) sizeof(RING)) { close(fd); errno = EINVAL; return NULL; }
+
+  RING *r = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (r == MAP_FAILED) return NULL;
+
+  if (atomic_load_explicit((_Atomic uint32_t *) &r->magic, memory_order_acquire) != RING_MAGIC
+      || r->version != RING_VERSION
+      || r->slot_size != sizeof(RING_SLOT)
+      || ring_size(r->n_slots) > (size_t) st.st_size)
+  {
+    munmap(r, st.st_size);
+    errno = EPROTO;
+    return NULL;
+  }
+
+  RING_READER *rr = calloc(1, sizeof *rr);
+  if (rr == NULL) { munmap(r, st.st_size); return NULL; }
+  rr->ring = r;
+  rr->size = st.st_size;
+
+  uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+  rr->cursor = (head > r->n_slots) ? head - r->n_slots : 0;
+  return rr;
+}
+
+// Copy the next event into 'ev'.  Returns 1 if an event was read, 0 if
+// the reader has caught up with the writer.  Events the writer
+// overwrote before they could be read are added to rr->lost.
+int ring_next(RING_READER *rr, EVENT *ev)
+{
+  RING *r = rr->ring;
+  while (true)
+  {
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    if (rr->cursor >= head) return 0;
+    if (head - rr->cursor > r->n_slots) // lapped
+    {
+      rr->lost   += head - rr->cursor - r->n_slots;
+      rr->cursor  = head - r->n_slots;
+    }
+
+    RING_SLOT *slot = &r->slots[rr->cursor & (r->n_slots - 1)];
+    uint64_t before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    memcpy(ev, &slot->ev, sizeof *ev);
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t after  = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+    if (before == rr->cursor + 1 && after == before)
+    {
+      rr->cursor++;
+      return 1;
+    }
+    // the writer got to this slot first; skip it and re-check the head
+    rr->lost++;
+    rr->cursor++;
+  }
+}
+
+void ring_close(RING_READER *rr)
+{
+  munmap(rr->ring, rr->size);
+  free(rr);
+}
@@ -0,0 +1,150 @@
+#ifndef VICHESS_EVENTS_H
+#define VICHESS_EVENTS_H
+
+/*
+ * Parsed events, and the shared-memory ring they are published on.
+ *
+ * This header is self-contained (no curses, no vichess.h) so that local
+ * consumers can include it and link events.o alone; see
+ * tools/vichess-tail.c.
+ *
+ * Every structure here is plain old data with fixed-size fields: an
+ * EVENT can be copied, written to a file or mapped into another process
+ * as is.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define EV_NICK_MAX     18      // NICK_MAX in vichess.h
+#define EV_TEXT_MAX     984     // longer lines are truncated
+
+// A Style 12 update with every field kept, in the server's (absolute)
+// orientation: board[0] is White's 8th rank, board[0][0] is a8.
+typedef struct STYLE12
+{
+  uint32_t  game_number;
+  char      board[8][8];            // "-" for empty, else RNBQKPrnbqkp
+  char      turn;                   // 'W' or 'B'
+  int8_t    double_push;            // file 0-7, or -1
+  bool      white_castle_short;
+  bool      white_castle_long;
+  bool      black_castle_short;
+  bool      black_castle_long;
+  uint16_t  irreversible;           // moves since last irreversible move
+  int8_t    relation;               // my_status, see __MODES
+  uint8_t   flip;                   // 1 = black at bottom
+  uint16_t  match_minutes;
+  uint16_t  match_increment;
+  int16_t   white_strength;
+  int16_t   black_strength;
+  int32_t   white_ms;               // remaining time (may be negative)
+  int32_t   black_ms;
+  uint16_t  move_number;
+  char      white[EV_NICK_MAX];
+  char      black[EV_NICK_MAX];
+  char      verbose_move[12];       // e.g. "P/e7-e8=Q", "none"
+  char      elapsed[16];            // e.g. "(0:06.123)"
+  char      pretty_move[12];        // e.g. "exd8=Q+", "none"
+} STYLE12;
+
+// A <g1> gameinfo line.
+typedef struct GAMEINFO
+{
+  uint32_t  game_number;
+  char      type[16];               // "blitz", "lightning", ...
+  bool      private;
+  bool      rated;
+  bool      white_registered;
+  bool      black_registered;
+  bool      white_timeseal;
+  bool      black_timeseal;
+  uint32_t  white_initial_time;
+  uint32_t  black_initial_time;
+  uint32_t  white_initial_inc;
+  uint32_t  black_initial_inc;
+  uint32_t  partner_game_number;
+  char      white_rating[8];        // with provshow character, e.g. "1500E"
+  char      black_rating[8];
+  uint32_t  m;                      // undocumented; kept as sent
+  uint32_t  noescape;               // n=, undocumented
+} GAMEINFO;
+
+enum __EVENT_TYPES
+{
+  EV_BOARD      = 1,
+  EV_GAMEINFO   = 2,
+  EV_TEXT       = 3,
+};
+
+typedef struct EVENT
+{
+  uint16_t  type;                   // EV_*
+  uint8_t   session;                // CONFIG.sessions index
+  uint8_t   truncated;              // text did not fit
+  uint32_t  len;                    // bytes of text used, excluding '\0'
+  uint64_t  ns;                     // CLOCK_REALTIME at publication
+  union
+  {
+    STYLE12   board;
+    GAMEINFO  gameinfo;
+    char      text[EV_TEXT_MAX];
+  };
+} EVENT;
+
+// Headless mode (-H binary) writes each event as a native-endian
+// uint32_t length followed by the first event_size() bytes of the EVENT.
+size_t event_size(const EVENT *);
+
+/*
+ * Single-writer, multi-reader ring in POSIX shared memory.
+ *
+ * The writer never waits for readers: it claims the next slot, fills in
+ * the EVENT in place and publishes it.  Each slot carries a sequence
+ * number (a per-slot seqlock), so a reader that falls more than a ring
+ * behind, or whose slot is overwritten while copying, notices and
+ * counts the events it lost instead of returning garbage.
+ */
+
+#define RING_MAGIC      0x76696368  // "vich"
+#define RING_VERSION    1
+#define RING_SLOTS      4096        // must be a power of 2
+
+typedef struct RING_SLOT
+{
+  _Atomic uint64_t  seq;            // event number + 1, or 0 while written
+  EVENT             ev;
+} RING_SLOT;
+
+typedef struct RING
+{
+  uint32_t          magic;
+  uint32_t          version;
+  uint32_t          n_slots;
+  uint32_t          slot_size;
+  _Atomic uint64_t  head;           // number of events published
+  RING_SLOT         slots[];
+} RING;
+
+typedef struct RING_READER
+{
+  RING      *ring;
+  size_t    size;
+  uint64_t  cursor;                 // next event number to read
+  uint64_t  lost;                   // events overwritten before read
+} RING_READER;
+
+// writer
+RING *ring_create(const char *, uint32_t);
+EVENT *ring_claim(RING *);
+void ring_publish(RING *);
+void ring_destroy(RING *, const char *);
+
+// readers
+RING_READER *ring_open(const char *);
+int ring_next(RING_READER *, EVENT *);
+void ring_close(RING_READER *);
+
+#endif
@@ -35,10 +35,8 @@ char *type_to_sym(char *type)
     case 'b': return BLITZ;
     case 's': return STANDARD;
     case 'u': return UNTIMED;
-    default: break;
+    default: return ""; // crazyhouse, wild, ...: no symbol
   }
-  error("type to symbol mapping failed");
-  return 0;
 }
 
 char *status_to_str(int status)
@@ -59,11 +57,18 @@ char *status_to_str(int status)
 
 
 /// Style 12
-//
-//
-// n.b. strdup()s must be free()d !
+
+// Replace one of the update's strings, freeing the last board's.
+static void set_string(char **field, const char *value)
+{
+  mem_free(*field);
+  *field = value != NULL ? mem_strdup(MEM_PARSER, value) : NULL;
+}
+
+// n.b. the strings are the update's: mem_free() them with it
 void parse_s12_string(const char line[MAX_LINE_SIZE], UPDATE *u)
 {
+  uint64_t trace = trace_begin();
   /* begin parsing */
 
   char          *cp         = strdupa(line);
@@ -91,6 +96,7 @@ void parse_s12_string(const char line[MAX_LINE_SIZE], UPDATE *u)
     row = strtok(NULL, delim);
     for (int j=0; j < strlen(row); j++)
       board[i][j] = char_to_piece(row[j]);
+    memcpy(u->s12.board[i], row, N_COLS);
   }
   //
   //  - color whose turn it is to move ("B" or "W")
@@ -170,15 +176,32 @@ void parse_s12_string(const char line[MAX_LINE_SIZE], UPDATE *u)
 
   //Style12Update *update = malloc(sizeof(*update)); if (update == NULL) { error("parse s12 'lloc"); }
 
+  // the plain copy, in the server's orientation (board was filled in above)
+  u->s12.game_number          = game_number;
+  u->s12.turn                 = turn;
+  u->s12.double_push          = double_push;
+  u->s12.white_castle_short   = white_can_castle_short;
+  u->s12.white_castle_long    = white_can_castle_long;
+  u->s12.black_castle_short   = black_can_castle_short;
+  u->s12.black_castle_long    = black_can_castle_long;
+  u->s12.irreversible         = moves_since_irreversible_move;
+  u->s12.relation             = my_status;
+  u->s12.flip                 = board_orientation;
+  u->s12.match_minutes        = match_minutes;
+  u->s12.match_increment      = match_increment;
+  u->s12.white_strength       = white_strength;
+  u->s12.black_strength       = black_strength;
+  u->s12.white_ms             = white_seconds;
+  u->s12.black_ms             = black_seconds;
+  u->s12.move_number          = move_number;
+  snprintf(u->s12.white,        sizeof u->s12.white,        "%s", whites_nick);
+  snprintf(u->s12.black,        sizeof u->s12.black,        "%s", blacks_nick);
+  snprintf(u->s12.verbose_move, sizeof u->s12.verbose_move, "%s", verbose_notation);
+  snprintf(u->s12.elapsed,      sizeof u->s12.elapsed,      "%s", elapsed_previous_move);
+  snprintf(u->s12.pretty_move,  sizeof u->s12.pretty_move,  "%s", pretty_notation);
+
   // suppress compiler warnings for unused tokens
-  UNUSED( pretty_notation   );
-  UNUSED( verbose_notation  );
-  UNUSED( game_number       );
-  UNUSED( moves_since_irreversible_move );
   UNUSED( marker );
-  UNUSED( double_push );
-  UNUSED( elapsed_previous_move );
-  UNUSED( move_number );
 
   // 
   // Convert absolute player positioning (white/black) to relative
@@ -212,8 +235,8 @@ void parse_s12_string(const char line[MAX_LINE_SIZE], UPDATE *u)
       for (int j=0; j<N_ROWS; j++) for (int i=0; i<N_ROWS/2; i++) swap(&board[i][j], &board[N_ROWS-i-1][j]);
 
       //
-      u->my_nick                = strdup(blacks_nick);
-      u->opp_nick               = strdup(whites_nick);
+      set_string(&u->my_nick, blacks_nick);
+      set_string(&u->opp_nick, whites_nick);
       u->my_color               = BLACK;
       u->my_turn                = (turn == 'B');
       u->i_can_castle_long      = black_can_castle_long;
@@ -224,15 +247,15 @@ void parse_s12_string(const char line[MAX_LINE_SIZE], UPDATE *u)
       u->opp_strength           = white_strength;
       u->my_ms                  = black_seconds;
       u->opp_ms                 = white_seconds;
-      u->my_rating              = strdup(u->black_rating);
-      u->opp_rating             = strdup(u->white_rating);
+      set_string(&u->my_rating, u->black_rating);
+      set_string(&u->opp_rating, u->white_rating);
       break;
 
     case PLAYING_AS_WHITE:
       
       //
-      u->my_nick                = strdup(whites_nick);
-      u->opp_nick               = strdup(blacks_nick);
+      set_string(&u->my_nick, whites_nick);
+      set_string(&u->opp_nick, blacks_nick);
       u->my_color               = WHITE;
       u->my_turn                = (turn == 'W');
       u->i_can_castle_long      = white_can_castle_long;
@@ -243,8 +266,8 @@ void parse_s12_string(const char line[MAX_LINE_SIZE], UPDATE *u)
       u->opp_strength           = black_strength;
       u->my_ms                  = white_seconds;
       u->opp_ms                 = black_seconds;
-      u->my_rating              = strdup(u->white_rating);
-      u->opp_rating             = strdup(u->black_rating);
+      set_string(&u->my_rating, u->white_rating);
+      set_string(&u->opp_rating, u->black_rating);
       break;
       
     default:
@@ -253,212 +276,260 @@ void parse_s12_string(const char line[MAX_LINE_SIZE], UPDATE *u)
 
   // Set fields that do not depend on board orientation
   //
-  u->text              = strdup(line);
+  set_string(&u->text, line);
   u->my_status         = my_status;
-  u->my_status_str     = strdup(status_to_str( my_status ));
+  set_string(&u->my_status_str, status_to_str( my_status ));
   u->match_minutes     = match_minutes;
   u->match_increment   = match_increment;
   memcpy(u->board, board, sizeof board);
 
   /* end assignment */
+  trace_end(TR_PARSE_S12, trace);
 
   //return update;
 }
 
+// Half-moves played before this board: 0 for the initial position
+int style12_ply(const STYLE12 *b)
+{
+  return ( b->move_number - 1 ) * 2 + ( b->turn == 'B' );
+}
+
+// The game number of a Style12 line, without parsing the rest: it is
+// the 16th field
+unsigned int style12_game(const char *line)
+{
+  const char *p = line;
+  for (int field = 0; field < 16 && p != NULL; field++) p = strchr(p + 1, ' ');
+  return p != NULL ? atoi(p) : 0;
+}
+
+
+/// Holdings
+
+// Crazyhouse and bughouse holdings, sent after a board with a drop or a
+// capture:
+//
+//  "<b1> game 77 white [PNB] black [QP]"
+//  "<b1> game 77 white [PNB] black [QPP] <- BP"
+//
+// Counts go to holdings[side][piece], side 0 for white and 1 for
+// black, piece in HOLDING_PIECES order.  Returns the game number, or 0 if the line
+// is not a holdings line.
+unsigned int parse_holdings(const char *line, unsigned char holdings[2][N_HOLDINGS])
+{
+  unsigned int game;
+  char white[64], black[64];
+  if ( sscanf(line, HOLDINGS_MARKER " game %u white [%63[A-Za-z]] black [%63[A-Za-z]]", &game, white, black) != 3 )
+  {
+    // either side may hold nothing: "[]" does not scan as %[
+    *white = *black = '\0';
+    if ( sscanf(line, HOLDINGS_MARKER " game %u white [%63[A-Za-z]] black []", &game, white) != 2
+        && sscanf(line, HOLDINGS_MARKER " game %u white [] black [%63[A-Za-z]]", &game, black) != 2
+        && sscanf(line, HOLDINGS_MARKER " game %u white [] black []", &game) != 1 )
+      return 0;
+  }
+  memset(holdings, 0, 2 * N_HOLDINGS);
+  for (const char *p = white; *p != '\0'; p++)
+    if ( strchr(HOLDING_PIECES, toupper(*p)) ) holdings[0][strchr(HOLDING_PIECES, toupper(*p)) - HOLDING_PIECES]++;
+  for (const char *p = black; *p != '\0'; p++)
+    if ( strchr(HOLDING_PIECES, toupper(*p)) ) holdings[1][strchr(HOLDING_PIECES, toupper(*p)) - HOLDING_PIECES]++;
+  return game;
+}
+
 
 /// Gameinfo
 
-void parse_gameinfo_string(const char line[MAX_LINE_SIZE], UPDATE *u)
+//  Gameinfo messaging specification,
+//  http://www.freechess.org/Help/HelpFiles/iv_gameinfo.html
+//
+//  "<g1> 77 p=0 t=lightning r=1 u=0,0 it=60,0 i=60,0 pt=0 rt=1880,1789 ts=1,1 m=2 n=1"
+//
+//  The game number, then key=value fields: one value, or white's and
+//  black's separated by a comma.  "Note any new fields will be appended
+//  to the end so the interface must be able to handle this."  So the
+//  fields are looked up by key in G1_FIELDS, in whatever order they
+//  come, and a key not in the table is skipped.
+
+enum __G1_KINDS
 {
-  /* begin parsing */
-  char *cp                  = strdupa(line);
-  //  
-  //  Gameinfo messaging specification, 
-  //  http://www.freechess.org/Help/HelpFiles/iv_gameinfo.html
-  //
-  //  Note:  some of this is redundant with the Style12 message (see
-  //  below); however, rating and timeseal are not in S12, and that is
-  //  interesting.
-  //
-  //  Example message:
-  //
-  //  "<g1> 77 p=0 t=lightning r=1 u=0,0 it=60,0 i=60,0 pt=0 rt=1880,1789 ts=1,1 m=2 n=1"
-  //
-  //  Thus, 3 delimiters are necessary:
-  //
-  const char *_delim    = " ";
-  const char *__delim   = "=";
-  const char *___delim  = ",";
-  // and 3 (end) token placeholders
-  char *_, *__, *___, *_end, *__end, *___end;
-  //
-  //  Setting ivariable gameinfo provides the interface with extra
-  //  notifications when the start starts a game or simul or a game is
-  //  observed. 
-  //  
-  //    "Note any new fields will be appended to the end so the
-  //    interface must be able to handle this."
-  //
-  //  - <g1>  the string to identify a gameinfo line
-  // 
-  char *marker                      = strtok_r(cp,          _delim,     &_end);
-  //
-  // game_number
-  unsigned int game_number          = atoi(strtok_r(NULL,   _delim,         &_end));
-  //
-  //
-  // p=private(1/0)
-  _                                 = strtok_r(NULL,        _delim,         &_end);     // e.g., "a=b"
-  __                                = strtok_r(_,           __delim,        &__end);    // discard "p="
-  bool private                      = atoi(strtok_r(NULL,   __delim,        &__end));
-  //
-  // t=type : one of {lightning, blitz, standard ... ?}
-  _                                 = strtok_r(NULL,        _delim,         &_end);     
-  __                                = strtok_r(_,           __delim,        &__end);    // discard "t="
-  char * type                       = strtok_r(NULL,        __delim,        &__end);
-  //
-  // whether game is rated or unrated
-  // r=rated(1/0)
-  _                                 = strtok_r(NULL,        _delim,         &_end);     
-  __                                = strtok_r(_,           __delim,        &__end);    // discard "r="
-  bool rated                        = atoi(strtok_r(NULL,   __delim,        &__end));
-  //
-  // u=white_registered(1/0),black_registered(1/0) 
-  _                                 = strtok_r(NULL,        _delim,         &_end);     
-  __                                = strtok_r(_,           __delim,        &__end);    // discard "u="
-  ___                               = strtok_r(NULL,        __delim,        &__end);    // "m,n"
-  bool white_registered             = atoi(strtok_r(___,    ___delim,       &___end));  // m
-  bool black_registered             = atoi(strtok_r(NULL,   ___delim,       &___end));  // n
-  //
-  // it=initial_white_time,initial_black_time
-  _                                 = strtok_r(NULL,        _delim,         &_end);      
-  __                                = strtok_r(_,           __delim,        &__end);    // discard "it="
-  ___                               = strtok_r(NULL,        __delim,        &__end);    // "m,n"
-  unsigned int white_initial_time   = atoi(strtok_r(___,    ___delim,       &___end));
-  unsigned int black_initial_time   = atoi(strtok_r(NULL,   ___delim,       &___end));
-  //
-  // 
-  // i=initial_white_inc, initial_black_inc
-  _                                 = strtok_r(NULL,        _delim,         &_end);      
-  __                                = strtok_r(_,           __delim,        &__end);    // discard "i="
-  ___                               = strtok_r(NULL,        __delim,        &__end);
-  unsigned white_increment          = atoi(strtok_r(___,    ___delim,       &___end));
-  unsigned black_increment          = atoi(strtok_r(NULL,   ___delim,       &___end));
-  //
-  // pt=partner's_game_number(or 0 if none)
-  _                                 = strtok_r(NULL,        _delim,         &_end);      
-  __                                = strtok_r(_,           __delim,        &__end);    // discard "pt="
-  unsigned int partner_game_number  = atoi(strtok_r(NULL,   __delim,        &__end));
-  //
-  // rt=white_rating(+ provshow character),black_rating(+ provshow chara    cter)
-  _                                 = strtok_r(NULL,        _delim,         &_end);      
-  __                                = strtok_r(_,           __delim,        &__end);    // discard "rt="
-  ___                               = strtok_r(NULL,        __delim,        &__end);
-  char * white_rating               = strtok_r(___,         ___delim,       &___end);
-  char * black_rating               = strtok_r(NULL,        ___delim,       &___end);
-  //
-  // ts=white_uses_timeseal(0/1),black_uses_timeseal(0/1)
-  _                                 = strtok_r(NULL,        _delim,         &_end);      
-  __                                = strtok_r(_,           __delim,        &__end);    // discard "ts="
-  ___                               = strtok_r(NULL,        __delim,        &__end);
-  bool white_timeseal               = atoi(strtok_r(___,    ___delim,       &___end));
-  bool black_timeseal               = atoi(strtok_r(NULL,   ___delim,       &___end));
+  G1_NUMBER,                    // "pt=12"
+  G1_NUMBERS,                   // "it=180,60": white's, black's
+  G1_FLAG,                      // "r=1"
+  G1_FLAGS,                     // "u=1,0"
+  G1_STRING,                    // "t=blitz"
+  G1_STRINGS                    // "rt=1880,1789E"
+};
 
-  /* end parsing */
+typedef struct G1_FIELD
+{
+  uint32_t key;                 // G1_KEY()
+  uint8_t kind;                 // G1_*
+  uint8_t size;                 // of a string
+  uint16_t white, black;        // offsets into GAMEINFO; white's is the one value
+} G1_FIELD;
 
-  /* begin assignment */
+// a key of up to three characters, as one word
+#define G1_KEY(a, b, c) ( (uint32_t) (a) | (uint32_t) (b) << 8 | (uint32_t) (c) << 16 )
+#define G1_AT(f)        offsetof(GAMEINFO, f)
+#define G1_SIZE(f)      sizeof ((GAMEINFO *) 0)->f
 
-  //                            mark unused to suppress compiler warnings
-  UNUSED( _                     );
-  UNUSED( __                    );
-  UNUSED( ___                   );
-  UNUSED( marker                );
-  UNUSED( private               );
-  UNUSED( black_increment       );
-  UNUSED( white_increment       );
-  UNUSED( black_registered      );
-  UNUSED( white_registered      );
-  UNUSED( black_initial_time    );
-  UNUSED( white_initial_time    );
-  UNUSED( partner_game_number   );
-  
-  u->text                       = strdup(line);
-  u->type                       = strdup( type );
-  u->type_sym                   = type_to_sym ( type );
-  u->rated                      = rated;
-  u->game_number                = game_number;
-  u->white_rating               = strdup( white_rating );
-  u->black_rating               = strdup( black_rating );
-  u->white_timeseal             = white_timeseal;
-  u->black_timeseal             = black_timeseal;
+static const G1_FIELD G1_FIELDS[] =
+{
+  { G1_KEY('p', 0, 0),   G1_FLAG,    0,                     G1_AT(private),             0 },
+  { G1_KEY('t', 0, 0),   G1_STRING,  G1_SIZE(type),         G1_AT(type),                0 },
+  { G1_KEY('r', 0, 0),   G1_FLAG,    0,                     G1_AT(rated),               0 },
+  { G1_KEY('u', 0, 0),   G1_FLAGS,   0,                     G1_AT(white_registered),    G1_AT(black_registered) },
+  { G1_KEY('i', 't', 0), G1_NUMBERS, 0,                     G1_AT(white_initial_time),  G1_AT(black_initial_time) },
+  { G1_KEY('i', 0, 0),   G1_NUMBERS, 0,                     G1_AT(white_initial_inc),   G1_AT(black_initial_inc) },
+  { G1_KEY('p', 't', 0), G1_NUMBER,  0,                     G1_AT(partner_game_number), 0 },
+  { G1_KEY('r', 't', 0), G1_STRINGS, G1_SIZE(white_rating), G1_AT(white_rating),        G1_AT(black_rating) },
+  { G1_KEY('t', 's', 0), G1_FLAGS,   0,                     G1_AT(white_timeseal),      G1_AT(black_timeseal) },
+  { G1_KEY('m', 0, 0),   G1_NUMBER,  0,                     G1_AT(m),                   0 },
+  { G1_KEY('n', 0, 0),   G1_NUMBER,  0,                     G1_AT(noescape),            0 },
+};
 
-  /* end assignment */
+static inline bool g1_space(char ch)
+{
+  return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t';
+}
 
-  //return gi;
+static uint32_t g1_number(const char *p, const char *end)
+{
+  uint32_t n = 0;
+  for ( ; p < end && *p >= '0' && *p <= '9'; p++) n = n * 10 + ( *p - '0' );
+  return n;
+}
+
+// One value of 'f', [p, end), into the GAMEINFO field at 'at'.
+static void g1_store(const G1_FIELD *f, char *at, const char *p, const char *end)
+{
+  switch ( f->kind )
+  {
+    case G1_NUMBER: case G1_NUMBERS:
+      *(uint32_t *) at = g1_number(p, end);
+      break;
+    case G1_FLAG: case G1_FLAGS:
+      *(bool *) at = g1_number(p, end) != 0;
+      break;
+    case G1_STRING: case G1_STRINGS:
+    {
+      size_t len = end - p < f->size - 1 ? (size_t) ( end - p ) : (size_t) f->size - 1;
+      memcpy(at, p, len);
+      at[len] = '\0';
+      break;
+    }
+  }
+}
+
+// Parse a <g1> line into 'g', without allocating.  Fields missing from
+// the line are zero.  Returns false if it is not a gameinfo line.
+bool parse_gameinfo(const char *line, GAMEINFO *g)
+{
+  if ( strncmp(line, GAMEINFO_MARKER, sizeof GAMEINFO_MARKER - 1) != 0 ) return false;
+  const char *p = line + sizeof GAMEINFO_MARKER - 1;
+  while ( g1_space(*p) ) p++;
+  if ( *p < '0' || *p > '9' ) return false;
+
+  memset(g, 0, sizeof *g);
+  while ( *p >= '0' && *p <= '9' ) g->game_number = g->game_number * 10 + ( *p++ - '0' );
+
+  while ( *p != '\0' )
+  {
+    while ( g1_space(*p) ) p++;
+    // the key, packed as it is read
+    uint32_t key = 0;
+    int len = 0;
+    for ( ; *p != '\0' && *p != '=' && ! g1_space(*p); p++, len++) if ( len < 3 ) key |= (uint32_t) (unsigned char) *p << ( 8 * len );
+    const char *value = p + 1;
+    while ( *p != '\0' && ! g1_space(*p) ) p++;
+    if ( value > p || len > 3 ) continue;
+
+    const G1_FIELD *f = NULL;
+    for (int i = 0; i < LEN(G1_FIELDS); i++) if ( G1_FIELDS[i].key == key ) { f = &G1_FIELDS[i]; break; }
+    if ( f == NULL ) continue; // a field added since
+
+    const char *comma = memchr(value, ',', p - value);
+    bool pair = f->kind == G1_NUMBERS || f->kind == G1_FLAGS || f->kind == G1_STRINGS;
+    g1_store(f, (char *) g + f->white, value, pair && comma != NULL ? comma : p);
+    if ( pair && comma != NULL ) g1_store(f, (char *) g + f->black, comma + 1, p);
+  }
+  return true;
+}
+
+// Parse a <g1> line into the update's GAMEINFO; the UPDATE's own
+// gameinfo fields point into it.
+void parse_gameinfo_string(const char *line, UPDATE *u)
+{
+  uint64_t trace = trace_begin();
+  if ( ! parse_gameinfo(line, &u->g1) ) { trace_end(TR_PARSE_GAMEINFO, trace); return; }
+
+  u->type                       = u->g1.type;
+  u->type_sym                   = type_to_sym(u->g1.type);
+  u->rated                      = u->g1.rated;
+  u->game_number                = u->g1.game_number;
+  u->white_rating               = u->g1.white_rating;
+  u->black_rating               = u->g1.black_rating;
+  u->white_timeseal             = u->g1.white_timeseal;
+  u->black_timeseal             = u->g1.black_timeseal;
+  trace_end(TR_PARSE_GAMEINFO, trace);
+}
+
+
+/// Events
+
+// Fill in an event (see events.h) for a message.  'type' is EV_*;
+// boards and gameinfo are taken from the UPDATE they were just parsed
+// into, text from 'line'.
+void make_event(EVENT *e, int session, int type, UPDATE *u, const char *line)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  e->type       = type;
+  e->session    = session;
+  e->truncated  = 0;
+  e->len        = 0;
+  e->ns         = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+  switch ( type )
+  {
+    case EV_BOARD:      e->board    = u->s12; break;
+    case EV_GAMEINFO:   e->gameinfo = u->g1;  break;
+    case EV_TEXT:
+    {
+      // drop the line terminators: "\n" once framed, "\n\r" as sent
+      while ( *line == '\n' ) line++;
+      size_t len = strlen(line);
+      while ( len > 0 && ( line[len-1] == '\r' || line[len-1] == '\n' ) ) len--;
+      if ( len >= EV_TEXT_MAX ) { len = EV_TEXT_MAX - 1; e->truncated = 1; }
+      memcpy(e->text, line, len);
+      e->text[len] = '\0';
+      e->len = len;
+      break;
+    }
+  }
+}
+
+// Publish a message to local viewers, built straight into the ring
+// slot.
+void publish_event(CONFIG *c, int session, int type, UPDATE *u, const char *line)
+{
+  if ( c->ring == NULL ) return;
+  make_event(ring_claim(c->ring), session, type, u, line);
+  ring_publish(c->ring);
 }
 
 
 /// Logging
 
-void print_g1(UPDATE *update)
+// Every field, as one binary record; the log's decoder formats them.
+void print_g1(int session, const UPDATE *update)
 {
-  debug("\
-          text: %s\n \
-          game_number: %i\n \
-          type: %s\n \
-          rated: %i\n \
-          white_rating: %s \n \
-          black_rating: %s \n \
-          white_timeseal: %i \n \
-          black_timeseal: %i \n",
-          update->text,
-          update->game_number,
-          update->type,
-          update->rated,
-          update->white_rating,
-          update->black_rating,
-          update->white_timeseal,
-          update->black_timeseal
-  );
+  log_g1(LOG_DEBUG, LOGC_PARSE, session, &update->g1);
 }
 
-void print_s12(UPDATE *update)
+void print_s12(int session, const UPDATE *update)
 {
-  debug("\
-          text: %s\n \
-          my_turn: %i\n \
-          i_can_castle_short: %i\n \
-          i_can_castle_long: %i\n \
-          opp_can_castle_short: %i\n \
-          opp_can_castle_long: %i\n \
-          my_nick: %s\n \
-          opp_nick: %s\n \
-          my_status: %i\n \
-          match_minutes: %i\n \
-          match_increment: %i\n \
-          my_strength: %i\n \
-          opp_strength: %i\n \
-          my_seconds: %i\n \
-          opp_seconds: %i\n",
-          update->text,
-          update->my_turn,
-          update->i_can_castle_short,
-          update->i_can_castle_long,
-          update->opp_can_castle_short,
-          update->opp_can_castle_long,
-          update->my_nick,
-          update->opp_nick,
-          update->my_status,
-          update->match_minutes,
-          update->match_increment,
-          update->my_strength,
-          update->opp_strength,
-          update->my_ms,
-          update->opp_ms
-  );
-  for (int i=0; i<N_COLS; i++)
-    for (int j=0; j<N_ROWS; j++)
-      debug(" %i %i %s ", i, j, update->board[i][j]);
-    debug("\n");
+  log_s12(LOG_DEBUG, LOGC_PARSE, session, &update->s12);
 }
 
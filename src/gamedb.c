@@ -0,0 +1,474 @@
+#include "vichess.h"
+
+// Game database: a PGN file, and an index from position to the games
+// that reached it, built by `vichess -i FILE.pgn` and mapped with -I.
+//
+// The importer maps the PGN, cuts it into chunks at game boundaries
+// and parses the chunks on every cpu.  Each game is replayed for its
+// first GAMEDB_PLIES plies, and each (position key, game) pair is kept;
+// every chunk sorts its own pairs, and the sorted runs are merged into
+// the index file:
+//
+//   header page | fan-out: uint64 first entry for each top 16 bits of key
+//               | keys: uint64, sorted | games: uint32, in key order
+//               | game table: PGN offset and length, by game id
+//
+// A query reads the fan-out, then binary searches one slice of keys.
+
+#define GAMEDB_MAGIC    "VIGAMEDB"
+#define GAMEDB_HEADER   4096
+#define FANOUT          ( 1 << 16 )
+#define CHUNKS_PER_CPU  8
+
+typedef struct GAMEDB_HEADER_PAGE
+{
+  char magic[8];
+  uint64_t start_key;           // Zobrist key of the start position
+  uint64_t n_games;
+  uint64_t n_entries;
+  uint64_t pgn_size;            // the PGN the index was built from
+  char pgn[PATH_MAX];
+} GAMEDB_HEADER_PAGE;
+
+typedef struct GAME_RECORD
+{
+  uint64_t offset;
+  uint32_t length;
+  uint32_t unused;
+} GAME_RECORD;
+
+struct GAMEDB
+{
+  void *map;
+  size_t size;
+  const GAMEDB_HEADER_PAGE *header;
+  const uint64_t *fanout, *keys;
+  const uint32_t *games;
+  const GAME_RECORD *records;
+  const char *pgn;              // the PGN, mapped; NULL if it is gone
+  size_t pgn_size;
+};
+
+static size_t index_size(uint64_t n_games, uint64_t n_entries)
+{
+  size_t size = GAMEDB_HEADER + ( FANOUT + 1 ) * sizeof(uint64_t) + n_entries * sizeof(uint64_t) + n_entries * sizeof(uint32_t);
+  size = ( size + 7 ) & ~(size_t) 7;
+  return size + n_games * sizeof(GAME_RECORD);
+}
+
+
+/// Import
+
+typedef struct PAIR
+{
+  uint64_t key;
+  uint32_t game;                // within the chunk, until the merge
+} PAIR;
+
+typedef struct CHUNK
+{
+  const char *start, *end;
+  GAME_RECORD *games;
+  uint32_t n_games, max_games;
+  PAIR *pairs;
+  uint64_t n_pairs, max_pairs;
+  uint64_t errors;              // games with a move that did not parse
+  uint32_t base;                // id of the chunk's first game
+} CHUNK;
+
+typedef struct IMPORT
+{
+  const char *pgn;
+  CHUNK *chunks;
+  int n_chunks;
+  atomic_int next;
+} IMPORT;
+
+static int compare_pairs(const void *a, const void *b)
+{
+  const PAIR *x = a, *y = b;
+  if ( x->key != y->key ) return x->key < y->key ? -1 : 1;
+  return ( x->game > y->game ) - ( x->game < y->game );
+}
+
+static void add_pair(CHUNK *c, uint64_t key)
+{
+  if ( c->n_pairs == c->max_pairs )
+  {
+    c->max_pairs = c->max_pairs ? c->max_pairs * 2 : 4096;
+    if ( (c->pairs = realloc(c->pairs, c->max_pairs * sizeof *c->pairs)) == NULL ) error("gamedb import");
+  }
+  c->pairs[c->n_pairs++] = (PAIR) { .key = key, .game = c->n_games - 1 };
+}
+
+static bool is_result(const char *tok, size_t n)
+{
+  return ( n == 1 && *tok == '*' ) || ( n == 3 && ( ! memcmp(tok, "1-0", 3) || ! memcmp(tok, "0-1", 3) ) )
+      || ( n == 7 && ! memcmp(tok, "1/2-1/2", 7) );
+}
+
+// Parse the games in one chunk.  Movetext is only replayed as far as
+// it is indexed; the rest of a game is scanned for its end.
+static void parse_chunk(const char *base, CHUNK *c)
+{
+  const char *p = c->start, *end = c->end;
+  POSITION pos;
+  bool in_game = false, in_moves = false, failed = false;
+  int ply = 0;
+
+  while ( p < end )
+  {
+    char ch = *p;
+    if ( isspace(ch) ) { p++; continue; }
+
+    if ( ch == '[' && ! in_moves )
+    {
+      if ( ! in_game )
+      {
+        if ( c->n_games == c->max_games )
+        {
+          c->max_games = c->max_games ? c->max_games * 2 : 1024;
+          if ( (c->games = realloc(c->games, c->max_games * sizeof *c->games)) == NULL ) error("gamedb import");
+        }
+        c->games[c->n_games++] = (GAME_RECORD) { .offset = p - base };
+        position_start(&pos);
+        in_game = true; failed = false; ply = 0;
+      }
+      const char *eol = memchr(p, '\n', end - p);
+      if ( eol == NULL ) eol = end;
+      if ( eol - p > 6 && ! memcmp(p, "[FEN \"", 6) )
+      {
+        char fen[FEN_MAX + 8];
+        snprintf(fen, sizeof fen, "%.*s", (int) ( eol - p - 6 ), p + 6);
+        fen[strcspn(fen, "\"")] = '\0';
+        if ( ! position_from_fen(&pos, fen) ) failed = true;
+      }
+      p = eol;
+      continue;
+    }
+    if ( ! in_game ) { p++; continue; } // stray text between games
+
+    in_moves = true;
+    if ( ch == '{' ) { const char *q = memchr(p, '}', end - p); p = q ? q + 1 : end; continue; }
+    if ( ch == ';' || ch == '%' ) { const char *q = memchr(p, '\n', end - p); p = q ? q : end; continue; }
+    if ( ch == '(' )
+    {
+      for (int depth = 0; p < end; p++)
+        if ( *p == '(' ) depth++;
+        else if ( *p == ')' && --depth == 0 ) { p++; break; }
+      continue;
+    }
+
+    const char *tok = p;
+    while ( p < end && ! isspace(*p) && ! strchr("{}();[]", *p) ) p++;
+    size_t n = p - tok;
+    if ( n == 0 ) { p++; continue; }
+
+    if ( is_result(tok, n) )
+    {
+      c->games[c->n_games - 1].length = p - base - c->games[c->n_games - 1].offset;
+      in_game = in_moves = false;
+      continue;
+    }
+    if ( *tok == '$' || failed || ply >= GAMEDB_PLIES ) continue;
+    while ( n > 0 && isdigit(*tok) ) tok++, n--;   // "12." "12..." "12.e4"
+    while ( n > 0 && *tok == '.' ) tok++, n--;
+    if ( n == 0 ) continue;
+
+    char san[16];
+    snprintf(san, sizeof san, "%.*s", (int) n, tok);
+    MOVE m = parse_move(&pos, san);
+    UNDO undo;
+    if ( m == MOVE_NONE ) { failed = true; c->errors++; continue; }
+    make_move(&pos, m, &undo);
+    ply++;
+    add_pair(c, pos.hash);
+  }
+  if ( in_game ) c->games[c->n_games - 1].length = end - base - c->games[c->n_games - 1].offset;
+
+  // sort, and drop repeats of a position within a game
+  qsort(c->pairs, c->n_pairs, sizeof *c->pairs, compare_pairs);
+  uint64_t n = 0;
+  for (uint64_t i = 0; i < c->n_pairs; i++)
+    if ( n == 0 || c->pairs[i].key != c->pairs[n-1].key || c->pairs[i].game != c->pairs[n-1].game )
+      c->pairs[n++] = c->pairs[i];
+  c->n_pairs = n;
+}
+
+static void *t_import(void *arg)
+{
+  IMPORT *im = (IMPORT *) arg;
+  for (int i; (i = atomic_fetch_add(&im->next, 1)) < im->n_chunks; )
+    parse_chunk(im->pgn, &im->chunks[i]);
+  return NULL;
+}
+
+// a min-heap of chunk indices, by their next pair
+typedef struct HEAP { int *items, n; CHUNK *chunks; uint64_t *at; } HEAP;
+
+static bool heap_less(HEAP *h, int a, int b)
+{
+  const PAIR *x = &h->chunks[a].pairs[h->at[a]], *y = &h->chunks[b].pairs[h->at[b]];
+  if ( x->key != y->key ) return x->key < y->key;
+  return h->chunks[a].base + x->game < h->chunks[b].base + y->game;
+}
+
+static void heap_down(HEAP *h, int i)
+{
+  for (;;)
+  {
+    int l = 2 * i + 1, r = l + 1, min = i;
+    if ( l < h->n && heap_less(h, h->items[l], h->items[min]) ) min = l;
+    if ( r < h->n && heap_less(h, h->items[r], h->items[min]) ) min = r;
+    if ( min == i ) return;
+    int t = h->items[i]; h->items[i] = h->items[min]; h->items[min] = t;
+    i = min;
+  }
+}
+
+// Build the index at 'index' for the PGN file at 'pgn' with 'threads'
+// threads.  Returns false, with errno set, on failure.
+bool gamedb_import(const char *pgn, const char *index, int threads, IMPORT_STATS *stats)
+{
+  uint64_t start = now_ns();
+  position_init();
+
+  int fd = open(pgn, O_RDONLY | O_CLOEXEC);
+  if ( fd == -1 ) return false;
+  struct stat st;
+  if ( fstat(fd, &st) == -1 ) { close(fd); return false; }
+  if ( st.st_size == 0 ) { close(fd); errno = EINVAL; return false; }
+  const char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if ( map == MAP_FAILED ) return false;
+  madvise((void *) map, st.st_size, MADV_SEQUENTIAL);
+
+  // chunks start at "[Event " on a line of its own, or the file start
+  IMPORT im = { .pgn = map, .n_chunks = threads * CHUNKS_PER_CPU };
+  if ( (im.chunks = calloc(im.n_chunks, sizeof *im.chunks)) == NULL ) error("gamedb import");
+  const char *from = map, *end = map + st.st_size;
+  int n = 0;
+  for (int i = 1; i <= im.n_chunks && from < end; i++)
+  {
+    const char *to = end;
+    if ( i < im.n_chunks )
+    {
+      to = map + (size_t) st.st_size / im.n_chunks * i;
+      if ( to < from ) to = from;
+      to = memmem(to, end - to, "\n[Event ", 8);
+      to = to ? to + 1 : end;
+    }
+    if ( to > from ) im.chunks[n++] = (CHUNK) { .start = from, .end = to };
+    from = to;
+  }
+  im.n_chunks = n;
+
+  pthread_t tid[threads];
+  for (int i = 0; i < threads; i++) pthread_create(&tid[i], NULL, t_import, &im);
+  for (int i = 0; i < threads; i++) pthread_join(tid[i], NULL);
+
+  uint64_t n_games = 0, n_entries = 0, errors = 0;
+  for (int i = 0; i < im.n_chunks; i++)
+  {
+    im.chunks[i].base = n_games;
+    n_games   += im.chunks[i].n_games;
+    n_entries += im.chunks[i].n_pairs;
+    errors    += im.chunks[i].errors;
+  }
+
+  // write the index through a shared mapping of the new file
+  bool ok = false;
+  size_t size = index_size(n_games, n_entries);
+  char *out = MAP_FAILED;
+  if ( (fd = open(index, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) != -1 && ftruncate(fd, size) == 0 )
+    out = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if ( fd != -1 ) close(fd);
+  if ( out != MAP_FAILED )
+  {
+    GAMEDB_HEADER_PAGE *h = (GAMEDB_HEADER_PAGE *) out;
+    POSITION startpos;
+    position_start(&startpos);
+    memcpy(h->magic, GAMEDB_MAGIC, 8);
+    h->start_key = startpos.hash;
+    h->n_games   = n_games;
+    h->n_entries = n_entries;
+    h->pgn_size  = st.st_size;
+    if ( realpath(pgn, h->pgn) == NULL ) snprintf(h->pgn, sizeof h->pgn, "%s", pgn);
+
+    uint64_t *fanout  = (uint64_t *) ( out + GAMEDB_HEADER );
+    uint64_t *keys    = fanout + FANOUT + 1;
+    uint32_t *games   = (uint32_t *) ( keys + n_entries );
+    GAME_RECORD *records = (GAME_RECORD *) ( out + size - n_games * sizeof(GAME_RECORD) );
+
+    for (int i = 0; i < im.n_chunks; i++)
+      memcpy(records + im.chunks[i].base, im.chunks[i].games, im.chunks[i].n_games * sizeof *records);
+
+    // k-way merge of the sorted chunks
+    uint64_t at[im.n_chunks];
+    int items[im.n_chunks];
+    HEAP heap = { .items = items, .chunks = im.chunks, .at = at };
+    for (int i = 0; i < im.n_chunks; i++) { at[i] = 0; if ( im.chunks[i].n_pairs > 0 ) items[heap.n++] = i; }
+    for (int i = heap.n / 2 - 1; i >= 0; i--) heap_down(&heap, i);
+    uint64_t k = 0;
+    int bucket = 0;
+    while ( heap.n > 0 )
+    {
+      CHUNK *c = &im.chunks[items[0]];
+      PAIR *pair = &c->pairs[at[items[0]]];
+      while ( bucket <= (int) ( pair->key >> 48 ) ) fanout[bucket++] = k;
+      keys[k]  = pair->key;
+      games[k] = c->base + pair->game;
+      k++;
+      if ( ++at[items[0]] == c->n_pairs ) items[0] = items[--heap.n];
+      heap_down(&heap, 0);
+    }
+    while ( bucket <= FANOUT ) fanout[bucket++] = k;
+
+    ok = msync(out, size, MS_SYNC) == 0;
+    munmap(out, size);
+  }
+
+  for (int i = 0; i < im.n_chunks; i++) { free(im.chunks[i].games); free(im.chunks[i].pairs); }
+  free(im.chunks);
+  munmap((void *) map, st.st_size);
+
+  stats->bytes     = st.st_size;
+  stats->games     = n_games;
+  stats->positions = n_entries;
+  stats->errors    = errors;
+  stats->ns        = now_ns() - start;
+  return ok;
+}
+
+
+/// Queries
+
+// Map the index at 'path', and the PGN it was built from if it is still
+// there.  Returns NULL, with errno set, on failure.
+GAMEDB *gamedb_open(const char *path)
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if ( fd == -1 ) return NULL;
+  struct stat st;
+  if ( fstat(fd, &st) == -1 || st.st_size < GAMEDB_HEADER ) { close(fd); errno = EINVAL; return NULL; }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if ( map == MAP_FAILED ) return NULL;
+
+  position_init();
+  POSITION start;
+  position_start(&start);
+  const GAMEDB_HEADER_PAGE *h = map;
+  if ( memcmp(h->magic, GAMEDB_MAGIC, 8) != 0 || h->start_key != start.hash
+      || (size_t) st.st_size != index_size(h->n_games, h->n_entries) )
+  {
+    munmap(map, st.st_size);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  GAMEDB *db = calloc(1, sizeof *db);
+  if ( db == NULL ) error("gamedb_open");
+  db->map     = map;
+  db->size    = st.st_size;
+  db->header  = h;
+  db->fanout  = (const uint64_t *) ( (const char *) map + GAMEDB_HEADER );
+  db->keys    = db->fanout + FANOUT + 1;
+  db->games   = (const uint32_t *) ( db->keys + h->n_entries );
+  db->records = (const GAME_RECORD *) ( (const char *) map + st.st_size - h->n_games * sizeof(GAME_RECORD) );
+
+  // the PGN, for showing games; an index without it still counts them
+  if ( (fd = open(h->pgn, O_RDONLY | O_CLOEXEC)) != -1 )
+  {
+    if ( fstat(fd, &st) == 0 && (uint64_t) st.st_size == h->pgn_size )
+    {
+      void *pgn = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if ( pgn != MAP_FAILED ) { db->pgn = pgn; db->pgn_size = st.st_size; }
+    }
+    close(fd);
+  }
+  return db;
+}
+
+void gamedb_close(GAMEDB *db)
+{
+  if ( db->pgn != NULL ) munmap((void *) db->pgn, db->pgn_size);
+  munmap(db->map, db->size);
+  free(db);
+}
+
+// The games that reached the position with key 'key': returns how
+// many, and stores the first 'max' of their ids in 'games'.
+size_t gamedb_query(const GAMEDB *db, uint64_t key, uint32_t *games, size_t max)
+{
+  uint64_t lo = db->fanout[key >> 48], hi = db->fanout[( key >> 48 ) + 1];
+  while ( lo < hi )
+  {
+    uint64_t mid = lo + ( hi - lo ) / 2;
+    if ( db->keys[mid] < key ) lo = mid + 1; else hi = mid;
+  }
+  size_t n = 0;
+  for (uint64_t i = lo; i < db->header->n_entries && db->keys[i] == key; i++, n++)
+    if ( n < max ) games[n] = db->games[i];
+  return n;
+}
+
+static void tag_value(const char *p, const char *end, const char *name, char *out, size_t n)
+{
+  char prefix[32];
+  int len = snprintf(prefix, sizeof prefix, "[%s \"", name);
+  *out = '\0';
+  for ( ; p < end && *p == '['; p++)
+  {
+    const char *eol = memchr(p, '\n', end - p);
+    if ( eol == NULL ) eol = end;
+    if ( eol - p > len && ! memcmp(p, prefix, len) )
+    {
+      const char *q = memchr(p + len, '"', eol - p - len);
+      snprintf(out, n, "%.*s", (int) ( ( q ? q : eol ) - p - len ), p + len);
+      return;
+    }
+    p = eol;
+    while ( p + 1 < end && isspace(p[1]) ) p++;
+  }
+}
+
+// One line about game 'game': "Newton (1880) - Einstein (1789) 1-0 2019.01.02"
+void gamedb_describe(const GAMEDB *db, uint32_t game, char *out, size_t n)
+{
+  const GAME_RECORD *r = &db->records[game];
+  if ( db->pgn == NULL || r->offset + r->length > db->pgn_size ) { snprintf(out, n, "game %u", game + 1); return; }
+  const char *p = db->pgn + r->offset, *end = p + r->length;
+  char white[64], black[64], white_elo[8], black_elo[8], result[8], date[16];
+  tag_value(p, end, "White", white, sizeof white);
+  tag_value(p, end, "Black", black, sizeof black);
+  tag_value(p, end, "WhiteElo", white_elo, sizeof white_elo);
+  tag_value(p, end, "BlackElo", black_elo, sizeof black_elo);
+  tag_value(p, end, "Result", result, sizeof result);
+  tag_value(p, end, "Date", date, sizeof date);
+  snprintf(out, n, "%s (%s) - %s (%s) %s %s", white, *white_elo ? white_elo : "-", black,
+      *black_elo ? black_elo : "-", result, date);
+}
+
+// :games -- the games that reached the active session's board
+void gamedb_status(CONFIG *c)
+{
+  if ( c->gamedb == NULL ) { send_message(c->ib_mq, c->active, MSG_NOTICE, "no game database (see -I)\n"); return; }
+  STYLE12 b = c->sessions[c->active]->u.s12;
+  if ( b.game_number == 0 ) { send_message(c->ib_mq, c->active, MSG_NOTICE, "no board\n"); return; }
+
+  POSITION pos;
+  position_from_style12(&pos, &b);
+  uint32_t games[10];
+  uint64_t start = now_ns();
+  size_t n = gamedb_query(c->gamedb, pos.hash, games, LEN(games));
+  uint64_t elapsed = now_ns() - start;
+  send_message(c->ib_mq, c->active, MSG_NOTICE, "%zu of %lu games reached this position (%.2f ms)\n",
+      n, (unsigned long) c->gamedb->header->n_games, elapsed / 1e6);
+  for (size_t i = 0; i < n && i < LEN(games); i++)
+  {
+    char line[256];
+    gamedb_describe(c->gamedb, games[i], line, sizeof line);
+    send_message(c->ib_mq, c->active, MSG_NOTICE, "  %s\n", line);
+  }
+}
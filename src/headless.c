@@ -0,0 +1,221 @@
+#include "vichess.h"
+
+// Headless mode: the same socket -> parse pipeline as the curses
+// front-end, but events (see events.h) are written to a file instead of
+// windows, and commands are read from stdin.  For bots and recorders.
+//
+//    -H json     one JSON object per line
+//    -H binary   length-prefixed EVENTs, see event_size()
+
+static void json_string(FILE *f, const char *s, size_t n)
+{
+  static const char hex[] = "0123456789abcdef";
+  putc_unlocked('"', f);
+  for (size_t i = 0; i < n && s[i] != '\0'; i++)
+  {
+    unsigned char ch = s[i];
+    switch ( ch )
+    {
+      case '"':   fputs_unlocked("\\\"", f); break;
+      case '\\':  fputs_unlocked("\\\\", f); break;
+      case '\n':  fputs_unlocked("\\n", f);  break;
+      case '\r':  fputs_unlocked("\\r", f);  break;
+      case '\t':  fputs_unlocked("\\t", f);  break;
+      default:
+        if ( ch < 0x20 )
+        {
+          fputs_unlocked("\\u00", f);
+          putc_unlocked(hex[ch >> 4], f);
+          putc_unlocked(hex[ch & 15], f);
+        }
+        else putc_unlocked(ch, f);
+        break;
+    }
+  }
+  putc_unlocked('"', f);
+}
+
+#define JSON_STRING(f, key, field) \
+  fputs_unlocked(",\"" key "\":", f); json_string(f, field, sizeof field)
+
+void write_event_json(FILE *f, const EVENT *e)
+{
+  switch ( e->type )
+  {
+    case EV_BOARD:
+    {
+      const STYLE12 *b = &e->board;
+      fprintf(f, "{\"type\":\"board\",\"session\":%d,\"ns\":%llu,\"game\":%u,\"board\":\"",
+          e->session, (unsigned long long) e->ns, b->game_number);
+      for (int i = 0; i < N_ROWS; i++)
+      {
+        fwrite_unlocked(b->board[i], 1, N_COLS, f);
+        if ( i < N_ROWS - 1 ) putc_unlocked('/', f);
+      }
+      fprintf(f, "\",\"turn\":\"%c\",\"double_push\":%d,\"castle\":\"%s%s%s%s\","
+                 "\"irreversible\":%u,\"relation\":%d,\"flip\":%u,\"time\":[%u,%u],"
+                 "\"strength\":[%d,%d],\"ms\":[%d,%d],\"move_number\":%u",
+          b->turn, b->double_push,
+          b->white_castle_short ? "K" : "", b->white_castle_long ? "Q" : "",
+          b->black_castle_short ? "k" : "", b->black_castle_long ? "q" : "",
+          b->irreversible, b->relation, b->flip, b->match_minutes, b->match_increment,
+          b->white_strength, b->black_strength, b->white_ms, b->black_ms, b->move_number);
+      JSON_STRING(f, "white",   b->white);
+      JSON_STRING(f, "black",   b->black);
+      JSON_STRING(f, "move",    b->verbose_move);
+      JSON_STRING(f, "elapsed", b->elapsed);
+      JSON_STRING(f, "san",     b->pretty_move);
+      fputs_unlocked("}\n", f);
+      break;
+    }
+    case EV_GAMEINFO:
+    {
+      const GAMEINFO *g = &e->gameinfo;
+      fprintf(f, "{\"type\":\"gameinfo\",\"session\":%d,\"ns\":%llu,\"game\":%u",
+          e->session, (unsigned long long) e->ns, g->game_number);
+      JSON_STRING(f, "game_type", g->type);
+      fprintf(f, ",\"private\":%d,\"rated\":%d,\"registered\":[%d,%d],\"timeseal\":[%d,%d],"
+                 "\"initial_time\":[%u,%u],\"initial_inc\":[%u,%u],\"partner\":%u,\"m\":%u,\"noescape\":%u",
+          g->private, g->rated, g->white_registered, g->black_registered,
+          g->white_timeseal, g->black_timeseal,
+          g->white_initial_time, g->black_initial_time,
+          g->white_initial_inc, g->black_initial_inc, g->partner_game_number, g->m, g->noescape);
+      fputs_unlocked(",\"ratings\":[", f);
+      json_string(f, g->white_rating, sizeof g->white_rating);
+      putc_unlocked(',', f);
+      json_string(f, g->black_rating, sizeof g->black_rating);
+      fputs_unlocked("]}\n", f);
+      break;
+    }
+    case EV_TEXT:
+      fprintf(f, "{\"type\":\"text\",\"session\":%d,\"ns\":%llu,\"text\":",
+          e->session, (unsigned long long) e->ns);
+      json_string(f, e->text, e->len);
+      fprintf(f, ",\"truncated\":%d}\n", e->truncated);
+      break;
+  }
+}
+
+void write_event_binary(FILE *f, const EVENT *e)
+{
+  uint32_t len = event_size(e);
+  fwrite_unlocked(&len, sizeof len, 1, f);
+  fwrite_unlocked(e, 1, len, f);
+}
+
+void write_event(CONFIG *c, const EVENT *e)
+{
+  if ( c->format == OUT_BINARY )  write_event_binary(c->out, e);
+  else                            write_event_json(c->out, e);
+}
+
+void t_headless_writer(void *config) // write events to c->out
+{
+  CONFIG *c = (CONFIG*) config;
+  setvbuf(c->out, NULL, _IOFBF, 1 << 20);
+  trace_thread("writer");
+
+  while ( running )
+  {
+    MESSAGE msg;
+    EVENT ev;
+    uint64_t trace = trace_begin();
+    if ( mq_receive(c->ib_mq, (char *) &msg, sizeof msg, 0) == -1 ) error("mq_receive");
+    trace_end(TR_MQ_RECEIVE, trace);
+    if ( msg.session >= c->n_sessions ) continue;
+
+    SESSION *s  = c->sessions[msg.session];
+    UPDATE *u   = &s->u;
+    int type    = EV_TEXT;
+    metric_add(M_MSG_LINE + msg.type, 1);
+    mem_message(msg.type);
+
+    if ( msg.type == MSG_SWITCH || msg.type == MSG_INPUT ) continue; // no echo
+
+    if ( msg.type != MSG_LINE ) ; // :ls output etc. is plain text
+    else if ( begins_with(msg.text, "{Game ") )
+    {
+      if ( c->archive != NULL ) archive_text(c->archive, s->id, msg.text);
+      if ( c->stats != NULL )   stats_text(c->stats, s->id, msg.text);
+    }
+    else if ( begins_with(msg.text, GAMEINFO_MARKER) )
+    {
+      parse_gameinfo_string( msg.text, u );
+      print_g1(s->id, u);
+      type = EV_GAMEINFO;
+      metric_add(M_GAMEINFOS, 1);
+    }
+    else if ( begins_with(msg.text, STYLE12_MARKER) )
+    {
+      parse_s12_string( msg.text, u );
+      print_s12(s->id, u);
+      if ( c->analysis != NULL ) analysis_submit(c->analysis, s->id, &u->s12);
+      if ( c->archive != NULL )  archive_board(c->archive, s->id, &u->s12, &u->g1);
+      if ( c->stats != NULL )
+      {
+        POSITION pos;
+        position_from_style12(&pos, &u->s12);
+        stats_board(c->stats, s->id, &u->s12, &u->g1, c->eco != NULL ? eco_lookup(c->eco, pos.hash) : NULL);
+      }
+      type = EV_BOARD;
+      metric_add(M_BOARDS, 1);
+    }
+
+    if ( type == EV_TEXT && msg.type == MSG_LINE ) metric_add(M_TEXT, 1);
+    make_event(&ev, s->id, type, u, msg.text);
+    publish_event(c, s->id, type, u, msg.text);
+    write_event(c, &ev);
+
+    int draw = DRAW_NONE;
+    if ( type == EV_BOARD )
+    {
+      POSITION pos;
+      position_from_style12(&pos, &u->s12);
+      draw = history_update(s, &u->s12, pos.hash);
+    }
+    if ( draw != DRAW_NONE )
+    {
+      char notice[MAX_LINE_SIZE];
+      draw_notice(draw, &u->s12, notice, sizeof notice);
+      make_event(&ev, s->id, EV_TEXT, u, notice);
+      publish_event(c, s->id, EV_TEXT, u, notice);
+      write_event(c, &ev);
+    }
+
+    // batch writes while there is a backlog, flush as soon as there
+    // isn't, so a bot reading the stream sees each event promptly
+    struct mq_attr attr;
+    if ( mq_getattr(c->ib_mq, &attr) == -1 || attr.mq_curmsgs == 0 ) fflush(c->out);
+  }
+  fflush(c->out);
+}
+
+void t_headless_reader(void *config) // read commands from stdin
+{
+  CONFIG *c = (CONFIG*) config;
+  trace_thread("reader");
+  mem_message(MSG_INPUT);
+  LINE_BUFFER *in = mem_calloc(MEM_TRANSPORT, 1, sizeof *in); if ( in == NULL ) error("headless reader calloc");
+  int fd = STDIN_FILENO;
+  if ( fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1 ) error("fcntl");
+
+  // poll() with a timeout rather than block in read(), so that the
+  // thread notices when the last session closes
+  while ( running )
+  {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    int ready = poll(&pfd, 1, 100);
+    if ( ready == 0 || ( ready == -1 && errno == EINTR ) ) continue;
+    if ( ready == -1 ) error("poll");
+
+    char command_buf[MAX_LINE_SIZE];
+    ssize_t len;
+    while ( (len = read_line_buffered(fd, in, command_buf, MAX_LINE_SIZE, '\n')) > 0 )
+    {
+      if ( local_command(c, command_buf) )  continue;
+      send_message(c->ob_mq, c->active, MSG_INPUT, "%s", command_buf);
+    }
+    if ( len == 0 ) fd = -1; // EOF: stop reading, but keep the sessions running
+  }
+  mem_free(in);
+}
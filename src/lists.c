@@ -0,0 +1,609 @@
+#include "vichess.h"
+
+// Listings: the output of games, who and sought, recognized line by
+// line as it arrives and kept as a table per session, indexed by
+// rating, time control and player:
+//
+//    :list games rating=1800-2200 type=blitz sort=rating
+//    :list who player=gue
+//    :list sought time=1-3 inc=0 rated=1 sort=time
+//
+// Rows are held back from the terminal until the footer ("27 ads
+// displayed.") arrives.  The first listing of a kind is then shown as
+// the server sent it; a refresh shows only what changed since the last
+// one.  A line that is not a row before the footer shows the held rows
+// as they were: it was not a listing after all.
+
+#define LIST_ROWS       2048    // rows kept per listing; the rest are dropped
+
+typedef struct PLAYER_KEY
+{
+  uint16_t row;
+  uint8_t which;                // 0 player, 1 opponent
+} PLAYER_KEY;
+
+typedef struct LIST
+{
+  int kind, n;
+  LIST_ROW rows[LIST_ROWS];
+  // indexes: row numbers in key order
+  uint16_t by_id[LIST_ROWS];        // game or ad number; handle in who
+  uint16_t by_rating[LIST_ROWS];    // highest first
+  uint16_t by_time[LIST_ROWS];      // shortest first
+  PLAYER_KEY by_player[2 * LIST_ROWS];
+  int n_players;
+} LIST;
+
+struct LISTS
+{
+  pthread_mutex_t lock;         // the writer builds, :list reads
+  int collecting;               // kind being collected, or -1
+  LIST *building;
+  LIST *snapshots[N_LISTS];
+  char *held;                   // the raw lines of the listing so far
+  size_t held_len, held_size;
+  uint64_t parse_ns;            // spent on this listing so far
+};
+
+static const char *KIND_NAMES[N_LISTS] = { "games", "who", "sought" };
+
+static const struct { char code; const char *name; } GAME_TYPES[] =
+{
+  { 'b', "blitz" },     { 'l', "lightning" }, { 's', "standard" }, { 'u', "untimed" },
+  { 'w', "wild" },      { 'z', "crazyhouse" },{ 'B', "bughouse" }, { 'L', "losers" },
+  { 'S', "suicide" },   { 'x', "atomic" },    { 'n', "nonstandard" },
+};
+
+
+/// Parsing
+
+// "1738", "1738E", "1738P", "++++", "----"; 0 for unrated
+static bool parse_rating(const char *s, int len, int *rating)
+{
+  if ( len == 4 && ( ! strncmp(s, "++++", 4) || ! strncmp(s, "----", 4) ) ) { *rating = 0; return true; }
+  if ( len > 0 && ( s[len-1] == 'E' || s[len-1] == 'P' ) ) len--;
+  if ( len < 1 || len > 4 ) return false;
+  *rating = 0;
+  for (int i = 0; i < len; i++)
+  {
+    if ( ! isdigit(s[i]) ) return false;
+    *rating = *rating * 10 + s[i] - '0';
+  }
+  return true;
+}
+
+// "Toby", "Ralph(C)", "Foo(*)(TD)": the handle, without its titles
+static bool parse_handle(const char *s, int len, char *handle)
+{
+  int n = 0;
+  while ( n < len && isalpha(s[n]) ) n++;
+  if ( n < 2 || n >= NICK_MAX ) return false;
+  for (int i = n; i < len; i++)
+    if ( ! isupper(s[i]) && ! strchr("()*", s[i]) ) return false;
+  memcpy(handle, s, n);
+  handle[n] = '\0';
+  return true;
+}
+
+static int split(const char *line, const char *tokens[], int lengths[], int max)
+{
+  int n = 0;
+  while ( n < max )
+  {
+    while ( *line == ' ' ) line++;
+    if ( *line == '\0' ) break;
+    tokens[n] = line;
+    while ( *line != '\0' && *line != ' ' ) line++;
+    lengths[n] = line - tokens[n];
+    n++;
+  }
+  return n;
+}
+
+static bool parse_number(const char *s, int len, int *v)
+{
+  if ( len < 1 || len > 6 ) return false;
+  *v = 0;
+  for (int i = 0; i < len; i++)
+  {
+    if ( ! isdigit(s[i]) ) return false;
+    *v = *v * 10 + s[i] - '0';
+  }
+  return true;
+}
+
+//  93 1738 Ralph      1816 Toby       [ br  3   0]   2:47 -  2:51 (39-39) W:  5
+//  12 (Exam. 1813 Foo         1759 Bar       ) [ uu  0   0] W: 21
+static bool parse_game(const char *line, LIST_ROW *r)
+{
+  const char *bracket = strchr(line, '[');
+  if ( bracket == NULL || strlen(bracket) < 11 ) return false;
+  char before[128];
+  snprintf(before, sizeof before, "%.*s", (int) ( bracket - line ), line);
+
+  const char *t[8];
+  int len[8], n = split(before, t, len, LEN(t)), i = 1;
+  if ( n < 5 || ! parse_number(t[0], len[0], &r->id) ) return false;
+  r->status = ' ';
+  if ( t[1][0] == '(' ) { r->status = t[1][1] == 'E' ? 'x' : 's'; i++; } // examined or set up
+  if ( n - i < 4 ) return false;
+  if ( ! parse_rating(t[i], len[i], &r->rating) || ! parse_handle(t[i+1], len[i+1], r->player)
+      || ! parse_rating(t[i+2], len[i+2], &r->opponent_rating) || ! parse_handle(t[i+3], len[i+3], r->opponent) )
+    return false;
+
+  char flags[4];
+  if ( sscanf(bracket, "[%3c %d %d]", flags, &r->time, &r->inc) != 3 ) return false;
+  r->rated = flags[2] == 'r';
+  snprintf(r->type, sizeof r->type, "%c", flags[1]);
+  for (int k = 0; k < LEN(GAME_TYPES); k++)
+    if ( GAME_TYPES[k].code == flags[1] ) snprintf(r->type, sizeof r->type, "%s", GAME_TYPES[k].name);
+  return true;
+}
+
+//   9 1476 Ralph(C)           5   0 rated   blitz      [white]  1400-1600 f
+static bool parse_seek(const char *line, LIST_ROW *r)
+{
+  const char *t[12];
+  int len[12], n = split(line, t, len, LEN(t)), i = 7;
+  if ( n < 8 ) return false;
+  if ( ! parse_number(t[0], len[0], &r->id) || ! parse_rating(t[1], len[1], &r->rating)
+      || ! parse_handle(t[2], len[2], r->player) || ! parse_number(t[3], len[3], &r->time)
+      || ! parse_number(t[4], len[4], &r->inc) ) return false;
+  if      ( len[5] == 5 && ! strncmp(t[5], "rated", 5) )    r->rated = true;
+  else if ( len[5] == 7 && ! strncmp(t[5], "unrated", 7) )  r->rated = false;
+  else return false;
+  snprintf(r->type, sizeof r->type, "%.*s", len[6], t[6]);
+  r->status = ' ';
+  if ( t[i][0] == '[' ) r->status = t[i++][1];  // [white] [black]
+  int lo, hi;
+  return i < n && sscanf(t[i], "%d-%d", &lo, &hi) == 2;
+}
+
+//  1938 Toby         1785.Ralph         ++++ GuestXYZW
+//
+// One row per entry.  Returns the number of entries, 0 if the line is
+// not part of a who listing.
+static int parse_who(const char *line, LIST_ROW *rows, int max)
+{
+  int n = 0;
+  const char *p = line;
+  while ( *p != '\0' )
+  {
+    while ( *p == ' ' ) p++;
+    if ( *p == '\0' ) break;
+    if ( n == max ) return 0;
+
+    LIST_ROW *r = &rows[n];
+    memset(r, 0, sizeof *r);
+    const char *start = p;
+    while ( isdigit(*p) || *p == '+' || *p == '-' || *p == 'E' || *p == 'P' ) p++;
+    if ( p - start < 3 || ! parse_rating(start, p - start, &r->rating) ) return 0;
+    if ( *p == '\0' || ! strchr(" ^.:#~&", *p) ) return 0;
+    r->status = *p++;
+    const char *handle = p;
+    while ( *p != '\0' && *p != ' ' ) p++;
+    if ( ! parse_handle(handle, p - handle, r->player) ) return 0;
+    snprintf(r->text, sizeof r->text, "%.*s", (int) ( p - start ), start);
+    n++;
+  }
+  return n;
+}
+
+// "  27 ads displayed.", "561 players displayed (of 561). ..."
+static int parse_footer(const char *line)
+{
+  int n;
+  char what[16];
+  if ( sscanf(line, "%d %15s displayed", &n, what) != 2 || ! contains((char *) line, " displayed") ) return -1;
+  if ( equals(what, "games") || equals(what, "game") )      return LIST_GAMES;
+  if ( equals(what, "players") || equals(what, "player") )  return LIST_WHO;
+  if ( equals(what, "ads") || equals(what, "ad") )          return LIST_SOUGHT;
+  return -1;
+}
+
+
+/// Indexes
+
+static int row_rating(const LIST_ROW *r) { return r->rating > r->opponent_rating ? r->rating : r->opponent_rating; }
+static int row_time(const LIST_ROW *r)   { return r->time * 1000 + r->inc; }
+
+static int compare_id(const void *a, const void *b, void *list)
+{
+  const LIST *l = list;
+  const LIST_ROW *x = &l->rows[*(const uint16_t *) a], *y = &l->rows[*(const uint16_t *) b];
+  if ( l->kind == LIST_WHO ) return strcasecmp(x->player, y->player);
+  return ( x->id > y->id ) - ( x->id < y->id );
+}
+
+static int compare_rating(const void *a, const void *b, void *list)
+{
+  const LIST *l = list;
+  int x = row_rating(&l->rows[*(const uint16_t *) a]), y = row_rating(&l->rows[*(const uint16_t *) b]);
+  return ( x < y ) - ( x > y );
+}
+
+static int compare_time(const void *a, const void *b, void *list)
+{
+  const LIST *l = list;
+  int x = row_time(&l->rows[*(const uint16_t *) a]), y = row_time(&l->rows[*(const uint16_t *) b]);
+  return ( x > y ) - ( x < y );
+}
+
+static const char *player_of(const LIST *l, PLAYER_KEY k)
+{
+  return k.which ? l->rows[k.row].opponent : l->rows[k.row].player;
+}
+
+static int compare_player(const void *a, const void *b, void *list)
+{
+  const LIST *l = list;
+  return strcasecmp(player_of(l, *(const PLAYER_KEY *) a), player_of(l, *(const PLAYER_KEY *) b));
+}
+
+static void index_list(LIST *l)
+{
+  l->n_players = 0;
+  for (int i = 0; i < l->n; i++)
+  {
+    l->by_id[i] = l->by_rating[i] = l->by_time[i] = i;
+    l->by_player[l->n_players++] = (PLAYER_KEY) { .row = i, .which = 0 };
+    if ( l->kind == LIST_GAMES ) l->by_player[l->n_players++] = (PLAYER_KEY) { .row = i, .which = 1 };
+  }
+  qsort_r(l->by_id, l->n, sizeof *l->by_id, compare_id, l);
+  qsort_r(l->by_rating, l->n, sizeof *l->by_rating, compare_rating, l);
+  qsort_r(l->by_time, l->n, sizeof *l->by_time, compare_time, l);
+  qsort_r(l->by_player, l->n_players, sizeof *l->by_player, compare_player, l);
+}
+
+
+/// Snapshots
+
+static LIST *new_list(void)
+{
+  LIST *l = mem_alloc(MEM_PARSER, sizeof *l);
+  if ( l == NULL ) error("lists");
+  l->n = 0;
+  return l;
+}
+
+LISTS *lists_new(void)
+{
+  LISTS *l = mem_calloc(MEM_PARSER, 1, sizeof *l);
+  if ( l == NULL ) error("lists_new");
+  pthread_mutex_init(&l->lock, NULL);
+  l->collecting = -1;
+  return l;
+}
+
+void lists_free(LISTS *l)
+{
+  if ( l == NULL ) return;
+  for (int i = 0; i < N_LISTS; i++) mem_free(l->snapshots[i]);
+  mem_free(l->building);
+  mem_free(l->held);
+  pthread_mutex_destroy(&l->lock);
+  mem_free(l);
+}
+
+static void show(CONFIG *c, SESSION *s, const char *text)
+{
+  if ( c->w2 != NULL && s->id == c->active ) use_window(c->w2, (NCURSES_WINDOW_CB) cb_write_response, (void *) text);
+}
+
+static void show_held(CONFIG *c, SESSION *s, LISTS *l)
+{
+  for (char *p = l->held; p < l->held + l->held_len; p += strlen(p) + 1) show(c, s, p);
+  l->held_len = 0;
+}
+
+static void hold(LISTS *l, const char *line)
+{
+  size_t len = strlen(line) + 1;
+  if ( l->held_len + len > l->held_size )
+  {
+    l->held_size = ( l->held_len + len ) * 2;
+    if ( (l->held = mem_realloc(MEM_PARSER, l->held, l->held_size)) == NULL ) error("lists");
+  }
+  memcpy(l->held + l->held_len, line, len);
+  l->held_len += len;
+}
+
+// Rows are the same row if they have the same key, and have changed if
+// anything but the clocks and move number has.
+static int compare_keys(int kind, const LIST_ROW *x, const LIST_ROW *y)
+{
+  if ( kind == LIST_WHO ) return strcasecmp(x->player, y->player);
+  return ( x->id > y->id ) - ( x->id < y->id );
+}
+
+static bool row_changed(int kind, const LIST_ROW *x, const LIST_ROW *y)
+{
+  if ( kind == LIST_GAMES )
+    return x->rating != y->rating || x->opponent_rating != y->opponent_rating || x->status != y->status
+        || ! equals((char *) x->player, (char *) y->player) || ! equals((char *) x->opponent, (char *) y->opponent)
+        || x->time != y->time || x->inc != y->inc || ! equals((char *) x->type, (char *) y->type);
+  return ! equals((char *) x->text, (char *) y->text);
+}
+
+// Show what changed between 'old' and 'new', both walked in key order.
+static void show_diff(CONFIG *c, SESSION *s, const LIST *old, const LIST *new, int counts[3])
+{
+  char line[LIST_TEXT + 8];
+  int i = 0, j = 0;
+  while ( i < old->n || j < new->n )
+  {
+    const LIST_ROW *x = i < old->n ? &old->rows[old->by_id[i]] : NULL;
+    const LIST_ROW *y = j < new->n ? &new->rows[new->by_id[j]] : NULL;
+    int cmp = x == NULL ? 1 : y == NULL ? -1 : compare_keys(new->kind, x, y);
+    if ( cmp < 0 )
+    {
+      snprintf(line, sizeof line, "- %s\n", x->text); show(c, s, line); counts[1]++; i++;
+    }
+    else if ( cmp > 0 )
+    {
+      snprintf(line, sizeof line, "+ %s\n", y->text); show(c, s, line); counts[0]++; j++;
+    }
+    else
+    {
+      if ( row_changed(new->kind, x, y) ) { snprintf(line, sizeof line, "~ %s\n", y->text); show(c, s, line); counts[2]++; }
+      i++, j++;
+    }
+  }
+}
+
+static void finish(CONFIG *c, SESSION *s, LISTS *l, int kind, const char *footer)
+{
+  uint64_t start = now_ns();
+  if ( l->building == NULL ) l->building = new_list();
+  if ( l->collecting != kind ) l->building->n = 0; // an empty listing
+  LIST *new = l->building;
+  new->kind = kind;
+  index_list(new);
+
+  pthread_mutex_lock(&l->lock);
+  LIST *old = l->snapshots[kind];
+  l->snapshots[kind] = new;
+  l->building = old;
+  pthread_mutex_unlock(&l->lock);
+
+  if ( old == NULL )
+  {
+    // the first listing of its kind: as the server sent it
+    show_held(c, s, l);
+    show(c, s, footer);
+  }
+  else
+  {
+    int counts[3] = { 0 };
+    l->held_len = 0;
+    show_diff(c, s, old, new, counts);
+    char summary[MAX_LINE_SIZE];
+    snprintf(summary, sizeof summary, "%s: %d rows, %d new, %d gone, %d changed (%.2f ms)\n", KIND_NAMES[kind], new->n,
+        counts[0], counts[1], counts[2], ( l->parse_ns + now_ns() - start ) / 1e6);
+    show(c, s, summary);
+  }
+  l->collecting = -1;
+  l->parse_ns = 0;
+}
+
+// Feed a line received by session 's' to its listings.  Returns true
+// if the line is part of a listing and has been dealt with; false if
+// it should be shown as usual.  Writer thread only.
+bool lists_feed(CONFIG *c, SESSION *s, const char *line)
+{
+  if ( s->lists == NULL ) s->lists = lists_new();
+  LISTS *l = s->lists;
+  uint64_t start = now_ns();
+
+  char trimmed[LIST_TEXT];
+  const char *p = line;
+  if ( begins_with((char *) p, "% ") ) p += 2; // a prompt ahead of the output
+  while ( *p == '\n' || *p == '\r' ) p++;
+  snprintf(trimmed, sizeof trimmed, "%s", p);
+  size_t n = strcspn(trimmed, "\r\n");
+  trimmed[n] = '\0';
+  while ( n > 0 && trimmed[n-1] == ' ' ) trimmed[--n] = '\0';
+
+  // cheap rejection: every row and footer starts with a number or rating
+  int footer = -1, kind = -1, n_rows = 0;
+  LIST_ROW rows[8];
+  const char *q = trimmed + strspn(trimmed, " ");
+  if ( isdigit(*q) || *q == '+' || *q == '-' )
+  {
+    memset(rows, 0, sizeof rows[0]);
+    if      ( (footer = parse_footer(trimmed)) != -1 ) ;
+    else if ( parse_game(trimmed, &rows[0]) )          kind = LIST_GAMES, n_rows = 1;
+    else if ( parse_seek(trimmed, &rows[0]) )          kind = LIST_SOUGHT, n_rows = 1;
+    else if ( (n_rows = parse_who(trimmed, rows, LEN(rows))) > 0 ) kind = LIST_WHO;
+  }
+
+  if ( footer != -1 )
+  {
+    if ( l->collecting != -1 && l->collecting != footer ) show_held(c, s, l);
+    l->parse_ns += now_ns() - start;
+    finish(c, s, l, footer, line);
+    return true;
+  }
+  if ( kind == -1 && *q == '\0' && l->collecting != -1 )
+  {
+    hold(l, line); // the blank line ahead of the footer
+    return true;
+  }
+  if ( kind == -1 )
+  {
+    if ( l->collecting != -1 ) { show_held(c, s, l); l->collecting = -1; l->parse_ns = 0; }
+    return false;
+  }
+
+  if ( l->collecting != kind )
+  {
+    if ( l->collecting != -1 ) show_held(c, s, l);
+    if ( l->building == NULL ) l->building = new_list();
+    l->building->n = 0;
+    l->collecting = kind;
+    l->parse_ns = 0;
+  }
+  hold(l, line);
+  LIST *b = l->building;
+  for (int i = 0; i < n_rows && b->n < LIST_ROWS; i++)
+  {
+    if ( kind != LIST_WHO ) snprintf(rows[i].text, sizeof rows[i].text, "%s", trimmed);
+    b->rows[b->n++] = rows[i];
+  }
+  l->parse_ns += now_ns() - start;
+  return true;
+}
+
+
+/// Queries
+
+typedef struct QUERY
+{
+  RANGE rating, time, inc;
+  int rated;                    // -1 for either
+  char type[16], player[NICK_MAX];
+  char sort;                    // 'r'ating, 't'ime, 'p'layer, 'i'd; 0 for server order
+} QUERY;
+
+static bool parse_query(char *args, QUERY *q)
+{
+  memset(q, 0, sizeof *q);
+  q->rating.any = q->time.any = q->inc.any = true;
+  q->rated = -1;
+  char *save;
+  for (char *tok = strtok_r(args, " \t\n", &save); tok != NULL; tok = strtok_r(NULL, " \t\n", &save))
+  {
+    char *value = strchr(tok, '=');
+    if ( value == NULL ) return false;
+    *value++ = '\0';
+    if      ( equals(tok, "rating") ) { if ( ! parse_range(value, &q->rating) ) return false; }
+    else if ( equals(tok, "time") )   { if ( ! parse_range(value, &q->time) )   return false; }
+    else if ( equals(tok, "inc") )    { if ( ! parse_range(value, &q->inc) )    return false; }
+    else if ( equals(tok, "rated") )  q->rated = atoi(value) != 0;
+    else if ( equals(tok, "type") )   snprintf(q->type, sizeof q->type, "%s", value);
+    else if ( equals(tok, "player") ) snprintf(q->player, sizeof q->player, "%s", value);
+    else if ( equals(tok, "sort") && strchr("rtpi", *value) && *value != '\0' ) q->sort = *value;
+    else return false;
+  }
+  return true;
+}
+
+static bool row_matches(const QUERY *q, const LIST_ROW *r)
+{
+  size_t n = strlen(q->player);
+  return in_range(q->rating, row_rating(r)) && in_range(q->time, r->time) && in_range(q->inc, r->inc)
+      && ( q->rated == -1 || q->rated == r->rated )
+      && ( q->type[0] == '\0' || equals((char *) q->type, (char *) r->type) )
+      && ( n == 0 || strncasecmp(r->player, q->player, n) == 0 || strncasecmp(r->opponent, q->player, n) == 0 );
+}
+
+// The rows of the last listing of 'kind' that match 'query', in the
+// order it asks for: their texts go to 'texts', at most 'max' of them.
+// Returns the number of matches, or -1 for a bad query; 'total' is the
+// number of rows in the listing.
+//
+// The most selective indexed condition (player, then rating, then
+// time) narrows the candidates by binary search; the sort walks an
+// index in order, so neither step sorts anything.
+int lists_select(LISTS *l, int kind, const char *query, char (*texts)[LIST_TEXT], int max, int *total)
+{
+  QUERY q;
+  if ( ! parse_query(strdupa(query), &q) ) return -1;
+  *total = 0;
+  if ( l == NULL ) return 0;
+
+  pthread_mutex_lock(&l->lock);
+  const LIST *list = l->snapshots[kind];
+  if ( list == NULL ) { pthread_mutex_unlock(&l->lock); return 0; }
+  *total = list->n;
+
+  bool candidate[LIST_ROWS] = { false };
+  size_t n = strlen(q.player);
+  if ( n > 0 )
+  {
+    int lo = 0, hi = list->n_players;
+    while ( lo < hi )
+    {
+      int mid = ( lo + hi ) / 2;
+      if ( strncasecmp(player_of(list, list->by_player[mid]), q.player, n) < 0 ) lo = mid + 1; else hi = mid;
+    }
+    for (int i = lo; i < list->n_players && strncasecmp(player_of(list, list->by_player[i]), q.player, n) == 0; i++)
+      candidate[list->by_player[i].row] = true;
+  }
+  else if ( ! q.rating.any )
+  {
+    int lo = 0, hi = list->n;
+    while ( lo < hi )
+    {
+      int mid = ( lo + hi ) / 2;
+      if ( row_rating(&list->rows[list->by_rating[mid]]) > q.rating.hi ) lo = mid + 1; else hi = mid;
+    }
+    for (int i = lo; i < list->n && row_rating(&list->rows[list->by_rating[i]]) >= q.rating.lo; i++)
+      candidate[list->by_rating[i]] = true;
+  }
+  else if ( ! q.time.any )
+  {
+    int lo = 0, hi = list->n;
+    while ( lo < hi )
+    {
+      int mid = ( lo + hi ) / 2;
+      if ( list->rows[list->by_time[mid]].time < q.time.lo ) lo = mid + 1; else hi = mid;
+    }
+    for (int i = lo; i < list->n && list->rows[list->by_time[i]].time <= q.time.hi; i++)
+      candidate[list->by_time[i]] = true;
+  }
+  else memset(candidate, true, list->n);
+
+  int found = 0;
+  for (int i = 0; i < list->n; i++)
+  {
+    int row = i;
+    if      ( q.sort == 'r' ) row = list->by_rating[i];
+    else if ( q.sort == 't' ) row = list->by_time[i];
+    else if ( q.sort == 'i' ) row = list->by_id[i];
+    else if ( q.sort == 'p' ) row = -1;
+    if ( row == -1 ) break;
+    if ( ! candidate[row] || ! row_matches(&q, &list->rows[row]) ) continue;
+    if ( found < max ) snprintf(texts[found], LIST_TEXT, "%s", list->rows[row].text);
+    found++;
+  }
+  if ( q.sort == 'p' ) // each row once, by its first player in the index
+    for (int i = 0; i < list->n_players; i++)
+    {
+      int row = list->by_player[i].row;
+      if ( ! candidate[row] || ! row_matches(&q, &list->rows[row]) ) continue;
+      candidate[row] = false;
+      if ( found < max ) snprintf(texts[found], LIST_TEXT, "%s", list->rows[row].text);
+      found++;
+    }
+  pthread_mutex_unlock(&l->lock);
+  return found;
+}
+
+// :list KIND [key=value ...] -- from the last listing, no server round trip
+void lists_command(CONFIG *c, const char *args)
+{
+  char what[16];
+  int kind = -1, n = 0;
+  if ( sscanf(args, "%15s%n", what, &n) == 1 )
+    for (int i = 0; i < N_LISTS; i++)
+      if ( equals(what, (char *) KIND_NAMES[i]) ) kind = i;
+  if ( kind == -1 )
+  {
+    send_message(c->ib_mq, c->active, MSG_NOTICE, "usage: :list games|who|sought [rating=LO-HI] [time=LO-HI] [inc=LO-HI] "
+        "[rated=0|1] [type=T] [player=PREFIX] [sort=rating|time|player|id]\n");
+    return;
+  }
+
+  char (*texts)[LIST_TEXT] = mem_alloc(MEM_RENDER, LIST_ROWS * sizeof *texts);
+  if ( texts == NULL ) error("lists_command");
+  int total, found = lists_select(c->sessions[c->active]->lists, kind, args + n, texts, LIST_ROWS, &total);
+  if ( found == -1 )      send_message(c->ib_mq, c->active, MSG_NOTICE, "bad query: %s", args + n);
+  else if ( total == 0 )  send_message(c->ib_mq, c->active, MSG_NOTICE, "no %s listing yet; type %s\n", what, what);
+  else
+  {
+    for (int i = 0; i < found && i < LIST_ROWS; i++) send_message(c->ib_mq, c->active, MSG_NOTICE, "%s\n", texts[i]);
+    send_message(c->ib_mq, c->active, MSG_NOTICE, "%d of %d %s rows\n", found, total, what);
+  }
+  mem_free(texts);
+}
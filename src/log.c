@@ -0,0 +1,370 @@
+#include "vichess.h"
+
+// Binary logging, off the hot path.
+//
+//    vichess -L /tmp/vichess.log         log, at info and above
+//    :log debug parse,net                 change what is logged
+//    vichess -l /tmp/vichess.log          print a log as text
+//
+// A thread that logs copies a record into a byte ring of its own and
+// moves on: a Style12 update is its STYLE12 struct, a server line its
+// bytes, and only messages from cold paths are formatted as they are
+// made.  Nothing is shared between producers and nothing blocks; a
+// record that doesn't fit is dropped and counted.  One thread drains
+// the rings every LOG_DRAIN_MS into the file, which -l renders.  Level
+// and categories are checked before anything is copied, so a record
+// that isn't wanted costs two relaxed loads.
+//
+// The file is a LOG_FILE_HEADER, then records as they were made,
+// each thread's in order.
+
+#define LOG_BYTES       ( 1 << 20 )     // bytes per thread
+#define LOG_THREADS     32
+#define LOG_DRAIN_MS    5
+#define LOG_MAGIC       "VICHLOG1"
+
+static const char *LEVELS[N_LOG_LEVELS] = { "error", "warn", "info", "debug", "trace" };
+static const char *CATEGORIES[] = { "net", "parse", "ui", "engine", "session", "misc" };
+
+enum __LOG_RECORDS
+{
+  LOGR_PAD,                     // the rest of the ring, before it wraps
+  LOGR_TEXT,                    // formatted text
+  LOGR_LINE_IN,                 // a line from the server
+  LOGR_LINE_OUT,                // a command to the server
+  LOGR_S12,                     // a STYLE12
+  LOGR_G1,                      // a GAMEINFO
+  LOGR_THREAD                   // the text is the thread's name
+};
+
+typedef struct LOG_RECORD
+{
+  uint64_t ns;                  // now_ns()
+  uint16_t size;                // header and payload, a multiple of 8
+  uint8_t kind;                 // LOGR_*
+  uint8_t level;
+  uint8_t category;             // one LC_* bit
+  uint8_t thread;
+  int16_t session;              // -1 for none
+  // payload follows
+} LOG_RECORD;
+
+typedef struct LOG_FILE_HEADER
+{
+  char magic[8];
+  uint32_t record_header;       // sizeof(LOG_RECORD)
+  uint32_t style12, gameinfo;   // payload sizes
+  uint32_t reserved;
+  int64_t realtime_offset;      // CLOCK_REALTIME - CLOCK_MONOTONIC, ns
+} LOG_FILE_HEADER;
+
+typedef struct LOG_RING
+{
+  _Atomic uint64_t head;        // bytes ever written
+  _Atomic uint64_t tail;        // bytes ever drained
+  _Atomic uint64_t dropped;
+  unsigned char buf[LOG_BYTES];
+} LOG_RING;
+
+atomic_int log_level = -1;      // nothing until log_open()
+atomic_int log_categories = LOGC_ALL;
+static LOG_RING *_Atomic rings[LOG_THREADS];
+static atomic_int n_rings;
+static _Thread_local LOG_RING *mine;
+static _Thread_local int my_index;
+static _Thread_local bool no_ring; // LOG_THREADS taken
+static FILE *log_file;
+static pthread_t logger;
+static atomic_bool logging;
+
+static LOG_RECORD *reserve(size_t payload, size_t *size);
+static void publish(size_t size);
+
+static LOG_RING *my_ring(void)
+{
+  if ( mine != NULL || no_ring ) return mine;
+  int i = atomic_fetch_add(&n_rings, 1);
+  if ( i >= LOG_THREADS ) { no_ring = true; return NULL; }
+  if ( (mine = calloc(1, sizeof *mine)) == NULL ) error("log calloc");
+  my_index = i;
+  atomic_store(&rings[i], mine);
+
+  // the thread's name, for the decoder
+  const char *name = trace_thread_name() != NULL ? trace_thread_name() : "thread";
+  size_t size;
+  LOG_RECORD *r = reserve(strlen(name) + 1, &size);
+  if ( r == NULL ) return mine;
+  *r = (LOG_RECORD) { .ns = now_ns(), .size = size, .kind = LOGR_THREAD, .level = LOG_ERROR, .category = LOGC_MISC, .thread = i, .session = -1 };
+  strcpy((char *) ( r + 1 ), name);
+  publish(size);
+  return mine;
+}
+
+// Room for a record with 'payload' bytes after its header, not yet
+// published; NULL (and counted) if the ring is full.
+static LOG_RECORD *reserve(size_t payload, size_t *size)
+{
+  LOG_RING *r = my_ring();
+  if ( r == NULL ) return NULL;
+  *size = ( sizeof(LOG_RECORD) + payload + 7 ) & ~(size_t) 7;
+  if ( *size > UINT16_MAX ) return NULL;
+  uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  uint64_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+  size_t offset = head % LOG_BYTES, pad = offset + *size > LOG_BYTES ? LOG_BYTES - offset : 0;
+  if ( head + pad + *size - tail > LOG_BYTES )
+  {
+    atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+    return NULL;
+  }
+  if ( pad > 0 )
+  {
+    // a record never wraps; a gap too small for a header is skipped
+    // by the reader without one
+    if ( pad >= sizeof(LOG_RECORD) ) *(LOG_RECORD *) ( r->buf + offset ) = (LOG_RECORD) { .size = pad, .kind = LOGR_PAD };
+    atomic_store_explicit(&r->head, head + pad, memory_order_release);
+    offset = 0;
+  }
+  return (LOG_RECORD *) ( r->buf + offset );
+}
+
+static void publish(size_t size)
+{
+  atomic_store_explicit(&mine->head, atomic_load_explicit(&mine->head, memory_order_relaxed) + size, memory_order_release);
+}
+
+static void record(int kind, int level, int category, int session, const void *payload, size_t n, bool text)
+{
+  size_t size;
+  LOG_RECORD *r = reserve(n + text, &size);
+  if ( r == NULL ) return;
+  *r = (LOG_RECORD) { .ns = now_ns(), .size = size, .kind = kind, .level = level, .category = category,
+      .thread = my_index, .session = session };
+  memcpy(r + 1, payload, n);
+  if ( text ) ( (char *) ( r + 1 ) )[n] = '\0';
+  publish(size);
+}
+
+void log_s12(int level, int category, int session, const STYLE12 *b)
+{
+  if ( log_enabled(level, category) ) record(LOGR_S12, level, category, session, b, sizeof *b, false);
+}
+
+void log_g1(int level, int category, int session, const GAMEINFO *g)
+{
+  if ( log_enabled(level, category) ) record(LOGR_G1, level, category, session, g, sizeof *g, false);
+}
+
+// A line to or from the server, as it was, up to its line end.
+void log_line(int level, int category, int session, const char *line, bool out)
+{
+  if ( ! log_enabled(level, category) ) return;
+  size_t n = strcspn(line, "\r\n");
+  record(out ? LOGR_LINE_OUT : LOGR_LINE_IN, level, category, session, line, n < 1024 ? n : 1024, true);
+}
+
+void log_vtext(int level, int category, const char *fmt, va_list args)
+{
+  if ( ! log_enabled(level, category) ) return;
+  char text[1024];
+  int n = vsnprintf(text, sizeof text, fmt, args);
+  if ( n >= (int) sizeof text ) n = sizeof text - 1;
+  while ( n > 0 && text[n-1] == '\n' ) n--;
+  record(LOGR_TEXT, level, category, -1, text, n, true);
+}
+
+void log_text(int level, int category, const char *fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  log_vtext(level, category, fmt, args);
+  va_end(args);
+}
+
+// Move every ring's records to the file.
+static void drain(void)
+{
+  int threads = atomic_load(&n_rings);
+  for (int t = 0; t < threads && t < LOG_THREADS; t++)
+  {
+    LOG_RING *r = atomic_load(&rings[t]);
+    if ( r == NULL ) continue;
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    while ( tail < head )
+    {
+      size_t offset = tail % LOG_BYTES;
+      if ( LOG_BYTES - offset < sizeof(LOG_RECORD) ) { tail += LOG_BYTES - offset; continue; }
+      LOG_RECORD *rec = (LOG_RECORD *) ( r->buf + offset );
+      if ( rec->kind != LOGR_PAD ) fwrite(rec, 1, rec->size, log_file);
+      tail += rec->size;
+    }
+    atomic_store_explicit(&r->tail, tail, memory_order_release);
+
+    uint64_t dropped = atomic_exchange(&r->dropped, 0);
+    if ( dropped > 0 ) log_text(LOG_WARN, LOGC_MISC, "thread %d: %lu records dropped, ring full", t, (unsigned long) dropped);
+  }
+  fflush(log_file);
+}
+
+static void *t_logger(void *arg)
+{
+  UNUSED( arg );
+  trace_thread("logger");
+  struct timespec pause = { 0, LOG_DRAIN_MS * 1000000L };
+  while ( atomic_load(&logging) )
+  {
+    drain();
+    nanosleep(&pause, NULL);
+  }
+  drain();
+  return NULL;
+}
+
+// Log to 'path', at 'level' and above.  Returns false, with errno set,
+// if it can't be written.
+bool log_open(const char *path, int level)
+{
+  if ( (log_file = fopen(path, "w")) == NULL ) return false;
+  setvbuf(log_file, NULL, _IOFBF, 1 << 16);
+  struct timespec real;
+  clock_gettime(CLOCK_REALTIME, &real);
+  LOG_FILE_HEADER h = { .magic = LOG_MAGIC, .record_header = sizeof(LOG_RECORD),
+      .style12 = sizeof(STYLE12), .gameinfo = sizeof(GAMEINFO),
+      .realtime_offset = (int64_t) ( (uint64_t) real.tv_sec * 1000000000 + real.tv_nsec ) - (int64_t) now_ns() };
+  if ( fwrite(&h, sizeof h, 1, log_file) != 1 ) { fclose(log_file); log_file = NULL; return false; }
+
+  atomic_store(&logging, true);
+  if ( (errno = pthread_create(&logger, NULL, t_logger, NULL)) != 0 )
+  {
+    atomic_store(&logging, false);
+    fclose(log_file);
+    log_file = NULL;
+    return false;
+  }
+  atomic_store(&log_level, level);
+  return true;
+}
+
+// Write what is left and close the file.
+void log_close(void)
+{
+  if ( log_file == NULL ) return;
+  atomic_store(&log_level, -1);
+  atomic_store(&logging, false);
+  pthread_join(logger, NULL);
+  fclose(log_file);
+  log_file = NULL;
+}
+
+int log_parse_level(const char *name)
+{
+  for (int i = 0; i < N_LOG_LEVELS; i++) if ( equals((char *) name, (char *) LEVELS[i]) ) return i;
+  return -1;
+}
+
+// ":log [LEVEL [CATEGORY,...]]": show or change what is logged.
+void log_command(CONFIG *c, const char *args)
+{
+  char level[16] = "", categories[128] = "";
+  if ( sscanf(args, "%15s %127s", level, categories) >= 1 )
+  {
+    int l = log_parse_level(level), mask = 0;
+    if ( l == -1 ) { send_message(c->ib_mq, c->active, MSG_NOTICE, "no log level %s\n", level); return; }
+    char *save;
+    for (char *tok = strtok_r(categories, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save))
+    {
+      int bit = -1;
+      for (int i = 0; i < LEN(CATEGORIES); i++) if ( equals(tok, (char *) CATEGORIES[i]) ) bit = i;
+      if ( bit == -1 && ! equals(tok, "all") ) { send_message(c->ib_mq, c->active, MSG_NOTICE, "no log category %s\n", tok); return; }
+      mask |= bit == -1 ? LOGC_ALL : 1 << bit;
+    }
+    atomic_store(&log_categories, mask ? mask : LOGC_ALL);
+    if ( log_file != NULL ) atomic_store(&log_level, l);
+  }
+
+  int l = atomic_load(&log_level), mask = atomic_load(&log_categories);
+  char shown[128] = "";
+  for (int i = 0; i < LEN(CATEGORIES); i++)
+    if ( mask & ( 1 << i ) ) snprintf(shown + strlen(shown), sizeof shown - strlen(shown), "%s%s", shown[0] ? "," : "", CATEGORIES[i]);
+  if ( log_file == NULL ) send_message(c->ib_mq, c->active, MSG_NOTICE, "not logging; start with -L file\n");
+  else send_message(c->ib_mq, c->active, MSG_NOTICE, "logging %s and above: %s\n", LEVELS[l], shown);
+}
+
+
+/// Decoder
+
+static void print_s12_record(FILE *out, const STYLE12 *b)
+{
+  fprintf(out, "<12> game %u %s-%s ply %d %c to move, %s %s %s, clocks %d/%d ms, board ",
+      b->game_number, b->white, b->black, ( b->move_number - 1 ) * 2 + ( b->turn == 'B' ), b->turn, b->verbose_move, b->pretty_move, b->elapsed,
+      b->white_ms, b->black_ms);
+  for (int row = 0; row < 8; row++) fprintf(out, "%.8s%s", b->board[row], row < 7 ? "/" : "");
+  fprintf(out, " castle %c%c%c%c ep %d irreversible %u relation %d\n",
+      b->white_castle_short ? 'K' : '-', b->white_castle_long ? 'Q' : '-',
+      b->black_castle_short ? 'k' : '-', b->black_castle_long ? 'q' : '-',
+      b->double_push, b->irreversible, b->relation);
+}
+
+static void print_g1_record(FILE *out, const GAMEINFO *g)
+{
+  fprintf(out, "<g1> game %u %s %s, %u+%u, ratings %s/%s, partner %u\n", g->game_number, g->type,
+      g->rated ? "rated" : "unrated", g->white_initial_time, g->white_initial_inc, g->white_rating, g->black_rating,
+      g->partner_game_number);
+}
+
+// Print the log at 'path' as text, a line per record.  Returns the
+// number of records, or -1 (errno set).
+long log_decode(const char *path, FILE *out)
+{
+  FILE *in = fopen(path, "r");
+  if ( in == NULL ) return -1;
+  LOG_FILE_HEADER h;
+  if ( fread(&h, sizeof h, 1, in) != 1 || memcmp(h.magic, LOG_MAGIC, 8) != 0 || h.record_header != sizeof(LOG_RECORD)
+      || h.style12 != sizeof(STYLE12) || h.gameinfo != sizeof(GAMEINFO) )
+  {
+    fclose(in);
+    errno = EPROTO;
+    return -1;
+  }
+
+  char names[LOG_THREADS][32];
+  for (int i = 0; i < LOG_THREADS; i++) snprintf(names[i], sizeof names[i], "%d", i);
+  static unsigned char payload[UINT16_MAX];
+  LOG_RECORD r;
+  long n = 0;
+  while ( fread(&r, sizeof r, 1, in) == 1 )
+  {
+    size_t len = r.size - sizeof r;
+    if ( r.size < sizeof r || fread(payload, 1, len, in) != len ) { errno = EPROTO; n = -1; break; }
+    payload[len < sizeof payload ? len : sizeof payload - 1] = '\0';
+    if ( r.kind == LOGR_THREAD )
+    {
+      if ( r.thread < LOG_THREADS ) snprintf(names[r.thread], sizeof names[r.thread], "%.31s", (char *) payload);
+      continue;
+    }
+
+    int64_t real = (int64_t) r.ns + h.realtime_offset;
+    time_t secs = real / 1000000000;
+    struct tm tm;
+    char when[32];
+    localtime_r(&secs, &tm);
+    strftime(when, sizeof when, "%F %T", &tm);
+    int category = __builtin_ctz(r.category | 64);
+    fprintf(out, "%s.%09ld %-5s %-7s [%s]", when, (long) ( real % 1000000000 ),
+        r.level < N_LOG_LEVELS ? LEVELS[r.level] : "?", category < LEN(CATEGORIES) ? CATEGORIES[category] : "?",
+        r.thread < LOG_THREADS ? names[r.thread] : "?");
+    if ( r.session >= 0 ) fprintf(out, " s%d", r.session + 1);
+    fprintf(out, " ");
+    switch ( r.kind )
+    {
+      case LOGR_S12:      print_s12_record(out, (STYLE12 *) payload); break;
+      case LOGR_G1:       print_g1_record(out, (GAMEINFO *) payload); break;
+      case LOGR_LINE_IN:  fprintf(out, "< %s\n", (char *) payload); break;
+      case LOGR_LINE_OUT: fprintf(out, "> %s\n", (char *) payload); break;
+      default:            fprintf(out, "%s\n", (char *) payload); break;
+    }
+    n++;
+  }
+  fclose(in);
+  return n;
+}
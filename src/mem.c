@@ -0,0 +1,297 @@
+#include "vichess.h"
+
+#include <sys/resource.h>   // getrusage()
+
+// Memory accounting (-m, or :mem on).  The client's own allocations go
+// through mem_alloc() and friends, which put a header in front of each
+// block saying how big it is and whom it is counted against: the
+// subsystem that asked (MEM_*), and the kind of queue message the
+// thread was handling (see mem_message()).  Each of those keeps live
+// bytes, their peak, and allocations and bytes ever allocated.  Until
+// counting is turned on a block is only tagged; one allocated while it
+// is off is freed without being counted, so turning it on and off
+// never leaves the live figures wrong.
+//
+// A sampler thread reads the resident set size every MEM_SAMPLE_S
+// seconds into a day-long ring, and warns, once, when the RSS passes
+// the budget given with -m.  curses, libc and the thread stacks show
+// only in the RSS.
+
+#define MEM_SAMPLE_S    10
+#define MEM_SAMPLES     ( 86400 / MEM_SAMPLE_S )
+
+typedef struct MEM_HEADER
+{
+  size_t size;
+  uint8_t subsystem;            // MEM_*
+  uint8_t message;              // MSG_* + 1, or 0
+  bool counted;
+} __attribute__(( aligned(16) )) MEM_HEADER; // keeps the block aligned as malloc's
+
+typedef struct MEM_COUNTS
+{
+  _Atomic int64_t live, peak;
+  _Atomic int64_t allocs, bytes;
+} MEM_COUNTS;
+
+typedef struct MEM_SAMPLE
+{
+  uint32_t time;
+  uint32_t rss_kb;
+} MEM_SAMPLE;
+
+static const char *const SUBSYSTEMS[N_MEM_SUBSYSTEMS] =
+{
+  [MEM_PARSER]    = "parser",
+  [MEM_RENDER]    = "render",
+  [MEM_TRANSPORT] = "transport",
+  [MEM_GAMES]     = "games",
+};
+
+static const char *const MESSAGES[MEM_MESSAGES] =
+{
+  [0]                   = "none",
+  [MSG_LINE + 1]        = "line",
+  [MSG_INPUT + 1]       = "input",
+  [MSG_SWITCH + 1]      = "switch",
+  [MSG_NOTICE + 1]      = "notice",
+  [MSG_SEEKS + 1]       = "seeks",
+  [MSG_MOVES + 1]       = "moves",
+};
+
+atomic_bool mem_counting;
+static MEM_COUNTS subsystems[N_MEM_SUBSYSTEMS], messages[MEM_MESSAGES];
+static _Thread_local uint8_t message;
+static _Atomic uint64_t counting_since; // unix seconds, when first turned on
+
+static pthread_mutex_t samples_lock = PTHREAD_MUTEX_INITIALIZER;
+static MEM_SAMPLE samples[MEM_SAMPLES];
+static unsigned n_samples;              // ever taken; the ring holds the last MEM_SAMPLES
+static atomic_bool sampling;
+static _Atomic long budget_kb;
+
+// The thread handles a queue message of 'type' (MSG_*) from here on;
+// -1 for none.
+void mem_message(int type)
+{
+  message = type + 1;
+}
+
+static void count(MEM_COUNTS *c, int64_t bytes)
+{
+  int64_t live = atomic_fetch_add_explicit(&c->live, bytes, memory_order_relaxed) + bytes;
+  if ( bytes < 0 ) return;
+  atomic_fetch_add_explicit(&c->allocs, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&c->bytes, bytes, memory_order_relaxed);
+  int64_t peak = atomic_load_explicit(&c->peak, memory_order_relaxed);
+  while ( live > peak && ! atomic_compare_exchange_weak_explicit(&c->peak, &peak, live, memory_order_relaxed, memory_order_relaxed) )
+    ;
+}
+
+static void *tag(MEM_HEADER *h, int subsystem, size_t size)
+{
+  h->size      = size;
+  h->subsystem = subsystem;
+  h->message   = message;
+  h->counted   = atomic_load_explicit(&mem_counting, memory_order_relaxed);
+  if ( h->counted )
+  {
+    count(&subsystems[subsystem], size);
+    count(&messages[h->message], size);
+  }
+  return h + 1;
+}
+
+static void untag(const MEM_HEADER *h)
+{
+  if ( ! h->counted ) return;
+  count(&subsystems[h->subsystem], -(int64_t) h->size);
+  count(&messages[h->message], -(int64_t) h->size);
+}
+
+void *mem_alloc(int subsystem, size_t size)
+{
+  MEM_HEADER *h = malloc(sizeof *h + size);
+  return h != NULL ? tag(h, subsystem, size) : NULL;
+}
+
+void *mem_calloc(int subsystem, size_t n, size_t size)
+{
+  if ( size != 0 && n > ( SIZE_MAX - sizeof(MEM_HEADER) ) / size ) { errno = ENOMEM; return NULL; }
+  MEM_HEADER *h = calloc(1, sizeof *h + n * size);
+  return h != NULL ? tag(h, subsystem, n * size) : NULL;
+}
+
+// Counted as a free and an allocation.
+void *mem_realloc(int subsystem, void *p, size_t size)
+{
+  if ( p == NULL ) return mem_alloc(subsystem, size);
+  MEM_HEADER *h = (MEM_HEADER *) p - 1, old = *h;
+  if ( (h = realloc(h, sizeof *h + size)) == NULL ) return NULL;
+  untag(&old);
+  return tag(h, subsystem, size);
+}
+
+char *mem_strdup(int subsystem, const char *s)
+{
+  size_t len = strlen(s) + 1;
+  char *p = mem_alloc(subsystem, len);
+  return p != NULL ? memcpy(p, s, len) : NULL;
+}
+
+// For blocks from mem_*() only.
+void mem_free(void *p)
+{
+  if ( p == NULL ) return;
+  MEM_HEADER *h = (MEM_HEADER *) p - 1;
+  untag(h);
+  free(h);
+}
+
+void mem_get(int subsystem, MEM_STATS *s)
+{
+  const MEM_COUNTS *c = &subsystems[subsystem];
+  s->live   = atomic_load_explicit(&c->live, memory_order_relaxed);
+  s->peak   = atomic_load_explicit(&c->peak, memory_order_relaxed);
+  s->allocs = atomic_load_explicit(&c->allocs, memory_order_relaxed);
+  s->bytes  = atomic_load_explicit(&c->bytes, memory_order_relaxed);
+}
+
+
+/// RSS
+
+// Resident set size in kB, from /proc/self/statm, or 0.
+long mem_rss_kb(void)
+{
+  FILE *f = fopen("/proc/self/statm", "r");
+  if ( f == NULL ) return 0;
+  long size, resident = 0;
+  if ( fscanf(f, "%ld %ld", &size, &resident) != 2 ) resident = 0;
+  fclose(f);
+  return resident * ( sysconf(_SC_PAGESIZE) / 1024 );
+}
+
+static void *t_sampler(void *config)
+{
+  CONFIG *c = (CONFIG *) config;
+  trace_thread("mem");
+  bool over = false;
+  while ( true )
+  {
+    sleep(MEM_SAMPLE_S); // the first once the client is up
+    long rss = mem_rss_kb(), budget = atomic_load(&budget_kb);
+    pthread_mutex_lock(&samples_lock);
+    samples[n_samples++ % MEM_SAMPLES] = (MEM_SAMPLE) { .time = time(NULL), .rss_kb = rss };
+    pthread_mutex_unlock(&samples_lock);
+
+    if ( budget > 0 && rss > budget && ! over )
+    {
+      log_text(LOG_WARN, LOGC_MISC, "rss %.1f MB is over the budget of %.1f MB", rss / 1024.0, budget / 1024.0);
+      send_message(c->ib_mq, c->active, MSG_NOTICE, "memory: rss %.1f MB is over the budget of %.1f MB (see :mem)\n",
+          rss / 1024.0, budget / 1024.0);
+    }
+    over = budget > 0 && rss > budget;
+  }
+  return NULL;
+}
+
+// Count from here on, and sample the RSS; warn when it passes 'budget_mb'
+// (0: never).
+void mem_start(CONFIG *c, long budget_mb)
+{
+  atomic_store(&budget_kb, budget_mb * 1024);
+  atomic_store(&mem_counting, true);
+  uint64_t never = 0;
+  atomic_compare_exchange_strong(&counting_since, &never, time(NULL));
+  if ( atomic_exchange(&sampling, true) ) return;
+
+  // not one of the workers: it sleeps until the process exits
+  pthread_t t;
+  if ( pthread_create(&t, NULL, t_sampler, c) != 0 ) { atomic_store(&sampling, false); return; }
+  pthread_detach(t);
+}
+
+
+/// Reports
+
+static void family(FILE *f, const char *name, const char *type, const char *help, const char *label,
+    const char *const *names, const MEM_COUNTS *counts, int n, size_t field)
+{
+  fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+  for (int i = 0; i < n; i++)
+    fprintf(f, "%s{%s=\"%s\"} %ld\n", name, label, names[i],
+        (long) atomic_load_explicit((_Atomic int64_t *) ( (char *) &counts[i] + field ), memory_order_relaxed));
+}
+
+// The counts and RSS in the Prometheus text format, once counting has
+// been on; for metrics_write().
+void mem_write_metrics(FILE *f)
+{
+  if ( counting_since == 0 ) return;
+  family(f, "vichess_memory_live_bytes", "gauge", "Bytes allocated by the client and not yet freed, by subsystem (-m).",
+      "subsystem", SUBSYSTEMS, subsystems, N_MEM_SUBSYSTEMS, offsetof(MEM_COUNTS, live));
+  family(f, "vichess_memory_peak_bytes", "gauge", "The most live bytes, by subsystem.",
+      "subsystem", SUBSYSTEMS, subsystems, N_MEM_SUBSYSTEMS, offsetof(MEM_COUNTS, peak));
+  family(f, "vichess_memory_allocated_bytes_total", "counter", "Bytes ever allocated, by subsystem.",
+      "subsystem", SUBSYSTEMS, subsystems, N_MEM_SUBSYSTEMS, offsetof(MEM_COUNTS, bytes));
+  family(f, "vichess_memory_allocations_total", "counter", "Allocations, by subsystem.",
+      "subsystem", SUBSYSTEMS, subsystems, N_MEM_SUBSYSTEMS, offsetof(MEM_COUNTS, allocs));
+  family(f, "vichess_memory_message_live_bytes", "gauge", "Live bytes, by the queue message being handled when allocated.",
+      "type", MESSAGES, messages, MEM_MESSAGES, offsetof(MEM_COUNTS, live));
+  family(f, "vichess_memory_message_allocated_bytes_total", "counter", "Bytes ever allocated, by the queue message being handled.",
+      "type", MESSAGES, messages, MEM_MESSAGES, offsetof(MEM_COUNTS, bytes));
+  fprintf(f, "# HELP vichess_resident_bytes Resident set size.\n# TYPE vichess_resident_bytes gauge\n"
+             "vichess_resident_bytes %ld\n", mem_rss_kb() * 1024);
+}
+
+static void show_counts(CONFIG *c, const char *name, const MEM_COUNTS *m, double seconds)
+{
+  int64_t allocs = atomic_load(&m->allocs), bytes = atomic_load(&m->bytes);
+  if ( allocs == 0 ) return;
+  send_message(c->ib_mq, c->active, MSG_NOTICE, "  %-10s %9.1f %9.1f %10lu %9.2f\n", name,
+      atomic_load(&m->live) / 1024.0, atomic_load(&m->peak) / 1024.0, (unsigned long) allocs, bytes / 1024.0 / seconds);
+}
+
+// RSS in MB at 'points' times, 'step' seconds apart, the last now.
+static void show_rss(CONFIG *c, const char *what, int points, int step)
+{
+  char line[MAX_LINE_SIZE];
+  int n = 0;
+  pthread_mutex_lock(&samples_lock);
+  unsigned held = n_samples < MEM_SAMPLES ? n_samples : MEM_SAMPLES;
+  for (int i = points - 1; i >= 0; i--)
+  {
+    unsigned back = i * step / MEM_SAMPLE_S;
+    if ( back < held ) n += snprintf(line + n, sizeof line - n, " %.1f", samples[( n_samples - 1 - back ) % MEM_SAMPLES].rss_kb / 1024.0);
+    else               n += snprintf(line + n, sizeof line - n, " -");
+  }
+  pthread_mutex_unlock(&samples_lock);
+  send_message(c->ib_mq, c->active, MSG_NOTICE, "rss MB, %s:%s\n", what, line);
+}
+
+//    :mem          live and peak bytes, allocations and rate, RSS
+//    :mem on|off   count allocations, or stop
+void mem_command(CONFIG *c, char *args)
+{
+  while ( *args == ' ' ) args++;
+  if      ( begins_with(args, "on") )  mem_start(c, atomic_load(&budget_kb) / 1024);
+  else if ( begins_with(args, "off") ) atomic_store(&mem_counting, false);
+
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  long budget = atomic_load(&budget_kb);
+  char limit[64] = "";
+  if ( budget > 0 ) snprintf(limit, sizeof limit, ", budget %.1f MB", budget / 1024.0);
+  long rss = mem_rss_kb(), peak = ru.ru_maxrss > rss ? ru.ru_maxrss : rss;
+  send_message(c->ib_mq, c->active, MSG_NOTICE, "memory: rss %.1f MB (peak %.1f MB%s), counting %s\n",
+      rss / 1024.0, peak / 1024.0, limit, atomic_load(&mem_counting) ? "on" : "off");
+  if ( counting_since == 0 ) return;
+
+  double seconds = time(NULL) - counting_since + 1;
+  send_message(c->ib_mq, c->active, MSG_NOTICE, "  %-10s %9s %9s %10s %9s\n", "", "live KB", "peak KB", "allocs", "KB/s");
+  for (int i = 0; i < N_MEM_SUBSYSTEMS; i++) show_counts(c, SUBSYSTEMS[i], &subsystems[i], seconds);
+  send_message(c->ib_mq, c->active, MSG_NOTICE, "by message:\n");
+  for (int i = 0; i < MEM_MESSAGES; i++) show_counts(c, MESSAGES[i], &messages[i], seconds);
+  show_rss(c, "the last hour by 5 minutes", 13, 300);
+  show_rss(c, "the last day by 2 hours", 13, 7200);
+}
@@ -0,0 +1,194 @@
+#include "vichess.h"
+
+#include <sys/un.h>     // struct sockaddr_un
+
+// Runtime metrics, scraped in the Prometheus text format from a unix
+// socket (-M path):
+//
+//    curl --unix-socket /tmp/vichess.sock http://localhost/metrics
+//    socat - UNIX-CONNECT:/tmp/vichess.sock
+//
+// Counters are sharded by thread: each thread takes a cache line of
+// its own the first time it counts, so metric_add() is one uncontended
+// relaxed add and the threads never share a line.  A scrape sums the
+// shards.  Gauges are a single value, set by whoever owns the figure;
+// the queue depths are read from the queues when scraped.
+
+#define METRICS_SHARDS  16      // threads beyond share the last shard
+
+typedef struct METRIC
+{
+  const char *name;
+  const char *labels;           // NULL for none
+  bool gauge;
+  const char *help;             // shown once per name
+} METRIC;
+
+static const METRIC METRICS[N_METRICS] =
+{
+  [M_LINES_IN]          = { "vichess_lines_in_total",   NULL,                   false, "Lines read from server sockets." },
+  [M_BYTES_IN]          = { "vichess_bytes_in_total",   NULL,                   false, "Bytes of lines read from server sockets." },
+  [M_LINES_OUT]         = { "vichess_lines_out_total",  NULL,                   false, "Commands written to server sockets." },
+  [M_BYTES_OUT]         = { "vichess_bytes_out_total",  NULL,                   false, "Bytes written to server sockets." },
+  [M_MSG_LINE]          = { "vichess_messages_total",   "type=\"line\"",        false, "Queue messages handled by the writer, by type." },
+  [M_MSG_INPUT]         = { "vichess_messages_total",   "type=\"input\"",       false, NULL },
+  [M_MSG_SWITCH]        = { "vichess_messages_total",   "type=\"switch\"",      false, NULL },
+  [M_MSG_NOTICE]        = { "vichess_messages_total",   "type=\"notice\"",      false, NULL },
+  [M_MSG_SEEKS]         = { "vichess_messages_total",   "type=\"seeks\"",       false, NULL },
+  [M_MSG_MOVES]         = { "vichess_messages_total",   "type=\"moves\"",       false, NULL },
+  [M_BOARDS]            = { "vichess_server_lines_total", "kind=\"board\"",     false, "Server lines handled by the writer, by kind." },
+  [M_GAMEINFOS]         = { "vichess_server_lines_total", "kind=\"gameinfo\"",  false, NULL },
+  [M_HOLDINGS]          = { "vichess_server_lines_total", "kind=\"holdings\"",  false, NULL },
+  [M_TEXT]              = { "vichess_server_lines_total", "kind=\"text\"",      false, NULL },
+  [M_PARSE_BOARD]       = { "vichess_parse_errors_total", "kind=\"board\"",     false, "Input that could not be used: boards not following the last, unreadable move lists, seeks out of range." },
+  [M_PARSE_MOVES]       = { "vichess_parse_errors_total", "kind=\"moves\"",     false, NULL },
+  [M_PARSE_SEEK]        = { "vichess_parse_errors_total", "kind=\"seek\"",      false, NULL },
+  [M_RENDER_BOARD]      = { "vichess_renders_total",    "what=\"board\"",       false, "Window updates, by what was drawn." },
+  [M_RENDER_PLAYERS]    = { "vichess_renders_total",    "what=\"players\"",     false, NULL },
+  [M_RENDER_SEEKS]      = { "vichess_renders_total",    "what=\"seeks\"",       false, NULL },
+  [M_RENDER_MOVES]      = { "vichess_renders_total",    "what=\"moves\"",       false, NULL },
+  [M_RENDER_TEXT]       = { "vichess_renders_total",    "what=\"text\"",        false, NULL },
+  [M_SESSIONS_OPEN]     = { "vichess_sessions_open",    NULL,                   true,  "Sessions whose server socket is open." },
+};
+
+typedef struct SHARD
+{
+  _Atomic uint64_t v[N_METRICS];
+} __attribute__(( aligned(64) )) SHARD;
+
+static SHARD shards[METRICS_SHARDS];
+static atomic_int n_shards;
+static _Thread_local SHARD *mine;
+static _Atomic int64_t gauges[N_METRICS];
+
+void metric_add(int metric, uint64_t n)
+{
+  if ( mine == NULL )
+  {
+    int i = atomic_fetch_add(&n_shards, 1);
+    mine = &shards[i < METRICS_SHARDS ? i : METRICS_SHARDS - 1];
+  }
+  atomic_fetch_add_explicit(&mine->v[metric], n, memory_order_relaxed);
+}
+
+void metric_set(int metric, int64_t value)
+{
+  atomic_store_explicit(&gauges[metric], value, memory_order_relaxed);
+}
+
+uint64_t metric_value(int metric)
+{
+  if ( METRICS[metric].gauge ) return atomic_load_explicit(&gauges[metric], memory_order_relaxed);
+  uint64_t sum = 0;
+  for (int i = 0; i < METRICS_SHARDS; i++) sum += atomic_load_explicit(&shards[i].v[metric], memory_order_relaxed);
+  return sum;
+}
+
+static int queue_depth(FILE *f, mqd_t mq, const char *queue, bool header)
+{
+  struct mq_attr attr;
+  if ( mq_getattr(mq, &attr) == -1 ) return 0;
+  if ( header )
+    fprintf(f, "# HELP vichess_queue_depth Messages waiting on a queue: ib to the writer, ob to the sockets.\n"
+               "# TYPE vichess_queue_depth gauge\n");
+  fprintf(f, "vichess_queue_depth{queue=\"%s\"} %ld\n", queue, attr.mq_curmsgs);
+  return attr.mq_maxmsg;
+}
+
+// Every metric, in the Prometheus text format.  'c' may be NULL: then
+// the queues are left out.
+void metrics_write(FILE *f, CONFIG *c)
+{
+  for (int m = 0; m < N_METRICS; m++)
+  {
+    const METRIC *d = &METRICS[m];
+    if ( d->help != NULL )
+      fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", d->name, d->help, d->name, d->gauge ? "gauge" : "counter");
+    if ( d->gauge ) fprintf(f, "%s%s%s%s %ld\n", d->name, d->labels ? "{" : "", d->labels ? d->labels : "", d->labels ? "}" : "", (long) metric_value(m));
+    else            fprintf(f, "%s%s%s%s %lu\n", d->name, d->labels ? "{" : "", d->labels ? d->labels : "", d->labels ? "}" : "", (unsigned long) metric_value(m));
+  }
+  mem_write_metrics(f);
+  if ( c == NULL ) return;
+  int capacity = queue_depth(f, c->ib_mq, "ib", true);
+  queue_depth(f, c->ob_mq, "ob", false);
+  fprintf(f, "# HELP vichess_queue_capacity Messages a queue holds.\n# TYPE vichess_queue_capacity gauge\n"
+             "vichess_queue_capacity %d\n", capacity);
+}
+
+typedef struct METRICS_SERVER
+{
+  CONFIG *c;
+  int fd;
+} METRICS_SERVER;
+
+// One scrape per connection.  An HTTP request (curl, or Prometheus
+// behind a socket proxy) gets an HTTP response; anything else, or
+// nothing within 100 ms, gets the bare text.
+static void *t_metrics(void *data)
+{
+  METRICS_SERVER *m = (METRICS_SERVER *) data;
+  while ( true )
+  {
+    int fd = accept(m->fd, NULL, NULL);
+    if ( fd == -1 )
+    {
+      if ( errno == EINTR || errno == ECONNABORTED ) continue;
+      perror("metrics accept");
+      break;
+    }
+    char request[512] = "";
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    if ( poll(&pfd, 1, 100) == 1 ) { ssize_t n = recv(fd, request, sizeof request - 1, 0); UNUSED( n ); }
+
+    char *body = NULL;
+    size_t size = 0;
+    FILE *f = open_memstream(&body, &size);
+    if ( f == NULL ) { close(fd); continue; }
+    metrics_write(f, m->c);
+    fclose(f);
+
+    char header[128] = "";
+    if ( begins_with(request, "GET ") )
+      snprintf(header, sizeof header, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n", size);
+    if ( send(fd, header, strlen(header), MSG_NOSIGNAL) != -1 ) send(fd, body, size, MSG_NOSIGNAL);
+    free(body);
+    close(fd);
+  }
+  return NULL;
+}
+
+// Serve the metrics on unix socket 'path', from a thread of their own.
+// Returns false, with errno set, if the socket can't be made.
+bool metrics_serve(CONFIG *c, const char *path)
+{
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  if ( strlen(path) >= sizeof addr.sun_path ) { errno = ENAMETOOLONG; return false; }
+  snprintf(addr.sun_path, sizeof addr.sun_path, "%s", path);
+  // a stale socket from an earlier run goes; anything else is not ours
+  struct stat st;
+  if ( lstat(path, &st) == 0 )
+  {
+    if ( ! S_ISSOCK(st.st_mode) ) { errno = EEXIST; return false; }
+    unlink(path);
+  }
+
+  METRICS_SERVER *m = malloc(sizeof *m);
+  if ( m == NULL ) return false;
+  m->c = c;
+  if ( (m->fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1
+      || bind(m->fd, (struct sockaddr *) &addr, sizeof addr) == -1
+      || listen(m->fd, 8) == -1 )
+  {
+    int saved = errno;
+    if ( m->fd != -1 ) close(m->fd);
+    free(m);
+    errno = saved;
+    return false;
+  }
+
+  // not one of the workers: it blocks in accept() until the process exits
+  pthread_t t;
+  if ( (errno = pthread_create(&t, NULL, t_metrics, m)) != 0 ) { close(m->fd); free(m); return false; }
+  pthread_detach(t);
+  return true;
+}
@@ -0,0 +1,320 @@
+#include "vichess.h"
+
+// Vi-style move entry.  ":vi" puts the terminal in board mode, where
+// keystrokes are read one at a time, unechoed, and drive a cursor over
+// the board instead of filling the input line:
+//
+//    h j k l   left, down, up, right on the screen, so as the board is
+//              turned; a count first moves that many squares ("3k")
+//    K Q R B N P   the next of your pieces of that kind, in reading
+//              order from the cursor; a count skips ("2N")
+//    space x   pick up the piece under the cursor; on another square,
+//              put it down: the move goes out on that keystroke
+//    Esc       drop the count and the piece picked up
+//    :         one command line, as typed in line mode; local commands
+//              keep their ':', anything else goes to the server
+//    i         back to line mode
+//
+// A move is sent as coordinates ("e2e4", promoting to whatever "promote"
+// is set to) and checked against the board first when it is your move;
+// on the opponent's it goes as a premove, unchecked.  The reader stamps
+// each keystroke as wgetch() returns it, and the I/O loop measures from
+// the stamp of a move's last keystroke to its send() on the socket.
+
+#define KEY_LATENCIES   1024            // the last moves, for ":vi stats"
+#define ESC             27
+
+static atomic_int mode = KM_LINE;
+static atomic_int cursor = -1;          // screen square, row * 8 + col
+static atomic_int selected = -1;        // likewise, or -1
+static int count;                       // the reader's alone
+
+// the active session's board, as the writer last showed it
+static pthread_mutex_t board_lock = PTHREAD_MUTEX_INITIALIZER;
+static STYLE12 board;
+static int board_session = -1;          // -1: no board yet
+static int board_pane;
+
+// keystroke to socket
+static _Atomic uint64_t key_ns;         // the last keystroke of the move in flight
+static pthread_mutex_t latency_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t latencies[KEY_LATENCIES];
+static uint64_t n_latencies;
+
+int modal_mode(void)
+{
+  return atomic_load(&mode);
+}
+
+// The piece on screen square 'cell' of 'b', "-" if none.  The writer
+// turns the board when black is at the bottom.
+static char piece_at(const STYLE12 *b, int cell)
+{
+  int row = cell / N_COLS, col = cell % N_COLS;
+  return b->flip ? b->board[N_ROWS - 1 - row][N_COLS - 1 - col] : b->board[row][col];
+}
+
+static void square_name(const STYLE12 *b, int cell, char *name)
+{
+  int row = cell / N_COLS, col = cell % N_COLS;
+  if ( b->flip ) { row = N_ROWS - 1 - row; col = N_COLS - 1 - col; }
+  name[0] = 'a' + col;
+  name[1] = '8' - row;
+  name[2] = '\0';
+}
+
+// Whose pieces the cursor picks up: the side at the bottom in your own
+// game, else the side to move.
+static bool mine(const STYLE12 *b, char piece)
+{
+  if ( piece == '-' ) return false;
+  bool white = b->relation == PLAYING_MY_MOVE || b->relation == PLAYING_OPPONENTS_MOVE ? ! b->flip : b->turn == 'W';
+  return white == (bool) isupper(piece);
+}
+
+// The color pair for board square ('row', 'col') on screen, where the
+// square would otherwise be 'pair'.  Called by cb_write_board() with w1
+// held, so it takes no lock.
+int modal_square(int row, int col, int pair)
+{
+  if ( atomic_load(&mode) != KM_BOARD ) return pair;
+  int cell = row * N_COLS + col;
+  if ( cell == atomic_load(&selected) ) return SELECTED_SQUARE;
+  if ( cell == atomic_load(&cursor) )   return CURSOR_SQUARE;
+  return pair;
+}
+
+// Redraw square 'cell' of the board, if it is on screen.
+static void draw(CONFIG *c, int cell)
+{
+  if ( c->w1 == NULL || cell < 0 ) return;
+  pthread_mutex_lock(&board_lock);
+  bool shown = board_session == c->active;
+  char piece = piece_at(&board, cell);
+  int pane = board_pane;
+  pthread_mutex_unlock(&board_lock);
+  if ( ! shown ) return;
+
+  int row = cell / N_COLS, col = cell % N_COLS;
+  SQUARE_VIEW v = { .pane = pane, .row = row, .col = col, .glyph = char_to_piece(piece),
+      .pair = modal_square(row, col, even(row + col) ? LIGHT_SQUARE : DARK_SQUARE) };
+  use_window(c->w1, (NCURSES_WINDOW_CB) cb_write_square, &v);
+}
+
+// The writer, having shown session 'session''s board 's12' in 'pane'.
+void modal_board(int session, const STYLE12 *s12, int pane)
+{
+  pthread_mutex_lock(&board_lock);
+  board = *s12;
+  board_pane = pane;
+  board_session = s12->game_number != 0 ? session : -1;
+  pthread_mutex_unlock(&board_lock);
+}
+
+static void move_cursor(CONFIG *c, int cell)
+{
+  int old = atomic_exchange(&cursor, cell);
+  if ( old == cell ) return;
+  draw(c, old);
+  draw(c, cell);
+}
+
+static void select_square(CONFIG *c, int cell)
+{
+  int old = atomic_exchange(&selected, cell);
+  if ( old == cell ) return;
+  draw(c, old);
+  draw(c, cell);
+}
+
+// The 'n'th of your pieces 'letter' (upper case) after the cursor, in
+// reading order, wrapping; -1 if there is none.
+static int find_piece(int letter, int n)
+{
+  int from = atomic_load(&cursor), found = -1, seen = 0;
+  pthread_mutex_lock(&board_lock);
+  for (int i = 1; i <= N_ROWS * N_COLS && seen < n; i++)
+  {
+    int cell = ( from + i + N_ROWS * N_COLS ) % ( N_ROWS * N_COLS );
+    char piece = piece_at(&board, cell);
+    if ( toupper(piece) == letter && mine(&board, piece) ) { found = cell; seen++; }
+  }
+  pthread_mutex_unlock(&board_lock);
+  return found;
+}
+
+// Space on square 'cell': pick up, put down, or send.
+static void pick(CONFIG *c, int cell, uint64_t ns)
+{
+  char move[8], to[3], notice[64] = "";
+  int from = atomic_load(&selected), session;
+
+  pthread_mutex_lock(&board_lock);
+  session = board_session;
+  STYLE12 b = board;
+  pthread_mutex_unlock(&board_lock);
+  if ( session == -1 ) { send_message(c->ib_mq, c->active, MSG_NOTICE, "no board\n"); return; }
+
+  // another of your own pieces is picked up instead
+  if ( from == -1 || from == cell || mine(&b, piece_at(&b, cell)) )
+  {
+    select_square(c, from == cell || ! mine(&b, piece_at(&b, cell)) ? -1 : cell);
+    return;
+  }
+
+  square_name(&b, from, move);
+  square_name(&b, cell, to);
+  strcat(move, to);
+  if ( b.relation == PLAYING_MY_MOVE || b.relation == EXAMINING )
+  {
+    POSITION pos;
+    position_from_style12(&pos, &b);
+    if ( parse_move(&pos, move) == MOVE_NONE ) snprintf(notice, sizeof notice, "illegal move %s\n", move);
+  }
+  else if ( b.relation != PLAYING_OPPONENTS_MOVE )
+    snprintf(notice, sizeof notice, "not your game\n");
+
+  if ( notice[0] == '\0' )
+  {
+    // the move first, then the echo and the redraw
+    atomic_store(&key_ns, ns);
+    send_command(c->ob_mq, session, BO_MOVE, "%s\n", move);
+    send_message(c->ib_mq, session, MSG_INPUT, "%s\n", move);
+  }
+  else send_message(c->ib_mq, c->active, MSG_NOTICE, "%s", notice);
+  select_square(c, -1);
+}
+
+// Handle keystroke 'ch', read at 'ns'.  Returns true if a command line
+// is to be read.
+bool modal_key(CONFIG *c, int ch, uint64_t ns)
+{
+  if ( ( ch >= '1' && ch <= '9' ) || ( ch == '0' && count > 0 ) )
+  {
+    if ( count < 100 ) count = count * 10 + ch - '0';
+    return false;
+  }
+  int n = count > 0 ? count : 1, cell = atomic_load(&cursor);
+  int row = cell / N_COLS, col = cell % N_COLS;
+  count = 0;
+
+  switch ( ch )
+  {
+    case 'h': col = col - n < 0 ? 0 : col - n; break;
+    case 'l': col = col + n >= N_COLS ? N_COLS - 1 : col + n; break;
+    case 'k': row = row - n < 0 ? 0 : row - n; break;
+    case 'j': row = row + n >= N_ROWS ? N_ROWS - 1 : row + n; break;
+    case 'K': case 'Q': case 'R': case 'B': case 'N': case 'P':
+      if ( (cell = find_piece(ch, n)) == -1 ) return false;
+      move_cursor(c, cell);
+      return false;
+    case ' ': case 'x': case '\n':
+      pick(c, cell, ns);
+      return false;
+    case ESC:
+      select_square(c, -1);
+      return false;
+    case 'i':
+      modal_leave(c);
+      return false;
+    case ':':
+      return true;
+    default:
+      return false;
+  }
+  move_cursor(c, row * N_COLS + col);
+  return false;
+}
+
+// ":vi": board mode, the cursor on your king the first time.
+void modal_enter(CONFIG *c)
+{
+  if ( atomic_load(&cursor) == -1 )
+  {
+    int king = find_piece('K', 1);
+    atomic_store(&cursor, king != -1 ? king : ( N_ROWS - 1 ) * N_COLS + 4);
+  }
+  count = 0;
+  atomic_store(&mode, KM_BOARD);
+  draw(c, atomic_load(&cursor));
+}
+
+void modal_leave(CONFIG *c)
+{
+  select_square(c, -1);
+  atomic_store(&mode, KM_LINE);
+  draw(c, atomic_load(&cursor));
+}
+
+// Read and handle one keystroke, waiting KEY_POLL_MS at most.  Returns
+// true if a command line is to be read.
+bool modal_read(CONFIG *c)
+{
+  KEYSTROKE k = { .ch = ERR };
+  char here[3] = "", there[3] = "";
+  int from = atomic_load(&selected), cell = atomic_load(&cursor);
+
+  pthread_mutex_lock(&board_lock);
+  bool have_board = board_session != -1;
+  if ( from != -1 ) square_name(&board, from, here);
+  square_name(&board, cell, there);
+  pthread_mutex_unlock(&board_lock);
+
+  if ( ! have_board )  snprintf(k.status, sizeof k.status, "-- BOARD --  (no board)");
+  else if ( count > 0 ) snprintf(k.status, sizeof k.status, "-- BOARD --  %s%s%s  %d", here, from != -1 ? "-" : "", there, count);
+  else                 snprintf(k.status, sizeof k.status, "-- BOARD --  %s%s%s", here, from != -1 ? "-" : "", there);
+
+  use_window(c->w3, (NCURSES_WINDOW_CB) cb_read_key, &k);
+  return k.ch != ERR && modal_key(c, k.ch, k.ns);
+}
+
+// The I/O loop, having written a keyed move to its socket.
+void modal_sent(void)
+{
+  uint64_t now = now_ns(), start = atomic_exchange(&key_ns, 0);
+  if ( start == 0 ) return;
+  if ( atomic_load_explicit(&tracing, memory_order_relaxed) ) trace_record(TR_KEY_TO_SOCKET, start, now);
+  pthread_mutex_lock(&latency_lock);
+  latencies[n_latencies++ % KEY_LATENCIES] = now - start;
+  pthread_mutex_unlock(&latency_lock);
+  log_text(LOG_DEBUG, LOGC_UI, "move keyed to socket in %.1f us", ( now - start ) / 1e3);
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return (x > y) - (x < y);
+}
+
+// Keystroke-to-socket figures over the last moves, in ns; returns how
+// many moves they cover.
+size_t modal_latency(uint64_t *p50, uint64_t *p99, uint64_t *max)
+{
+  uint64_t sorted[KEY_LATENCIES];
+  pthread_mutex_lock(&latency_lock);
+  size_t n = n_latencies < KEY_LATENCIES ? n_latencies : KEY_LATENCIES;
+  memcpy(sorted, latencies, n * sizeof *sorted);
+  pthread_mutex_unlock(&latency_lock);
+
+  *p50 = *p99 = *max = 0;
+  if ( n == 0 ) return 0;
+  qsort(sorted, n, sizeof *sorted, compare_latency);
+  *p50 = sorted[n / 2];
+  *p99 = sorted[n * 99 / 100];
+  *max = sorted[n - 1];
+  return n;
+}
+
+// ":vi [stats]"
+void modal_command(CONFIG *c, char *args)
+{
+  char verb[8] = "";
+  sscanf(args, "%7s", verb);
+  if ( ! equals(verb, "stats") ) { modal_enter(c); return; }
+
+  uint64_t p50, p99, max;
+  size_t n = modal_latency(&p50, &p99, &max);
+  if ( n == 0 ) send_message(c->ib_mq, c->active, MSG_NOTICE, "no moves keyed yet\n");
+  else send_message(c->ib_mq, c->active, MSG_NOTICE, "keystroke to socket, last %zu moves: p50 %.1f p99 %.1f max %.1f us\n",
+      n, p50 / 1e3, p99 / 1e3, max / 1e3);
+}
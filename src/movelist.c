@@ -0,0 +1,321 @@
+#include "vichess.h"
+
+// Full move history per game, for local navigation.
+//
+// Each game keeps its moves (packed, with the server's SAN to show)
+// and a snapshot of the position every MOVELIST_SNAPSHOT plies.  Any
+// ply is then one snapshot copy and fewer than MOVELIST_SNAPSHOT moves
+// away, so stepping back or forward, or jumping, costs the same however
+// long the game is, and nothing goes to the server.
+//
+// Boards arrive one ply at a time and each move is checked against the
+// board that follows it; a board that does not follow (a missed move,
+// a game joined late) starts the record again from its position.  A
+// game joined after its first move is backfilled once from the
+// server's "moves" listing, which is read here and, when it is the
+// reply to the client's own request (BO_MOVES), kept out of the console:
+//
+//    Movelist for game 77:
+//    ...
+//    Move  Newton                  Einstein
+//    ----  ---------------------   ---------------------
+//      1.  e4      (0:00.000)      e5      (0:00.000)
+//      2.  Nf3     (0:01.234)
+//          {Still in progress} *
+//
+// The game's ply may go back without losing the moves after it, as in
+// an examined game; they are dropped when a different move is made.
+
+static void reserve(GAME_MOVES *g, int n)
+{
+  if ( n <= g->max ) return;
+  int max = g->max ? g->max : 128;
+  while ( max < n ) max *= 2;
+  if ( (g->moves = mem_realloc(MEM_GAMES, g->moves, max * sizeof *g->moves)) == NULL
+      || (g->san = mem_realloc(MEM_GAMES, g->san, max * sizeof *g->san)) == NULL
+      || (g->snapshots = mem_realloc(MEM_GAMES, g->snapshots, ( max / MOVELIST_SNAPSHOT + 1 ) * sizeof *g->snapshots)) == NULL )
+    error("movelist realloc");
+  g->max = max;
+}
+
+// start the record over at 'pos', ply 'ply'
+static void restart(GAME_MOVES *g, const POSITION *pos, int ply)
+{
+  reserve(g, 1);
+  g->first_ply = g->ply = ply;
+  g->n = 0;
+  g->snapshots[0] = g->current = *pos;
+  g->view = -1;
+  g->drawn = -1;
+}
+
+// Make move 'm' at the game's ply.  The moves recorded after it go,
+// unless it is the one that was recorded next.
+static void push(GAME_MOVES *g, MOVE m, const char *san)
+{
+  int i = g->ply - g->first_ply;
+  if ( i >= g->n || g->moves[i] != m )
+  {
+    if ( g->drawn > i ) g->drawn = -1; // the pane shows moves that are gone
+    if ( g->view > g->first_ply + i ) g->view = -1;
+    reserve(g, i + 1);
+    g->moves[i] = m;
+    snprintf(g->san[i], sizeof g->san[i], "%s", san);
+    g->n = i + 1;
+  }
+  UNDO undo;
+  make_move(&g->current, m, &undo);
+  g->ply++;
+  if ( ( i + 1 ) % MOVELIST_SNAPSHOT == 0 ) g->snapshots[( i + 1 ) / MOVELIST_SNAPSHOT] = g->current;
+}
+
+// The position at ply 'ply' of the record: its snapshot, and the moves
+// since.
+void movelist_position(const GAME_MOVES *g, int ply, POSITION *pos)
+{
+  int i = ply - g->first_ply, k = i / MOVELIST_SNAPSHOT;
+  *pos = g->snapshots[k];
+  UNDO undo;
+  for (int j = k * MOVELIST_SNAPSHOT; j < i; j++) make_move(pos, g->moves[j], &undo);
+}
+
+GAME_MOVES *movelist_find(SESSION *s, unsigned int game_number)
+{
+  if ( s->movelist == NULL || game_number == 0 ) return NULL;
+  for (int i = 0; i < MOVELIST_GAMES; i++)
+    if ( s->movelist->games[i].used && s->movelist->games[i].game_number == game_number ) return &s->movelist->games[i];
+  return NULL;
+}
+
+// the game's record, or a new one in place of the least recently used
+static GAME_MOVES *find_game(SESSION *s, unsigned int game_number)
+{
+  if ( s->movelist == NULL && (s->movelist = mem_calloc(MEM_GAMES, 1, sizeof *s->movelist)) == NULL ) error("movelist calloc");
+  GAME_MOVES *g = movelist_find(s, game_number), *lru = &s->movelist->games[0];
+  if ( g != NULL ) return g;
+  for (int i = 0; i < MOVELIST_GAMES; i++)
+  {
+    g = &s->movelist->games[i];
+    if ( ! g->used || ( lru->used && g->last_used < lru->last_used ) ) lru = g;
+  }
+  lru->used         = true;
+  lru->game_number  = game_number;
+  lru->backfill     = BACKFILL_NONE;
+  lru->ply          = -1; // no board yet; the buffers are kept
+  return lru;
+}
+
+// The move a board reports, made on the position before it.
+static bool follows(const GAME_MOVES *g, const STYLE12 *b, const POSITION *pos, MOVE *m)
+{
+  POSITION before = g->current;
+  *m = parse_move(&before, b->pretty_move);
+  if ( *m == MOVE_NONE && strlen(b->verbose_move) > 2 ) *m = parse_move(&before, b->verbose_move + 2); // "P/e2-e4"
+  UNDO undo;
+  return *m != MOVE_NONE && make_move(&before, *m, &undo) && before.hash == pos->hash;
+}
+
+// Record a board of session 's' whose position is 'pos'.  Returns the
+// game's record.
+GAME_MOVES *movelist_board(CONFIG *c, SESSION *s, const STYLE12 *b, const POSITION *pos)
+{
+  GAME_MOVES *g = find_game(s, b->game_number);
+  int ply = style12_ply(b);
+  g->last_used = now_ns();
+
+  MOVE m;
+  if ( g->ply == -1 ) restart(g, pos, ply);
+  else if ( ply == g->ply && pos->hash == g->current.hash ) return g; // refresh
+  else if ( ply == g->ply + 1 && follows(g, b, pos, &m) ) push(g, m, b->pretty_move);
+  else if ( ply >= g->first_ply && ply <= g->first_ply + g->n )
+  {
+    // along the record: a takeback, or backward and forward when examining
+    POSITION at;
+    movelist_position(g, ply, &at);
+    if ( at.hash == pos->hash ) { g->ply = ply; g->current = at; }
+    else { restart(g, pos, ply); metric_add(M_PARSE_BOARD, 1); }
+  }
+  else
+  {
+    if ( ply == 0 ) g->backfill = BACKFILL_NONE; // the number went to a new game
+    else            metric_add(M_PARSE_BOARD, 1);
+    restart(g, pos, ply);
+  }
+
+  // a player follows the game whatever they were looking at
+  if ( b->relation == PLAYING_MY_MOVE || b->relation == PLAYING_OPPONENTS_MOVE ) g->view = -1;
+
+  // joined late: ask for the moves before this board, once
+  if ( g->first_ply > 0 && g->backfill == BACKFILL_NONE && c->w2 != NULL && b->relation != ISOLATED )
+  {
+    g->backfill = BACKFILL_ASKED;
+    send_command(c->ob_mq, s->id, BO_MOVES, "moves %u\n", b->game_number);
+  }
+  return g;
+}
+
+// A game's "moves" listing is read: put its moves ahead of the record,
+// if they lead to the position the record starts from.
+static void backfill(MOVELIST *l, GAME_MOVES *g)
+{
+  GAME_MOVES *r = &l->read;
+  g->backfill = BACKFILL_DONE;
+  if ( l->failed || g->first_ply == 0 || g->first_ply > r->first_ply + r->n ) return;
+
+  POSITION at;
+  movelist_position(r, g->first_ply, &at);
+  if ( at.hash != g->snapshots[0].hash ) return; // a setup or wild position
+
+  r->ply = g->first_ply;
+  r->current = at;
+  for (int i = 0; i < g->n; i++) push(r, g->moves[i], g->san[i]);
+  r->ply = g->ply;
+  movelist_position(r, g->ply, &r->current);
+
+  // the merged record takes the game's place; its old buffers are
+  // kept for the next listing
+  GAME_MOVES merged = *r;
+  merged.used         = true;
+  merged.game_number  = g->game_number;
+  merged.last_used    = g->last_used;
+  merged.view         = g->view;
+  merged.backfill     = BACKFILL_DONE;
+  merged.drawn        = -1;
+  *r = *g;
+  *g = merged;
+}
+
+// A line of session 's', from the reply to a command of 'owner' (BO_*).
+// Returns true if it belongs to the reply to a "moves" the client sent
+// itself; those are not shown.  One the user typed is read, and shown.
+bool movelist_feed(CONFIG *c, SESSION *s, const char *line, int owner)
+{
+  UNUSED( c );
+  MOVELIST *l = s->movelist;
+  if ( l == NULL ) return false;
+
+  const char *p = line;
+  if ( begins_with((char *) p, "% ") ) p += 2; // a prompt ahead of the output
+  p += strspn(p, "\n\r ");
+
+  unsigned int game;
+  if ( sscanf(p, "Movelist for game %u:", &game) == 1 )
+  {
+    GAME_MOVES *g = movelist_find(s, game);
+    if ( g == NULL ) return false;
+    POSITION start;
+    position_start(&start);
+    restart(&l->read, &start, 0);
+    l->reading  = game;
+    l->hide     = owner == BO_MOVES;
+    l->failed   = false;
+    l->rows     = 0;
+    return l->hide;
+  }
+  if ( l->reading == 0 ) return false;
+
+  bool hide = l->hide;
+  if ( *p == '{' || ++l->rows > MOVELIST_ROWS ) // "{Still in progress} *", "{White resigns} 0-1"
+  {
+    GAME_MOVES *g = movelist_find(s, l->reading);
+    if ( g != NULL ) backfill(l, g);
+    l->reading = 0;
+  }
+  else if ( isdigit(*p) && ! l->failed )
+  {
+    // "  1.  e4      (0:00.000)      e5      (0:00.000)"
+    char *cp = strdupa(p), *save;
+    char *tok = strtok_r(cp, " \r\n", &save);
+    if ( tok == NULL || tok[strlen(tok) - 1] != '.' ) return hide;
+    while ( (tok = strtok_r(NULL, " \r\n", &save)) != NULL )
+    {
+      if ( tok[0] == '(' || equals(tok, "...") ) continue; // times
+      MOVE m = parse_move(&l->read.current, tok);
+      if ( m == MOVE_NONE ) { l->failed = true; metric_add(M_PARSE_MOVES, 1); break; }
+      push(&l->read, m, tok);
+    }
+  }
+  return hide;
+}
+
+void movelist_free(SESSION *s)
+{
+  if ( s->movelist == NULL ) return;
+  for (int i = 0; i <= MOVELIST_GAMES; i++)
+  {
+    GAME_MOVES *g = i < MOVELIST_GAMES ? &s->movelist->games[i] : &s->movelist->read;
+    mem_free(g->moves);
+    mem_free(g->san);
+    mem_free(g->snapshots);
+  }
+  mem_free(s->movelist);
+  s->movelist = NULL;
+}
+
+// Draw session 's''s main board at the ply it is viewed at.
+static void draw_board(CONFIG *c, SESSION *s, const GAME_MOVES *g)
+{
+  UPDATE *u = &s->u;
+  if ( u->white_rating == NULL || u->my_nick == NULL ) return;
+  if ( g == NULL || g->view == -1 ) { use_window(c->w1, (NCURSES_WINDOW_CB) cb_write_board, u); return; }
+
+  UPDATE v = *u;
+  POSITION pos;
+  movelist_position(g, g->view, &pos);
+  bool flip = u->my_color == BLACK;
+  for (int row = 0; row < N_ROWS; row++)
+    for (int file = 0; file < N_COLS; file++)
+      v.board[flip ? 7 - row : row][flip ? 7 - file : file] = char_to_piece(piece_char(pos.board[( 7 - row ) * 16 + file]));
+
+  // where we are, in place of the opening
+  char caption[MAX_LINE_SIZE];
+  int last = g->first_ply + g->n, before = g->view - 1;
+  if ( g->view == g->first_ply )
+    snprintf(caption, sizeof caption, "start (ply %d of %d)  :live to return", g->view, last);
+  else
+    snprintf(caption, sizeof caption, "%d.%s %s (ply %d of %d)  :live to return", before / 2 + 1,
+        before % 2 ? ".." : "", g->san[before - g->first_ply], g->view, last);
+  v.opening = caption;
+  use_window(c->w1, (NCURSES_WINDOW_CB) cb_write_board, &v);
+}
+
+// The main board of session 's' and its move list, as the user is
+// viewing them.  Writer thread only.
+void movelist_show(CONFIG *c, SESSION *s)
+{
+  GAME_MOVES *g = movelist_find(s, s->u.s12.game_number);
+  draw_board(c, s, g);
+  if ( s->u.pane == PANE_WHOLE ) use_window(c->w1, (NCURSES_WINDOW_CB) cb_write_moves, g);
+}
+
+// A navigation command for session 's' (":" dropped):
+//
+//    back [N]      N plies back (default 1)
+//    fwd [N]       N plies forward
+//    goto N        the position after move N; 0 for the first
+//    live          back to the game as it is
+//
+// Writer thread only.
+void movelist_command(CONFIG *c, SESSION *s, const char *command)
+{
+  GAME_MOVES *g = movelist_find(s, s->u.s12.game_number);
+  if ( g == NULL )
+  {
+    use_window(c->w2, (NCURSES_WINDOW_CB) cb_write_response, "no game to navigate\n");
+    return;
+  }
+
+  char verb[16] = "";
+  int n = 1, view = g->view == -1 ? g->ply : g->view;
+  sscanf(command, "%15s %d", verb, &n);
+  if      ( equals(verb, "back") ) view -= n;
+  else if ( equals(verb, "fwd") )  view += n;
+  else if ( equals(verb, "goto") ) view = n * 2;
+  else                             view = g->ply;
+
+  int last = g->first_ply + g->n;
+  if ( view < g->first_ply ) view = g->first_ply;
+  if ( view > last )         view = last;
+  g->view = view == g->ply ? -1 : view;
+  if ( s->id == c->active ) draw_board(c, s, g);
+}
@@ -0,0 +1,206 @@
+#include "vichess.h"
+
+// Offline play against the built-in engine (-c THREADS).
+//
+// The engine sits behind a socketpair and talks like a (very small)
+// chess server: it sends <g1> and <12> lines and plain text, so the
+// rest of the client -- I/O loop, parsers, board, event ring -- cannot
+// tell it from FICS.  Commands typed in the session:
+//
+//    e4, Nf3, exd5, e2e4   make a move; the engine answers
+//    go                    let the engine move now (e.g. to play black)
+//    new                   start over
+//    time MS, depth N      limit each search (default 1000 ms)
+//    quit
+
+#define OFFLINE_GAME    1
+#define OFFLINE_NAME    "vichess"
+
+typedef struct OFFLINE
+{
+  int sk;
+  char handle[NICK_MAX];
+  POSITION pos;
+  uint64_t keys[MAX_GAME_PLY];  // hashes of the positions so far
+  int n_keys;
+  int engine_side;
+  bool over;
+  SEARCH_LIMITS limits;
+  LINE_BUFFER in;
+} OFFLINE;
+
+static void offline_send(OFFLINE *o, char *fmt, ...)
+{
+  char msg[MAX_LINE_SIZE];
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(msg, MAX_LINE_SIZE, fmt, args);
+  va_end(args);
+  if (len >= MAX_LINE_SIZE) len = MAX_LINE_SIZE - 1;
+  if (send(o->sk, msg, len, MSG_NOSIGNAL) == -1) perror("offline send");
+}
+
+static void send_board(OFFLINE *o, const char *verbose, const char *san)
+{
+  char line[MAX_LINE_SIZE];
+  bool user_white = o->engine_side == BLACK_SIDE;
+  int relation    = o->over ? ISOLATED : (o->pos.side == o->engine_side ? PLAYING_OPPONENTS_MOVE : PLAYING_MY_MOVE);
+  position_to_style12(&o->pos, line, sizeof line, OFFLINE_GAME,
+      user_white ? o->handle : OFFLINE_NAME, user_white ? OFFLINE_NAME : o->handle,
+      relation, user_white ? PLAYING_AS_WHITE : PLAYING_AS_BLACK, 0, 0, verbose, san);
+  offline_send(o, "%s", line);
+}
+
+static void new_game(OFFLINE *o, int engine_side)
+{
+  position_start(&o->pos);
+  o->n_keys       = 0;
+  o->engine_side  = engine_side;
+  o->over         = false;
+  engine_tt_clear();
+  offline_send(o, "<g1> %d p=0 t=untimed r=0 u=1,0 it=0,0 i=0,0 pt=0 rt=0,0 ts=0,0\n\r", OFFLINE_GAME);
+  offline_send(o, "New game: %s vs. %s.  Type a move, or \"go\" to let %s move.\n\r",
+      o->handle, OFFLINE_NAME, OFFLINE_NAME);
+  send_board(o, NULL, NULL);
+}
+
+// Announce the result if the game is over.
+static void check_game_over(OFFLINE *o)
+{
+  MOVE_LIST list;
+  generate_legal_moves(&o->pos, &list);
+
+  int repetitions = 1;
+  for (int i = o->n_keys - 2; i >= 0; i--) repetitions += ( o->keys[i] == o->pos.hash );
+
+  const char *white = o->engine_side == BLACK_SIDE ? o->handle : OFFLINE_NAME;
+  const char *black = o->engine_side == BLACK_SIDE ? OFFLINE_NAME : o->handle;
+  const char *loser = o->pos.side == WHITE_SIDE ? white : black;
+  if      ( list.n == 0 && in_check(&o->pos) )
+    offline_send(o, "{Game %d (%s vs. %s) %s checkmated} %s\n\r", OFFLINE_GAME, white, black, loser,
+        o->pos.side == WHITE_SIDE ? "0-1" : "1-0");
+  else if ( list.n == 0 )
+    offline_send(o, "{Game %d (%s vs. %s) Game drawn by stalemate} 1/2-1/2\n\r", OFFLINE_GAME, white, black);
+  else if ( o->pos.halfmove >= 100 )
+    offline_send(o, "{Game %d (%s vs. %s) Game drawn by the 50 move rule} 1/2-1/2\n\r", OFFLINE_GAME, white, black);
+  else if ( repetitions >= 3 )
+    offline_send(o, "{Game %d (%s vs. %s) Game drawn by repetition} 1/2-1/2\n\r", OFFLINE_GAME, white, black);
+  else return;
+  o->over = true;
+}
+
+static void play(OFFLINE *o, MOVE m)
+{
+  char verbose[16], san[16];
+  UNDO undo;
+  move_to_verbose(&o->pos, m, verbose);
+  move_to_san(&o->pos, m, san);
+  if ( o->n_keys < MAX_GAME_PLY ) o->keys[o->n_keys++] = o->pos.hash;
+  make_move(&o->pos, m, &undo);
+  check_game_over(o);
+  send_board(o, verbose, san);
+}
+
+static void engine_move(OFFLINE *o)
+{
+  if ( o->over ) return;
+  o->engine_side = o->pos.side;
+  SEARCH_RESULT r = engine_search(&o->pos, o->keys, o->n_keys, o->limits);
+
+  // the principal variation in SAN, played out on a copy
+  char pv[MAX_LINE_SIZE / 2] = "", score[16];
+  size_t len = 0;
+  POSITION p = o->pos;
+  UNDO undo;
+  for (int i = 0; i < r.pv_len && len < sizeof pv - 16; i++)
+  {
+    char san[16];
+    move_to_san(&p, r.pv[i], san);
+    len += snprintf(pv + len, sizeof pv - len, " %s", san);
+    if ( ! make_move(&p, r.pv[i], &undo) ) break;
+  }
+  format_score(r.score, score, sizeof score);
+  offline_send(o, "%s: depth %d score %s nodes %lu nps %.0f threads %d pv%s\n\r",
+      OFFLINE_NAME, r.depth, score, (unsigned long) r.nodes, r.nodes * 1e9 / (r.ns ? r.ns : 1),
+      o->limits.threads, pv);
+  play(o, r.best);
+}
+
+static void handle_command(OFFLINE *o, char *command)
+{
+  int n;
+  command[strcspn(command, "\r\n")] = '\0';
+  char *cmd = command + strspn(command, " \t");
+  if ( *cmd == '\0' ) return;
+
+  if      ( equals(cmd, "new") )  new_game(o, BLACK_SIDE);
+  else if ( equals(cmd, "go") )   engine_move(o);
+  else if ( sscanf(cmd, "time %d", &n) == 1 )
+  {
+    o->limits.movetime_ms = n; o->limits.depth = 0;
+    offline_send(o, "Search time set to %d ms.\n\r", n);
+  }
+  else if ( sscanf(cmd, "depth %d", &n) == 1 )
+  {
+    o->limits.depth = n; o->limits.movetime_ms = 0;
+    offline_send(o, "Search depth set to %d.\n\r", n);
+  }
+  else if ( o->over ) offline_send(o, "The game is over; \"new\" starts another.\n\r");
+  else
+  {
+    MOVE m = parse_move(&o->pos, cmd);
+    if ( m == MOVE_NONE ) { offline_send(o, "Illegal move (%s).\n\r", cmd); return; }
+    o->engine_side = ! o->pos.side;
+    play(o, m);
+    engine_move(o);
+  }
+}
+
+static void *t_offline(void *arg)
+{
+  OFFLINE *o = (OFFLINE *) arg;
+  new_game(o, BLACK_SIDE);
+
+  char line[MAX_LINE_SIZE];
+  ssize_t len;
+  while ( (len = read_line_buffered(o->sk, &o->in, line, sizeof line, '\n')) > 0 )
+  {
+    if ( begins_with(line, FICS_QUIT) ) break;
+    handle_command(o, line);
+  }
+  // closing our end shows up as EOF in the I/O loop, like a server
+  // hanging up
+  close(o->sk);
+  free(o);
+  return NULL;
+}
+
+// Create a session whose "server" is the built-in engine, searching
+// with 'threads' threads.  No login: the session starts configured.
+// n.b.: client must session_free()
+SESSION *session_offline(int id, int threads)
+{
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) error("socketpair");
+
+  SESSION *s = calloc(1, sizeof *s);
+  OFFLINE *o = calloc(1, sizeof *o);
+  if (s == NULL || o == NULL) error("session_offline");
+
+  s->id         = id;
+  s->sk         = sv[0];
+  s->message_id = 28;   // past the login sequence
+  s->configured = true;
+  snprintf(s->handle, NICK_MAX, "%s", "you");
+  if (fcntl(s->sk, F_SETFL, fcntl(s->sk, F_GETFL) | O_NONBLOCK) == -1) error("fcntl");
+
+  o->sk                 = sv[1];
+  o->limits.threads     = threads;
+  o->limits.movetime_ms = 1000;
+  snprintf(o->handle, NICK_MAX, "%s", s->handle);
+
+  pthread_t tid;
+  if (pthread_create(&tid, NULL, t_offline, o) != 0) error("pthread_create");
+  pthread_detach(tid);
+  return s;
+}
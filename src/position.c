@@ -0,0 +1,669 @@
+#include "vichess.h"
+
+// Chess positions: a 0x88 board with legal move generation, SAN, FEN
+// and Style12 conversion, and Zobrist hashing.
+//
+// Squares are 0x88 indices, rank * 16 + file, so a1 = 0x00 and h8 =
+// 0x77; (sq & 0x88) != 0 means "off the board".
+
+#define ON_BOARD(sq)    ( ((sq) & 0x88) == 0 )
+#define SQ64(sq)        ( ((sq) >> 4) * 8 + ((sq) & 7) )
+
+static const int KNIGHT_STEPS[] = { 33, 31, 18, 14, -14, -18, -31, -33 };
+static const int BISHOP_STEPS[] = { 17, 15, -15, -17 };
+static const int ROOK_STEPS[]   = { 16, 1, -1, -16 };
+static const int KING_STEPS[]   = { 17, 16, 15, 1, -1, -15, -16, -17 };
+
+// castle rights lost when a move touches a square
+static uint8_t CASTLE_MASK[128];
+
+
+/// Zobrist keys
+//
+// Keys come from a fixed-seed generator, so hashes are stable across
+// runs and builds; on-disk tables keyed by them stay valid.
+
+static uint64_t Z_PIECE[16][64], Z_CASTLE[16], Z_EP[8], Z_SIDE;
+
+static uint64_t splitmix64(uint64_t *state)
+{
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void init_tables(void)
+{
+  uint64_t seed = 0x7669636865737321ULL; // "vichess!"
+  for (int p = 0; p < 16; p++) for (int sq = 0; sq < 64; sq++) Z_PIECE[p][sq] = splitmix64(&seed);
+  for (int i = 0; i < 16; i++) Z_CASTLE[i] = splitmix64(&seed);
+  for (int i = 0; i < 8; i++)  Z_EP[i]     = splitmix64(&seed);
+  Z_SIDE = splitmix64(&seed);
+
+  memset(CASTLE_MASK, CASTLE_ALL, sizeof CASTLE_MASK);
+  CASTLE_MASK[0x00] &= ~CASTLE_WQ; CASTLE_MASK[0x07] &= ~CASTLE_WK; CASTLE_MASK[0x04] &= ~(CASTLE_WK | CASTLE_WQ);
+  CASTLE_MASK[0x70] &= ~CASTLE_BQ; CASTLE_MASK[0x77] &= ~CASTLE_BK; CASTLE_MASK[0x74] &= ~(CASTLE_BK | CASTLE_BQ);
+}
+
+void position_init(void) { pthread_once(&tables_once, init_tables); }
+
+// Hash from scratch; make_move() keeps pos->hash up to date
+// incrementally.  The en passant file only counts when a capture is
+// actually possible, so transpositions hash alike.
+uint64_t position_hash(const POSITION *pos)
+{
+  uint64_t h = 0;
+  for (int sq = 0; sq < 128; sq++)
+    if ( ON_BOARD(sq) && pos->board[sq] != EMPTY ) h ^= Z_PIECE[pos->board[sq]][SQ64(sq)];
+  h ^= Z_CASTLE[pos->castle];
+  if ( pos->ep != SQ_NONE ) h ^= Z_EP[pos->ep & 7];
+  if ( pos->side == BLACK_SIDE ) h ^= Z_SIDE;
+  return h;
+}
+
+
+/// Setup
+
+static int piece_of(char ch)
+{
+  switch ( ch )
+  {
+    case 'P': return W_PAWN;   case 'N': return W_KNIGHT; case 'B': return W_BISHOP;
+    case 'R': return W_ROOK;   case 'Q': return W_QUEEN;  case 'K': return W_KING;
+    case 'p': return B_PAWN;   case 'n': return B_KNIGHT; case 'b': return B_BISHOP;
+    case 'r': return B_ROOK;   case 'q': return B_QUEEN;  case 'k': return B_KING;
+  }
+  return EMPTY;
+}
+
+char piece_char(int piece)
+{
+  static const char chars[] = "-PNBRQK--pnbrqk-";
+  return chars[piece & 15];
+}
+
+// the en passant square only if a pawn of the side to move can take
+static int real_ep(const POSITION *pos, int ep)
+{
+  if ( ep == SQ_NONE ) return SQ_NONE;
+  int pawn = pos->side == WHITE_SIDE ? W_PAWN : B_PAWN;
+  int from = pos->side == WHITE_SIDE ? ep - 16 : ep + 16;
+  if ( ON_BOARD(from - 1) && pos->board[from - 1] == pawn ) return ep;
+  if ( ON_BOARD(from + 1) && pos->board[from + 1] == pawn ) return ep;
+  return SQ_NONE;
+}
+
+static void finish_setup(POSITION *pos)
+{
+  position_init();
+  for (int sq = 0; sq < 128; sq++)
+    if ( ON_BOARD(sq) && PIECE_TYPE(pos->board[sq]) == KING ) pos->king[PIECE_SIDE(pos->board[sq])] = sq;
+  pos->ep   = real_ep(pos, pos->ep);
+  pos->hash = position_hash(pos);
+}
+
+// Parse a FEN string; returns false if it is malformed.
+bool position_from_fen(POSITION *pos, const char *fen)
+{
+  memset(pos, 0, sizeof *pos);
+  int rank = 7, file = 0;
+  for ( ; *fen != ' ' && *fen != '\0'; fen++)
+  {
+    if      ( *fen == '/' ) { rank--; file = 0; }
+    else if ( isdigit(*fen) ) file += *fen - '0';
+    else
+    {
+      if ( rank < 0 || file > 7 || piece_of(*fen) == EMPTY ) return false;
+      pos->board[rank * 16 + file++] = piece_of(*fen);
+    }
+  }
+  if ( *fen++ != ' ' ) return false;
+  pos->side = ( *fen++ == 'b' ) ? BLACK_SIDE : WHITE_SIDE;
+
+  char castle[5] = "-", ep[3] = "-";
+  int halfmove = 0, fullmove = 1;
+  sscanf(fen, " %4s %2s %d %d", castle, ep, &halfmove, &fullmove);
+  for (char *c = castle; *c; c++)
+    switch ( *c )
+    {
+      case 'K': pos->castle |= CASTLE_WK; break;
+      case 'Q': pos->castle |= CASTLE_WQ; break;
+      case 'k': pos->castle |= CASTLE_BK; break;
+      case 'q': pos->castle |= CASTLE_BQ; break;
+    }
+  pos->ep       = ( ep[0] >= 'a' && ep[0] <= 'h' ) ? (ep[1] - '1') * 16 + (ep[0] - 'a') : SQ_NONE;
+  pos->halfmove = halfmove;
+  pos->fullmove = fullmove;
+  finish_setup(pos);
+  return true;
+}
+
+void position_start(POSITION *pos)
+{
+  position_from_fen(pos, START_FEN);
+}
+
+// Decode the position in a Style12 update.
+void position_from_style12(POSITION *pos, const STYLE12 *s)
+{
+  memset(pos, 0, sizeof *pos);
+  for (int row = 0; row < 8; row++)
+    for (int file = 0; file < 8; file++)
+      pos->board[(7 - row) * 16 + file] = piece_of(s->board[row][file]);
+  pos->side     = ( s->turn == 'B' ) ? BLACK_SIDE : WHITE_SIDE;
+  pos->castle   = ( s->white_castle_short ? CASTLE_WK : 0 ) | ( s->white_castle_long ? CASTLE_WQ : 0 )
+                | ( s->black_castle_short ? CASTLE_BK : 0 ) | ( s->black_castle_long ? CASTLE_BQ : 0 );
+  // double_push is the file of the pawn that just moved two squares
+  pos->ep       = ( s->double_push >= 0 && s->double_push < 8 )
+                ? ( pos->side == WHITE_SIDE ? 0x50 : 0x20 ) + s->double_push : SQ_NONE;
+  pos->halfmove = s->irreversible;
+  pos->fullmove = s->move_number;
+  finish_setup(pos);
+}
+
+// Write the position as a FEN string (at least 92 bytes).
+void position_to_fen(const POSITION *pos, char *fen)
+{
+  for (int rank = 7; rank >= 0; rank--)
+  {
+    int empty = 0;
+    for (int file = 0; file < 8; file++)
+    {
+      int piece = pos->board[rank * 16 + file];
+      if ( piece == EMPTY ) { empty++; continue; }
+      if ( empty ) *fen++ = '0' + empty;
+      empty = 0;
+      *fen++ = piece_char(piece);
+    }
+    if ( empty ) *fen++ = '0' + empty;
+    if ( rank ) *fen++ = '/';
+  }
+  fen += sprintf(fen, " %c ", pos->side == WHITE_SIDE ? 'w' : 'b');
+  if ( pos->castle & CASTLE_WK ) *fen++ = 'K';
+  if ( pos->castle & CASTLE_WQ ) *fen++ = 'Q';
+  if ( pos->castle & CASTLE_BK ) *fen++ = 'k';
+  if ( pos->castle & CASTLE_BQ ) *fen++ = 'q';
+  if ( pos->castle == 0 ) *fen++ = '-';
+  if ( pos->ep != SQ_NONE ) fen += sprintf(fen, " %c%c", 'a' + (pos->ep & 7), '1' + (pos->ep >> 4));
+  else                      fen += sprintf(fen, " -");
+  sprintf(fen, " %d %d", pos->halfmove, pos->fullmove);
+}
+
+
+/// Attacks and move generation
+
+bool square_attacked(const POSITION *pos, int sq, int by)
+{
+  const uint8_t *b = pos->board;
+  int color = by == WHITE_SIDE ? 0 : BLACK_BIT;
+
+  // pawns attack diagonally forward, so look backward from sq
+  int behind = by == WHITE_SIDE ? -16 : 16;
+  if ( ON_BOARD(sq + behind - 1) && b[sq + behind - 1] == (PAWN | color) ) return true;
+  if ( ON_BOARD(sq + behind + 1) && b[sq + behind + 1] == (PAWN | color) ) return true;
+
+  for (int i = 0; i < 8; i++)
+  {
+    int to = sq + KNIGHT_STEPS[i];
+    if ( ON_BOARD(to) && b[to] == (KNIGHT | color) ) return true;
+    to = sq + KING_STEPS[i];
+    if ( ON_BOARD(to) && b[to] == (KING | color) ) return true;
+  }
+  for (int i = 0; i < 4; i++)
+  {
+    for (int to = sq + BISHOP_STEPS[i]; ON_BOARD(to); to += BISHOP_STEPS[i])
+    {
+      if ( b[to] == EMPTY ) continue;
+      if ( b[to] == (BISHOP | color) || b[to] == (QUEEN | color) ) return true;
+      break;
+    }
+    for (int to = sq + ROOK_STEPS[i]; ON_BOARD(to); to += ROOK_STEPS[i])
+    {
+      if ( b[to] == EMPTY ) continue;
+      if ( b[to] == (ROOK | color) || b[to] == (QUEEN | color) ) return true;
+      break;
+    }
+  }
+  return false;
+}
+
+bool in_check(const POSITION *pos)
+{
+  return square_attacked(pos, pos->king[pos->side], ! pos->side);
+}
+
+static inline void add(MOVE_LIST *list, int from, int to, int flags, int promotion)
+{
+  list->moves[list->n++] = MAKE_MOVE(from, to, flags, promotion);
+}
+
+static void add_pawn_move(MOVE_LIST *list, int from, int to, int flags)
+{
+  int rank = to >> 4;
+  if ( rank == 0 || rank == 7 )
+    for (int p = QUEEN; p >= KNIGHT; p--) add(list, from, to, flags | MOVE_PROMOTION, p);
+  else
+    add(list, from, to, flags, 0);
+}
+
+// Generate pseudo-legal moves (the king may be left in check); with
+// 'captures_only', just captures and promotions, for quiescence.
+void generate_moves(const POSITION *pos, MOVE_LIST *list, bool captures_only)
+{
+  const uint8_t *b = pos->board;
+  int us = pos->side, color = us == WHITE_SIDE ? 0 : BLACK_BIT;
+  int forward = us == WHITE_SIDE ? 16 : -16;
+  int start_rank = us == WHITE_SIDE ? 1 : 6;
+  list->n = 0;
+
+  for (int from = 0; from < 128; from++)
+  {
+    if ( ! ON_BOARD(from) ) { from += 7; continue; }
+    int piece = b[from];
+    if ( piece == EMPTY || ( piece & BLACK_BIT ) != color ) continue;
+
+    switch ( PIECE_TYPE(piece) )
+    {
+      case PAWN:
+      {
+        int to = from + forward;
+        if ( ON_BOARD(to) && b[to] == EMPTY )
+        {
+          if ( ! captures_only || (to >> 4) == 0 || (to >> 4) == 7 ) add_pawn_move(list, from, to, 0);
+          if ( ! captures_only && (from >> 4) == start_rank && b[to + forward] == EMPTY )
+            add(list, from, to + forward, MOVE_DOUBLE_PUSH, 0);
+        }
+        for (int side = -1; side <= 1; side += 2)
+        {
+          to = from + forward + side;
+          if ( ! ON_BOARD(to) ) continue;
+          if ( b[to] != EMPTY && ( b[to] & BLACK_BIT ) != color ) add_pawn_move(list, from, to, MOVE_CAPTURE);
+          else if ( to == pos->ep ) add(list, from, to, MOVE_CAPTURE | MOVE_EN_PASSANT, 0);
+        }
+        break;
+      }
+      case KNIGHT:
+      case KING:
+      {
+        const int *steps = PIECE_TYPE(piece) == KNIGHT ? KNIGHT_STEPS : KING_STEPS;
+        for (int i = 0; i < 8; i++)
+        {
+          int to = from + steps[i];
+          if ( ! ON_BOARD(to) ) continue;
+          if ( b[to] == EMPTY ) { if ( ! captures_only ) add(list, from, to, 0, 0); }
+          else if ( ( b[to] & BLACK_BIT ) != color ) add(list, from, to, MOVE_CAPTURE, 0);
+        }
+        break;
+      }
+      default: // sliders
+      {
+        int type = PIECE_TYPE(piece);
+        for (int dir = 0; dir < 8; dir++)
+        {
+          int step;
+          if      ( dir < 4 ) { if ( type == ROOK )   continue; step = BISHOP_STEPS[dir]; }
+          else                { if ( type == BISHOP ) continue; step = ROOK_STEPS[dir - 4]; }
+          for (int to = from + step; ON_BOARD(to); to += step)
+          {
+            if ( b[to] == EMPTY ) { if ( ! captures_only ) add(list, from, to, 0, 0); continue; }
+            if ( ( b[to] & BLACK_BIT ) != color ) add(list, from, to, MOVE_CAPTURE, 0);
+            break;
+          }
+        }
+        break;
+      }
+    }
+  }
+
+  // castling: the king may not start in, pass through or land in check
+  if ( captures_only ) return;
+  int home = us == WHITE_SIDE ? 0x04 : 0x74;
+  int short_right = us == WHITE_SIDE ? CASTLE_WK : CASTLE_BK;
+  int long_right  = us == WHITE_SIDE ? CASTLE_WQ : CASTLE_BQ;
+  if ( ( pos->castle & short_right ) && b[home + 1] == EMPTY && b[home + 2] == EMPTY
+      && ! square_attacked(pos, home, ! us) && ! square_attacked(pos, home + 1, ! us) )
+    add(list, home, home + 2, MOVE_CASTLE, 0);
+  if ( ( pos->castle & long_right ) && b[home - 1] == EMPTY && b[home - 2] == EMPTY && b[home - 3] == EMPTY
+      && ! square_attacked(pos, home, ! us) && ! square_attacked(pos, home - 1, ! us) )
+    add(list, home, home - 2, MOVE_CASTLE, 0);
+}
+
+static inline void put(POSITION *pos, int sq, int piece)
+{
+  pos->board[sq] = piece;
+  pos->hash ^= Z_PIECE[piece][SQ64(sq)];
+}
+
+static inline void lift(POSITION *pos, int sq)
+{
+  pos->hash ^= Z_PIECE[pos->board[sq]][SQ64(sq)];
+  pos->board[sq] = EMPTY;
+}
+
+// Make a pseudo-legal move.  Returns false, with the position
+// restored, if it leaves the mover's king in check.
+bool make_move(POSITION *pos, MOVE m, UNDO *undo)
+{
+  int from = MOVE_FROM(m), to = MOVE_TO(m), flags = MOVE_FLAGS(m);
+  int piece = pos->board[from], us = pos->side;
+
+  undo->captured  = pos->board[to];
+  undo->castle    = pos->castle;
+  undo->ep        = pos->ep;
+  undo->halfmove  = pos->halfmove;
+  undo->hash      = pos->hash;
+
+  if ( pos->ep != SQ_NONE ) pos->hash ^= Z_EP[pos->ep & 7];
+  pos->hash ^= Z_CASTLE[pos->castle];
+
+  if ( flags & MOVE_EN_PASSANT )
+  {
+    int victim = to + ( us == WHITE_SIDE ? -16 : 16 );
+    undo->captured = pos->board[victim];
+    lift(pos, victim);
+  }
+  else if ( undo->captured != EMPTY ) lift(pos, to);
+
+  lift(pos, from);
+  put(pos, to, ( flags & MOVE_PROMOTION ) ? ( MOVE_PROMOTED(m) | ( piece & BLACK_BIT ) ) : piece);
+
+  if ( flags & MOVE_CASTLE )
+  {
+    int rook_from = to > from ? to + 1 : to - 2, rook_to = to > from ? to - 1 : to + 1;
+    int rook = pos->board[rook_from];
+    lift(pos, rook_from);
+    put(pos, rook_to, rook);
+  }
+
+  if ( PIECE_TYPE(piece) == KING ) pos->king[us] = to;
+  pos->castle  &= CASTLE_MASK[from] & CASTLE_MASK[to];
+  pos->hash    ^= Z_CASTLE[pos->castle];
+  pos->halfmove = ( PIECE_TYPE(piece) == PAWN || undo->captured != EMPTY ) ? 0 : pos->halfmove + 1;
+  if ( us == BLACK_SIDE ) pos->fullmove++;
+  pos->side     = ! us;
+  pos->hash    ^= Z_SIDE;
+  pos->ep       = ( flags & MOVE_DOUBLE_PUSH ) ? real_ep(pos, (from + to) / 2) : SQ_NONE;
+  if ( pos->ep != SQ_NONE ) pos->hash ^= Z_EP[pos->ep & 7];
+
+  if ( square_attacked(pos, pos->king[us], pos->side) )
+  {
+    unmake_move(pos, m, undo);
+    return false;
+  }
+  return true;
+}
+
+void unmake_move(POSITION *pos, MOVE m, const UNDO *undo)
+{
+  int from = MOVE_FROM(m), to = MOVE_TO(m), flags = MOVE_FLAGS(m);
+  int us = ! pos->side;
+  int piece = pos->board[to];
+  if ( flags & MOVE_PROMOTION ) piece = PAWN | ( piece & BLACK_BIT );
+
+  pos->board[from] = piece;
+  pos->board[to]   = EMPTY;
+  if ( flags & MOVE_EN_PASSANT )  pos->board[to + ( us == WHITE_SIDE ? -16 : 16 )] = undo->captured;
+  else                            pos->board[to] = undo->captured;
+  if ( flags & MOVE_CASTLE )
+  {
+    int rook_from = to > from ? to + 1 : to - 2, rook_to = to > from ? to - 1 : to + 1;
+    pos->board[rook_from] = pos->board[rook_to];
+    pos->board[rook_to]   = EMPTY;
+  }
+  if ( PIECE_TYPE(piece) == KING ) pos->king[us] = from;
+  if ( us == BLACK_SIDE ) pos->fullmove--;
+  pos->side     = us;
+  pos->castle   = undo->castle;
+  pos->ep       = undo->ep;
+  pos->halfmove = undo->halfmove;
+  pos->hash     = undo->hash;
+}
+
+// Null move, for the search: pass the turn.
+void make_null_move(POSITION *pos, UNDO *undo)
+{
+  undo->ep    = pos->ep;
+  undo->hash  = pos->hash;
+  if ( pos->ep != SQ_NONE ) pos->hash ^= Z_EP[pos->ep & 7];
+  pos->ep     = SQ_NONE;
+  pos->side   = ! pos->side;
+  pos->hash  ^= Z_SIDE;
+}
+
+void unmake_null_move(POSITION *pos, const UNDO *undo)
+{
+  pos->side = ! pos->side;
+  pos->ep   = undo->ep;
+  pos->hash = undo->hash;
+}
+
+// Legal moves only.
+void generate_legal_moves(POSITION *pos, MOVE_LIST *list)
+{
+  MOVE_LIST pseudo;
+  UNDO undo;
+  generate_moves(pos, &pseudo, false);
+  list->n = 0;
+  for (int i = 0; i < pseudo.n; i++)
+    if ( make_move(pos, pseudo.moves[i], &undo) )
+    {
+      unmake_move(pos, pseudo.moves[i], &undo);
+      list->moves[list->n++] = pseudo.moves[i];
+    }
+}
+
+uint64_t perft(POSITION *pos, int depth)
+{
+  if ( depth == 0 ) return 1;
+  MOVE_LIST list;
+  UNDO undo;
+  uint64_t nodes = 0;
+  generate_moves(pos, &list, false);
+  for (int i = 0; i < list.n; i++)
+    if ( make_move(pos, list.moves[i], &undo) )
+    {
+      nodes += perft(pos, depth - 1);
+      unmake_move(pos, list.moves[i], &undo);
+    }
+  return nodes;
+}
+
+
+/// Notation
+
+// "e2e4", "e7e8q": long algebraic, as UCI engines want it
+void move_to_uci(MOVE m, char *out)
+{
+  int from = MOVE_FROM(m), to = MOVE_TO(m);
+  out += sprintf(out, "%c%c%c%c", 'a' + (from & 7), '1' + (from >> 4), 'a' + (to & 7), '1' + (to >> 4));
+  if ( MOVE_FLAGS(m) & MOVE_PROMOTION ) *out++ = tolower(piece_char(MOVE_PROMOTED(m)));
+  *out = '\0';
+}
+
+// Style12 "verbose coordinate notation": "P/e2-e4", "o-o", "P/e7-e8=Q".
+// Call before making the move.
+void move_to_verbose(const POSITION *pos, MOVE m, char *out)
+{
+  int from = MOVE_FROM(m), to = MOVE_TO(m);
+  if ( MOVE_FLAGS(m) & MOVE_CASTLE ) { strcpy(out, to > from ? "o-o" : "o-o-o"); return; }
+  out += sprintf(out, "%c/%c%c-%c%c", toupper(piece_char(pos->board[from])),
+      'a' + (from & 7), '1' + (from >> 4), 'a' + (to & 7), '1' + (to >> 4));
+  if ( MOVE_FLAGS(m) & MOVE_PROMOTION ) sprintf(out, "=%c", piece_char(MOVE_PROMOTED(m)));
+}
+
+// Standard algebraic notation, with check and mate marks.  Call
+// before making the move; 'm' must be legal.
+void move_to_san(POSITION *pos, MOVE m, char *out)
+{
+  int from = MOVE_FROM(m), to = MOVE_TO(m), type = PIECE_TYPE(pos->board[from]);
+  char *p = out;
+
+  if ( MOVE_FLAGS(m) & MOVE_CASTLE ) p += sprintf(p, to > from ? "O-O" : "O-O-O");
+  else
+  {
+    if ( type == PAWN )
+    {
+      if ( MOVE_FLAGS(m) & MOVE_CAPTURE ) *p++ = 'a' + (from & 7);
+    }
+    else
+    {
+      *p++ = piece_char(type);
+      // disambiguate between identical pieces that can reach 'to'
+      MOVE_LIST list;
+      bool ambiguous = false, same_file = false, same_rank = false;
+      generate_legal_moves(pos, &list);
+      for (int i = 0; i < list.n; i++)
+      {
+        int other = MOVE_FROM(list.moves[i]);
+        if ( other == from || MOVE_TO(list.moves[i]) != to || PIECE_TYPE(pos->board[other]) != type ) continue;
+        ambiguous = true;
+        same_file |= ( (other & 7) == (from & 7) );
+        same_rank |= ( (other >> 4) == (from >> 4) );
+      }
+      if ( ambiguous && ! same_file )     *p++ = 'a' + (from & 7);
+      else if ( ambiguous && ! same_rank ) *p++ = '1' + (from >> 4);
+      else if ( ambiguous ) { *p++ = 'a' + (from & 7); *p++ = '1' + (from >> 4); }
+    }
+    if ( MOVE_FLAGS(m) & MOVE_CAPTURE ) *p++ = 'x';
+    *p++ = 'a' + (to & 7);
+    *p++ = '1' + (to >> 4);
+    if ( MOVE_FLAGS(m) & MOVE_PROMOTION ) { *p++ = '='; *p++ = piece_char(MOVE_PROMOTED(m)); }
+  }
+
+  UNDO undo;
+  if ( make_move(pos, m, &undo) )
+  {
+    if ( in_check(pos) )
+    {
+      MOVE_LIST replies;
+      generate_legal_moves(pos, &replies);
+      *p++ = replies.n == 0 ? '#' : '+';
+    }
+    unmake_move(pos, m, &undo);
+  }
+  *p = '\0';
+}
+
+static bool legal(POSITION *pos, MOVE m)
+{
+  UNDO undo;
+  if ( ! make_move(pos, m, &undo) ) return false;
+  unmake_move(pos, m, &undo);
+  return true;
+}
+
+// Parse a move in SAN ("Nbd7", "exd6", "e8=Q+", "O-O") or coordinate
+// notation ("e2e4", "e2-e4", "e7e8q").  Returns MOVE_NONE unless the
+// move is legal and unambiguous.
+MOVE parse_move(POSITION *pos, const char *text)
+{
+  char s[16];
+  int n = 0;
+  for ( ; *text != '\0' && n < (int) sizeof s - 1; text++)
+    if ( ! strchr("+#!?x-=:", *text) ) s[n++] = *text;
+  s[n] = '\0';
+  while ( n > 0 && isspace(s[n-1]) ) s[--n] = '\0';
+
+  // pseudo-legal moves, and legality checked only for the candidates
+  // that match: parsing is the bulk of a PGN import
+  MOVE_LIST list;
+  generate_moves(pos, &list, false);
+
+  // castling, "O-O" / "0-0" / "o-o" (dashes already dropped)
+  bool castle_short = equals(s, "OO") || equals(s, "00") || equals(s, "oo");
+  bool castle_long  = equals(s, "OOO") || equals(s, "000") || equals(s, "ooo");
+  if ( castle_short || castle_long )
+  {
+    for (int i = 0; i < list.n; i++)
+      if ( ( MOVE_FLAGS(list.moves[i]) & MOVE_CASTLE )
+          && ( MOVE_TO(list.moves[i]) > MOVE_FROM(list.moves[i]) ) == castle_short && legal(pos, list.moves[i]) )
+        return list.moves[i];
+    return MOVE_NONE;
+  }
+
+  // coordinates: from square, to square, optional promotion piece
+  if ( n >= 4 && s[0] >= 'a' && s[0] <= 'h' && isdigit(s[1]) && s[2] >= 'a' && s[2] <= 'h' && isdigit(s[3]) )
+  {
+    int from = (s[1] - '1') * 16 + (s[0] - 'a'), to = (s[3] - '1') * 16 + (s[2] - 'a');
+    int promotion = n > 4 ? PIECE_TYPE(piece_of(toupper(s[4]))) : 0;
+    for (int i = 0; i < list.n; i++)
+    {
+      MOVE m = list.moves[i];
+      if ( MOVE_FROM(m) != from || MOVE_TO(m) != to ) continue;
+      if ( ( MOVE_FLAGS(m) & MOVE_PROMOTION ) && MOVE_PROMOTED(m) != ( promotion ? promotion : QUEEN ) ) continue;
+      return legal(pos, m) ? m : MOVE_NONE;
+    }
+    return MOVE_NONE;
+  }
+
+  // SAN: [piece] [file] [rank] square [promotion]
+  int type = PAWN, promotion = 0, from_file = -1, from_rank = -1;
+  char *p = s;
+  if ( *p != '\0' && strchr("NBRQK", *p) ) type = PIECE_TYPE(piece_of(*p++));
+  n = strlen(p);
+  if ( n > 0 && isalpha(p[n-1]) && strchr("NBRQnbrq", p[n-1]) ) { promotion = PIECE_TYPE(piece_of(toupper(p[n-1]))); p[--n] = '\0'; }
+  if ( n < 2 ) return MOVE_NONE;
+  int to = (p[n-1] - '1') * 16 + (p[n-2] - 'a');
+  if ( p[n-2] < 'a' || p[n-2] > 'h' || p[n-1] < '1' || p[n-1] > '8' ) return MOVE_NONE;
+  for (int i = 0; i < n - 2; i++)
+  {
+    if      ( p[i] >= 'a' && p[i] <= 'h' ) from_file = p[i] - 'a';
+    else if ( p[i] >= '1' && p[i] <= '8' ) from_rank = p[i] - '1';
+    else return MOVE_NONE;
+  }
+
+  MOVE found = MOVE_NONE;
+  for (int i = 0; i < list.n; i++)
+  {
+    MOVE m = list.moves[i];
+    int from = MOVE_FROM(m);
+    if ( MOVE_TO(m) != to || PIECE_TYPE(pos->board[from]) != type ) continue;
+    if ( from_file != -1 && (from & 7) != from_file ) continue;
+    if ( from_rank != -1 && (from >> 4) != from_rank ) continue;
+    if ( ( MOVE_FLAGS(m) & MOVE_PROMOTION ) && MOVE_PROMOTED(m) != ( promotion ? promotion : QUEEN ) ) continue;
+    if ( ! legal(pos, m) ) continue; // e.g. the other knight is pinned
+    if ( found != MOVE_NONE ) return MOVE_NONE; // ambiguous
+    found = m;
+  }
+  return found;
+}
+
+// Material in the units Style12 uses (pawn 1, minor 3, rook 5, queen 9).
+int material(const POSITION *pos, int side)
+{
+  static const int value[] = { 0, 1, 3, 3, 5, 9, 0, 0 };
+  int total = 0;
+  for (int sq = 0; sq < 128; sq++)
+    if ( ON_BOARD(sq) && pos->board[sq] != EMPTY && PIECE_SIDE(pos->board[sq]) == side )
+      total += value[PIECE_TYPE(pos->board[sq])];
+  return total;
+}
+
+// Write the position as a Style12 line, as the server would send it.
+// 'last' is the move that led here (MOVE_NONE if none) with its
+// verbose and SAN forms.  Fields after the flip flag are zero.
+void position_to_style12(const POSITION *pos, char *out, size_t n, int game_number,
+    const char *white, const char *black, int relation, int flip,
+    int white_ms, int black_ms, const char *verbose, const char *san)
+{
+  char rows[8][9];
+  for (int rank = 7; rank >= 0; rank--)
+  {
+    for (int file = 0; file < 8; file++) rows[7 - rank][file] = piece_char(pos->board[rank * 16 + file]);
+    rows[7 - rank][8] = '\0';
+  }
+  // the double push file; pos->ep is only kept when a capture is possible
+  int double_push = pos->ep != SQ_NONE ? ( pos->ep & 7 ) : -1;
+  snprintf(out, n,
+      "<12> %s %s %s %s %s %s %s %s %c %d %d %d %d %d %d %d %s %s %d 0 0 %d %d %d %d %d %s (0:00.000) %s %d 0 0\n\r",
+      rows[0], rows[1], rows[2], rows[3], rows[4], rows[5], rows[6], rows[7],
+      pos->side == WHITE_SIDE ? 'W' : 'B', double_push,
+      !! ( pos->castle & CASTLE_WK ), !! ( pos->castle & CASTLE_WQ ),
+      !! ( pos->castle & CASTLE_BK ), !! ( pos->castle & CASTLE_BQ ),
+      pos->halfmove, game_number, white, black, relation,
+      material(pos, WHITE_SIDE), material(pos, BLACK_SIDE), white_ms, black_ms,
+      pos->fullmove, verbose ? verbose : "none", san ? san : "none", flip);
+}
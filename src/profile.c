@@ -0,0 +1,174 @@
+#include "vichess.h"
+
+#include <malloc.h>         // mallopt()
+#include <sys/resource.h>   // setrlimit()
+
+// The tournament profile (-t), for games where the time from a board
+// coming off the socket to it being drawn should not vary.  Each
+// worker can be pinned to a CPU, and the socket loop can run
+// SCHED_FIFO, so that nothing at normal priority keeps it from a
+// readable socket.  Memory is locked as it is touched, and the hot
+// parts are touched up front: each worker gets a populated stack of
+// PROFILE_STACK bytes in place of the default one paged in on demand,
+// and PROFILE_HEAP bytes of heap are touched and kept, so that malloc
+// neither faults nor gives memory back to the kernel while a game is on.
+//
+// Whatever cannot be had is left out and reported in the profile's
+// notice.  That covers a CPU outside the process's set, and SCHED_FIFO
+// or mlockall without the privilege.  The client runs the same, only
+// less steadily.
+
+#define PROFILE_STACK           ( 2 << 20 )
+#define PROFILE_HEAP            ( 16 << 20 )
+#define PROFILE_FIFO_PRIORITY   10          // above nothing but other SCHED_OTHER threads
+
+static const char *const WORKERS[N_WORKERS] =
+{
+  [W_SOCKET_IO] = "socket io",
+  [W_WRITER]    = "writer",
+  [W_READER]    = "reader",
+  [W_ANALYSIS]  = "analysis",
+};
+
+// Parse "CPUS[:fifo]": a CPU for each worker in W_* order, "-" for one
+// left to the scheduler, e.g. "2,3,3:fifo".  Returns false if 'spec'
+// does not parse.
+bool profile_parse(PROFILE *p, const char *spec)
+{
+  *p = (PROFILE) { .on = true };
+  for (int w = 0; w < N_WORKERS; w++) p->cpu[w] = -1;
+  const char *colon = strchr(spec, ':');
+  if ( colon != NULL && ! equals((char *) colon + 1, "fifo") ) return false;
+  p->fifo = colon != NULL;
+
+  const char *end = colon != NULL ? colon : spec + strlen(spec);
+  for (int w = 0; spec < end; w++)
+  {
+    char *next;
+    if ( w == N_WORKERS ) return false;
+    if ( *spec == '-' ) next = (char *) spec + 1;
+    else if ( (p->cpu[w] = strtol(spec, &next, 10)) < 0 || next == spec ) return false;
+    if ( next < end && *next != ',' ) return false;
+    spec = next + ( next < end );
+  }
+  return true;
+}
+
+// Lock memory as it is touched and touch the heap.  Called once, before
+// the workers are created.
+void profile_memory(PROFILE *p)
+{
+  // one arena, kept whole: memory malloc has touched stays its own
+  mallopt(M_ARENA_MAX, 1);
+  mallopt(M_MMAP_MAX, 0);
+  mallopt(M_TRIM_THRESHOLD, INT_MAX);
+
+  // MCL_FUTURE over the memlock limit would fail later allocations, so
+  // without room for everything only what is mapped now is locked
+  struct rlimit unlimited = { RLIM_INFINITY, RLIM_INFINITY }, limit;
+  setrlimit(RLIMIT_MEMLOCK, &unlimited);
+  getrlimit(RLIMIT_MEMLOCK, &limit);
+  p->lock_future = limit.rlim_cur == RLIM_INFINITY;
+  // on fault: the sparse stats and archive maps are not read in whole
+  int flags = MCL_CURRENT | MCL_ONFAULT | ( p->lock_future ? MCL_FUTURE : 0 );
+  p->lock_errno = mlockall(flags) == -1 ? errno : 0;
+  p->memlock_kb = limit.rlim_cur == RLIM_INFINITY ? -1 : (long) ( limit.rlim_cur / 1024 );
+
+  char *heap = malloc(PROFILE_HEAP);
+  if ( heap != NULL ) memset(heap, 0, PROFILE_HEAP), p->heap = PROFILE_HEAP;
+  free(heap);
+}
+
+// pthread_create() for 'worker' (W_*) under the profile: on its CPU,
+// on a populated stack, and for the socket loop at SCHED_FIFO if asked
+// for.  Without a profile, or whatever of it cannot be had, the thread
+// is created as ever.  Returns pthread_create()'s result.
+int profile_create(PROFILE *p, pthread_t *t, int worker, void *(*start)(void *), void *arg)
+{
+  if ( p == NULL || ! p->on ) return pthread_create(t, NULL, start, arg);
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  long page = sysconf(_SC_PAGESIZE);
+  char *stack = mmap(NULL, PROFILE_STACK + page, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_POPULATE, -1, 0);
+  if ( stack != MAP_FAILED )
+  {
+    mprotect(stack, page, PROT_NONE); // the guard the default stack has
+    pthread_attr_setstack(&attr, stack + page, PROFILE_STACK);
+    p->stack[worker] = stack;
+  }
+
+  cpu_set_t allowed, cpus;
+  int cpu = p->cpu[worker];
+  p->pinned[worker] = -1;
+  if ( cpu >= 0 && cpu < CPU_SETSIZE && sched_getaffinity(0, sizeof allowed, &allowed) == 0 && CPU_ISSET(cpu, &allowed) )
+  {
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    pthread_attr_setaffinity_np(&attr, sizeof cpus, &cpus);
+    p->pinned[worker] = cpu;
+  }
+
+  // refused SCHED_FIFO, the thread still gets the rest of the profile
+  int result = -1;
+  if ( worker == W_SOCKET_IO && p->fifo )
+  {
+    struct sched_param param = { .sched_priority = PROFILE_FIFO_PRIORITY };
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &param);
+    result = pthread_create(t, &attr, start, arg);
+    p->fifo_errno = result;
+    pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+  }
+  if ( result != 0 ) result = pthread_create(t, &attr, start, arg);
+  p->created[worker] = result == 0;
+  pthread_attr_destroy(&attr);
+  return result;
+}
+
+// What the profile came to, in a line: CPUs and scheduling of the
+// workers created, then memory.
+void profile_describe(const PROFILE *p, char *out, size_t size)
+{
+  int n = snprintf(out, size, "tournament profile:");
+  for (int w = 0; w < N_WORKERS && n < (int) size; w++)
+  {
+    if ( ! p->created[w] ) continue;
+    n += snprintf(out + n, size - n, " %s", WORKERS[w]);
+    if      ( p->pinned[w] >= 0 ) n += snprintf(out + n, size - n, " cpu %d", p->pinned[w]);
+    else if ( p->cpu[w] >= 0 )    n += snprintf(out + n, size - n, " (cpu %d not available)", p->cpu[w]);
+    if ( w == W_SOCKET_IO && p->fifo )
+    {
+      if ( p->fifo_errno == 0 ) n += snprintf(out + n, size - n, " fifo %d", PROFILE_FIFO_PRIORITY);
+      else                      n += snprintf(out + n, size - n, " (fifo: %s)", strerror(p->fifo_errno));
+    }
+    n += snprintf(out + n, size - n, ",");
+  }
+  if ( n >= (int) size ) return;
+  if ( p->lock_errno != 0 )
+    n += snprintf(out + n, size - n, " memory not locked (%s, limit %ld kB)", strerror(p->lock_errno), p->memlock_kb);
+  else
+    n += snprintf(out + n, size - n, " memory locked%s", p->lock_future ? "" : " as mapped now");
+  if ( n < (int) size )
+    snprintf(out + n, size - n, ", %d MB heap touched", (int) ( p->heap >> 20 ));
+}
+
+// Log and show the profile, once the workers are up.
+void profile_report(const PROFILE *p, CONFIG *c)
+{
+  char line[256];
+  profile_describe(p, line, sizeof line);
+  bool short_of = p->lock_errno != 0 || ( p->fifo && p->fifo_errno != 0 );
+  for (int w = 0; w < N_WORKERS; w++) short_of |= p->created[w] && p->cpu[w] >= 0 && p->pinned[w] < 0;
+  log_text(short_of ? LOG_WARN : LOG_INFO, LOGC_MISC, "%s", line);
+  send_message(c->ib_mq, c->active, MSG_NOTICE, "%s\n", line);
+}
+
+// Unmap the stacks of workers that have been joined.
+void profile_free(PROFILE *p)
+{
+  for (int w = 0; w < N_WORKERS; w++)
+    if ( p->stack[w] != NULL ) munmap(p->stack[w], PROFILE_STACK + sysconf(_SC_PAGESIZE)), p->stack[w] = NULL;
+}
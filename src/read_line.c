@@ -69,3 +69,50 @@ ssize_t read_line(int fd, void *buffer, size_t n)
 
   return total;
 }
+
+/*
+ *  Buffered, non-blocking variant of read_line() for the I/O loop.
+ *
+ *  Bytes are read from 'fd' into 'lb' and the first complete line
+ *  (ending in 'delim', '\r' for the server) is copied into 'line'.  Lines longer
+ *  than (n - 1) bytes are truncated.  Leftover bytes stay in 'lb' for
+ *  the next call.
+ *
+ *  Returns the length of the line, 0 on EOF, or -1 with errno set to
+ *  EAGAIN if no complete line is available yet.
+ */
+
+ssize_t read_line_buffered(int fd, LINE_BUFFER *lb, char *line, size_t n, char delim)
+{
+  while (true)
+  {
+    char *cr = memchr(lb->buf, delim, lb->len);
+    if (cr != NULL || lb->len == sizeof lb->buf)
+    {
+      size_t total = (cr != NULL) ? (size_t)(cr - lb->buf) + 1 : lb->len;
+      size_t copy  = (total < n - 1) ? total : n - 1;
+      memcpy(line, lb->buf, copy);
+      line[copy] = '\0';
+      lb->len -= total;
+      memmove(lb->buf, lb->buf + total, lb->len);
+      return copy;
+    }
+
+    ssize_t n_read = read(fd, lb->buf + lb->len, sizeof lb->buf - lb->len);
+    if (n_read == -1)
+    {
+      if (errno == EINTR) { continue;   } // interrupted; restart read()
+      else                { return -1;  } // EAGAIN or other error
+    }
+    else if (n_read == 0) // EOF
+    {
+      if (lb->len == 0) { return 0; }
+      size_t copy = (lb->len < n - 1) ? lb->len : n - 1; // flush the tail
+      memcpy(line, lb->buf, copy);
+      line[copy] = '\0';
+      lb->len = 0;
+      return copy;
+    }
+    lb->len += n_read;
+  }
+}
@@ -0,0 +1,116 @@
+#include "vichess.h"
+
+// Per-game position history for local draw detection.
+//
+// Each game keeps the Zobrist keys of its positions since the last
+// irreversible move (capture or pawn move, as Style12 counts), at most
+// HISTORY_WINDOW of them, and a small hash table counting how often
+// each occurs.  A new board costs one table update, so threefold
+// repetition is known as soon as the position arrives; the 50-move
+// rule is just Style12's irreversible count.  Memory per game is fixed
+// by the window, whatever the length of the game.
+//
+// Boards are placed by ply, so a refreshed board is not counted twice
+// and a takeback unwinds the positions taken back.
+
+static int *count_of(GAME_HISTORY *g, uint64_t key)
+{
+  for (int i = 0; i < HISTORY_SLOTS; i++)
+  {
+    int slot = ( key + i ) & ( HISTORY_SLOTS - 1 );
+    if ( g->counts[slot].key == key ) return &g->counts[slot].count;
+    if ( g->counts[slot].key == 0 )
+    {
+      g->counts[slot].key = key;
+      return &g->counts[slot].count;
+    }
+  }
+  return NULL; // full of stale keys; the caller rebuilds
+}
+
+static void rebuild_counts(GAME_HISTORY *g)
+{
+  memset(g->counts, 0, sizeof g->counts);
+  for (int i = 0; i < g->n; i++)
+    ( *count_of(g, g->window[( g->head - g->n + i ) & ( HISTORY_WINDOW - 1 )].key) )++;
+}
+
+// drop the oldest position
+static void pop_oldest(GAME_HISTORY *g)
+{
+  ( *count_of(g, g->window[( g->head - g->n ) & ( HISTORY_WINDOW - 1 )].key) )--;
+  g->n--;
+}
+
+// drop the newest position
+static void pop_newest(GAME_HISTORY *g)
+{
+  g->head = ( g->head - 1 ) & ( HISTORY_WINDOW - 1 );
+  ( *count_of(g, g->window[g->head].key) )--;
+  g->n--;
+}
+
+static GAME_HISTORY *find_game(SESSION *s, unsigned int game_number)
+{
+  if ( s->games == NULL && (s->games = mem_calloc(MEM_GAMES, HISTORY_GAMES, sizeof *s->games)) == NULL ) error("history calloc");
+
+  GAME_HISTORY *lru = &s->games[0];
+  for (int i = 0; i < HISTORY_GAMES; i++)
+  {
+    GAME_HISTORY *g = &s->games[i];
+    if ( g->used && g->game_number == game_number ) return g;
+    if ( ! g->used || ( lru->used && g->last_used < lru->last_used ) ) lru = g;
+  }
+  memset(lru, 0, sizeof *lru);
+  lru->used         = true;
+  lru->game_number  = game_number;
+  lru->last_ply     = -1;
+  return lru;
+}
+
+// Record a board of session 's', whose position has Zobrist key 'key'.
+// Returns the DRAW_* that has just become claimable with this board, or
+// DRAW_NONE -- also when it was already reported for this position.
+int history_update(SESSION *s, const STYLE12 *b, uint64_t key)
+{
+  GAME_HISTORY *g = find_game(s, b->game_number);
+  int ply = style12_ply(b);
+  g->last_used = now_ns();
+  if ( ply == g->last_ply ) return DRAW_NONE; // refresh
+
+  // a takeback: unwind to before this ply
+  while ( g->n > 0 && ply <= g->window[( g->head - 1 ) & ( HISTORY_WINDOW - 1 )].ply ) pop_newest(g);
+  // positions before the last irreversible move can never recur
+  while ( g->n > 0 && g->window[( g->head - g->n ) & ( HISTORY_WINDOW - 1 )].ply < ply - (int) b->irreversible ) pop_oldest(g);
+  if ( g->n == HISTORY_WINDOW ) pop_oldest(g);
+  if ( g->n == 0 ) memset(g->counts, 0, sizeof g->counts);
+
+  g->window[g->head].key = key;
+  g->window[g->head].ply = ply;
+  g->head = ( g->head + 1 ) & ( HISTORY_WINDOW - 1 );
+  g->n++;
+  int *count = count_of(g, key);
+  if ( count == NULL ) { rebuild_counts(g); count = count_of(g, key); }
+  else ( *count )++;
+  g->last_ply = ply;
+
+  // each once: the fifty moves again only after a capture or pawn move
+  bool fifty = b->irreversible >= 100 && ! g->fifty_reported;
+  g->fifty_reported = b->irreversible >= 100;
+  if ( *count == 3 )  return DRAW_REPETITION;
+  if ( fifty )        return DRAW_FIFTY_MOVES;
+  return DRAW_NONE;
+}
+
+// The notice for a claimable draw.  Only a player can claim, with the
+// server's "draw" command; observers are just told.
+void draw_notice(int draw, const STYLE12 *b, char *out, size_t n)
+{
+  const char *reason = draw == DRAW_REPETITION ? "threefold repetition" : "50 moves without a capture or pawn move";
+  bool playing = b->relation == PLAYING_MY_MOVE || b->relation == PLAYING_OPPONENTS_MOVE;
+  if ( playing )
+    snprintf(out, n, "Game %u: %s; type \"draw\"%s to claim it.\n", b->game_number, reason,
+        b->relation == PLAYING_MY_MOVE ? "" : " after your next move");
+  else
+    snprintf(out, n, "Game %u: %s; either player may claim a draw.\n", b->game_number, reason);
+}
@@ -0,0 +1,107 @@
+#include "vichess.h"
+
+// Seek graph: the seeks on the server, kept up to date from seekinfo
+// ("iset seekinfo 1") and drawn as counts by rating and time control
+// beside the board:
+//
+//    <s> 8 w=visar ti=02 rt=2194  t=4 i=0 r=r tp=suicide c=? rr=0-9999 a=t f=f
+//    <sr> 8 13
+//    <sc>
+//
+// The I/O loop applies each line to the table as it is framed; seekinfo
+// never goes through the queue.  Only the cells whose count changed are
+// marked, and at most one MSG_SEEKS per session is ever queued, so a
+// burst of seeks costs the writer one redraw of the cells it touched,
+// between the boards, however many lines it was.
+
+static const int RATING_BANDS[SEEK_ROWS - 1] = { 2000, 1800, 1600, 1400, 1200, 1 }; // lower bounds; last row unrated
+static const int TIME_BANDS[SEEK_COLS] = { 0, 120, 180, 300, 600, 900, 1800 };     // expected seconds
+
+// FICS's own estimate of a game's length: minutes + 2/3 of the increment
+static int seek_cell(int rating, int time, int inc, const char *type)
+{
+  int row = 0, col = SEEK_COLS - 1, expected = time * 60 + inc * 40;
+  while ( row < SEEK_ROWS - 1 && rating < RATING_BANDS[row] ) row++;
+  if ( ! equals((char *) type, "untimed") )
+    while ( col > 0 && expected < TIME_BANDS[col] ) col--;
+  return row * SEEK_COLS + col;
+}
+
+static void mark(SEEKS *t, int cell)
+{
+  atomic_fetch_or(&t->dirty, (uint64_t) 1 << cell);
+}
+
+static void seek_remove(SEEKS *t, int index)
+{
+  if ( index < 0 || index >= SEEK_MAX || ! t->slots[index].used ) return;
+  int cell = t->slots[index].cell;
+  t->slots[index].used = false;
+  atomic_fetch_sub(&t->counts[cell], 1);
+  t->n--;
+  mark(t, cell);
+}
+
+// "<s> 8 w=visar ti=02 rt=2194  t=4 i=0 r=r tp=suicide ..."
+static void seek_add(SEEKS *t, const char *line)
+{
+  char *cp = strdupa(line + 4), *save;
+  char *tok = strtok_r(cp, " \n\r", &save);
+  if ( tok == NULL ) return;
+  int index = atoi(tok);
+  if ( index < 0 || index >= SEEK_MAX ) { t->dropped++; metric_add(M_PARSE_SEEK, 1); return; }
+
+  SEEK seek = { .used = true };
+  char type[16] = "";
+  while ( (tok = strtok_r(NULL, " \n\r", &save)) != NULL )
+  {
+    if      ( begins_with(tok, "w=") )  snprintf(seek.from, sizeof seek.from, "%s", tok + 2);
+    else if ( begins_with(tok, "rt=") ) seek.rating = atoi(tok + 3); // "1500E", "0P"
+    else if ( begins_with(tok, "t=") )  seek.time = atoi(tok + 2);
+    else if ( begins_with(tok, "i=") )  seek.inc = atoi(tok + 2);
+    else if ( begins_with(tok, "r=") )  seek.rated = tok[2] == 'r';
+    else if ( begins_with(tok, "tp=") ) snprintf(type, sizeof type, "%s", tok + 3);
+  }
+  seek.cell = seek_cell(seek.rating, seek.time, seek.inc, type);
+
+  seek_remove(t, index); // a number is reused only once its seek is gone, but be safe
+  t->slots[index] = seek;
+  atomic_fetch_add(&t->counts[seek.cell], 1);
+  t->n++;
+  mark(t, seek.cell);
+}
+
+static void seek_clear(SEEKS *t)
+{
+  for (int i = 0; i < SEEK_MAX; i++) t->slots[i].used = false;
+  for (int i = 0; i < SEEK_ROWS * SEEK_COLS; i++) atomic_store(&t->counts[i], 0);
+  atomic_store(&t->dirty, ( (uint64_t) 1 << ( SEEK_ROWS * SEEK_COLS ) ) - 1);
+  t->n = 0;
+}
+
+// Apply a seekinfo line from session 's' to its seek table.  Returns
+// true if it was one; the curses client then has no further use for it.
+// I/O loop only.
+bool seeks_line(CONFIG *c, SESSION *s, const char *line)
+{
+  if ( line[0] != '<' || line[1] != 's' ) return false;
+  bool add = begins_with((char *) line, "<s> "), remove = begins_with((char *) line, "<sr> "), clear = begins_with((char *) line, "<sc>");
+  if ( ! add && ! remove && ! clear ) return false;
+
+  if ( s->seeks == NULL && (s->seeks = mem_calloc(MEM_PARSER, 1, sizeof *s->seeks)) == NULL ) error("seeks");
+  SEEKS *t = s->seeks;
+  if      ( add )   seek_add(t, line);
+  else if ( clear ) seek_clear(t);
+  else
+  {
+    char *cp = strdupa(line + 5), *save;
+    for (char *tok = strtok_r(cp, " \n\r", &save); tok != NULL; tok = strtok_r(NULL, " \n\r", &save))
+      seek_remove(t, atoi(tok));
+  }
+  t->updates++;
+
+  // one wake-up at a time: the writer picks up every change since
+  if ( c->w2 != NULL && ! atomic_exchange(&t->pending, true) )
+    send_message(c->ib_mq, s->id, MSG_SEEKS, "");
+  return c->w2 != NULL; // headless clients still get the lines as text
+}
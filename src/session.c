@@ -0,0 +1,163 @@
+#include "vichess.h"
+
+// Sessions: one per server connection.
+//
+// All sessions are serviced by the single I/O loop in workers.c, so a
+// session never blocks; its socket is non-blocking and partial lines
+// are kept in session->in until the rest arrives.
+
+// Create a session and connect it.  'login' is "handle" or
+// "handle:password"; NULL logs in as a guest.
+// n.b.: client must session_free()
+SESSION *session_new(int id, const char *login)
+{
+  SESSION *s = calloc(1, sizeof *s);
+  if (s == NULL) error("session_new");
+
+  s->id = id;
+  snprintf(s->handle, NICK_MAX, "%s", "guest");
+  if (login != NULL)
+  {
+    char *cp = strdupa(login);
+    char *password = strchr(cp, ':');
+    if (password != NULL) { *password++ = '\0'; s->password = mem_strdup(MEM_TRANSPORT, password); }
+    snprintf(s->handle, NICK_MAX, "%s", cp);
+  }
+
+  long *sock_fd = get_socket_fd( SERVER, PORT );
+  s->sk = *sock_fd;
+  free(sock_fd);
+  if (fcntl(s->sk, F_SETFL, fcntl(s->sk, F_GETFL) | O_NONBLOCK) == -1) error("fcntl");
+  log_text(LOG_INFO, LOGC_SESSION, "session %d: connected as %s", id + 1, s->handle);
+
+  return s;
+}
+
+void session_close(SESSION *s)
+{
+  if (s->sk != -1) { close(s->sk); log_text(LOG_INFO, LOGC_SESSION, "session %d: closed", s->id + 1); }
+  s->sk = -1; // poll() ignores negative descriptors
+}
+
+void session_free(SESSION *s)
+{
+  session_close(s);
+  for (UPDATE *u = &s->u; u != NULL; u = u == &s->u ? &s->partner : NULL)
+  {
+    mem_free(u->my_nick);
+    mem_free(u->opp_nick);
+    mem_free(u->my_rating);
+    mem_free(u->opp_rating);
+    mem_free(u->my_status_str);
+    mem_free(u->text);
+  }
+  mem_free(s->password);
+  mem_free(s->games);
+  lists_free(s->lists);
+  mem_free(s->seeks);
+  mem_free(s->blocks);
+  movelist_free(s);
+  free(s);
+}
+
+// Write a line straight to the session's socket.  Only the I/O loop
+// may call this; everyone else goes through ob_mq.
+// N.B.:  callers must always terminate message strings with "\n"
+void session_send(SESSION *s, char *fmt, ...)
+{
+  char msg[MAX_LINE_SIZE];
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(msg, MAX_LINE_SIZE, fmt, args);
+  va_end(args);
+  if (len >= MAX_LINE_SIZE) len = MAX_LINE_SIZE - 1;
+  if (s->sk != -1 && send(s->sk, msg, len, MSG_NOSIGNAL) == -1) { perror("send"); return; }
+  metric_add(M_LINES_OUT, 1);
+  metric_add(M_BYTES_OUT, len);
+  if (s->message_id != 27) log_line(LOG_TRACE, LOGC_NET, s->id, msg, true); // never the password
+}
+
+// Send a command, numbered in block mode, on behalf of 'owner' (BO_*),
+// who gets the reply.  Only the I/O loop may call this.
+void session_command(SESSION *s, int owner, char *fmt, ...)
+{
+  char command[MAX_LINE_SIZE];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(command, sizeof command, fmt, args);
+  va_end(args);
+  block_send(s, owner, command);
+}
+
+// Handle one line read from the server, framed and without its ending:
+// drive the login sequence, drop noise, and forward everything else to
+// the terminal writer.
+void session_handle_line(CONFIG *c, SESSION *s, char *line_buf)
+{
+  s->message_id++;
+
+  // Telnet server may have latency, so sleep()-and-send() doesn't
+  // work, and switching on message_id is no less brittle than
+  // grepping for magic strings...
+  // debug("message: %d %s", s->message_id, line_buf);
+  switch (s->message_id)
+  {
+    case 26:
+       session_send( s, "%s\n", s->handle );
+       break;
+    case 27:
+       if ( s->password != NULL )  session_send( s, "%s\n", s->password );
+       else                        session_send( s, "\n\n" );
+       break;
+    case 28:
+       // we're logged in; it should be OK to send commands to the
+       // server
+       if ( ! s->configured )
+       {
+        // numbered from here on, so that their replies can be told
+        // apart and dropped
+        block_enable( s );
+        if ( c->w2 != NULL ) // not headless
+        {
+          int w_y, w_x; getmaxyx(c->w2, w_y, w_x);
+          session_command( s, BO_LOGIN, "set height %d\n", w_y );  // server-side paging height
+          session_command( s, BO_LOGIN, "set width %d\n", w_x );  // server-side paging width
+        }
+        session_command( s, BO_LOGIN, "iset nowrap 1\n"         );  // don't wrap lines (breaks linewise hilighting)
+        session_command( s, BO_LOGIN, "iset gameinfo 1\n"       );  // request game information
+        session_command( s, BO_LOGIN, "iset ms 1\n"             );  // request timing in milliseconds
+        session_command( s, BO_LOGIN, "-channel 53\n"           );  // remove guest chat from channel list
+        session_command( s, BO_LOGIN, "set prompt %\n"          );  // a simpler prompt
+        session_command( s, BO_LOGIN, "set style 12\n"          );  // computer-readable output format
+        session_command( s, BO_LOGIN, "set seek %d\n", triggers_want_seeks() ); // seek ads only for triggers
+        if ( c->w2 != NULL )
+          session_command( s, BO_LOGIN, "iset seekinfo 1\n"    );  // the seek graph
+        session_command( s, BO_LOGIN, "set bell off\n"          );  // bell off
+        session_command( s, BO_LOGIN, "set provshow 1\n"        );  // annotate provisional and estimated ratings
+        session_command( s, BO_LOGIN, "set interface %s\n", TITLE );
+        s->configured = true;
+        log_text(LOG_INFO, LOGC_SESSION, "session %d: logged in", s->id + 1);
+       }
+       break;
+    default:
+       // user is now logged-in.  Handle any messages; replies to
+       // numbered commands go to whoever sent them
+       if ( (line_buf = block_line(c, s, line_buf)) == NULL ) return;
+       if ( begins_with(line_buf, "\a" ) )    return;   // skip bells and empty prompts
+       if ( begins_with(line_buf, "% \a" ) )  return;
+       if ( equals(line_buf, "% ") )          return;   // the prompt, then the next output
+       if ( equals(line_buf, FICS_PROMPT) )   return;
+
+       // seekinfo goes straight into the seek table
+       if ( seeks_line(c, s, line_buf) )      return;
+
+       // triggers act before anything else sees the line
+       TRIGGER *t = triggers_run(s, line_buf, s->received_ns);
+       if ( t != NULL )
+         send_message(c->ib_mq, s->id, MSG_NOTICE, "trigger %d fired: %s (%.1f us)\n",
+             (int) (t - TRIGGERS) + 1, t->action,
+             atomic_load_explicit(&t->last_latency, memory_order_relaxed) / 1000.0);
+       break;
+  }
+  send_message(c->ib_mq, s->id, MSG_LINE, "%s\n", line_buf);
+}
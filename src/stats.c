@@ -0,0 +1,579 @@
+#include "vichess.h"
+
+// Personal statistics: every game the user finishes is added to a
+// column store, and :stats sums it up -- rating history, clock used per
+// move, how often the clock ran low, and results by type, opening and
+// time control.
+//
+// The store is a fixed-size sparse file, mapped, with one region per
+// column: a row of every games column per finished game, a row of
+// every moves column per move the user made.  Rows are only ever
+// appended, games in the order they ended, so "since" is a binary
+// search on the time column and a query is a scan of contiguous slices
+// of a few narrow columns.  Big scans are split across threads, each
+// summing its slice into its own report; the reports then add up.
+//
+//   header page | games: time, first_move, n_moves, rating, opp_rating,
+//               |   base, eco, inc, type, color, score, trouble
+//               | moves: type, number, used_ms
+//
+// Only the writer thread appends.  The columns are written first and
+// n_games last, with release ordering, so a query never sees half a
+// game.
+
+#define STATS_MAGIC     "VISTATS1"
+#define STATS_HEADER    4096
+#define STATS_GAMES     ( 1 << 20 )
+#define STATS_MOVES     ( 1 << 25 )
+#define STATS_THREADS   16
+#define STATS_SLICE     ( 1 << 18 )     // rows worth a thread of their own
+#define STATS_GAME_MOVES 300            // moves kept per game
+#define MONTH           ( 30 * 86400 )
+
+typedef struct STATS_HEADER_PAGE
+{
+  char magic[8];
+  uint64_t games_capacity;
+  uint64_t moves_capacity;
+  _Atomic uint64_t n_games;
+  uint64_t n_moves;             // only the writer reads it
+} STATS_HEADER_PAGE;
+
+// the user's game in progress, on one session
+typedef struct TRACKER
+{
+  bool playing;
+  uint32_t game_number;
+  int last_ply;
+  int32_t clock;                // the user's ms, as of the last board
+  STATS_GAME g;
+  int n_moves;
+  STATS_MOVE moves[STATS_GAME_MOVES];
+} TRACKER;
+
+struct STATS
+{
+  void *map;
+  size_t size;
+  STATS_HEADER_PAGE *header;
+  // games columns
+  uint32_t *time, *first_move;
+  uint16_t *n_moves;
+  int16_t *rating, *opp_rating;
+  uint16_t *base, *eco;
+  uint8_t *inc, *type, *color, *score, *trouble;
+  // moves columns; type is the game's, so the moves scan alone
+  uint8_t *move_type;
+  uint16_t *number;
+  uint32_t *used_ms;
+  TRACKER trackers[MAX_SESSIONS];
+};
+
+typedef struct COLUMN
+{
+  size_t field;                 // of the column's pointer in STATS
+  size_t width;
+  bool moves;
+} COLUMN;
+
+#define GAMES_COLUMN(f) { offsetof(STATS, f), sizeof *( (STATS *) 0 )->f, false }
+#define MOVES_COLUMN(f) { offsetof(STATS, f), sizeof *( (STATS *) 0 )->f, true }
+
+static const COLUMN COLUMNS[] =
+{
+  GAMES_COLUMN(time),
+  GAMES_COLUMN(first_move),
+  GAMES_COLUMN(n_moves),
+  GAMES_COLUMN(rating),
+  GAMES_COLUMN(opp_rating),
+  GAMES_COLUMN(base),
+  GAMES_COLUMN(eco),
+  GAMES_COLUMN(inc),
+  GAMES_COLUMN(type),
+  GAMES_COLUMN(color),
+  GAMES_COLUMN(score),
+  GAMES_COLUMN(trouble),
+  MOVES_COLUMN(move_type),
+  MOVES_COLUMN(number),
+  MOVES_COLUMN(used_ms),
+};
+
+const char *const STATS_TYPES[N_STATS_TYPES] =
+{
+  [ST_LIGHTNING]  = "lightning",
+  [ST_BLITZ]      = "blitz",
+  [ST_STANDARD]   = "standard",
+  [ST_CRAZYHOUSE] = "crazyhouse",
+  [ST_BUGHOUSE]   = "bughouse",
+  [ST_WILD]       = "wild",
+  [ST_SUICIDE]    = "suicide",
+  [ST_ATOMIC]     = "atomic",
+  [ST_LOSERS]     = "losers",
+  [ST_UNTIMED]    = "untimed",
+  [ST_OTHER]      = "other",
+};
+
+static size_t column_size(const COLUMN *col)
+{
+  size_t size = col->width * ( col->moves ? STATS_MOVES : STATS_GAMES );
+  return ( size + STATS_HEADER - 1 ) & ~(size_t) ( STATS_HEADER - 1 );
+}
+
+// Open (or create) the store at 'path'.  The store is the user's own
+// history, so a file that is not one of this layout is left alone:
+// NULL with errno EINVAL.  Returns NULL, with errno set, on other
+// failures too.
+STATS *stats_open(const char *path)
+{
+  size_t size = STATS_HEADER;
+  for (int i = 0; i < LEN(COLUMNS); i++) size += column_size(&COLUMNS[i]);
+
+  int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if ( fd == -1 ) return NULL;
+  struct stat st;
+  if ( fstat(fd, &st) == -1 ) { close(fd); return NULL; }
+
+  bool fresh = st.st_size == 0;
+  if ( ! fresh && st.st_size != (off_t) size ) { close(fd); errno = EINVAL; return NULL; }
+  if ( fresh && ftruncate(fd, size) == -1 ) { close(fd); return NULL; }
+
+  // not populated: the file is mostly holes, and a query only touches
+  // the slices it scans
+  void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if ( map == MAP_FAILED ) return NULL;
+
+  STATS_HEADER_PAGE *h = (STATS_HEADER_PAGE *) map;
+  if ( ! fresh && ( memcmp(h->magic, STATS_MAGIC, 8) != 0 || h->games_capacity != STATS_GAMES
+        || h->moves_capacity != STATS_MOVES || h->n_games > STATS_GAMES || h->n_moves > STATS_MOVES ) )
+  {
+    munmap(map, size);
+    errno = EINVAL;
+    return NULL;
+  }
+  if ( fresh )
+  {
+    // the columns are only read below the counts: no need to clear them
+    memcpy(h->magic, STATS_MAGIC, 8);
+    h->games_capacity = STATS_GAMES;
+    h->moves_capacity = STATS_MOVES;
+    h->n_moves = 0;
+    atomic_store(&h->n_games, 0);
+  }
+
+  STATS *s = calloc(1, sizeof *s);
+  if ( s == NULL ) error("stats_open");
+  s->map    = map;
+  s->size   = size;
+  s->header = h;
+  char *p = (char *) map + STATS_HEADER;
+  for (int i = 0; i < LEN(COLUMNS); i++)
+  {
+    *(void **) ( (char *) s + COLUMNS[i].field ) = p;
+    p += column_size(&COLUMNS[i]);
+  }
+  return s;
+}
+
+void stats_close(STATS *s)
+{
+  msync(s->map, s->size, MS_ASYNC);
+  munmap(s->map, s->size);
+  free(s);
+}
+
+uint64_t stats_games(const STATS *s)
+{
+  return atomic_load_explicit(&s->header->n_games, memory_order_acquire);
+}
+
+// Add a finished game and the user's moves in it.  Returns false when
+// the store is full.
+bool stats_append(STATS *s, const STATS_GAME *g, const STATS_MOVE *moves, int n)
+{
+  STATS_HEADER_PAGE *h = s->header;
+  uint64_t row = atomic_load_explicit(&h->n_games, memory_order_relaxed), m = h->n_moves;
+  if ( row == STATS_GAMES || m + n > STATS_MOVES ) return false;
+
+  for (int i = 0; i < n; i++)
+  {
+    s->move_type[m + i] = g->type;
+    s->number[m + i]    = moves[i].number;
+    s->used_ms[m + i]   = moves[i].used_ms;
+  }
+  s->time[row]       = g->time;
+  s->first_move[row] = m;
+  s->n_moves[row]    = n;
+  s->rating[row]     = g->rating;
+  s->opp_rating[row] = g->opp_rating;
+  s->base[row]       = g->base;
+  s->eco[row]        = g->eco;
+  s->inc[row]        = g->inc;
+  s->type[row]       = g->type;
+  s->color[row]      = g->color;
+  s->score[row]      = g->score;
+  s->trouble[row]    = g->trouble;
+  h->n_moves = m + n;
+  atomic_store_explicit(&h->n_games, row + 1, memory_order_release);
+  return true;
+}
+
+
+/// Recording
+
+static int type_code(const char *type, int base, int inc)
+{
+  for (int i = 0; i < ST_OTHER; i++) if ( begins_with((char *) type, (char *) STATS_TYPES[i]) ) return i;
+  if ( *type != '\0' ) return ST_OTHER;
+  // no gameinfo: go by FICS's expected duration, base + 40 increments
+  int expected = base + 40 * inc;
+  return expected == 0 ? ST_UNTIMED : expected < 180 ? ST_LIGHTNING : expected < 900 ? ST_BLITZ : ST_STANDARD;
+}
+
+// "C65 Ruy Lopez: Berlin defence" is 265
+static int eco_code(const char *opening)
+{
+  if ( opening[0] < 'A' || opening[0] > 'E' || ! isdigit(opening[1]) || ! isdigit(opening[2]) ) return STATS_NO_ECO;
+  return ( opening[0] - 'A' ) * 100 + ( opening[1] - '0' ) * 10 + opening[2] - '0';
+}
+
+static int rating(const char *r)
+{
+  int v = atoi(r);
+  return v > 0 && v < INT16_MAX ? v : 0;
+}
+
+static void start_game(TRACKER *t, const STYLE12 *b, const GAMEINFO *g1)
+{
+  static const GAMEINFO none = { 0 };
+  if ( g1->game_number != b->game_number ) g1 = &none;
+  int white = ( b->relation == PLAYING_MY_MOVE ) == ( b->turn == 'W' );
+  int base = b->match_minutes * 60, inc = b->match_increment;
+
+  t->playing     = true;
+  t->game_number = b->game_number;
+  t->last_ply    = style12_ply(b);
+  t->clock       = white ? b->white_ms : b->black_ms;
+  t->n_moves     = 0;
+  t->g = (STATS_GAME)
+  {
+    .rating     = rating(white ? g1->white_rating : g1->black_rating),
+    .opp_rating = rating(white ? g1->black_rating : g1->white_rating),
+    .base       = base < UINT16_MAX ? base : UINT16_MAX,
+    .inc        = inc < UINT8_MAX ? inc : UINT8_MAX,
+    .type       = type_code(g1->type, base, inc),
+    .color      = white ? WHITE_SIDE : BLACK_SIDE,
+    .eco        = STATS_NO_ECO,
+  };
+}
+
+// Follow a board of session 'session'; 'g1' is the session's latest
+// gameinfo and 'opening' the board's ECO opening, or NULL.  Only the
+// user's own games count.
+void stats_board(STATS *s, int session, const STYLE12 *b, const GAMEINFO *g1, const char *opening)
+{
+  if ( b->relation != PLAYING_MY_MOVE && b->relation != PLAYING_OPPONENTS_MOVE ) return;
+  TRACKER *t = &s->trackers[session];
+  if ( ! t->playing || t->game_number != b->game_number ) start_game(t, b, g1);
+  if ( opening != NULL ) t->g.eco = eco_code(opening);
+
+  bool white = t->g.color == WHITE_SIDE;
+  int ply = style12_ply(b);
+  int32_t clock = white ? b->white_ms : b->black_ms;
+  // the user just moved: the clock ran from the last board to this one,
+  // less the increment.  s12 numbers the move about to be made.
+  if ( ply == t->last_ply + 1 && ( b->turn == 'W' ) != white && t->n_moves < STATS_GAME_MOVES )
+  {
+    int32_t used = t->clock - clock + t->g.inc * 1000;
+    t->moves[t->n_moves++] = (STATS_MOVE) { .number = white ? b->move_number : b->move_number - 1,
+                                            .used_ms = used > 0 ? used : 0 };
+  }
+  if ( t->g.base > 0 && clock < t->g.base * 100 ) t->g.trouble = 1; // under a tenth of the base
+  t->clock    = clock;
+  t->last_ply = ply;
+}
+
+// Watch session text for the end of the user's game:
+//   {Game 77 (Newton vs. Einstein) Einstein resigns} 1-0
+// Aborted and adjourned games ("*") are not counted.
+void stats_text(STATS *s, int session, const char *line)
+{
+  unsigned int game;
+  TRACKER *t = &s->trackers[session];
+  if ( ! t->playing || sscanf(line, "{Game %u (", &game) != 1 || game != t->game_number ) return;
+  const char *close = strrchr(line, '}');
+  if ( close == NULL ) return;
+
+  char result[8] = "";
+  sscanf(close + 1, "%7s", result);
+  bool white = t->g.color == WHITE_SIDE;
+  if      ( equals(result, "1-0") )     t->g.score = white ? 2 : 0;
+  else if ( equals(result, "0-1") )     t->g.score = white ? 0 : 2;
+  else if ( equals(result, "1/2-1/2") ) t->g.score = 1;
+  else if ( ! equals(result, "*") )     return; // "{Game 77 (...) Creating ...}" and the like
+
+  t->playing = false;
+  if ( equals(result, "*") ) return;
+  t->g.time = time(NULL);
+  if ( ! stats_append(s, &t->g, t->moves, t->n_moves) ) log_text(LOG_WARN, LOGC_MISC, "stats: store full");
+}
+
+
+/// Queries
+
+typedef uint32_t v8u __attribute__(( vector_size(32) ));
+typedef uint8_t v8b __attribute__(( vector_size(8) ));
+
+static inline v8u load8(const uint8_t *p)
+{
+  v8b b;
+  memcpy(&b, p, sizeof b);
+  return __builtin_convertvector(b, v8u);
+}
+
+static inline uint64_t lanes(v8u v)
+{
+  uint64_t sum = 0;
+  for (int i = 0; i < 8; i++) sum += v[i];
+  return sum;
+}
+
+// Games, score and time trouble by type over games [lo, hi), eight
+// rows at a time: each type is a compare mask over the type column,
+// and-ed with the score and trouble columns.
+static void scan_types(const STATS *s, uint64_t lo, uint64_t hi, STATS_REPORT *r)
+{
+  v8u games[N_STATS_TYPES] = { 0 }, score[N_STATS_TYPES] = { 0 };
+  v8u trouble[N_STATS_TYPES] = { 0 }, trouble_score[N_STATS_TYPES] = { 0 };
+  uint64_t i = lo;
+  for ( ; i + 8 <= hi; i += 8)
+  {
+    v8u type = load8(s->type + i), sc = load8(s->score + i), tr = -load8(s->trouble + i);
+    for (int k = 0; k < N_STATS_TYPES; k++)
+    {
+      v8u m = (v8u) ( type == (uint32_t) k );
+      games[k]         -= m;
+      score[k]         += sc & m;
+      trouble[k]       -= tr & m;
+      trouble_score[k] += sc & tr & m;
+    }
+  }
+  for (int k = 0; k < N_STATS_TYPES; k++)
+  {
+    r->by_type[k].games         += lanes(games[k]);
+    r->by_type[k].score         += lanes(score[k]);
+    r->by_type[k].trouble       += lanes(trouble[k]);
+    r->by_type[k].trouble_score += lanes(trouble_score[k]);
+  }
+  for ( ; i < hi; i++)
+  {
+    int k = s->type[i];
+    r->by_type[k].games++;
+    r->by_type[k].score += s->score[i];
+    r->by_type[k].trouble += s->trouble[i];
+    r->by_type[k].trouble_score += s->trouble[i] ? s->score[i] : 0;
+  }
+}
+
+// Results by opening and time control, and ratings by month, over
+// games [lo, hi).
+static void scan_games(const STATS *s, uint64_t lo, uint64_t hi, uint32_t now, STATS_REPORT *r)
+{
+  for (uint64_t i = lo; i < hi; i++)
+  {
+    int score = s->score[i], eco = s->eco[i];
+    if ( eco < STATS_ECOS ) { r->by_eco[eco].games++; r->by_eco[eco].score += score; }
+
+    int base = s->base[i] / 60, inc = s->inc[i];
+    if ( base < STATS_BASES && inc < STATS_INCS ) { r->by_control[base][inc].games++; r->by_control[base][inc].score += score; }
+
+    uint32_t age = ( now - s->time[i] ) / MONTH;
+    if ( age < STATS_MONTHS && s->rating[i] > 0 )
+    {
+      r->history[s->type[i]][age].games++;
+      r->history[s->type[i]][age].rating += s->rating[i];
+    }
+  }
+}
+
+// Clock used by move number over moves [lo, hi).
+static void scan_moves(const STATS *s, uint64_t lo, uint64_t hi, STATS_REPORT *r)
+{
+  for (uint64_t i = lo; i < hi; i++)
+  {
+    unsigned bin = ( s->number[i] - 1u ) / STATS_MOVES_PER_BIN;
+    bin = bin < STATS_MOVE_BINS ? bin : STATS_MOVE_BINS - 1;
+    r->clock[s->move_type[i]][bin].moves++;
+    r->clock[s->move_type[i]][bin].used_ms += s->used_ms[i];
+  }
+}
+
+typedef struct PART
+{
+  const STATS *s;
+  uint64_t lo, hi, move_lo, move_hi;
+  uint32_t now;
+  STATS_REPORT r;
+} PART;
+
+static void scan(PART *p)
+{
+  scan_types(p->s, p->lo, p->hi, &p->r);
+  scan_games(p->s, p->lo, p->hi, p->now, &p->r);
+  scan_moves(p->s, p->move_lo, p->move_hi, &p->r);
+}
+
+static void *t_part(void *arg)
+{
+  trace_thread("stats");
+  scan(arg);
+  return NULL;
+}
+
+// Sum the games that ended at or after 'since' into 'r', on up to
+// 'threads' threads; 'now' dates the rating history.
+void stats_query(const STATS *s, uint32_t since, uint32_t now, int threads, STATS_REPORT *r)
+{
+  uint64_t start = now_ns();
+  memset(r, 0, sizeof *r);
+  uint64_t hi = stats_games(s), lo = 0, top = hi;
+  while ( lo < top )
+  {
+    uint64_t mid = lo + ( top - lo ) / 2;
+    if ( s->time[mid] < since ) lo = mid + 1; else top = mid;
+  }
+  uint64_t move_lo = lo < hi ? s->first_move[lo] : 0;
+  uint64_t move_hi = lo < hi ? s->first_move[hi - 1] + s->n_moves[hi - 1] : 0;
+
+  // a thread per slice, not more than asked
+  uint64_t rows = hi - lo + move_hi - move_lo;
+  int parts = rows / STATS_SLICE + 1;
+  parts = parts < threads ? parts : threads;
+  parts = parts < STATS_THREADS ? parts : STATS_THREADS;
+  parts = parts > 0 ? parts : 1;
+
+  PART *p = calloc(parts, sizeof *p);
+  if ( p == NULL ) error("stats_query");
+  for (int i = 0; i < parts; i++)
+    p[i] = (PART) { .s = s, .now = now,
+                    .lo = lo + ( hi - lo ) * i / parts, .hi = lo + ( hi - lo ) * ( i + 1 ) / parts,
+                    .move_lo = move_lo + ( move_hi - move_lo ) * i / parts,
+                    .move_hi = move_lo + ( move_hi - move_lo ) * ( i + 1 ) / parts };
+  pthread_t tid[STATS_THREADS];
+  for (int i = 1; i < parts; i++) pthread_create(&tid[i], NULL, t_part, &p[i]);
+  scan(&p[0]); // the caller takes the first
+  for (int i = 1; i < parts; i++) pthread_join(tid[i], NULL);
+
+  // every field is a counter: the reports add up word by word
+  uint64_t *sum = (uint64_t *) r;
+  for (int i = 0; i < parts; i++)
+  {
+    const uint64_t *part = (const uint64_t *) &p[i].r;
+    for (size_t w = 0; w < sizeof *r / sizeof *sum; w++) sum[w] += part[w];
+  }
+  free(p);
+  r->moves   = move_hi - move_lo;
+  r->threads = parts;
+  r->ns      = now_ns() - start;
+}
+
+
+/// :stats
+
+static double percent(uint64_t score, uint64_t games)
+{
+  return games ? 50.0 * score / games : 0;
+}
+
+// The index of the largest of n counts not yet taken, or -1.
+static int next_top(const uint64_t *games, size_t stride, int n, bool *taken)
+{
+  int best = -1;
+  for (int i = 0; i < n; i++)
+    if ( ! taken[i] && games[i * stride] > 0 && ( best == -1 || games[i * stride] > games[best * stride] ) ) best = i;
+  if ( best != -1 ) taken[best] = true;
+  return best;
+}
+
+//    :stats [DAYS|all]   sum up the user's games of the last DAYS (365)
+void stats_command(CONFIG *c, char *args)
+{
+  if ( c->stats == NULL ) { send_message(c->ib_mq, c->active, MSG_NOTICE, "no statistics (see -s)\n"); return; }
+  int days = 365;
+  while ( *args == ' ' ) args++;
+  if ( begins_with(args, "all") ) days = 0;
+  else if ( *args != '\n' && *args != '\0' && ( days = atoi(args) ) <= 0 )
+  {
+    send_message(c->ib_mq, c->active, MSG_NOTICE, "usage: :stats [days|all]\n");
+    return;
+  }
+
+  static STATS_REPORT r; // only the reader asks
+  uint32_t now = time(NULL);
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  stats_query(c->stats, days ? now - days * 86400u : 0, now, cpus > 0 ? cpus : 1, &r);
+
+  uint64_t games = 0;
+  for (int k = 0; k < N_STATS_TYPES; k++) games += r.by_type[k].games;
+  char period[32] = "";
+  if ( days ) snprintf(period, sizeof period, " in the last %d days", days);
+  send_message(c->ib_mq, c->active, MSG_NOTICE, "%lu games, %lu moves%s (%.2f ms, %lu thread%s)\n",
+      (unsigned long) games, (unsigned long) r.moves, period, r.ns / 1e6, (unsigned long) r.threads, r.threads > 1 ? "s" : "");
+  if ( games == 0 ) return;
+
+  send_message(c->ib_mq, c->active, MSG_NOTICE, "  %-10s %6s %6s %8s %10s\n", "", "games", "score", "trouble", "its score");
+  for (int k = 0; k < N_STATS_TYPES; k++)
+  {
+    const struct STATS_BY_TYPE *t = &r.by_type[k];
+    if ( t->games == 0 ) continue;
+    send_message(c->ib_mq, c->active, MSG_NOTICE, "  %-10s %6lu %5.1f%% %7.1f%% %9.1f%%\n", STATS_TYPES[k],
+        (unsigned long) t->games, percent(t->score, t->games), 100.0 * t->trouble / t->games, percent(t->trouble_score, t->trouble));
+  }
+
+  send_message(c->ib_mq, c->active, MSG_NOTICE, "rating by month, oldest first:\n");
+  for (int k = 0; k < N_STATS_TYPES; k++)
+  {
+    char line[MAX_LINE_SIZE];
+    int n = 0, rated = 0;
+    for (int m = STATS_MONTHS - 1; m >= 0; m--)
+    {
+      const struct STATS_RATINGS *h = &r.history[k][m];
+      if ( h->games ) n += snprintf(line + n, sizeof line - n, " %5lu", (unsigned long) ( h->rating / h->games )), rated++;
+      else            n += snprintf(line + n, sizeof line - n, " %5s", "-");
+    }
+    if ( rated ) send_message(c->ib_mq, c->active, MSG_NOTICE, "  %-10s%s\n", STATS_TYPES[k], line);
+  }
+
+  send_message(c->ib_mq, c->active, MSG_NOTICE, "seconds per move, by move number in fives:\n");
+  for (int k = 0; k < N_STATS_TYPES; k++)
+  {
+    char line[MAX_LINE_SIZE];
+    int n = 0, moved = 0;
+    for (int b = 0; b < STATS_MOVE_BINS; b++)
+    {
+      const struct STATS_CLOCK *t = &r.clock[k][b];
+      if ( t->moves ) n += snprintf(line + n, sizeof line - n, " %5.1f", t->used_ms / 1000.0 / t->moves), moved++;
+      else            n += snprintf(line + n, sizeof line - n, " %5s", "-");
+    }
+    if ( moved ) send_message(c->ib_mq, c->active, MSG_NOTICE, "  %-10s%s\n", STATS_TYPES[k], line);
+  }
+
+  // the commonest, with their scores
+  char line[MAX_LINE_SIZE];
+  int n = snprintf(line, sizeof line, "time controls:");
+  bool taken[STATS_BASES * STATS_INCS] = { false };
+  for (int i = 0, top; i < 8 && ( top = next_top(&r.by_control[0][0].games, 2, STATS_BASES * STATS_INCS, taken) ) != -1; i++)
+  {
+    const struct STATS_RESULTS *t = &r.by_control[0][0] + top;
+    n += snprintf(line + n, sizeof line - n, "  %d+%d %lu %.0f%%", top / STATS_INCS, top % STATS_INCS,
+        (unsigned long) t->games, percent(t->score, t->games));
+  }
+  send_message(c->ib_mq, c->active, MSG_NOTICE, "%s\n", line);
+
+  n = snprintf(line, sizeof line, "openings:");
+  memset(taken, false, sizeof taken);
+  for (int i = 0, top; i < 8 && ( top = next_top(&r.by_eco[0].games, 2, STATS_ECOS, taken) ) != -1; i++)
+    n += snprintf(line + n, sizeof line - n, "  %c%02d %lu %.0f%%", 'A' + top / 100, top % 100,
+        (unsigned long) r.by_eco[top].games, percent(r.by_eco[top].score, r.by_eco[top].games));
+  send_message(c->ib_mq, c->active, MSG_NOTICE, "%s\n", line);
+}
@@ -0,0 +1,186 @@
+#include "vichess.h"
+
+// Framing for the server sockets, which speak telnet (RFC 854).
+//
+// Bytes are read into the session's TELNET buffer and framed there:
+// negotiation (IAC ...) is cut out of the text, every line ending --
+// "\n\r" from FICS, "\r\n", "\r\0", or a lone "\r" or "\n" -- ends one
+// line, and each line is handed to the caller NUL-terminated where it
+// lies, without its ending.  Ordinary text is found eight bytes at a
+// time and only moved if negotiation was cut out before it on the same
+// line, so a board costs a few word compares and no copy.  All state
+// lives in the TELNET, so a sequence or a line ending split between two
+// reads is handled the same as a whole one.
+//
+// Options are all refused: DO is answered WONT, WILL is answered DONT,
+// and the answers go out on the socket after the read that asked.
+
+enum __TELNET_BYTES
+{
+  T_SE          = 240,
+  T_SB          = 250,
+  T_WILL        = 251,
+  T_WONT        = 252,
+  T_DO          = 253,
+  T_DONT        = 254,
+  T_IAC         = 255,
+};
+
+enum __TELNET_STATES
+{
+  TS_DATA,
+  TS_IAC,                       // after IAC
+  TS_OPTION,                    // after IAC WILL, WONT, DO or DONT
+  TS_SB,                        // in a subnegotiation
+  TS_SB_IAC,                    // IAC in a subnegotiation
+};
+
+#define ONES    0x0101010101010101ULL
+#define HIGHS   0x8080808080808080ULL
+
+// The high bit of every byte of 'x' that equals 'b'; bits above the
+// lowest may be false, which is all next_special() looks at.
+static inline uint64_t bytes_equal(uint64_t x, unsigned char b)
+{
+  uint64_t y = x ^ ( b * ONES );
+  return ( y - ONES ) & ~y & HIGHS;
+}
+
+static inline bool special(unsigned char ch)
+{
+  return ch == T_IAC || ch == '\r' || ch == '\n';
+}
+
+// The first IAC, CR or LF in [p, end), or end.
+static inline char *next_special(char *p, char *end)
+{
+  for ( ; end - p >= 8; p += 8)
+  {
+    uint64_t w;
+    memcpy(&w, p, 8);
+    uint64_t m = bytes_equal(w, T_IAC) | bytes_equal(w, '\r') | bytes_equal(w, '\n');
+    if ( m != 0 ) return p + ( __builtin_ctzll(m) >> 3 );
+  }
+  while ( p < end && ! special(*p) ) p++;
+  return p;
+}
+
+static void refuse(TELNET *t, unsigned char verb, unsigned char option)
+{
+  unsigned char answer = verb == T_DO ? T_WONT : verb == T_WILL ? T_DONT : 0;
+  if ( answer == 0 || t->n_reply + 3 > sizeof t->reply ) return;
+  t->reply[t->n_reply++] = T_IAC;
+  t->reply[t->n_reply++] = answer;
+  t->reply[t->n_reply++] = option;
+}
+
+// Frame bytes [from, len) of the buffer, which follow the unended
+// line before them, passing each complete line to 'line'.  What is left
+// of the last line moves to the front.
+static void frame(TELNET *t, size_t from, TELNET_LINE line, void *arg)
+{
+  char *buf = t->buf, *p = buf + from, *end = buf + t->len, *start = buf, *out = p;
+
+  while ( p < end )
+  {
+    unsigned char ch = *p;
+    if ( t->state != TS_DATA )
+    {
+      // negotiation, a byte at a time: rare, and cut from the text
+      p++;
+      switch ( t->state )
+      {
+        case TS_IAC:
+          if      ( ch == T_IAC )   { *out++ = (char) T_IAC; t->state = TS_DATA; } // an escaped 255
+          else if ( ch >= T_WILL )  { t->verb = ch; t->state = TS_OPTION; }
+          else if ( ch == T_SB )    t->state = TS_SB;
+          else                      t->state = TS_DATA; // NOP, GA, ...
+          break;
+        case TS_OPTION: refuse(t, t->verb, ch); t->state = TS_DATA; break;
+        case TS_SB:     if ( ch == T_IAC ) t->state = TS_SB_IAC; break;
+        case TS_SB_IAC: t->state = ch == T_SE ? TS_DATA : TS_SB; break;
+      }
+      continue;
+    }
+
+    // the second half of "\n\r", "\r\n" or "\r\0" ends nothing
+    if ( t->eol != 0 )
+    {
+      bool pair = t->eol == '\n' ? ch == '\r' : ( ch == '\n' || ch == '\0' );
+      t->eol = 0;
+      if ( pair ) { start = out = ++p; continue; }
+    }
+
+    char *q = next_special(p, end);
+    if ( q != p )
+    {
+      if ( out != p ) memmove(out, p, q - p); // negotiation was cut before it
+      out += q - p;
+      p = q;
+      if ( p == end ) break;
+      ch = *p;
+    }
+    p++;
+    if ( ch == T_IAC ) { t->state = TS_IAC; continue; }
+
+    // a line ending: hand the line over where it lies
+    *out = '\0';
+    line(arg, start, out - start);
+    t->eol = ch;
+    start = out = p;
+  }
+
+  t->len = out - start;
+  if ( start != buf && t->len > 0 ) memmove(buf, start, t->len);
+
+  // a line that fills the buffer is passed on as it is
+  if ( t->len == sizeof t->buf - 1 )
+  {
+    buf[t->len] = '\0';
+    line(arg, buf, t->len);
+    t->len = 0;
+  }
+}
+
+// Pass 'n' bytes, as if read from the socket: for captured streams.
+void telnet_feed(TELNET *t, const char *data, size_t n, TELNET_LINE line, void *arg)
+{
+  while ( n > 0 )
+  {
+    size_t from = t->len, room = sizeof t->buf - 1 - from, take = n < room ? n : room;
+    memcpy(t->buf + from, data, take);
+    t->len += take;
+    frame(t, from, line, arg);
+    data += take;
+    n -= take;
+  }
+}
+
+// Read everything 'fd' has, passing each complete line to 'line', and
+// answer any negotiation.  Returns 0 at EOF, after passing on a last
+// unended line; otherwise -1 with errno set, EAGAIN once the socket is
+// drained.
+ssize_t telnet_read(int fd, TELNET *t, TELNET_LINE line, void *arg)
+{
+  ssize_t n;
+  while ( true )
+  {
+    size_t from = t->len;
+    n = read(fd, t->buf + from, sizeof t->buf - 1 - from);
+    if ( n == -1 && errno == EINTR ) continue;
+    if ( n <= 0 ) break;
+    t->len += n;
+    frame(t, from, line, arg);
+  }
+  int saved = errno;
+  if ( t->n_reply > 0 && send(fd, t->reply, t->n_reply, MSG_NOSIGNAL) == -1 ) perror("telnet send");
+  t->n_reply = 0;
+  if ( n == 0 && t->len > 0 )
+  {
+    t->buf[t->len] = '\0';
+    line(arg, t->buf, t->len);
+    t->len = 0;
+  }
+  errno = saved;
+  return n;
+}
@@ -0,0 +1,160 @@
+#include "vichess.h"
+
+// Trace spans around the phases a board goes through on its way to the
+// screen: framing the line, the queue hop, parsing, drawing.  Dumped as
+// Chrome trace JSON, they load in chrome://tracing or ui.perfetto.dev
+// with one track per thread:
+//
+//    vichess -T /tmp/vichess.trace.json       (or :trace on)
+//    kill -USR1 <pid>                         (or :trace dump [file])
+//
+// Each thread writes its spans into a ring of its own, TRACE_EVENTS
+// long, and only ever its own: no locks, no shared cache lines.  A dump
+// reads the rings while they are written, and keeps only the spans the
+// writers cannot have overwritten meanwhile.  While tracing is off a
+// span is one relaxed load and a branch.  Spans around mq_receive
+// include the time spent waiting for a message.
+
+#define TRACE_EVENTS    8192    // per thread, a power of two
+#define TRACE_THREADS   32
+
+static const char *SPANS[N_SPANS] =
+{
+  [TR_TELNET_READ]      = "telnet_read",
+  [TR_MQ_SEND]          = "mq_send",
+  [TR_MQ_RECEIVE]       = "mq_receive",
+  [TR_PARSE_S12]        = "parse_s12_string",
+  [TR_PARSE_GAMEINFO]   = "parse_gameinfo_string",
+  [TR_WRITE_BOARD]      = "cb_write_board",
+  [TR_WRITE_RESPONSE]   = "cb_write_response",
+  [TR_KEY_TO_SOCKET]    = "key_to_socket",
+};
+
+typedef struct SPAN
+{
+  uint64_t start, end;
+  int span;
+} SPAN;
+
+typedef struct TRACE_RING
+{
+  const char *name;
+  int tid;
+  _Atomic uint64_t head;        // spans ever written
+  SPAN spans[TRACE_EVENTS];
+} TRACE_RING;
+
+atomic_bool tracing;
+static TRACE_RING *_Atomic rings[TRACE_THREADS];
+static atomic_int n_rings;
+static _Thread_local TRACE_RING *mine;
+static _Thread_local const char *thread_name;
+static char *dump_path;
+
+// Name the calling thread's track.
+void trace_thread(const char *name)
+{
+  thread_name = name;
+  if ( mine != NULL ) mine->name = name;
+}
+
+// The calling thread's name, or NULL if it has none.
+const char *trace_thread_name(void)
+{
+  return thread_name;
+}
+
+void trace_record(int span, uint64_t start, uint64_t end)
+{
+  if ( mine == NULL )
+  {
+    int i = atomic_fetch_add(&n_rings, 1);
+    if ( i >= TRACE_THREADS ) return; // too many threads: the rest go untraced
+    if ( (mine = calloc(1, sizeof *mine)) == NULL ) error("trace calloc");
+    mine->name = thread_name != NULL ? thread_name : "thread";
+    mine->tid  = i + 1;
+    atomic_store(&rings[i], mine);
+  }
+  uint64_t head = atomic_load_explicit(&mine->head, memory_order_relaxed);
+  mine->spans[head & ( TRACE_EVENTS - 1 )] = (SPAN) { start, end, span };
+  atomic_store_explicit(&mine->head, head + 1, memory_order_release);
+}
+
+// Write every thread's spans to 'path' as Chrome trace JSON.  Returns
+// the number of spans written, or -1 with errno set.
+long trace_dump(const char *path)
+{
+  FILE *f = fopen(path, "w");
+  if ( f == NULL ) return -1;
+  setvbuf(f, NULL, _IOFBF, 1 << 20);
+  fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  SPAN *copy = malloc(TRACE_EVENTS * sizeof *copy);
+  if ( copy == NULL ) { fclose(f); return -1; }
+  long n = 0;
+  int pid = getpid(), threads = atomic_load(&n_rings);
+  for (int t = 0; t < threads && t < TRACE_THREADS; t++)
+  {
+    TRACE_RING *r = atomic_load(&rings[t]);
+    if ( r == NULL ) continue; // registered, not yet published
+    fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+        n++ ? ",\n" : "", pid, r->tid, r->name);
+
+    // copy what is there, then drop what may have been overwritten
+    // while copying
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    uint64_t from = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+    for (uint64_t i = from; i < head; i++) copy[i & ( TRACE_EVENTS - 1 )] = r->spans[i & ( TRACE_EVENTS - 1 )];
+    atomic_thread_fence(memory_order_acquire); // the copies stay before the recheck
+    uint64_t after = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if ( after >= TRACE_EVENTS && after - TRACE_EVENTS + 1 > from ) from = after - TRACE_EVENTS + 1;
+    for (uint64_t i = from; i < head; i++)
+    {
+      SPAN *s = &copy[i & ( TRACE_EVENTS - 1 )];
+      fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"vichess\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+          SPANS[s->span], pid, r->tid, s->start / 1000.0, ( s->end - s->start ) / 1000.0);
+      n++;
+    }
+  }
+  free(copy);
+  fprintf(f, "\n]}\n");
+  if ( fclose(f) == EOF ) return -1;
+  return n;
+}
+
+// SIGUSR1 dumps to the -T file.  The signal is blocked in every thread
+// but this one, which waits for it; nothing runs in a handler.
+static void *t_trace_signal(void *arg)
+{
+  UNUSED( arg );
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR1);
+  trace_thread("trace");
+  while ( true )
+  {
+    int sig;
+    if ( sigwait(&set, &sig) != 0 ) continue;
+    if ( trace_dump(dump_path) == -1 ) perror(dump_path);
+  }
+  return NULL;
+}
+
+// Trace from the start, dumping to 'path' on SIGUSR1 and at exit.  Call
+// before any thread is started, so that they all inherit the mask.
+void trace_start(const char *path)
+{
+  dump_path = strdup(path);
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+  pthread_t t;
+  if ( pthread_create(&t, NULL, t_trace_signal, NULL) == 0 ) pthread_detach(t);
+  atomic_store(&tracing, true);
+}
+
+// The file given to trace_start(), or NULL.
+const char *trace_path(void)
+{
+  return dump_path;
+}
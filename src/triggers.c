@@ -0,0 +1,253 @@
+#include "vichess.h"
+
+// Trigger rules: act on seeks and challenges as soon as the line is
+// framed, from the I/O loop, without a round trip through the
+// terminal.
+//
+// Rules are read from a file (-r FILE) at startup, one per line:
+//
+//    on seek time=1 inc=0 rating=1800-2100 send play %n
+//    on seek type=lightning rated=1 from=Alice send play %n
+//    on challenge from=Bob send accept %h
+//    on challenge session=2 time=3-5 send accept %h
+//
+// Conditions are key=value with ranges written lo-hi; all of them must
+// hold.  In the action, %n is the seek number and %h the handle of the
+// player seeking or challenging.  '#' starts a comment.
+
+#define MAX_TRIGGERS    64
+#define MAX_TOKENS      24
+
+TRIGGER TRIGGERS[MAX_TRIGGERS];
+int N_TRIGGERS = 0;
+
+// "5" or "3-5"
+bool parse_range(const char *s, RANGE *r)
+{
+  char *end;
+  r->lo = r->hi = strtol(s, &end, 10);
+  if ( end == s ) return false;
+  if ( *end == '-' ) r->hi = strtol(end + 1, &end, 10);
+  r->any = false;
+  return *end == '\0' && r->lo <= r->hi;
+}
+
+bool in_range(RANGE r, int v) { return r.any || ( v >= r.lo && v <= r.hi ); }
+
+// Compile one rule; returns false on a syntax error.
+static bool compile_trigger(char *rule, TRIGGER *t)
+{
+  memset(t, 0, sizeof *t);
+  t->time.any = t->inc.any = t->rating.any = true;
+  t->rated    = -1;
+  t->session  = -1;
+  snprintf(t->source, sizeof t->source, "%s", rule);
+
+  char *save, *tok = strtok_r(rule, " \t", &save);
+  if ( tok == NULL || ! equals(tok, "on") ) return false;
+
+  tok = strtok_r(NULL, " \t", &save);
+  if      ( tok == NULL )                 return false;
+  else if ( equals(tok, "seek") )         t->kind = TRIGGER_SEEK;
+  else if ( equals(tok, "challenge") )    t->kind = TRIGGER_CHALLENGE;
+  else return false;
+
+  while ( (tok = strtok_r(NULL, " \t", &save)) != NULL && ! equals(tok, "send") )
+  {
+    char *value = strchr(tok, '=');
+    if ( value == NULL ) return false;
+    *value++ = '\0';
+    if      ( equals(tok, "time") )     { if ( ! parse_range(value, &t->time) )   return false; }
+    else if ( equals(tok, "inc") )      { if ( ! parse_range(value, &t->inc) )    return false; }
+    else if ( equals(tok, "rating") )   { if ( ! parse_range(value, &t->rating) ) return false; }
+    else if ( equals(tok, "rated") )    t->rated = atoi(value) != 0;
+    else if ( equals(tok, "session") )  t->session = atoi(value) - 1;
+    else if ( equals(tok, "type") )     snprintf(t->type, sizeof t->type, "%s", value);
+    else if ( equals(tok, "from") )     snprintf(t->from, sizeof t->from, "%s", value);
+    else return false;
+  }
+  if ( tok == NULL || save == NULL || *save == '\0' ) return false; // no action
+
+  snprintf(t->action, sizeof t->action, "%s", save);
+  return true;
+}
+
+// Compile and add one rule.  Returns false on a syntax error.
+bool triggers_add(const char *rule)
+{
+  if ( N_TRIGGERS == MAX_TRIGGERS ) error("too many triggers");
+  if ( ! compile_trigger(strdupa(rule), &TRIGGERS[N_TRIGGERS]) ) return false;
+  N_TRIGGERS++;
+  return true;
+}
+
+// Read and compile the rules file.  Bad rules are fatal: better to find
+// out at startup than when the seek you wanted goes by.
+void triggers_load(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  if ( f == NULL ) { perror(path); error("triggers_load"); }
+
+  char line[MAX_LINE_SIZE];
+  int line_number = 0;
+  while ( fgets(line, sizeof line, f) != NULL )
+  {
+    line_number++;
+    char *hash = strchr(line, '#');
+    if ( hash != NULL ) *hash = '\0';
+    line[strcspn(line, "\r\n")] = '\0';
+    char *rule = line + strspn(line, " \t");
+    if ( *rule == '\0' ) continue;
+
+    if ( ! triggers_add(rule) )
+    {
+      fprintf(stderr, "%s:%d: bad rule\n", path, line_number);
+      error("triggers_load");
+    }
+  }
+  fclose(f);
+}
+
+// true if any rule needs seek advertisements ("set seek 1")
+bool triggers_want_seeks(void)
+{
+  for (int i = 0; i < N_TRIGGERS; i++)
+    if ( TRIGGERS[i].kind == TRIGGER_SEEK ) return true;
+  return false;
+}
+
+
+/// Matching
+
+// "1500", "1500E", "----", "++++" -> 1500, 1500, 0, 0
+static int rating_of(const char *s)
+{
+  while ( *s == '(' ) s++;
+  return atoi(s);
+}
+
+// Split a line into blank-separated tokens, in place.
+static int tokenize(char *line, char *tokens[MAX_TOKENS])
+{
+  int n = 0;
+  while ( n < MAX_TOKENS )
+  {
+    while ( *line == ' ' || *line == '\n' || *line == '\r' ) line++;
+    if ( *line == '\0' ) break;
+    tokens[n++] = line;
+    while ( *line != '\0' && *line != ' ' && *line != '\n' && *line != '\r' ) line++;
+    if ( *line == '\0' ) break;
+    *line++ = '\0';
+  }
+  return n;
+}
+
+// Recognize a seek advertisement or a challenge:
+//
+//    GuestQWPT (++++) seeking 2 12 unrated blitz ("play 89" to respond)
+//    Alice (1822) seeking 1 0 rated lightning [white] f ("play 7" to respond)
+//    Challenge: Bob (1650) GuestQWPT (++++) unrated blitz 5 0.
+//    Challenge: Bob (1650) [black] GuestQWPT (++++) rated blitz 5 0.
+//
+// Returns false for any other line.
+bool parse_offer(const char *line, OFFER *o)
+{
+  // cheap rejection before copying: most lines are neither
+  if ( ! contains((char *) line, " seeking ") && ! contains((char *) line, "Challenge: ") ) return false;
+
+  char *cp = strdupa(line), *t[MAX_TOKENS];
+  int n = tokenize(cp, t);
+  memset(o, 0, sizeof *o);
+
+  if ( n >= 8 && equals(t[2], "seeking") )
+  {
+    o->kind   = TRIGGER_SEEK;
+    snprintf(o->from, sizeof o->from, "%s", t[0]);
+    o->rating = rating_of(t[1]);
+    o->time   = atoi(t[3]);
+    o->inc    = atoi(t[4]);
+    o->rated  = equals(t[5], "rated");
+    snprintf(o->type, sizeof o->type, "%s", t[6]);
+    for (int i = 7; i < n - 1; i++)
+      if ( equals(t[i], "(\"play") ) { o->number = atoi(t[i+1]); return true; }
+    return false;
+  }
+
+  if ( n >= 9 && equals(t[0], "Challenge:") )
+  {
+    int i = 3;
+    o->kind   = TRIGGER_CHALLENGE;
+    snprintf(o->from, sizeof o->from, "%s", t[1]);
+    o->rating = rating_of(t[2]);
+    if ( t[i][0] == '[' ) i++;          // [color]
+    i += 2;                             // opponent (rating), i.e. me
+    if ( i + 3 >= n ) return false;
+    o->rated  = equals(t[i], "rated");
+    snprintf(o->type, sizeof o->type, "%s", t[i+1]);
+    o->time   = atoi(t[i+2]);
+    o->inc    = atoi(t[i+3]);
+    return true;
+  }
+  return false;
+}
+
+static bool trigger_matches(const TRIGGER *t, int session, const OFFER *o)
+{
+  return t->kind == o->kind
+      && ( t->session == -1 || t->session == session )
+      && in_range(t->time, o->time)
+      && in_range(t->inc, o->inc)
+      && in_range(t->rating, o->rating)
+      && ( t->rated == -1 || t->rated == o->rated )
+      && ( t->type[0] == '\0' || equals((char *) t->type, (char *) o->type) )
+      && ( t->from[0] == '\0' || strcasecmp(t->from, o->from) == 0 );
+}
+
+// Expand %n and %h in a rule's action.
+static void expand_action(const TRIGGER *t, const OFFER *o, char *out, size_t n)
+{
+  size_t len = 0;
+  for (const char *a = t->action; *a != '\0' && len < n - 2; a++)
+  {
+    if      ( a[0] == '%' && a[1] == 'n' ) { len += snprintf(out + len, n - len, "%d", o->number); a++; }
+    else if ( a[0] == '%' && a[1] == 'h' ) { len += snprintf(out + len, n - len, "%s", o->from);   a++; }
+    else out[len++] = *a;
+    if ( len >= n - 2 ) len = n - 2;
+  }
+  out[len++] = '\n';
+  out[len]   = '\0';
+}
+
+// Evaluate the rules against a line just read by session 's'; the
+// first rule that matches sends its action straight to the socket.
+// 'received_ns' is when the line came off the socket.  Returns the
+// matching rule, or NULL.
+TRIGGER *triggers_run(SESSION *s, const char *line, uint64_t received_ns)
+{
+  if ( N_TRIGGERS == 0 ) return NULL;
+
+  OFFER o;
+  if ( ! parse_offer(line, &o) ) return NULL;
+
+  for (int i = 0; i < N_TRIGGERS; i++)
+  {
+    TRIGGER *t = &TRIGGERS[i];
+    if ( ! trigger_matches(t, s->id, &o) ) continue;
+
+    char command[sizeof t->action + 64];
+    expand_action(t, &o, command, sizeof command);
+    block_send(s, BO_TRIGGER, command);
+
+    // only the I/O loop writes these; relaxed is enough for :triggers
+    uint64_t latency = now_ns() - received_ns;
+    uint64_t min = atomic_load_explicit(&t->latency_min, memory_order_relaxed);
+    if ( latency > atomic_load_explicit(&t->latency_max, memory_order_relaxed) )
+      atomic_store_explicit(&t->latency_max, latency, memory_order_relaxed);
+    if ( min == 0 || latency < min ) atomic_store_explicit(&t->latency_min, latency, memory_order_relaxed);
+    atomic_store_explicit(&t->last_latency, latency, memory_order_relaxed);
+    atomic_fetch_add_explicit(&t->latency_total, latency, memory_order_relaxed);
+    atomic_fetch_add_explicit(&t->fired, 1, memory_order_relaxed);
+    return t;
+  }
+  return NULL;
+}
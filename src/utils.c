@@ -2,14 +2,23 @@
 
 // Assorted general-purpose functions.
 
+// to the -L log, at debug level
 void debug(const char *fmt, ...)
 {
   va_list args;
   va_start(args, fmt);
-  vfprintf(stderr, fmt, args);
+  log_vtext(LOG_DEBUG, LOGC_MISC, fmt, args);
   va_end(args);
 }
 
+// monotonic clock in nanoseconds, for latency and throughput figures
+uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 void error(const char *msg)
 {
   printf("error:  %s\n", msg);
@@ -83,15 +92,45 @@ mqd_t *get_mq_fd(const char* name, int o_flags)
   return mqd;
 }
 
+static void vsend_message(mqd_t mq_fd, MESSAGE *msg, char *fmt, va_list args)
+{
+  vsnprintf(msg->text, sizeof msg->text, fmt, args);
+  size_t len = offsetof(MESSAGE, text) + strlen(msg->text) + 1;
+  uint64_t trace = trace_begin();
+  if(mq_send(mq_fd, (char *) msg, len, PRIORITY) == -1) { error("send_message"); }
+  trace_end(TR_MQ_SEND, trace);
+}
+
+// Queue a line for the given session.
 // N.B.:  callers must always terminate message strings with "\n"
-void send_message(int mq_fd, char *fmt, ...)
+void send_message(mqd_t mq_fd, int session, int type, char *fmt, ...)
+{
+  MESSAGE msg = { .session = session, .type = type };
+  va_list args;
+  va_start(args, fmt);
+  vsend_message(mq_fd, &msg, fmt, args);
+  va_end(args);
+}
+
+// Queue a command for the session's server on behalf of 'owner' (BO_*),
+// who gets the reply.
+void send_command(mqd_t mq_fd, int session, int owner, char *fmt, ...)
+{
+  MESSAGE msg = { .session = session, .type = MSG_INPUT, .owner = owner };
+  va_list args;
+  va_start(args, fmt);
+  vsend_message(mq_fd, &msg, fmt, args);
+  va_end(args);
+}
+
+// Queue a line of the server's reply to a command sent for 'owner'
+// (BO_*), for the writer to give to whoever asked.
+void send_reply(mqd_t mq_fd, int session, int owner, char *fmt, ...)
 {
-  char msg[MAX_LINE_SIZE];
-  memset(msg, 0, MAX_LINE_SIZE);
+  MESSAGE msg = { .session = session, .type = MSG_LINE, .owner = owner };
   va_list args;
   va_start(args, fmt);
-  vsprintf(msg, fmt, args);
-  if(mq_send(mq_fd, msg, strlen(msg), PRIORITY) == -1) { error("send_message"); }
+  vsend_message(mq_fd, &msg, fmt, args);
   va_end(args);
 }
 
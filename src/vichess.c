@@ -1,8 +1,42 @@
 #include "vichess.h"
 
-const char *QUEUES[] = { "/ob", "/ib" };
+// queue names are per-process so that several clients can share a host
+char QUEUES[2][32];
+void name_queues() { snprintf(QUEUES[0], 32, "/vichess.%d.ob", getpid()); snprintf(QUEUES[1], 32, "/vichess.%d.ib", getpid()); }
 void unlink_queues() { for (int i = 0; i < LEN(QUEUES); i++) { mq_unlink( QUEUES[i] ); } }
 
+void usage(char *argv0)
+{
+  fprintf(stderr, "usage: %s [-a engine [-A n] [-k cache]] [-c threads] [-e ring] [-E eco.bin] [-g games] [-I games.pgn.idx] [-H json|binary [-o file]] [-L log] [-m MB] [-M metrics.sock] [-r rules] [-s stats] [-t cpus[:fifo]] [-T trace.json] [-u handle[:password]] ...\n", argv0);
+  fprintf(stderr, "       %s -b benchmark|all\n", argv0);
+  fprintf(stderr, "       %s -p games > games.pgn\n", argv0);
+  fprintf(stderr, "       %s -i games.pgn\n", argv0);
+  fprintf(stderr, "       %s -l log\n", argv0);
+  fprintf(stderr, "  -a   analyse every game with this UCI engine command (e.g. ./vichess-uci)\n");
+  fprintf(stderr, "  -A   number of analysis engines to run (default 1)\n");
+  fprintf(stderr, "  -k   analysis cache file (default ~/.vichess-analysis)\n");
+  fprintf(stderr, "  -b   run a benchmark and exit (no server connection)\n");
+  fprintf(stderr, "  -c   play the built-in engine offline, searching with this many threads\n");
+  fprintf(stderr, "  -e   publish parsed events on shared-memory ring (e.g. /vichess)\n");
+  fprintf(stderr, "  -E   opening table, built by make (default ./" ECO_FILE ")\n");
+  fprintf(stderr, "  -g   record games into this archive (default ~/" ARCHIVE_FILE ")\n");
+  fprintf(stderr, "  -p   print the games in an archive as PGN and exit\n");
+  fprintf(stderr, "  -i   index a PGN file by position (into FILE.idx) and exit\n");
+  fprintf(stderr, "  -I   game database index, for :games\n");
+  fprintf(stderr, "  -L   log, in binary, to this file (info and above; see :log)\n");
+  fprintf(stderr, "  -l   print a log as text and exit\n");
+  fprintf(stderr, "  -m   count allocations (see :mem); warn when the RSS passes this many MB, or 0\n");
+  fprintf(stderr, "  -M   serve runtime metrics (Prometheus text) on this unix socket\n");
+  fprintf(stderr, "  -H   headless: write events to stdout (or -o file), read commands from stdin\n");
+  fprintf(stderr, "  -t   tournament profile: pin the socket io, writer, reader and analysis threads\n");
+  fprintf(stderr, "       to these CPUs (- for any, e.g. 0,1,1:fifo), run socket io SCHED_FIFO, lock memory\n");
+  fprintf(stderr, "  -T   trace spans; dump them as Chrome trace JSON to this file on SIGUSR1 and at exit\n");
+  fprintf(stderr, "  -r   load trigger rules from file (see src/triggers.c)\n");
+  fprintf(stderr, "  -s   record your games' statistics here, for :stats (default ~/" STATS_FILE ")\n");
+  fprintf(stderr, "  -u   open a session; with none, log in once as guest\n");
+  exit(EXIT_FAILURE);
+}
+
 /*
   // curses emits SIGWINCH upon window resize -- register callback
   //signal(SIGWINCH, handle_term_resize); //FIXME
@@ -45,7 +79,7 @@ void initialize_curses()
   w3 = newwin( 1,               COLS,      LINES - 1,      0              );
   if (w1 == NULL || w2 == NULL || w3 == NULL) { waddstr(stdscr, "newwin"); endwin(); }
 
-  echo(); scrollok(w2, TRUE);
+  echo(); cbreak(); scrollok(w2, TRUE);
 
   // initialize color tuples
   //   see http://www.calmar.ws/vim/256-xterm-24bit-rgb-color-chart.html
@@ -58,6 +92,8 @@ void initialize_curses()
   init_pair(    CLI_INPUT,      253,    232     ); 
   init_pair(    GRAY_ON_BLACK,  245,    233     ); 
   init_pair(    RED,            1,      52      ); 
+  init_pair(    CURSOR_SQUARE,  0,      117     );
+  init_pair(    SELECTED_SQUARE,0,      114     );
 
   wbkgd( w1, COLOR_PAIR( TERMINAL  ) );
   wbkgd( w2, COLOR_PAIR( TERMINAL  ) );
@@ -73,57 +109,233 @@ void initialize_curses()
 
 int main(int argc, char *argv[])
 {
+  // one session per -u, parsed before curses takes over the terminal
+  char *logins[MAX_SESSIONS];
+  int n_logins = 0, opt, offline_threads = 0;
+  char *ring_name = NULL, *out_name = NULL, *engine_command = NULL, *cache_name = NULL;
+  char *eco_name = NULL, *archive_name = NULL, *gamedb_name = NULL, *metrics_name = NULL, *trace_name = NULL, *stats_name = NULL;
+  long mem_budget = -1;
+  PROFILE profile = { .on = false };
+  char *log_name = NULL;
+  int n_engines = 1;
+  int format = OUT_CURSES;
+  while ((opt = getopt(argc, argv, "a:A:b:c:e:E:g:H:i:I:k:l:L:m:M:o:p:r:s:t:T:u:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'a': engine_command = optarg; break;
+      case 'A':
+        if ((n_engines = atoi(optarg)) < 1 || n_engines > ANALYSIS_MAX_ENGINES) usage(argv[0]);
+        break;
+      case 'b': return bench(optarg);
+      case 'c':
+        if ((offline_threads = atoi(optarg)) < 1) usage(argv[0]);
+        break;
+      case 'e': ring_name = optarg; break;
+      case 'E': eco_name = optarg; break;
+      case 'g': archive_name = optarg; break;
+      case 'H':
+        if      (equals(optarg, "json"))    format = OUT_JSON;
+        else if (equals(optarg, "binary"))  format = OUT_BINARY;
+        else usage(argv[0]);
+        break;
+      case 'i':
+      {
+        char index[PATH_MAX];
+        IMPORT_STATS st;
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        snprintf(index, sizeof index, "%s.idx", optarg);
+        if (! gamedb_import(optarg, index, cpus > 0 ? cpus : 1, &st)) { perror(optarg); return EXIT_FAILURE; }
+        printf("%s: %lu games, %lu positions (%lu games with bad moves), %.1f MB/s, %.0f games/s\n", index,
+            (unsigned long) st.games, (unsigned long) st.positions, (unsigned long) st.errors,
+            st.bytes / 1e6 / ( st.ns / 1e9 ), st.games / ( st.ns / 1e9 ));
+        return EXIT_SUCCESS;
+      }
+      case 'I': gamedb_name = optarg; break;
+      case 'k': cache_name = optarg; break;
+      case 'l':
+      {
+        static char buf[1 << 20];
+        setvbuf(stdout, buf, _IOFBF, sizeof buf);
+        if (log_decode(optarg, stdout) == -1) { perror(optarg); return EXIT_FAILURE; }
+        return fflush(stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+      }
+      case 'L': log_name = optarg; break;
+      case 'm': mem_budget = atol(optarg); break;
+      case 'M': metrics_name = optarg; break;
+      case 'o': out_name = optarg; break;
+      case 'p':
+      {
+        // a big buffer: the export is a stream of small writes
+        static char buf[1 << 20];
+        setvbuf(stdout, buf, _IOFBF, sizeof buf);
+        if (archive_export(optarg, stdout) == -1) { perror(optarg); return EXIT_FAILURE; }
+        return fflush(stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+      }
+      case 'r': triggers_load(optarg); break;
+      case 's': stats_name = optarg; break;
+      case 't':
+        if (! profile_parse(&profile, optarg)) usage(argv[0]);
+        break;
+      case 'T': trace_name = optarg; break;
+      case 'u':
+        if (n_logins == MAX_SESSIONS) usage(argv[0]);
+        logins[n_logins++] = optarg;
+        break;
+      default: usage(argv[0]);
+    }
+  }
+  if (n_logins == 0 && offline_threads == 0) logins[n_logins++] = NULL; // guest
+  if (n_logins == MAX_SESSIONS && offline_threads > 0) usage(argv[0]);
+  if (out_name != NULL && format == OUT_CURSES) usage(argv[0]);
+  if (trace_name != NULL) trace_start(trace_name); // before any thread
+
   if (setlocale( LC_ALL, "en_US.utf8" ) == NULL) error("setlocale");
+  trace_thread("main");
+  if (log_name != NULL && ! log_open(log_name, LOG_INFO)) { perror(log_name); error("log_open"); }
+
+  // opened before curses, so that a failure can be reported; the client
+  // runs without an archive rather than not at all
+  char default_archive[PATH_MAX];
+  if (archive_name == NULL && getenv("HOME") != NULL)
+    snprintf(default_archive, sizeof default_archive, "%s/" ARCHIVE_FILE, getenv("HOME")), archive_name = default_archive;
+  ARCHIVE *archive = archive_name != NULL ? archive_open(archive_name) : NULL;
+  if (archive_name != NULL && archive == NULL) perror(archive_name);
+  char default_stats[PATH_MAX];
+  if (stats_name == NULL && getenv("HOME") != NULL)
+    snprintf(default_stats, sizeof default_stats, "%s/" STATS_FILE, getenv("HOME")), stats_name = default_stats;
+  STATS *stats = stats_name != NULL ? stats_open(stats_name) : NULL;
+  // someone's game history is never reset; curses would hide the
+  // message, so the terminal is told again once the client is up
+  bool stats_refused = stats_name != NULL && stats == NULL && errno == EINVAL;
+  if (stats_refused)
+    fprintf(stderr, "%s: not a statistics file of this version; left as it is, and not recording\n", stats_name);
+  else if (stats_name != NULL && stats == NULL) perror(stats_name);
 
-  initialize_curses();
+  FILE *out = stdout;
+  if (format == OUT_CURSES)   initialize_curses();
+  else if (out_name != NULL && (out = fopen(out_name, "w")) == NULL) { perror(out_name); error("fopen"); }
 
+  name_queues();
   unlink_queues(); // delete any stale queues
 
   // central data structure contains pointers to various components --
-  // sockets, message queues, and curses windows.
+  // sessions (sockets), message queues, and curses windows.
   //
   mqd_t *ob_mq  = get_mq_fd(QUEUES[0], O_CREAT | O_RDWR);
   mqd_t *ib_mq  = get_mq_fd(QUEUES[1], O_CREAT | O_RDWR);
-  long *sock_fd = get_socket_fd( SERVER, PORT );
   CONFIG config = 
   { 
     .ob_mq      = *ob_mq, 
     .ib_mq      = *ib_mq, 
-    .sk         = *sock_fd, 
-    .w1         = w1, 
+    .w1         = w1,   // NULL when headless
     .w2         = w2, 
     .w3         = w3,
+    .active     = 0,
+    .format     = format,
+    .out        = out,
+    .archive    = archive,
+    .stats      = stats,
   };
+  if (ring_name != NULL && (config.ring = ring_create(ring_name, RING_SLOTS)) == NULL)
+  {
+    if (format == OUT_CURSES) endwin();
+    perror(ring_name);
+    error("ring_create");
+  }
+  if (engine_command != NULL)
+  {
+    // analysis survives restarts in the cache; without one it still works
+    char default_cache[PATH_MAX];
+    if (cache_name == NULL && getenv("HOME") != NULL)
+      snprintf(default_cache, sizeof default_cache, "%s/.vichess-analysis", getenv("HOME")), cache_name = default_cache;
+    CACHE *cache = cache_name != NULL ? cache_open(cache_name, CACHE_MB) : NULL;
+    if (cache_name != NULL && cache == NULL) perror(cache_name);
+    config.analysis = analysis_new(engine_command, n_engines, ANALYSIS_MOVETIME_MS, cache);
+  }
+  // without the default table openings just aren't shown
+  if ((config.eco = eco_open(eco_name != NULL ? eco_name : ECO_FILE)) == NULL && eco_name != NULL)
+  {
+    if (format == OUT_CURSES) endwin();
+    perror(eco_name);
+    error("eco_open");
+  }
+  if (gamedb_name != NULL && (config.gamedb = gamedb_open(gamedb_name)) == NULL)
+  {
+    if (format == OUT_CURSES) endwin();
+    perror(gamedb_name);
+    error("gamedb_open");
+  }
+  if (metrics_name != NULL && ! metrics_serve(&config, metrics_name))
+  {
+    if (format == OUT_CURSES) endwin();
+    perror(metrics_name);
+    error("metrics_serve");
+  }
+  if (mem_budget >= 0) mem_start(&config, mem_budget); // before the sessions allocate
+  for (int i = 0; i < n_logins; i++)
+    config.sessions[config.n_sessions++] = session_new(i, logins[i]);
+  if (offline_threads > 0)
+  {
+    config.sessions[config.n_sessions] = session_offline(config.n_sessions, offline_threads);
+    config.n_sessions++;
+  }
+  if (format == OUT_CURSES) use_window(w1, (NCURSES_WINDOW_CB) cb_write_sessions, &config);
+  if (stats_refused)
+  {
+    log_text(LOG_WARN, LOGC_MISC, "%s: not a statistics file of this version; not recording", stats_name);
+    send_message(config.ib_mq, config.active, MSG_NOTICE,
+        "%s: not a statistics file of this version; left as it is, and not recording (see -s)\n", stats_name);
+  }
 
   // define an array of worker threads
   //
   void (*workers[]) = 
   {
-    t_socket_line_writer,   // reads from message queue, writes to socket
-    t_socket_line_reader,   // reads from socket, writes to message queue
+    t_socket_io,            // reads from message queue and sockets, writes to sockets and message queue
     t_curses_term_writer,   // reads from message queue, writes to term
     t_curses_term_reader,   // reads from term, writes to message queue
+    t_analysis,             // reads from and writes to engine pipes, writes to message queue
   };
+  int n_workers = LEN(workers) - (config.analysis == NULL);
+  if (format != OUT_CURSES)
+  {
+    workers[1] = t_headless_writer; // reads from message queue, writes events to out
+    workers[2] = t_headless_reader; // reads from stdin, writes to message queue
+  }
   
-  // launch threads and wait for them to complete their work
+  // launch threads and wait for them to complete their work; under the
+  // tournament profile memory is locked before any of them starts
   //
+  if (profile.on) profile_memory(&profile);
   pthread_t T[ LEN( workers ) ];
-  for (int t = 0; t < LEN(T); t++) { pthread_create(&T[t],  NULL, workers[t], &config); }
-  for (int i = 0; i < LEN(T); i++) { pthread_join(T[i],     NULL); }
+  for (int t = 0; t < n_workers; t++) { profile_create(&profile, &T[t], t, workers[t], &config); }
+  if (profile.on) profile_report(&profile, &config);
+  for (int i = 0; i < n_workers; i++) { pthread_join(T[i],     NULL); }
+  profile_free(&profile);
 
   // Clean up file handles
-  close(config.sk);
+  for (int i = 0; i < config.n_sessions; i++) session_free(config.sessions[i]);
   mq_close(config.ob_mq); 
   mq_close(config.ib_mq);
   free(ob_mq);
   free(ib_mq);
-  free(sock_fd);
+  if (config.ring != NULL) ring_destroy(config.ring, ring_name);
+  if (config.analysis != NULL) analysis_free(config.analysis);
+  if (config.eco != NULL) eco_close(config.eco);
+  if (config.archive != NULL) archive_close(config.archive);
+  if (config.stats != NULL) stats_close(config.stats);
+  if (config.gamedb != NULL) gamedb_close(config.gamedb);
+  if (metrics_name != NULL) unlink(metrics_name);
+  if (trace_name != NULL && trace_dump(trace_name) == -1) perror(trace_name);
+  log_close();
+  unlink_queues();
+  if (format != OUT_CURSES) { fclose(out); return 0; }
 
   // clean up curses
   delwin(w1);
   delwin(w2);
   delwin(w3);
-  unlink_queues();
   endwin();
 
   return 0;
@@ -23,27 +23,104 @@
 #include <mqueue.h>     // mq_*
 #include <ncurses.h>    // curses - includes stdio.h, unctrl.h, stdarg.h, stddef.h
 #include <netdb.h>      // struct addrinfo
+#include <poll.h>       // poll()
 #include <pthread.h>    // pthread_create
 #include <signal.h>     // signals
+#include <stdatomic.h>  // atomic_*
 #include <stdbool.h>    // bool, true, false
 #include <stdlib.h>     // exit()
 #include <string.h>     // memset(), strtok(), strdup()
+#include <sys/file.h>   // flock()
+#include <sys/mman.h>   // mmap()
 #include <sys/socket.h> // sockets
 #include <sys/stat.h>   // S_* bits
+#include <sys/wait.h>   // waitpid()
+#include <time.h>       // clock_gettime()
 #include <unistd.h>     // close()
 
+#include "events.h"     // STYLE12, GAMEINFO, EVENT, RING
+
+// upper bound on concurrent server connections in one process
+#define MAX_SESSIONS    32
+
 // struct to contain file descriptors (or ids, as in the case of
-// message queues) and other config data
+// message queues) and other config data.  The queues and windows are
+// shared by every session; see session.c for what is per-connection.
 typedef struct CONFIG
 {
-  int sk;
   mqd_t ib_mq;
   mqd_t ob_mq;
   WINDOW *w1;
   WINDOW *w2;
   WINDOW *w3;
+  //
+  struct SESSION *sessions[MAX_SESSIONS];
+  int n_sessions;
+  int active;     // index of the session shown in the windows
+  //
+  RING *ring;     // parsed events for local viewers, or NULL
+  int format;     // OUT_*: curses, or the headless event format
+  FILE *out;      // headless event stream
+  struct ANALYSIS *analysis; // engine pool, or NULL
+  struct ECO *eco;           // opening table, or NULL
+  struct ARCHIVE *archive;   // game recorder, or NULL
+  struct GAMEDB *gamedb;     // imported games, or NULL
+  struct STATS *stats;       // the user's game statistics, or NULL
 } CONFIG;
 
+enum __OUTPUT_FORMATS
+{
+  OUT_CURSES,
+  OUT_JSON,
+  OUT_BINARY
+};
+
+// Everything on the queues is wrapped in a MESSAGE so a single pair of
+// queues can serve all sessions.  The whole struct is exactly one
+// queue message (MAX_LINE_SIZE bytes).
+enum __MESSAGE_TYPES
+{
+  MSG_LINE,       // a line read from the server
+  MSG_INPUT,      // a line typed by the user (echo, or to be sent)
+  MSG_SWITCH,     // the active session changed; repaint
+  MSG_NOTICE,     // a line from the client itself, e.g. :ls output
+  MSG_SEEKS,      // the session's seek graph changed; redraw it
+  MSG_MOVES,      // a move-list command, e.g. :back; the writer moves the board
+};
+
+typedef struct MESSAGE
+{
+  unsigned char session;
+  unsigned char type;
+  unsigned char owner;          // BO_*: MSG_INPUT, who gets the reply; MSG_LINE, whose reply it is
+  char text[MAX_LINE_SIZE - 3];
+} MESSAGE;
+
+// Framing state for descriptors polled with others (engine pipes,
+// stdin), which cannot block in read_line() while others have data.
+// Server sockets are framed by telnet.c.
+typedef struct LINE_BUFFER
+{
+  size_t len;
+  char buf[MAX_LINE_SIZE];
+} LINE_BUFFER;
+
+// A server socket's telnet framing state: the unended line, and where
+// the stream is between reads.
+typedef struct TELNET
+{
+  size_t len;                   // bytes of the unended line in buf
+  uint8_t state;                // in negotiation, or not
+  uint8_t verb;                 // WILL, WONT, DO or DONT, for its option
+  char eol;                     // the line ending just read, or 0
+  uint8_t n_reply;
+  unsigned char reply[30];      // answers to negotiation, not yet sent
+  char buf[MAX_LINE_SIZE];
+} TELNET;
+
+// Called with each line, NUL-terminated, without its ending.
+typedef void (*TELNET_LINE)(void *, char *, size_t);
+
 
 /* utils.c */
 
@@ -55,6 +132,8 @@ bool odd(int);
 long *get_socket_fd(const char *, const char *);
 mqd_t *get_mq_fd(const char* , int);
 ssize_t read_line(int , void *, size_t); 
+ssize_t read_line_buffered(int, LINE_BUFFER *, char *, size_t, char);
+uint64_t now_ns(void);
 unsigned int centered(char *);
 void debug(const char *, ...);
 void error(const char *);
@@ -63,15 +142,23 @@ void ms_to_hh_mm_ss_ms(int, char *);
 void set_realpath(char *, char *);
 void swap(char**, char **);
 
-/* client.c, term.c */
+/* telnet.c */
+
+void telnet_feed(TELNET *, const char *, size_t, TELNET_LINE, void *);
+ssize_t telnet_read(int, TELNET *, TELNET_LINE, void *);
 
-void t_socket_line_reader(void *);
-void t_socket_line_writer(void *);
+/* workers.c */
+
+extern bool running;
+bool local_command(CONFIG *, char *);
+void t_socket_io(void *);
 void t_curses_term_reader(void *);
 void t_curses_term_writer(void *);
 //
 void cb_term_resize(int);
-void send_message(mqd_t, char *, ...);
+void send_message(mqd_t, int, int, char *, ...);
+void send_command(mqd_t, int, int, char *, ...);
+void send_reply(mqd_t, int, int, char *, ...);
 
 /* callbacks.c */
 
@@ -82,10 +169,35 @@ void send_message(mqd_t, char *, ...);
 #define CENTER          COLS/2
 #define SQUARE_WIDTH    3
 
+enum __PANES
+{
+  PANE_WHOLE,
+  PANE_LEFT,                    // my game, in bughouse
+  PANE_RIGHT                    // my partner's game
+};
+
+// one square of the main board, redrawn alone
+typedef struct SQUARE_VIEW
+{
+  int pane;
+  int row, col;                 // on screen
+  int pair;
+  const char *glyph;
+} SQUARE_VIEW;
+
+void cb_clear(WINDOW *, void *);
 void cb_read_command(WINDOW *, void *);
+void cb_read_key(WINDOW *, void *);
+void cb_write_square(WINDOW *, void *);
 void cb_write_board(WINDOW *, void *);
+void cb_write_players(WINDOW *, void *);
 void cb_write_gameinfo(WINDOW *, void *);
 void cb_write_response(WINDOW *, void *);
+void cb_write_sessions(WINDOW *, void *);
+void cb_write_seeks(WINDOW *, void *);
+void cb_update_seeks(WINDOW *, void *);
+void cb_write_moves(WINDOW *, void *);
+void cb_update_moves(WINDOW *, void *);
 
 /* Output line numbers, relative to the curses Y coordinate.
  *
@@ -102,6 +214,7 @@ void cb_write_response(WINDOW *, void *);
  *    ...                                 |
  *    '___________________________________' <- BOARD_START_LINE + N_ROWS -1
  *              userb (rating) 00:00:10.282
+ *              C65 Ruy Lopez: Berlin Defence
  */
 enum __INTERFACE_LINE_NUMBERS
 {
@@ -110,7 +223,8 @@ enum __INTERFACE_LINE_NUMBERS
   OPP_INFO_LINE     = 2,
   BOARD_START_LINE  = 3,
   BOARD_END_LINE    = BOARD_START_LINE + N_ROWS - 1,
-  MY_INFO_LINE      = BOARD_END_LINE + 1
+  MY_INFO_LINE      = BOARD_END_LINE + 1,
+  OPENING_LINE      = MY_INFO_LINE + 1
 
 };
 
@@ -126,6 +240,9 @@ enum __INTERFACE_LINE_NUMBERS
 // update markers
 #define STYLE12_MARKER  "<12>"
 #define GAMEINFO_MARKER "<g1>"
+#define HOLDINGS_MARKER "<b1>"
+#define HOLDING_PIECES  "PNBRQ"
+#define N_HOLDINGS      5
 
 enum __PIECE_COLORS
 {
@@ -164,7 +281,9 @@ enum __CURSES_COLORS
   LIGHT_SQUARE,
   GRAY_ON_BLACK,
   BLUISH,
-  RED
+  RED,
+  CURSOR_SQUARE,                // board mode: the cursor
+  SELECTED_SQUARE               //   and the piece picked up
 };
 
 // unicode piece and box drawing character definitions
@@ -212,16 +331,16 @@ typedef struct UPDATE
   //
   unsigned int game_number;
 
-  //
-  char * type;
+  // type and ratings point into g1, below
+  const char * type;
   char * type_sym;
 
   //
   bool rated;
 
   //
-  char * white_rating;
-  char * black_rating;
+  const char * white_rating;
+  const char * black_rating;
   char * my_rating;
   char * opp_rating;
 
@@ -283,12 +402,796 @@ typedef struct UPDATE
   char *board[N_COLS][N_ROWS];
   char *old_board[N_COLS][N_ROWS];
 
+  /* The same messages, every field, as plain data (see events.h) */
+  //
+  STYLE12 s12;
+  GAMEINFO g1;
+
+  // "C65 Ruy Lopez: Berlin Defence", in the mapped ECO table; NULL
+  // until the game reaches a known opening position
+  const char *opening;
+
+  // crazyhouse and bughouse: pieces in hand, [0] white and [1] black,
+  // in HOLDING_PIECES order (see <b1>)
+  bool has_holdings;
+  unsigned char holdings[2][N_HOLDINGS];
+
+  // where in the board window this board goes: PANE_WHOLE, or side by
+  // side with the partner board in bughouse
+  int pane;
+
 } UPDATE;
 
 char *char_to_piece(char );
+bool parse_gameinfo(const char *, GAMEINFO *);
 void parse_gameinfo_string(const char *, UPDATE *);
 void parse_s12_string(const char *, UPDATE *);
-void print_g1(UPDATE *);
-void print_s12(UPDATE *);
+int style12_ply(const STYLE12 *);
+unsigned int style12_game(const char *);
+unsigned int parse_holdings(const char *, unsigned char [2][N_HOLDINGS]);
+void print_g1(int, const UPDATE *);
+void print_s12(int, const UPDATE *);
+void make_event(EVENT *, int, int, UPDATE *, const char *);
+void publish_event(CONFIG *, int, int, UPDATE *, const char *);
+
+/* headless.c */
+
+void t_headless_reader(void *);
+void t_headless_writer(void *);
+void write_event(CONFIG *, const EVENT *);
+void write_event_binary(FILE *, const EVENT *);
+void write_event_json(FILE *, const EVENT *);
+
+/* bench.c */
+
+int bench(const char *);
+
+/* session.c */
+
+// A session is one logged-in connection.  Keep this small: everything
+// that can be shared (threads, queues, windows) lives in CONFIG.
+typedef struct SESSION
+{
+  int id;                       // index into CONFIG.sessions
+  int sk;                       // socket, or -1 once closed
+  char handle[NICK_MAX];        // login handle ("guest" if none given)
+  char *password;               // NULL for guest logins
+  uint64_t received_ns;         // when the socket last became readable
+  long message_id;              // lines read, drives the login sequence
+  bool configured;
+  unsigned int unread;          // lines received while not active
+  TELNET in;                    // partial line from the socket
+  UPDATE u;                     // last board/gameinfo seen
+  UPDATE partner;               // bughouse: the partner game's board
+  struct GAME_HISTORY *games;   // per-game draw tracking, see repetition.c
+  struct LISTS *lists;          // games/who/sought tables, see lists.c
+  struct SEEKS *seeks;          // seekinfo table, see seeks.c
+  struct MOVELIST *movelist;    // per-game moves, see movelist.c
+  struct BLOCKS *blocks;        // commands in flight, see block.c; NULL until block mode
+} SESSION;
+
+SESSION *session_new(int, const char *);
+void session_close(SESSION *);
+void session_free(SESSION *);
+void session_handle_line(CONFIG *, SESSION *, char *);
+void session_send(SESSION *, char *, ...);
+void session_command(SESSION *, int, char *, ...);
+
+/* block.c */
+
+// who sent a command, and so gets its reply
+enum __BLOCK_OWNERS
+{
+  BO_TERMINAL,                  // typed: the reply is shown
+  BO_LOGIN,                     // settings sent at login: logged only
+  BO_MOVES,                     // a move list backfill
+  BO_TRIGGER,                   // a trigger's action
+  BO_MOVE,                      // a move keyed in board mode
+  N_BLOCK_OWNERS
+};
+
+void block_enable(SESSION *);
+int block_send(SESSION *, int, const char *);
+int block_in_flight(const SESSION *);
+char *block_line(CONFIG *, SESSION *, char *);
+
+/* modal.c */
+
+#define KEY_POLL_MS     100     // board mode reads wait no longer
+
+// what the terminal's keystrokes go to
+enum __KEY_MODES
+{
+  KM_LINE,                      // the input line, a command at a time
+  KM_BOARD                      // the board's cursor, a key at a time
+};
+
+// one keystroke read in board mode
+typedef struct KEYSTROKE
+{
+  char status[64];              // shown on the input line meanwhile
+  int ch;                       // ERR if none came
+  uint64_t ns;                  // when wgetch() returned it
+} KEYSTROKE;
+
+int modal_mode(void);
+int modal_square(int, int, int);
+void modal_board(int, const STYLE12 *, int);
+bool modal_key(CONFIG *, int, uint64_t);
+bool modal_read(CONFIG *);
+void modal_enter(CONFIG *);
+void modal_leave(CONFIG *);
+void modal_sent(void);
+size_t modal_latency(uint64_t *, uint64_t *, uint64_t *);
+void modal_command(CONFIG *, char *);
+
+/* triggers.c */
+
+enum __TRIGGER_KINDS
+{
+  TRIGGER_SEEK,
+  TRIGGER_CHALLENGE
+};
+
+typedef struct RANGE
+{
+  bool any;
+  int lo, hi;   // inclusive
+} RANGE;
+
+// a compiled rule, "on <kind> [key=value ...] send <action>"
+typedef struct TRIGGER
+{
+  int kind;
+  int session;                  // -1 for any
+  char from[NICK_MAX];          // "" for anyone
+  RANGE time, inc, rating;
+  int rated;                    // -1 for either
+  char type[16];                // "" for any
+  char action[128];
+  char source[256];
+  // how quickly matches went out, socket readable -> send() returned;
+  // written by the I/O loop, read by :triggers
+  _Atomic unsigned long fired;
+  _Atomic uint64_t latency_min, latency_max, latency_total, last_latency;
+} TRIGGER;
+
+// a seek or challenge, parsed from a server line
+typedef struct OFFER
+{
+  int kind;
+  char from[NICK_MAX];
+  int rating;
+  int time, inc;
+  bool rated;
+  char type[16];
+  int number;                   // seek number, for "play N"
+} OFFER;
+
+extern TRIGGER TRIGGERS[];
+extern int N_TRIGGERS;
+
+bool parse_offer(const char *, OFFER *);
+bool parse_range(const char *, RANGE *);
+bool in_range(RANGE, int);
+bool triggers_add(const char *);
+void triggers_load(const char *);
+TRIGGER *triggers_run(SESSION *, const char *, uint64_t);
+bool triggers_want_seeks(void);
+
+/* position.c */
+
+#define START_FEN       "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+#define SQ_NONE         -1
+#define FEN_MAX         100
+#define MAX_MOVES       256
+
+// pieces: type in the low three bits, BLACK_BIT for black
+enum __PIECES
+{
+  EMPTY, PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING,
+  BLACK_BIT = 8,
+  W_PAWN = PAWN, W_KNIGHT, W_BISHOP, W_ROOK, W_QUEEN, W_KING,
+  B_PAWN = PAWN | BLACK_BIT, B_KNIGHT, B_BISHOP, B_ROOK, B_QUEEN, B_KING
+};
+#define PIECE_TYPE(p)   ( (p) & 7 )
+#define PIECE_SIDE(p)   ( ( (p) & BLACK_BIT ) ? BLACK_SIDE : WHITE_SIDE )
+
+enum __SIDES { WHITE_SIDE, BLACK_SIDE };
+
+enum __CASTLE_RIGHTS
+{
+  CASTLE_WK = 1, CASTLE_WQ = 2, CASTLE_BK = 4, CASTLE_BQ = 8, CASTLE_ALL = 15
+};
+
+// A move packed in 32 bits: from and to (0x88 squares), flags, and the
+// piece type promoted to.
+typedef uint32_t MOVE;
+#define MOVE_NONE               0
+#define MAKE_MOVE(f, t, fl, p)  ( (MOVE) (f) | (MOVE) (t) << 8 | (MOVE) (fl) << 16 | (MOVE) (p) << 24 )
+#define MOVE_FROM(m)            ( (m) & 0xff )
+#define MOVE_TO(m)              ( ( (m) >> 8 ) & 0xff )
+#define MOVE_FLAGS(m)           ( ( (m) >> 16 ) & 0xff )
+#define MOVE_PROMOTED(m)        ( (m) >> 24 )
+
+enum __MOVE_FLAGS
+{
+  MOVE_CAPTURE      = 1,
+  MOVE_DOUBLE_PUSH  = 2,
+  MOVE_EN_PASSANT   = 4,
+  MOVE_CASTLE       = 8,
+  MOVE_PROMOTION    = 16
+};
+
+typedef struct POSITION
+{
+  uint8_t board[128];           // 0x88: rank * 16 + file, a1 = 0
+  int side;                     // WHITE_SIDE or BLACK_SIDE to move
+  int castle;                   // CASTLE_* bits
+  int ep;                       // en passant target square, or SQ_NONE
+  int halfmove;                 // since the last capture or pawn move
+  int fullmove;
+  int king[2];
+  uint64_t hash;                // Zobrist
+} POSITION;
+
+// what make_move() needs to take a move back
+typedef struct UNDO
+{
+  int captured, castle, ep, halfmove;
+  uint64_t hash;
+} UNDO;
+
+typedef struct MOVE_LIST
+{
+  int n;
+  MOVE moves[MAX_MOVES];
+} MOVE_LIST;
+
+void position_init(void);
+void position_start(POSITION *);
+bool position_from_fen(POSITION *, const char *);
+void position_from_style12(POSITION *, const STYLE12 *);
+void position_to_fen(const POSITION *, char *);
+void position_to_style12(const POSITION *, char *, size_t, int, const char *, const char *,
+    int, int, int, int, const char *, const char *);
+uint64_t position_hash(const POSITION *);
+char piece_char(int);
+int material(const POSITION *, int);
+bool square_attacked(const POSITION *, int, int);
+bool in_check(const POSITION *);
+void generate_moves(const POSITION *, MOVE_LIST *, bool);
+void generate_legal_moves(POSITION *, MOVE_LIST *);
+bool make_move(POSITION *, MOVE, UNDO *);
+void unmake_move(POSITION *, MOVE, const UNDO *);
+void make_null_move(POSITION *, UNDO *);
+void unmake_null_move(POSITION *, const UNDO *);
+uint64_t perft(POSITION *, int);
+MOVE parse_move(POSITION *, const char *);
+void move_to_san(POSITION *, MOVE, char *);
+void move_to_uci(MOVE, char *);
+void move_to_verbose(const POSITION *, MOVE, char *);
+
+/* engine.c */
+
+#define MAX_PLY         64
+#define MAX_GAME_PLY    1024
+#define ENGINE_TT_MB    64
+
+typedef struct SEARCH_LIMITS
+{
+  int depth;                    // 0 for no limit
+  int movetime_ms;              // 0 for no limit
+  int threads;
+} SEARCH_LIMITS;
+
+typedef struct SEARCH_RESULT
+{
+  MOVE best;
+  int score;                    // centipawns, from the side to move
+  int depth;                    // last iteration completed
+  uint64_t nodes;               // all threads
+  uint64_t ns;
+  MOVE pv[MAX_PLY];
+  int pv_len;
+} SEARCH_RESULT;
+
+int evaluate(const POSITION *);
+SEARCH_RESULT engine_search(const POSITION *, const uint64_t *, int, SEARCH_LIMITS);
+void engine_stop(void);
+void engine_tt_clear(void);
+void engine_tt_resize(size_t);
+void format_score(int, char *, size_t);
+
+/* cache.c */
+
+#define CACHE_MB        64
+#define CACHE_MATE      30000   // scores beyond CACHE_MATE - MAX_PLY are mates
+
+typedef struct CACHE CACHE;
+
+typedef struct CACHED
+{
+  MOVE move;
+  int score;                    // centipawns, from the side to move
+  int depth;
+} CACHED;
+
+typedef struct CACHE_STATS
+{
+  unsigned long entries, probes, hits, stores, probe_ns;
+} CACHE_STATS;
+
+CACHE *cache_open(const char *, size_t);
+void cache_close(CACHE *);
+bool cache_probe(CACHE *, uint64_t, CACHED *);
+void cache_store(CACHE *, uint64_t, MOVE, int, int);
+void cache_stats(CACHE *, CACHE_STATS *);
+
+/* analysis.c */
+
+#define ANALYSIS_MAX_ENGINES    16
+#define ANALYSIS_MOVETIME_MS    2000
+
+typedef struct ANALYSIS ANALYSIS;
+
+ANALYSIS *analysis_new(const char *, int, int, CACHE *);
+void analysis_free(ANALYSIS *);
+void analysis_status(CONFIG *);
+void analysis_submit(ANALYSIS *, int, const STYLE12 *);
+void t_analysis(void *);
+
+/* eco.c */
+
+// The opening table, as built by tools/vichess-eco.c from data/eco.pgn:
+// a header, then buckets of ECO_BUCKET slots keyed by Zobrist hash,
+// then the names the slots point to ("C65 Ruy Lopez: Berlin Defence").
+#define ECO_FILE        "eco.bin"
+#define ECO_MAGIC       "VIECO001"
+#define ECO_BUCKET      4       // slots per bucket, one cache line
+
+typedef struct ECO_HEADER
+{
+  char magic[8];
+  uint64_t start_key;           // Zobrist key of the start position
+  uint64_t n_buckets;           // a power of two
+  uint64_t names_size;
+  char unused[32];              // buckets start on a cache line
+} ECO_HEADER;
+
+typedef struct ECO_SLOT
+{
+  uint64_t key;                 // 0: empty
+  uint32_t name;                // offset into the names
+  uint32_t unused;
+} ECO_SLOT;
+
+typedef struct ECO ECO;
+
+ECO *eco_open(const char *);
+void eco_close(ECO *);
+const char *eco_lookup(const ECO *, uint64_t);
+
+/* archive.c */
+
+#define ARCHIVE_FILE    ".vichess-games"   // in $HOME
+
+typedef struct ARCHIVE ARCHIVE;
+
+ARCHIVE *archive_open(const char *);
+void archive_close(ARCHIVE *);
+void archive_board(ARCHIVE *, int, const STYLE12 *, const GAMEINFO *);
+void archive_text(ARCHIVE *, int, const char *);
+long archive_export(const char *, FILE *);
+
+/* stats.c */
+
+#define STATS_FILE      ".vichess-stats"   // in $HOME
+#define STATS_NO_ECO    0xFFFF
+#define STATS_ECOS      500     // A00 .. E99
+#define STATS_BASES     61      // time controls, by minutes
+#define STATS_INCS      31      //  and increment seconds
+#define STATS_MONTHS    12      // rating history, 30 days a month
+#define STATS_MOVE_BINS 13      // clock used, by move number
+#define STATS_MOVES_PER_BIN 5   //  1-5, 6-10, ... and 61 on
+
+enum __STATS_TYPES
+{
+  ST_LIGHTNING, ST_BLITZ, ST_STANDARD, ST_CRAZYHOUSE, ST_BUGHOUSE, ST_WILD,
+  ST_SUICIDE, ST_ATOMIC, ST_LOSERS, ST_UNTIMED, ST_OTHER,
+  N_STATS_TYPES
+};
+
+typedef struct STATS STATS;
+
+// A finished game of the user's: a row of the games columns.
+typedef struct STATS_GAME
+{
+  uint32_t time;                // when it ended
+  int16_t rating;               // 0 if unknown
+  int16_t opp_rating;
+  uint16_t base;                // seconds
+  uint16_t eco;                 // A00 is 0, E99 499; or STATS_NO_ECO
+  uint8_t inc;                  // seconds
+  uint8_t type;                 // ST_*
+  uint8_t color;                // WHITE_SIDE or BLACK_SIDE
+  uint8_t score;                // half points: 2 won, 1 drawn, 0 lost
+  uint8_t trouble;              // the clock went under a tenth of base
+} STATS_GAME;
+
+typedef struct STATS_MOVE
+{
+  uint16_t number;
+  uint32_t used_ms;
+} STATS_MOVE;
+
+// A query's sums.  Every field is a uint64_t counter, so partial
+// reports add up word by word; scores are in half points.
+typedef struct STATS_REPORT
+{
+  struct STATS_BY_TYPE { uint64_t games, score, trouble, trouble_score; } by_type[N_STATS_TYPES];
+  struct STATS_RESULTS { uint64_t games, score; } by_eco[STATS_ECOS], by_control[STATS_BASES][STATS_INCS];
+  struct STATS_RATINGS { uint64_t rating, games; } history[N_STATS_TYPES][STATS_MONTHS]; // [0]: the last 30 days
+  struct STATS_CLOCK { uint64_t used_ms, moves; } clock[N_STATS_TYPES][STATS_MOVE_BINS];
+  uint64_t moves, threads, ns;
+} STATS_REPORT;
+
+extern const char *const STATS_TYPES[N_STATS_TYPES];
+
+STATS *stats_open(const char *);
+void stats_close(STATS *);
+uint64_t stats_games(const STATS *);
+bool stats_append(STATS *, const STATS_GAME *, const STATS_MOVE *, int);
+void stats_board(STATS *, int, const STYLE12 *, const GAMEINFO *, const char *);
+void stats_text(STATS *, int, const char *);
+void stats_query(const STATS *, uint32_t, uint32_t, int, STATS_REPORT *);
+void stats_command(CONFIG *, char *);
+
+/* offline.c */
+
+SESSION *session_offline(int, int);
+
+/* repetition.c */
+
+#define HISTORY_GAMES   8       // games tracked per session
+#define HISTORY_WINDOW  128     // positions per game, > 100 plies
+#define HISTORY_SLOTS   256     // repetition count table
+
+enum __DRAWS
+{
+  DRAW_NONE,
+  DRAW_REPETITION,
+  DRAW_FIFTY_MOVES
+};
+
+typedef struct GAME_HISTORY
+{
+  bool used;
+  unsigned int game_number;
+  uint64_t last_used;
+  int last_ply;                 // ply of the newest board, -1 if none
+  bool fifty_reported;          // since the last capture or pawn move
+  int head, n;                  // ring of the last n positions
+  struct { uint64_t key; int ply; } window[HISTORY_WINDOW];
+  struct { uint64_t key; int count; } counts[HISTORY_SLOTS];
+} GAME_HISTORY;
+
+int history_update(SESSION *, const STYLE12 *, uint64_t);
+void draw_notice(int, const STYLE12 *, char *, size_t);
+
+/* movelist.c */
+
+#define MOVELIST_GAMES      8   // games kept per session
+#define MOVELIST_SNAPSHOT   16  // plies between position snapshots
+#define MOVELIST_ROWS       2048 // most rows of a "moves" listing read
+
+enum __BACKFILLS
+{
+  BACKFILL_NONE,
+  BACKFILL_ASKED,               // "moves N" sent
+  BACKFILL_DONE
+};
+
+typedef struct GAME_MOVES
+{
+  bool used;
+  unsigned int game_number;
+  uint64_t last_used;
+  int first_ply;                // ply of snapshots[0]
+  int n, max;                   // moves of plies first_ply .. first_ply + n - 1
+  MOVE *moves;
+  char (*san)[12];
+  POSITION *snapshots;          // every MOVELIST_SNAPSHOT plies from first_ply
+  int ply;                      // where the game is, -1 before its first board
+  POSITION current;             // ... and its position
+  int view;                     // ply on the board, -1 to follow the game
+  int backfill;                 // BACKFILL_*
+  int drawn;                    // moves in the move-list pane, -1 to rewrite it
+} GAME_MOVES;
+
+typedef struct MOVELIST
+{
+  GAME_MOVES games[MOVELIST_GAMES];
+  // a "moves" listing being read
+  unsigned int reading;         // its game, 0 if none
+  bool hide;                    // the reply to the client's own "moves"
+  bool failed;                  // a move in it did not parse
+  int rows;
+  GAME_MOVES read;              // its moves, from the start position
+} MOVELIST;
+
+GAME_MOVES *movelist_board(CONFIG *, SESSION *, const STYLE12 *, const POSITION *);
+GAME_MOVES *movelist_find(SESSION *, unsigned int);
+void movelist_position(const GAME_MOVES *, int, POSITION *);
+bool movelist_feed(CONFIG *, SESSION *, const char *, int);
+void movelist_command(CONFIG *, SESSION *, const char *);
+void movelist_show(CONFIG *, SESSION *);
+void movelist_free(SESSION *);
+
+/* mem.c */
+
+enum __MEM_SUBSYSTEMS
+{
+  MEM_PARSER,                   // server lines: boards, listings, seeks
+  MEM_RENDER,                   // what is drawn
+  MEM_TRANSPORT,                // block mode, command input
+  MEM_GAMES,                    // move lists and draw tracking
+  N_MEM_SUBSYSTEMS
+};
+
+#define MEM_MESSAGES    ( MSG_MOVES + 2 )   // by MSG_* + 1; 0 outside any message
+
+typedef struct MEM_STATS
+{
+  int64_t live;                 // bytes
+  int64_t peak;
+  int64_t allocs;
+  int64_t bytes;                // ever allocated
+} MEM_STATS;
+
+extern atomic_bool mem_counting;
+
+void mem_message(int);
+void *mem_alloc(int, size_t);
+void *mem_calloc(int, size_t, size_t);
+void *mem_realloc(int, void *, size_t);
+char *mem_strdup(int, const char *);
+void mem_free(void *);
+void mem_get(int, MEM_STATS *);
+long mem_rss_kb(void);
+void mem_start(CONFIG *, long);
+void mem_write_metrics(FILE *);
+void mem_command(CONFIG *, char *);
+
+/* profile.c */
+
+enum __WORKERS                  // main()'s threads, in the order created
+{
+  W_SOCKET_IO,
+  W_WRITER,
+  W_READER,
+  W_ANALYSIS,
+  N_WORKERS
+};
+
+typedef struct PROFILE
+{
+  bool on;
+  int cpu[N_WORKERS];           // asked for; -1: any
+  bool fifo;                    // the socket loop at SCHED_FIFO
+  // what was had
+  bool created[N_WORKERS];
+  int pinned[N_WORKERS];        // -1: not pinned
+  int fifo_errno;
+  int lock_errno;               // mlockall()
+  bool lock_future;             // memory mapped later is locked too
+  long memlock_kb;              // RLIMIT_MEMLOCK; -1: none
+  size_t heap;                  // bytes touched
+  char *stack[N_WORKERS];
+} PROFILE;
+
+bool profile_parse(PROFILE *, const char *);
+void profile_memory(PROFILE *);
+int profile_create(PROFILE *, pthread_t *, int, void *(*)(void *), void *);
+void profile_describe(const PROFILE *, char *, size_t);
+void profile_report(const PROFILE *, CONFIG *);
+void profile_free(PROFILE *);
+
+/* metrics.c */
+
+enum __METRICS
+{
+  M_LINES_IN,
+  M_BYTES_IN,
+  M_LINES_OUT,
+  M_BYTES_OUT,
+  M_MSG_LINE,                   // one per MSG_*, in that order
+  M_MSG_INPUT,
+  M_MSG_SWITCH,
+  M_MSG_NOTICE,
+  M_MSG_SEEKS,
+  M_MSG_MOVES,
+  M_BOARDS,
+  M_GAMEINFOS,
+  M_HOLDINGS,
+  M_TEXT,
+  M_PARSE_BOARD,
+  M_PARSE_MOVES,
+  M_PARSE_SEEK,
+  M_RENDER_BOARD,
+  M_RENDER_PLAYERS,
+  M_RENDER_SEEKS,
+  M_RENDER_MOVES,
+  M_RENDER_TEXT,
+  M_SESSIONS_OPEN,              // gauge
+  N_METRICS
+};
+
+void metric_add(int, uint64_t);
+void metric_set(int, int64_t);
+uint64_t metric_value(int);
+void metrics_write(FILE *, CONFIG *);
+bool metrics_serve(CONFIG *, const char *);
+
+/* trace.c */
+
+enum __SPANS
+{
+  TR_TELNET_READ,
+  TR_MQ_SEND,
+  TR_MQ_RECEIVE,
+  TR_PARSE_S12,
+  TR_PARSE_GAMEINFO,
+  TR_WRITE_BOARD,
+  TR_WRITE_RESPONSE,
+  TR_KEY_TO_SOCKET,             // a keyed move, last keystroke to send()
+  N_SPANS
+};
+
+extern atomic_bool tracing;
+
+void trace_thread(const char *);
+const char *trace_thread_name(void);
+void trace_record(int, uint64_t, uint64_t);
+long trace_dump(const char *);
+void trace_start(const char *);
+const char *trace_path(void);
+
+// A span:  uint64_t t = trace_begin();  ...  trace_end(TR_..., t);
+static inline uint64_t trace_begin(void)
+{
+  return atomic_load_explicit(&tracing, memory_order_relaxed) ? now_ns() : 0;
+}
+
+static inline void trace_end(int span, uint64_t start)
+{
+  if ( start != 0 ) trace_record(span, start, now_ns());
+}
+
+/* log.c */
+
+enum __LOG_LEVELS
+{
+  LOG_ERROR,
+  LOG_WARN,
+  LOG_INFO,
+  LOG_DEBUG,
+  LOG_TRACE,
+  N_LOG_LEVELS
+};
+
+// categories, one bit each, selected with ":log LEVEL net,parse"
+enum __LOG_CATEGORIES
+{
+  LOGC_NET        = 1 << 0,       // lines to and from the server
+  LOGC_PARSE      = 1 << 1,       // boards and gameinfo as parsed
+  LOGC_UI         = 1 << 2,
+  LOGC_ENGINE     = 1 << 3,
+  LOGC_SESSION    = 1 << 4,       // logins, sessions opened and closed
+  LOGC_MISC       = 1 << 5,       // debug()
+  LOGC_ALL        = ( 1 << 6 ) - 1
+};
+
+extern atomic_int log_level, log_categories;
+
+bool log_open(const char *, int);
+void log_close(void);
+int log_parse_level(const char *);
+void log_command(CONFIG *, const char *);
+void log_text(int, int, const char *, ...);
+void log_vtext(int, int, const char *, va_list);
+void log_line(int, int, int, const char *, bool);
+void log_s12(int, int, int, const STYLE12 *);
+void log_g1(int, int, int, const GAMEINFO *);
+long log_decode(const char *, FILE *);
+
+// Whether a record at 'level' in 'category' would be kept: checked
+// before anything is copied.
+static inline bool log_enabled(int level, int category)
+{
+  return level <= atomic_load_explicit(&log_level, memory_order_relaxed)
+      && ( category & atomic_load_explicit(&log_categories, memory_order_relaxed) );
+}
+
+/* lists.c */
+
+#define LIST_TEXT       96
+
+enum __LIST_KINDS
+{
+  LIST_GAMES,
+  LIST_WHO,
+  LIST_SOUGHT,
+  N_LISTS
+};
+
+// one game, player or seek ad
+typedef struct LIST_ROW
+{
+  int id;                       // game or ad number; 0 in who
+  char player[NICK_MAX];        // white in games
+  char opponent[NICK_MAX];      // black in games, "" otherwise
+  int rating, opponent_rating;  // 0 if unrated
+  int time, inc;
+  bool rated;
+  char type[16];                // "blitz", "crazyhouse" ...
+  char status;                  // who: ' ' '^' '.' ...; games: 'x' examined, 's' setup; sought: 'w' 'b' color
+  char text[LIST_TEXT];         // as the server printed it
+} LIST_ROW;
+
+typedef struct LISTS LISTS;
+
+LISTS *lists_new(void);
+void lists_free(LISTS *);
+bool lists_feed(CONFIG *, SESSION *, const char *);
+int lists_select(LISTS *, int, const char *, char (*)[LIST_TEXT], int, int *);
+void lists_command(CONFIG *, const char *);
+
+/* seeks.c */
+
+#define SEEK_MAX        4096    // seek numbers; FICS reuses the lowest free one
+#define SEEK_ROWS       7       // rating bands, strongest first, unrated last
+#define SEEK_COLS       7       // time controls, fastest first
+
+typedef struct SEEK
+{
+  bool used;
+  bool rated;
+  uint8_t cell;                 // row * SEEK_COLS + column
+  int rating, time, inc;
+  char from[NICK_MAX];
+} SEEK;
+
+typedef struct SEEKS
+{
+  SEEK slots[SEEK_MAX];         // by seek number: add and remove are O(1)
+  int n;
+  unsigned long updates, dropped;
+  // shared with the writer
+  atomic_int counts[SEEK_ROWS * SEEK_COLS];
+  atomic_uint_least64_t dirty;  // cells to redraw
+  atomic_bool pending;          // a MSG_SEEKS is queued
+  bool drawn;                   // writer only: labels are on screen
+} SEEKS;
+
+bool seeks_line(CONFIG *, SESSION *, const char *);
+
+/* gamedb.c */
+
+#define GAMEDB_PLIES    60      // plies of each game that are indexed
+
+typedef struct IMPORT_STATS
+{
+  uint64_t bytes, games, positions, errors, ns;
+} IMPORT_STATS;
+
+typedef struct GAMEDB GAMEDB;
+
+bool gamedb_import(const char *, const char *, int, IMPORT_STATS *);
+GAMEDB *gamedb_open(const char *);
+void gamedb_close(GAMEDB *);
+size_t gamedb_query(const GAMEDB *, uint64_t, uint32_t *, size_t);
+void gamedb_describe(const GAMEDB *, uint32_t, char *, size_t);
+void gamedb_status(CONFIG *);
 
 #endif
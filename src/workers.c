@@ -1,106 +1,199 @@
 #include "vichess.h"
 
-static bool running = true;
+bool running = true;
 
-void t_socket_line_writer(void *config) // write messages to socket
+typedef struct SOCKET_LINE
+{
+  CONFIG *c;
+  SESSION *s;
+} SOCKET_LINE;
+
+// Each line framed from a server socket.
+static void on_line(void *data, char *line, size_t len)
+{
+  SOCKET_LINE *sl = (SOCKET_LINE *) data;
+  metric_add(M_LINES_IN, 1);
+  metric_add(M_BYTES_IN, len);
+  log_line(LOG_TRACE, LOGC_NET, sl->s->id, line, false);
+  session_handle_line(sl->c, sl->s, line);
+}
+
+// One loop services every session: it polls the outbound queue (on
+// Linux an mqd_t is a descriptor) together with all session sockets,
+// writes queued commands to their socket and frames incoming lines.
+void t_socket_io(void *config)
 {
   CONFIG *c = (CONFIG *) config;
+  struct pollfd fds[MAX_SESSIONS + 1];
+  trace_thread("socket io");
+
   while ( running )
   {
-    // TODO window resizing
-    // int y1, x1, y2, x2, y3, x3; getmaxyx(c->w1, y1, x1); getmaxyx(c->w2, y2, x2); getmaxyx(c->w3, y3, x3);
-    char recv_buf[MAX_LINE_SIZE]; memset(recv_buf, 0, MAX_LINE_SIZE);
-    if ( mq_receive(c->ob_mq, recv_buf, MAX_LINE_SIZE, 0) == -1 )   error("mq_recv");
-    if ( send(c->sk, recv_buf, strlen(recv_buf), 0) == -1)          error("send");
+    int n_fds = 0, n_open = 0;
+    fds[n_fds++] = (struct pollfd) { .fd = c->ob_mq, .events = POLLIN };
+    for (int i = 0; i < c->n_sessions; i++)
+    {
+      fds[n_fds++] = (struct pollfd) { .fd = c->sessions[i]->sk, .events = POLLIN };
+      if ( c->sessions[i]->sk != -1 ) n_open++;
+    }
+    metric_set(M_SESSIONS_OPEN, n_open);
+    if ( n_open == 0 )
+    {
+      running = false; // every server socket closed
+      send_message(c->ib_mq, c->active, MSG_SWITCH, ""); // wake the writer
+      break;
+    }
+
+    if ( poll(fds, n_fds, -1) == -1 )
+    {
+      if (errno == EINTR) continue;
+      error("poll");
+    }
+
+    // write messages to sockets
+    if ( fds[0].revents & POLLIN )
+    {
+      MESSAGE msg;
+      uint64_t trace = trace_begin();
+      if ( mq_receive(c->ob_mq, (char *) &msg, sizeof msg, 0) == -1 )  error("mq_recv");
+      trace_end(TR_MQ_RECEIVE, trace);
+      mem_message(msg.type);
+      if ( msg.session < c->n_sessions )
+        block_send(c->sessions[msg.session], msg.owner, msg.text);
+      if ( msg.owner == BO_MOVE ) modal_sent();
+    }
+
+    // read messages from sockets
+    for (int i = 0; i < c->n_sessions; i++)
+    {
+      SESSION *s = c->sessions[i];
+      if ( ! ( fds[i+1].revents & (POLLIN | POLLHUP | POLLERR) ) ) continue;
+      s->received_ns = now_ns();
+
+      SOCKET_LINE sl = { c, s };
+      mem_message(MSG_LINE);
+      uint64_t trace = trace_begin();
+      ssize_t len = telnet_read(s->sk, &s->in, on_line, &sl);
+      trace_end(TR_TELNET_READ, trace);
+      if ( len == 0 || errno != EAGAIN ) session_close(s); // server socket closed
+    }
   }
 }
 
-void t_socket_line_reader(void *config) // read messages from socket
+// Repaint the board window for session 's': title, board(s), moves,
+// seeks.
+static void repaint(CONFIG *c, SESSION *s)
 {
-  CONFIG *c         = (CONFIG*) config;
-  long message_id   = 0;
-  bool configured   = false;
+  use_window(c->w1, (NCURSES_WINDOW_CB) cb_clear, NULL);
+  use_window(c->w1, (NCURSES_WINDOW_CB) cb_write_sessions, c);
+  movelist_show(c, s);
+  if ( s->u.pane != PANE_WHOLE && s->partner.white_rating != NULL && s->partner.my_nick != NULL )
+    use_window(c->w1, (NCURSES_WINDOW_CB) cb_write_board, &s->partner);
+  if ( s->u.pane == PANE_WHOLE && s->seeks != NULL )
+    use_window(c->w1, (NCURSES_WINDOW_CB) cb_write_seeks, s->seeks);
+}
 
-  while ( running )
-  {
-    char line_buf[MAX_LINE_SIZE];
-    memset(line_buf, 0, MAX_LINE_SIZE);
+// Which of the session's boards a <g1>, <12> or <b1> for 'game' is for.
+// In bughouse the partner game, named by pt= in either game's <g1>,
+// goes to s->partner and the two boards share the window; any other
+// game takes the main board, and the window, back.  'partner' is the
+// pt= of a <g1>, -1 for other lines.  NULL for a partner board whose
+// <g1> has not arrived.
+static UPDATE *route(CONFIG *c, SESSION *s, unsigned int game, int partner, bool active)
+{
+  UPDATE *u = &s->u, *p = &s->partner;
+  if ( game == u->g1.game_number ) return u;
+  if ( p->g1.game_number != 0 && game == p->g1.game_number ) return p;
 
-    // read a message (1 line) from the socket and increment message count
-    if (read_line(c->sk, line_buf, MAX_LINE_SIZE) < 1) 
-    { 
-      running = false; // server socket closed
-      break;
-    } 
-    message_id++;
-
-    // Telnet server may have latency, so sleep()-and-send() doesn't
-    // work, and switching on message_id is no less brittle than
-    // grepping for magic strings...
-    // debug("message: %d %s", message_id, line_buf); 
-    switch (message_id)
-    {
-      case 26: send_message( c->ob_mq, "guest\n"  );  break;
-      case 27: send_message( c->ob_mq, "\n\n"     );  break;
-      case 28: 
-         // we're logged in; it should be OK to send commands to the
-         // server
-         if ( ! configured )
-         {
-          int w_y, w_x; getmaxyx(c->w2, w_y, w_x);
-          send_message( c->ob_mq, "set height %d\n", w_y    );  // server-side paging height
-          send_message( c->ob_mq, "set width %d\n", w_x     );  // server-side paging width
-          send_message( c->ob_mq, "iset nowrap 1\n"         );  // don't wrap lines (breaks linewise hilighting)
-          send_message( c->ob_mq, "iset gameinfo 1\n"       );  // request game information
-          send_message( c->ob_mq, "iset ms 1\n"             );  // request timing in milliseconds
-          send_message( c->ob_mq, "-channel 53\n"           );  // remove guest chat from channel list
-          send_message( c->ob_mq, "set prompt %\n"          );  // a simpler prompt
-          send_message( c->ob_mq, "set style 12\n"          );  // computer-readable output format
-          send_message( c->ob_mq, "set seek 0\n"            );  // no seek advertisements TODO seek graph (?)
-          send_message( c->ob_mq, "set bell off\n"          );  // bell off
-          send_message( c->ob_mq, "set provshow 1\n"        );  // annotate provisional and estimated ratings
-          send_message( c->ob_mq, "set interface %s\n", TITLE );
-          configured = true;
-         } 
-         break;
-      default:
-         // user is now logged-in.  Handle any messages
-         if ( begins_with(line_buf, "\a" ) )    continue;   // skip bells and empty prompts
-         if ( begins_with(line_buf, "% \a" ) )  continue;
-         if ( begins_with(line_buf, "% \n" ) )  continue;
-         if ( equals(line_buf, FICS_PROMPT) )   continue;
-         break;
-    } 
-    if ((mq_send(c->ib_mq, line_buf, MAX_LINE_SIZE, PRIORITY)) == -1) perror("mq_send");
+  bool is_partner = u->g1.game_number != 0
+      && ( game == u->g1.partner_game_number || ( partner > 0 && (unsigned int) partner == u->g1.game_number ) );
+  if ( ! is_partner && partner == -1 ) return u; // a board before any gameinfo: as ever
+
+  int pane = is_partner ? PANE_LEFT : PANE_WHOLE;
+  if ( ! is_partner ) p->g1.game_number = 0;   // a new game; the partner board goes
+  if ( u->pane != pane )
+  {
+    u->pane = pane;
+    p->pane = PANE_RIGHT;
+    if ( active ) repaint(c, s);
   }
+  if ( ! is_partner ) return u;
+  return partner != -1 || p->white_rating != NULL ? p : NULL;
 }
 
 void t_curses_term_writer(void *config) // write messages to terminal
 {
   CONFIG *c = (CONFIG*) config;
-  UPDATE *u = malloc(sizeof *u); if ( u == NULL ) error("update malloc");
+  trace_thread("writer");
 
   // track changes matrix out as false
   bool changed[N_ROWS][N_COLS];// = { [0 ... N_ROWS-1][0 ... N_COLS-1] = false };
 
-  int s12, g1, _ = 0;
+  int s12 = 0;
   while ( running )
   {
     // 
-    char recv_buf[MAX_LINE_SIZE];
-    memset(recv_buf, 0, MAX_LINE_SIZE);
+    MESSAGE msg;
+    memset(&msg, 0, sizeof msg);
 
     int MODE = IDLE;
 
-    if ( mq_receive(c->ib_mq, recv_buf, MAX_LINE_SIZE, 0) == -1 ) error("mq_receive");
+    uint64_t trace = trace_begin();
+    if ( mq_receive(c->ib_mq, (char *) &msg, sizeof msg, 0) == -1 ) error("mq_receive");
+    trace_end(TR_MQ_RECEIVE, trace);
+    if ( msg.session >= c->n_sessions ) continue;
+
+    char *recv_buf  = msg.text;
+    SESSION *s      = c->sessions[msg.session];
+    UPDATE *u       = &s->u;
+    bool active     = ( s->id == c->active );
+    metric_add(M_MSG_LINE + msg.type, 1);
+    mem_message(msg.type);
 
     // peek into the message and handle appropriately
     //
-    if ( begins_with(recv_buf, GAMEINFO_MARKER) )
+    if ( msg.type == MSG_SWITCH )
+    {
+      // repaint everything for the newly active session
+      s->unread = 0;
+      repaint(c, s);
+      modal_board(s->id, &u->s12, u->pane);
+    }
+    else if ( msg.type == MSG_SEEKS )
+    {
+      // every change since the last one; a background graph is redrawn
+      // whole when its session is switched to.  Bughouse boards take
+      // its place.
+      atomic_store(&s->seeks->pending, false);
+      if ( active && u->pane == PANE_WHOLE ) use_window(c->w1, (NCURSES_WINDOW_CB) cb_update_seeks, s->seeks);
+    }
+    else if ( msg.type == MSG_MOVES )
+      movelist_command(c, s, recv_buf);
+    else if ( begins_with(recv_buf, GAMEINFO_MARKER) )
     {
+      const char *pt = strstr(recv_buf, " pt=");
+      u = route(c, s, atoi(recv_buf + strlen(GAMEINFO_MARKER)), pt != NULL ? atoi(pt + 4) : 0, active);
       parse_gameinfo_string( recv_buf, u );
-      g1++;
+      print_g1(s->id, u);
+      publish_event(c, s->id, EV_GAMEINFO, u, NULL);
+      metric_add(M_GAMEINFOS, 1);
     }
+    else if ( begins_with(recv_buf, HOLDINGS_MARKER) )
+    {
+      // pieces in hand change only the player lines of their board
+      unsigned char holdings[2][N_HOLDINGS];
+      unsigned int game = parse_holdings(recv_buf, holdings);
+      metric_add(M_HOLDINGS, 1);
+      if ( game != 0 && (u = route(c, s, game, -1, active)) != NULL )
+      {
+        memcpy(u->holdings, holdings, sizeof holdings);
+        u->has_holdings = true;
+        if ( active && u->white_rating != NULL && u->my_nick != NULL )
+          use_window(c->w1, (NCURSES_WINDOW_CB) cb_write_players, u);
+      }
+    }
+    else if ( begins_with(recv_buf, STYLE12_MARKER) && (u = route(c, s, style12_game(recv_buf), -1, active)) == NULL )
+      ; // the partner board, before its gameinfo: nothing to show it with
     else if ( begins_with(recv_buf, STYLE12_MARKER) )
     { 
       // make a copy of the existing ("old") board
@@ -108,7 +201,23 @@ void t_curses_term_writer(void *config) // write messages to terminal
       memcpy(u->old_board, u->board, sizeof u->board);
 
       // parse the new board
+      unsigned int game = u->s12.game_number;
       parse_s12_string( recv_buf, u );
+      print_s12(s->id, u);
+      publish_event(c, s->id, EV_BOARD, u, NULL);
+      metric_add(M_BOARDS, 1);
+      if ( c->analysis != NULL ) analysis_submit(c->analysis, s->id, &u->s12);
+      if ( c->archive != NULL )  archive_board(c->archive, s->id, &u->s12, &u->g1);
+
+      POSITION pos;
+      position_from_style12(&pos, &u->s12);
+      int draw = history_update(s, &u->s12, pos.hash);
+      GAME_MOVES *moves = movelist_board(c, s, &u->s12, &pos);
+      // the opening sticks once the game leaves the table
+      if ( u->s12.game_number != game ) { u->opening = NULL; u->has_holdings = false; }
+      const char *opening = c->eco != NULL ? eco_lookup(c->eco, pos.hash) : NULL;
+      if ( opening != NULL ) u->opening = opening;
+      if ( c->stats != NULL ) stats_board(c->stats, s->id, &u->s12, &u->g1, u->opening);
 
       if (s12 > 0) // this is not the first message
       {
@@ -121,16 +230,58 @@ void t_curses_term_writer(void *config) // write messages to terminal
       }
 
       MODE = u->my_status;
-      if ( ! ( u->white_rating == NULL) ) // have gameinfo
-        use_window(c->w1, (NCURSES_WINDOW_CB) cb_write_board, u);
+      if ( active && u == &s->u ) modal_board(s->id, &u->s12, u->pane);
+      if ( active && ! ( u->white_rating == NULL) ) // have gameinfo
+      {
+        // looking back through the game: only the clocks move
+        if ( moves->view == -1 ) use_window(c->w1, (NCURSES_WINDOW_CB) cb_write_board, u);
+        else                     use_window(c->w1, (NCURSES_WINDOW_CB) cb_write_players, u);
+        if ( u->pane == PANE_WHOLE ) use_window(c->w1, (NCURSES_WINDOW_CB) cb_update_moves, moves);
+      }
+
+      // a claimable draw is worth interrupting for, even from the background
+      if ( draw != DRAW_NONE && ( active || u->s12.relation == PLAYING_MY_MOVE || u->s12.relation == PLAYING_OPPONENTS_MOVE ) )
+      {
+        char notice[MAX_LINE_SIZE];
+        draw_notice(draw, &u->s12, notice, sizeof notice);
+        char tagged[MAX_LINE_SIZE + 16];
+        if ( active ) snprintf(tagged, sizeof tagged, "%s", notice);
+        else          snprintf(tagged, sizeof tagged, "[%d] %s", s->id + 1, notice);
+        use_window(c->w2, (NCURSES_WINDOW_CB) cb_write_response, tagged);
+      }
 
       s12++;
     }
-    else
+    else if ( msg.type == MSG_LINE && movelist_feed(c, s, recv_buf, msg.owner) )
+      ; // a "moves" listing asked for to fill in a game joined late
+    else if ( active )
     { 
       // normal line, no parsing necessary.  write to w2
-      use_window(c->w2, (NCURSES_WINDOW_CB) cb_write_response, recv_buf);
-      _++;
+      if ( msg.type == MSG_LINE ) publish_event(c, s->id, EV_TEXT, NULL, recv_buf);
+      if ( msg.type == MSG_LINE && c->archive != NULL ) archive_text(c->archive, s->id, recv_buf);
+      if ( msg.type == MSG_LINE && c->stats != NULL )   stats_text(c->stats, s->id, recv_buf);
+      // games/who/sought rows are held, then shown whole or as a diff
+      if ( msg.type != MSG_LINE || ! lists_feed(c, s, recv_buf) )
+        use_window(c->w2, (NCURSES_WINDOW_CB) cb_write_response, recv_buf);
+      if ( msg.type == MSG_LINE ) metric_add(M_TEXT, 1);
+    }
+    else
+    {
+      // background session: count it, but only interrupt for tells
+      if ( msg.type == MSG_LINE ) publish_event(c, s->id, EV_TEXT, NULL, recv_buf);
+      if ( msg.type == MSG_LINE && c->archive != NULL ) archive_text(c->archive, s->id, recv_buf);
+      if ( msg.type == MSG_LINE && c->stats != NULL )   stats_text(c->stats, s->id, recv_buf);
+      if ( msg.type == MSG_LINE ) lists_feed(c, s, recv_buf);
+      s->unread++;
+      if ( contains(recv_buf, " tells you: ") )
+      {
+        char tagged[MAX_LINE_SIZE + 16];
+        snprintf(tagged, sizeof tagged, "[%d] %s", s->id + 1, recv_buf);
+        use_window(c->w2, (NCURSES_WINDOW_CB) cb_write_response, tagged);
+      }
+      if ( c->n_sessions > 1 )
+        use_window(c->w1, (NCURSES_WINDOW_CB) cb_write_sessions, c);
+      if ( msg.type == MSG_LINE ) metric_add(M_TEXT, 1);
     }
 
     // handle cursor placement in a mode-dependent way
@@ -151,29 +302,167 @@ void t_curses_term_writer(void *config) // write messages to terminal
       default: break;
     }
   }
-  // clear dynamic memory
-  free(u->my_nick);
-  free(u->opp_nick);
-  free(u->text);
-  free(u->type);
-  free(u->white_rating);
-  free(u->black_rating);
-  free(u);
-  u = NULL;
+}
+
+// Local commands, vi style.  Sessions are listed and switched like
+// buffers:
+//
+//    :ls       list sessions
+//    :b N      switch to session N
+//    :bn :bp   next / previous session
+//    :triggers list trigger rules and their latencies
+//    :analysis show the analysis engines and their counters
+//    :games    search the game database for the active board
+//    :list     query the last games, who or sought listing
+//    :back [N] :fwd [N]  step through the game on the board
+//    :goto N   the position after move N
+//    :live     back to the game as it stands
+//    :trace [on|off|dump [FILE]]  trace spans, dumped as Chrome trace JSON
+//    :vi       board mode: moves keyed on the board (see modal.c)
+//    :vi stats keystroke-to-socket latency of keyed moves
+//    :stats [DAYS|all]  rating, clock use and results of your games
+//    :mem [on|off]  allocations by subsystem and message, RSS over time
+//
+// Returns false if the line is not a local command and should go to
+// the server.
+bool local_command(CONFIG *c, char *command_buf)
+{
+  int target = c->active, n;
+  if      ( equals(command_buf, ":bn\n") ) target = (c->active + 1) % c->n_sessions;
+  else if ( equals(command_buf, ":bp\n") ) target = (c->active + c->n_sessions - 1) % c->n_sessions;
+  else if ( sscanf(command_buf, ":b %d", &n) == 1 )
+  {
+    if ( n < 1 || n > c->n_sessions ) 
+    {
+      send_message(c->ib_mq, c->active, MSG_NOTICE, "no session %d\n", n);
+      return true;
+    }
+    target = n - 1;
+  }
+  else if ( equals(command_buf, ":triggers\n") )
+  {
+    for (int i = 0; i < N_TRIGGERS; i++)
+    {
+      TRIGGER *t = &TRIGGERS[i];
+      send_message(c->ib_mq, c->active, MSG_NOTICE, "%2d %s\n", i + 1, t->source);
+      // the I/O loop may be firing it meanwhile
+      unsigned long fired = atomic_load_explicit(&t->fired, memory_order_relaxed);
+      uint64_t total = atomic_load_explicit(&t->latency_total, memory_order_relaxed);
+      uint64_t min   = atomic_load_explicit(&t->latency_min, memory_order_relaxed);
+      uint64_t max   = atomic_load_explicit(&t->latency_max, memory_order_relaxed);
+      if ( fired )
+        send_message(c->ib_mq, c->active, MSG_NOTICE, "   fired %lu, latency min %.1f avg %.1f max %.1f us\n",
+            fired, min / 1000.0, total / 1000.0 / fired, max / 1000.0);
+    }
+    return true;
+  }
+  else if ( equals(command_buf, ":analysis\n") )
+  {
+    analysis_status(c);
+    return true;
+  }
+  else if ( begins_with(command_buf, ":list ") || equals(command_buf, ":list\n") )
+  {
+    lists_command(c, command_buf + 5);
+    return true;
+  }
+  else if ( equals(command_buf, ":back\n") || begins_with(command_buf, ":back ")
+      || equals(command_buf, ":fwd\n") || begins_with(command_buf, ":fwd ")
+      || begins_with(command_buf, ":goto ") || equals(command_buf, ":live\n") )
+  {
+    // the writer owns the boards
+    send_message(c->ib_mq, c->active, MSG_MOVES, "%s", command_buf + 1);
+    return true;
+  }
+  else if ( begins_with(command_buf, ":log ") || equals(command_buf, ":log\n") )
+  {
+    log_command(c, command_buf + 4);
+    return true;
+  }
+  else if ( begins_with(command_buf, ":trace ") || equals(command_buf, ":trace\n") )
+  {
+    char verb[8] = "", file[PATH_MAX] = "";
+    sscanf(command_buf + 6, "%7s %4095s", verb, file);
+    if      ( equals(verb, "on") )  atomic_store(&tracing, true);
+    else if ( equals(verb, "off") ) atomic_store(&tracing, false);
+    else if ( equals(verb, "dump") )
+    {
+      const char *path = file[0] ? file : trace_path() ? trace_path() : "vichess.trace.json";
+      long n = trace_dump(path);
+      if ( n == -1 ) send_message(c->ib_mq, c->active, MSG_NOTICE, "%s: %s\n", path, strerror(errno));
+      else           send_message(c->ib_mq, c->active, MSG_NOTICE, "%ld trace events in %s\n", n, path);
+      return true;
+    }
+    send_message(c->ib_mq, c->active, MSG_NOTICE, "tracing %s\n", atomic_load(&tracing) ? "on" : "off");
+    return true;
+  }
+  else if ( equals(command_buf, ":vi\n") || begins_with(command_buf, ":vi ") )
+  {
+    modal_command(c, command_buf + 3);
+    return true;
+  }
+  else if ( equals(command_buf, ":stats\n") || begins_with(command_buf, ":stats ") )
+  {
+    stats_command(c, command_buf + 6);
+    return true;
+  }
+  else if ( equals(command_buf, ":mem\n") || begins_with(command_buf, ":mem ") )
+  {
+    mem_command(c, command_buf + 4);
+    return true;
+  }
+  else if ( equals(command_buf, ":games\n") )
+  {
+    gamedb_status(c);
+    return true;
+  }
+  else if ( equals(command_buf, ":ls\n") )
+  {
+    for (int i = 0; i < c->n_sessions; i++)
+    {
+      SESSION *s = c->sessions[i];
+      send_message(c->ib_mq, c->active, MSG_NOTICE, "%c%2d %-17s %s %u unread\n",
+          (i == c->active) ? '%' : ' ', i + 1, s->handle,
+          (s->sk == -1) ? "closed" : "open  ", s->unread);
+    }
+    return true;
+  }
+  else return false;
+
+  c->active = target;
+  send_message(c->ib_mq, c->active, MSG_SWITCH, "");
+  return true;
 }
 
 void t_curses_term_reader(void *config) // read messages from terminal
 {
   CONFIG *c = (CONFIG*) config;
+  trace_thread("reader");
+  mem_message(MSG_INPUT); // all the reader does
   while ( running )
   {
+    // board mode takes a key at a time, until ':' asks for a line
+    bool prompted = modal_mode() == KM_BOARD;
+    if ( prompted && ! modal_read(c) ) continue;
+
     char command_buf[MAX_LINE_SIZE];
     memset(command_buf, 0, MAX_LINE_SIZE);
+    if ( prompted ) command_buf[0] = ':';
     use_window(c->w3, (NCURSES_WINDOW_CB) cb_read_command, command_buf);
     if ( strlen(command_buf) < 1 )          continue;
+    if ( local_command(c, command_buf) )    continue;
+    // after board mode's ':', anything but a local command is the server's
+    char *command = command_buf + prompted;
+    if ( prompted && equals(command, "\n") ) continue;
     // user command to the server AND echo to the screen
-    send_message(c->ob_mq, command_buf);
-    send_message(c->ib_mq, command_buf);
-    if ( begins_with(command_buf, FICS_QUIT) ) running = false;
+    send_message(c->ob_mq, c->active, MSG_INPUT, "%s", command);
+    send_message(c->ib_mq, c->active, MSG_INPUT, "%s", command);
+    if ( begins_with(command, FICS_QUIT) )
+    {
+      // the last open session takes the client down with it
+      int n_open = 0;
+      for (int i = 0; i < c->n_sessions; i++) n_open += (c->sessions[i]->sk != -1);
+      if ( n_open <= 1 ) running = false;
+    }
   }
 }
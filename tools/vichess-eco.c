@@ -0,0 +1,148 @@
+/*
+ * vichess-eco -- build the opening table that vichess maps at startup
+ * (see src/eco.c) from a PGN file of opening lines:
+ *
+ *    % vichess-eco data/eco.pgn eco.bin
+ *
+ * Each game is replayed and the position it ends in is tagged with its
+ * ECO, Opening and Variation tags.  The first game to reach a position
+ * wins.  The number of buckets is doubled until every position fits in
+ * its home bucket, so that vichess needs a single probe per lookup.
+ */
+
+#include "../src/vichess.h"
+
+typedef struct OPENING
+{
+  uint64_t key;
+  uint32_t name;
+} OPENING;
+
+static OPENING *openings = NULL;
+static int n_openings = 0, max_openings = 0;
+static char *names = NULL;
+static size_t names_size = 0;
+
+static void tag(const char *line, const char *name, char *value, size_t n)
+{
+  char prefix[32];
+  snprintf(prefix, sizeof prefix, "[%s \"", name);
+  if ( ! begins_with((char *) line, prefix) ) return;
+  snprintf(value, n, "%s", line + strlen(prefix));
+  value[strcspn(value, "\"")] = '\0';
+}
+
+static void add(uint64_t key, const char *eco, const char *opening, const char *variation)
+{
+  for (int i = 0; i < n_openings; i++)
+    if ( openings[i].key == key ) return; // reached before, by an earlier line
+
+  char name[MAX_LINE_SIZE];
+  int len = snprintf(name, sizeof name, "%s %s%s%s", eco, opening, *variation ? ": " : "", variation);
+  if ( (names = realloc(names, names_size + len + 1)) == NULL ) error("realloc");
+  memcpy(names + names_size, name, len + 1);
+
+  if ( n_openings == max_openings )
+  {
+    max_openings = max_openings ? max_openings * 2 : 256;
+    if ( (openings = realloc(openings, max_openings * sizeof *openings)) == NULL ) error("realloc");
+  }
+  openings[n_openings++] = (OPENING) { .key = key, .name = names_size };
+  names_size += len + 1;
+}
+
+static void read_pgn(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  if ( f == NULL ) error(path);
+
+  char line[MAX_LINE_SIZE], eco[8] = "", opening[128] = "", variation[128] = "";
+  POSITION pos;
+  position_start(&pos);
+  bool in_moves = false;
+  for (int n = 1; fgets(line, sizeof line, f) != NULL; n++)
+  {
+    line[strcspn(line, "\r\n")] = '\0';
+    if ( line[0] == ';' || line[0] == '%' ) continue;
+    if ( line[0] == '[' )
+    {
+      if ( in_moves ) { position_start(&pos); *eco = *opening = *variation = '\0'; in_moves = false; }
+      tag(line, "ECO", eco, sizeof eco);
+      tag(line, "Opening", opening, sizeof opening);
+      tag(line, "Variation", variation, sizeof variation);
+      continue;
+    }
+
+    char *save, *tok;
+    for (tok = strtok_r(line, " \t", &save); tok != NULL; tok = strtok_r(NULL, " \t", &save))
+    {
+      in_moves = true;
+      if ( *tok == '{' || *tok == ';' ) break; // comments run to the end of the line here
+      if ( equals(tok, "*") || equals(tok, "1-0") || equals(tok, "0-1") || equals(tok, "1/2-1/2") )
+      {
+        if ( *eco != '\0' ) add(pos.hash, eco, opening, variation);
+        position_start(&pos);
+        *eco = *opening = *variation = '\0';
+        in_moves = false;
+        continue;
+      }
+      while ( isdigit(*tok) ) tok++; // move numbers, "1." "1..." "1.e4"
+      while ( *tok == '.' ) tok++;
+      if ( *tok == '\0' ) continue;
+
+      MOVE m = parse_move(&pos, tok);
+      UNDO undo;
+      if ( m == MOVE_NONE ) { fprintf(stderr, "%s:%d: bad move %s\n", path, n, tok); exit(EXIT_FAILURE); }
+      make_move(&pos, m, &undo);
+    }
+  }
+  fclose(f);
+}
+
+static void write_table(const char *path)
+{
+  uint64_t n_buckets = 1;
+  while ( n_buckets * ECO_BUCKET < (uint64_t) n_openings * 2 ) n_buckets *= 2;
+
+  ECO_SLOT *slots = NULL;
+  for (bool placed = false; ! placed; )
+  {
+    free(slots);
+    if ( (slots = calloc(n_buckets * ECO_BUCKET, sizeof *slots)) == NULL ) error("calloc");
+    placed = true;
+    for (int i = 0; i < n_openings && placed; i++)
+    {
+      ECO_SLOT *bucket = &slots[( openings[i].key & ( n_buckets - 1 ) ) * ECO_BUCKET];
+      int j = 0;
+      while ( j < ECO_BUCKET && bucket[j].key != 0 ) j++;
+      if ( j == ECO_BUCKET ) { placed = false; n_buckets *= 2; }
+      else bucket[j] = (ECO_SLOT) { .key = openings[i].key, .name = openings[i].name };
+    }
+  }
+
+  POSITION start;
+  position_start(&start);
+  ECO_HEADER h = { .start_key = start.hash, .n_buckets = n_buckets, .names_size = names_size };
+  memcpy(h.magic, ECO_MAGIC, 8);
+
+  FILE *f = fopen(path, "w");
+  if ( f == NULL ) error(path);
+  if ( fwrite(&h, sizeof h, 1, f) != 1
+      || fwrite(slots, sizeof *slots, n_buckets * ECO_BUCKET, f) != n_buckets * ECO_BUCKET
+      || fwrite(names, 1, names_size, f) != names_size
+      || fclose(f) != 0 ) error(path);
+  printf("%s: %d openings, %lu buckets, %zu bytes\n", path, n_openings, (unsigned long) n_buckets,
+      sizeof h + n_buckets * ECO_BUCKET * sizeof *slots + names_size);
+  free(slots);
+}
+
+int main(int argc, char **argv)
+{
+  if ( argc != 3 ) { fprintf(stderr, "usage: %s eco.pgn eco.bin\n", argv[0]); return EXIT_FAILURE; }
+  position_init();
+  read_pgn(argv[1]);
+  write_table(argv[2]);
+  free(openings);
+  free(names);
+  return EXIT_SUCCESS;
+}
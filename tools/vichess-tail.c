@@ -0,0 +1,66 @@
+/*
+ * vichess-tail -- follow the event ring published by `vichess -e NAME`
+ *
+ *    % vichess-tail /vichess
+ *
+ * Prints one line per event and reports events lost to overruns.  This
+ * is the reference consumer for src/events.h; it links events.o only.
+ */
+
+#define _GNU_SOURCE
+
+#include "../src/events.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+int main(int argc, char *argv[])
+{
+  if (argc != 2) { fprintf(stderr, "usage: %s ring\n", argv[0]); return EXIT_FAILURE; }
+
+  RING_READER *rr = ring_open(argv[1]);
+  if (rr == NULL) { perror(argv[1]); return EXIT_FAILURE; }
+
+  EVENT ev;
+  uint64_t lost = 0;
+  struct timespec idle = { .tv_sec = 0, .tv_nsec = 1000000 };
+  while (true)
+  {
+    if (ring_next(rr, &ev) == 0) { nanosleep(&idle, NULL); continue; }
+    if (rr->lost != lost)
+    {
+      printf("-- overrun: %llu events lost\n", (unsigned long long) (rr->lost - lost));
+      lost = rr->lost;
+    }
+
+    switch (ev.type)
+    {
+      case EV_BOARD:
+      {
+        STYLE12 *b = &ev.board;
+        printf("[%d] <12> #%u %s %d:%c %s (%.3f) vs %s (%.3f) ",
+            ev.session, b->game_number, b->pretty_move,
+            b->move_number, b->turn, b->white, b->white_ms / 1000.0,
+            b->black, b->black_ms / 1000.0);
+        for (int i = 0; i < 8; i++) printf("%.8s%c", b->board[i], i < 7 ? '/' : '\n');
+        break;
+      }
+      case EV_GAMEINFO:
+      {
+        GAMEINFO *g = &ev.gameinfo;
+        printf("[%d] <g1> #%u %s %s %s-%s\n",
+            ev.session, g->game_number, g->type, g->rated ? "rated" : "unrated",
+            g->white_rating, g->black_rating);
+        break;
+      }
+      case EV_TEXT:
+        printf("[%d] %s%s\n", ev.session, ev.text, ev.truncated ? "..." : "");
+        break;
+    }
+    fflush(stdout);
+  }
+
+  ring_close(rr);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,110 @@
+/*
+ * vichess-uci -- the built-in engine (src/engine.c) behind a UCI front
+ * end, as a stand-in for a real engine in `vichess -a`:
+ *
+ *    % vichess -a ./vichess-uci
+ *
+ * Understands uci, isready, ucinewgame, setoption (Threads, Hash),
+ * position, go (depth, movetime, infinite), stop and quit.  Searches
+ * run on their own thread so that "stop" is heard.
+ */
+
+#include "../src/vichess.h"
+
+static POSITION root;
+static uint64_t history[MAX_GAME_PLY];
+static int n_history = 0;
+static SEARCH_LIMITS limits = { .threads = 1 };
+static pthread_t searcher;
+static bool searching = false;
+
+static void *t_go(void *arg)
+{
+  UNUSED(arg);
+  SEARCH_RESULT r = engine_search(&root, history, n_history, limits);
+  char move[8], pv[MAX_PLY * 6 + 1] = "";
+  size_t len = 0;
+  for (int i = 0; i < r.pv_len; i++)
+  {
+    move_to_uci(r.pv[i], move);
+    len += snprintf(pv + len, sizeof pv - len, " %s", move);
+  }
+  move_to_uci(r.best, move);
+  printf("info depth %d score cp %d nodes %lu nps %.0f time %lu pv%s\n",
+      r.depth, r.score, (unsigned long) r.nodes, r.nodes * 1e9 / (r.ns ? r.ns : 1),
+      (unsigned long) (r.ns / 1000000), pv);
+  printf("bestmove %s\n", r.best == MOVE_NONE ? "0000" : move);
+  fflush(stdout);
+  return NULL;
+}
+
+static void wait_search(void)
+{
+  if ( ! searching ) return;
+  // keep asking: a stop that lands before the search starts is lost
+  struct timespec tick = { .tv_sec = 0, .tv_nsec = 1000000 };
+  do engine_stop(); while ( pthread_tryjoin_np(searcher, NULL) == EBUSY && nanosleep(&tick, NULL) == 0 );
+  searching = false;
+}
+
+// position [startpos | fen FEN] [moves m1 m2 ...]
+static void set_position(char *args)
+{
+  char *moves = strstr(args, " moves ");
+  if ( moves != NULL ) *moves = '\0', moves += strlen(" moves ");
+
+  if      ( begins_with(args, "startpos") )  position_start(&root);
+  else if ( begins_with(args, "fen ") )      position_from_fen(&root, args + 4);
+  n_history = 0;
+
+  char *save, *tok = moves ? strtok_r(moves, " ", &save) : NULL;
+  for ( ; tok != NULL; tok = strtok_r(NULL, " ", &save))
+  {
+    MOVE m = parse_move(&root, tok);
+    if ( m == MOVE_NONE ) break;
+    UNDO undo;
+    if ( n_history < MAX_GAME_PLY ) history[n_history++] = root.hash;
+    make_move(&root, m, &undo);
+  }
+}
+
+static void go(char *args)
+{
+  int n;
+  limits.depth = limits.movetime_ms = 0;
+  char *p;
+  if ( (p = strstr(args, "depth ")) != NULL && sscanf(p, "depth %d", &n) == 1 )       limits.depth = n;
+  if ( (p = strstr(args, "movetime ")) != NULL && sscanf(p, "movetime %d", &n) == 1 ) limits.movetime_ms = n;
+  if ( limits.depth == 0 && limits.movetime_ms == 0 && strstr(args, "infinite") == NULL )
+    limits.movetime_ms = 1000;
+  if ( pthread_create(&searcher, NULL, t_go, NULL) != 0 ) error("pthread_create");
+  searching = true;
+}
+
+int main(void)
+{
+  position_init();
+  position_start(&root);
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  char line[MAX_LINE_SIZE];
+  while ( fgets(line, sizeof line, stdin) != NULL )
+  {
+    line[strcspn(line, "\r\n")] = '\0';
+    int n;
+    if      ( equals(line, "uci") )
+      printf("id name vichess\nid author vichess\n"
+             "option name Threads type spin default 1 min 1 max 256\n"
+             "option name Hash type spin default %d min 1 max 65536\nuciok\n", ENGINE_TT_MB);
+    else if ( equals(line, "isready") )                   printf("readyok\n");
+    else if ( equals(line, "ucinewgame") )                { wait_search(); engine_tt_clear(); }
+    else if ( sscanf(line, "setoption name Threads value %d", &n) == 1 ) limits.threads = n;
+    else if ( sscanf(line, "setoption name Hash value %d", &n) == 1 )    { wait_search(); engine_tt_resize(n); }
+    else if ( begins_with(line, "position ") )            { wait_search(); set_position(line + 9); }
+    else if ( begins_with(line, "go") )                   { wait_search(); go(line + 2); }
+    else if ( equals(line, "stop") )                      wait_search();
+    else if ( equals(line, "quit") )                      break;
+  }
+  wait_search();
+  return EXIT_SUCCESS;
+}